@@ -1,20 +1,421 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cctype>
+#include <new>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <memory>
+#include <charconv>
+#include <system_error>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <limits>
+#include <map>
+#include <complex>
+#include <deque>
+#include <chrono>
+#include <sstream>
+#include <csignal>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define COMPLEX_SIMD_X86 1  ///< Доступны ядра SSE2/AVX2/AVX-512 с выбором во время выполнения
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define COMPLEX_HAVE_POSIX 1  ///< Доступны mmap и другие вызовы POSIX
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define COMPLEX_HAVE_EPOLL 1  ///< Доступен серверный режим (epoll)
+#endif
+
+/**
+ * @def COMPLEX_COUNT_INSTANCES
+ * @brief Включает подсчет живых объектов Complex (отладочная сборка)
+ *
+ * По умолчанию не определен: Complex остается тривиально копируемым и
+ * constexpr-типом без накладных расходов. При сборке с -DCOMPLEX_COUNT_INSTANCES
+ * каждый конструктор и деструктор атомарно изменяет счетчик, доступный
+ * через Complex::instanceCount().
+ */
+#ifdef COMPLEX_COUNT_INSTANCES
+#define COMPLEX_CONSTEXPR
+#else
+#define COMPLEX_CONSTEXPR constexpr  ///< constexpr, если подсчет объектов выключен
+#endif
+
+/**
+ * @class FixedPoint
+ * @brief Число с фиксированной точкой: FractionBits дробных бит в Storage
+ *
+ * Умножение и деление выполняются в типе Wide двойной ширины с
+ * округлением к ближайшему. Переполнение при сложении и умножении не
+ * отслеживается (значение заворачивается), а преобразование из плавающей
+ * точки насыщается до границ диапазона. Поэтому такие числа подходят для
+ * нормированных данных. Квадрат модуля комплексного числа помещается в
+ * диапазон только при модуле меньше ~181 у Fixed16 и ~46340 у Fixed32,
+ * поэтому BasicComplex считает суммы квадратов в типе Wide (см. squareSum()).
+ */
+template <class Storage, class Wide, int FractionBits>
+class FixedPoint {
+private:
+    Storage raw;    ///< Значение, умноженное на 2^FractionBits
+
+    static constexpr Storage one = static_cast<Storage>(Storage(1) << FractionBits);
+
+    template <class A>
+    static constexpr Storage fromFloating(A value) {
+        if (value != value) {
+            return 0;
+        }
+        long double scaled = static_cast<long double>(value) * one;
+        long double limit = static_cast<long double>(std::numeric_limits<Storage>::max());
+        if (scaled >= limit) {
+            return std::numeric_limits<Storage>::max();
+        }
+        if (scaled <= -limit) {
+            return std::numeric_limits<Storage>::min();
+        }
+        return static_cast<Storage>(scaled < 0 ? scaled - 0.5L : scaled + 0.5L);
+    }
+
+    static constexpr Storage roundShift(Wide value) {
+        return static_cast<Storage>((value + (Wide(1) << (FractionBits - 1))) >> FractionBits);
+    }
+
+    /// Наибольшее значение Wide (numeric_limits не обязан знать __int128)
+    static constexpr Wide wideMax = ((Wide(1) << (sizeof(Wide) * 8 - 2)) - 1) * 2 + 1;
+
+    static constexpr Wide saturatingAdd(Wide a, Wide b) {
+        if (b > 0 && a > wideMax - b) {
+            return wideMax;
+        }
+        if (b < 0 && a < -wideMax - b) {
+            return -wideMax;
+        }
+        return a + b;
+    }
+
+public:
+    template <class, class, int> friend class FixedPoint;
+
+    /**
+     * @brief Ноль
+     */
+    constexpr FixedPoint() : raw(0) {}
+
+    /**
+     * @brief Целое число
+     * @param value Значение
+     */
+    explicit constexpr FixedPoint(int value) : raw(static_cast<Storage>(static_cast<Storage>(value) * one)) {}
+
+    /**
+     * @brief Преобразование из плавающей точки (с округлением и насыщением)
+     * @param value Значение
+     */
+    template <class A, std::enable_if_t<std::is_floating_point<A>::value, int> = 0>
+    explicit constexpr FixedPoint(A value) : raw(fromFloating(value)) {}
+
+    /**
+     * @brief Преобразование из другого формата с фиксированной точкой
+     * @param other Значение
+     */
+    template <class S, class W, int F>
+    explicit constexpr FixedPoint(const FixedPoint<S, W, F>& other)
+        : raw(F >= FractionBits ? static_cast<Storage>(other.raw >> (F - FractionBits))
+                                : static_cast<Storage>(static_cast<Storage>(other.raw) * (Storage(1) << (FractionBits - F)))) {}
+
+    /**
+     * @brief Создает число из внутреннего представления
+     * @param value Значение, умноженное на 2^FractionBits
+     * @return Число
+     */
+    static constexpr FixedPoint fromRaw(Storage value) {
+        FixedPoint result;
+        result.raw = value;
+        return result;
+    }
+
+    /**
+     * @brief Внутреннее представление
+     * @return Значение, умноженное на 2^FractionBits
+     */
+    constexpr Storage rawValue() const { return raw; }
+
+    /**
+     * @brief Преобразование в плавающую точку
+     */
+    template <class A, std::enable_if_t<std::is_floating_point<A>::value, int> = 0>
+    explicit constexpr operator A() const { return static_cast<A>(raw) / static_cast<A>(one); }
+
+    constexpr FixedPoint operator-() const { return fromRaw(static_cast<Storage>(-raw)); }
+    constexpr FixedPoint operator+(FixedPoint other) const { return fromRaw(static_cast<Storage>(raw + other.raw)); }
+    constexpr FixedPoint operator-(FixedPoint other) const { return fromRaw(static_cast<Storage>(raw - other.raw)); }
+    constexpr FixedPoint operator*(FixedPoint other) const { return fromRaw(roundShift(Wide(raw) * other.raw)); }
+
+    /**
+     * @throw std::runtime_error При делении на ноль
+     */
+    constexpr FixedPoint operator/(FixedPoint other) const {
+        if (other.raw == 0) {
+            throw std::runtime_error("Деление на ноль!");
+        }
+        return fromRaw(static_cast<Storage>(Wide(raw) * one / other.raw));
+    }
+
+    constexpr FixedPoint& operator++() { raw = static_cast<Storage>(raw + one); return *this; }
+    constexpr FixedPoint& operator--() { raw = static_cast<Storage>(raw - one); return *this; }
+
+    constexpr bool operator==(FixedPoint other) const { return raw == other.raw; }
+    constexpr bool operator!=(FixedPoint other) const { return raw != other.raw; }
+    constexpr bool operator<(FixedPoint other) const { return raw < other.raw; }
+    constexpr bool operator>(FixedPoint other) const { return raw > other.raw; }
+    constexpr bool operator<=(FixedPoint other) const { return raw <= other.raw; }
+    constexpr bool operator>=(FixedPoint other) const { return raw >= other.raw; }
+
+    /**
+     * @brief Сумма произведений a*b + c*d без округления
+     * @return Значение в типе Wide с 2*FractionBits дробными битами
+     *
+     * Сумма насыщается до границ Wide; сами произведения в Wide не переполняются.
+     */
+    static constexpr Wide productSum(FixedPoint a, FixedPoint b, FixedPoint c, FixedPoint d) {
+        return saturatingAdd(Wide(a.raw) * b.raw, Wide(c.raw) * d.raw);
+    }
+
+    /**
+     * @brief Сумма квадратов a² + b² без округления
+     * @return Значение в типе Wide с 2*FractionBits дробными битами
+     */
+    static constexpr Wide squareSum(FixedPoint a, FixedPoint b) { return productSum(a, a, b, b); }
+
+    /**
+     * @brief Округляет значение с 2*FractionBits дробными битами до FixedPoint
+     * @param value Результат productSum() или squareSum()
+     * @return Число, насыщенное до границ диапазона
+     */
+    static constexpr FixedPoint fromWide(Wide value) {
+        Wide shifted = ((value >> (FractionBits - 1)) + 1) >> 1;
+        if (shifted > Wide(std::numeric_limits<Storage>::max())) {
+            return fromRaw(std::numeric_limits<Storage>::max());
+        }
+        if (shifted < Wide(std::numeric_limits<Storage>::min())) {
+            return fromRaw(std::numeric_limits<Storage>::min());
+        }
+        return fromRaw(static_cast<Storage>(shifted));
+    }
+
+    /**
+     * @brief Частное двух значений с 2*FractionBits дробными битами
+     * @param numerator Делимое
+     * @param denominator Делитель
+     * @return Частное, округленное и насыщенное до границ диапазона
+     * @throw std::runtime_error При делении на ноль
+     *
+     * Делится в long double: сдвиг делимого еще на FractionBits бит
+     * переполнил бы и Wide.
+     */
+    static constexpr FixedPoint quotient(Wide numerator, Wide denominator) {
+        if (denominator == 0) {
+            throw std::runtime_error("Деление на ноль!");
+        }
+        return FixedPoint(static_cast<long double>(numerator) / static_cast<long double>(denominator));
+    }
+
+    /**
+     * @brief Квадратный корень значения с 2*FractionBits дробными битами
+     * @param value Результат squareSum()
+     * @return Корень (через long double), насыщенный до границ диапазона
+     */
+    static FixedPoint rootOfWide(Wide value) {
+        return FixedPoint(std::sqrt(static_cast<long double>(value)) / one);
+    }
+
+    /**
+     * @brief Квадратный корень (через long double)
+     */
+    friend FixedPoint sqrt(FixedPoint x) {
+        return FixedPoint(std::sqrt(static_cast<long double>(x)));
+    }
+
+    /**
+     * @brief Вывод в поток в десятичном виде
+     */
+    friend std::ostream& operator<<(std::ostream& os, FixedPoint x) {
+        return os << static_cast<double>(x);
+    }
+};
+
+using Fixed16 = FixedPoint<int32_t, int64_t, 16>;  ///< Формат 16.16
+
+#ifdef __SIZEOF_INT128__
+#define COMPLEX_HAVE_FIXED32 1  ///< Доступен формат 32.32 (нужен 128-битный промежуточный тип)
+__extension__ typedef __int128 FixedWide128;
+using Fixed32 = FixedPoint<int64_t, FixedWide128, 32>;  ///< Формат 32.32
+#endif
+
+/**
+ * @struct IsFixedPoint
+ * @brief Является ли T числом с фиксированной точкой
+ */
+template <class T> struct IsFixedPoint : std::false_type {};
+template <class S, class W, int F> struct IsFixedPoint<FixedPoint<S, W, F>> : std::true_type {};
 
 /**
- * @class Complex
- * @brief Класс для представления комплексных чисел
+ * @struct PromotedScalar
+ * @brief Тип, к которому приводятся компоненты в смешанных выражениях
+ *
+ * Правила:
+ * - две плавающие точки - std::common_type (float < double < long double);
+ * - фиксированная и плавающая точка - наименьшая из A, double и long double
+ *   (не уже плавающего типа), в мантиссу которой помещаются все значащие
+ *   биты фиксированного формата: Fixed16 с float и double - double,
+ *   Fixed32 - long double;
+ * - две фиксированные точки - формат с большим числом дробных бит.
+ */
+template <class A, class B>
+struct PromotedScalar {
+    using type = std::common_type_t<A, B>;
+};
+
+/// Наименьший плавающий тип не уже A, в мантиссе которого есть Digits бит
+template <class A, int Digits>
+using FloatingHolding = std::conditional_t<
+    (std::numeric_limits<A>::digits >= Digits), A,
+    std::conditional_t<(std::numeric_limits<std::common_type_t<A, double>>::digits >= Digits),
+                       std::common_type_t<A, double>, long double>>;
+
+template <class S, class W, int F, class B>
+struct PromotedScalar<FixedPoint<S, W, F>, B> {
+    using type = FloatingHolding<B, std::numeric_limits<S>::digits>;
+};
+
+template <class A, class S, class W, int F>
+struct PromotedScalar<A, FixedPoint<S, W, F>> {
+    using type = FloatingHolding<A, std::numeric_limits<S>::digits>;
+};
+
+template <class S1, class W1, int F1, class S2, class W2, int F2>
+struct PromotedScalar<FixedPoint<S1, W1, F1>, FixedPoint<S2, W2, F2>> {
+    using type = std::conditional_t<(F1 >= F2), FixedPoint<S1, W1, F1>, FixedPoint<S2, W2, F2>>;
+};
+
+template <class A, class B>
+using Promoted = typename PromotedScalar<A, B>::type;
+
+/**
+ * @struct ComplexNorm
+ * @brief Суммы квадратов и произведений для модуля и деления BasicComplex<T>
+ *
+ * Для плавающей точки Square совпадает с T. Для FixedPoint суммы считаются
+ * в типе Wide без округления и насыщаются, а не заворачиваются: иначе у
+ * Fixed16 квадрат модуля переполняется уже при модуле около 181.
+ */
+template <class T>
+struct ComplexNorm {
+    using Square = T;  ///< Тип сумм квадратов и произведений
+
+    static constexpr Square productSum(T a, T b, T c, T d) { return a * b + c * d; }
+    static constexpr Square squareSum(T a, T b) { return a * a + b * b; }
+    static constexpr T narrow(Square value) { return value; }
+    static constexpr T quotient(Square numerator, Square denominator) { return numerator / denominator; }
+    static T root(Square value) {
+        using std::sqrt;
+        return sqrt(value);
+    }
+};
+
+template <class S, class W, int F>
+struct ComplexNorm<FixedPoint<S, W, F>> {
+    using T = FixedPoint<S, W, F>;
+    using Square = W;
+
+    static constexpr Square productSum(T a, T b, T c, T d) { return T::productSum(a, b, c, d); }
+    static constexpr Square squareSum(T a, T b) { return T::squareSum(a, b); }
+    static constexpr T narrow(Square value) { return T::fromWide(value); }
+    static constexpr T quotient(Square numerator, Square denominator) { return T::quotient(numerator, denominator); }
+    static T root(Square value) { return T::rootOfWide(value); }
+};
+
+/**
+ * @struct WideningConversion
+ * @brief Является ли преобразование From -> To точным для всех значений
+ *
+ * Между плавающими и между фиксированными форматами - если To совпадает
+ * с Promoted<From, To>. Из фиксированной точки в плавающую - только если
+ * все значащие биты формата помещаются в мантиссу To: Fixed16 (31 бит)
+ * точно переводится в double, но не во float, Fixed32 (63 бита) - только
+ * в long double с 64-битной мантиссой. Из плавающей в фиксированную
+ * преобразование всегда сужающее.
+ */
+template <class From, class To>
+struct WideningConversion : std::is_same<Promoted<From, To>, To> {};
+
+template <class S, class W, int F, class To>
+struct WideningConversion<FixedPoint<S, W, F>, To>
+    : std::integral_constant<bool, (std::numeric_limits<S>::digits <= std::numeric_limits<To>::digits)> {};
+
+template <class From, class S, class W, int F>
+struct WideningConversion<From, FixedPoint<S, W, F>> : std::false_type {};
+
+template <class S1, class W1, int F1, class S2, class W2, int F2>
+struct WideningConversion<FixedPoint<S1, W1, F1>, FixedPoint<S2, W2, F2>>
+    : std::is_same<Promoted<FixedPoint<S1, W1, F1>, FixedPoint<S2, W2, F2>>, FixedPoint<S2, W2, F2>> {};
+
+/// Преобразование From -> To не теряет точности (выполняется неявно)
+template <class From, class To>
+constexpr bool isWideningConversion = WideningConversion<From, To>::value;
+
+/**
+ * @class BasicComplex
+ * @brief Класс для представления комплексных чисел с компонентами типа T
  * 
  * Класс представляет комплексное число вида a + bi, где a - действительная часть,
  * b - мнимая часть, i - мнимая единица. Реализованы основные математические операции
  * и перегрузки операторов.
+ *
+ * T - float, double, long double или FixedPoint. Основной тип программы -
+ * Complex (BasicComplex<double>); остальные точности нужны там, где важен
+ * объем данных (BasicComplex<float> занимает 8 байт вместо 16). Расширяющие
+ * преобразования между точностями неявные, сужающие - только явные.
  */
-class Complex {
+template <class T>
+class BasicComplex {
 private:
-    double real;        ///< Действительная часть комплексного числа
-    double imag;        ///< Мнимая часть комплексного числа
-    static int count;   ///< Статический счетчик созданных объектов
+    T real;        ///< Действительная часть комплексного числа
+    T imag;        ///< Мнимая часть комплексного числа
+#ifdef COMPLEX_COUNT_INSTANCES
+    static inline std::atomic<long> count{0};  ///< Счетчик живых объектов
+#endif
 
 public:
     /**
@@ -22,54 +423,117 @@ public:
      * 
      * Создает комплексное число 0 + 0i
      */
-    Complex() : real(0), imag(0) {count++;}
+    COMPLEX_CONSTEXPR BasicComplex() : real(), imag() {
+#ifdef COMPLEX_COUNT_INSTANCES
+        count.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
 
     /**
      * @brief Конструктор с параметрами
      * @param r Действительная часть
      * @param i Мнимая часть (по умолчанию 0)
      */
-    Complex(double r, double i = 0) : real(r), imag(i) {count++;}
+    COMPLEX_CONSTEXPR BasicComplex(T r, T i = T()) : real(r), imag(i) {
+#ifdef COMPLEX_COUNT_INSTANCES
+        count.fetch_add(1, std::memory_order_relaxed);
+#endif
+    }
+
+    /**
+     * @brief Расширяющее преобразование из другой точности (неявное)
+     * @param other Исходное число
+     */
+    template <class U, std::enable_if_t<!std::is_same<U, T>::value && isWideningConversion<U, T>, int> = 0>
+    COMPLEX_CONSTEXPR BasicComplex(const BasicComplex<U>& other)
+        : BasicComplex(static_cast<T>(other.getReal()), static_cast<T>(other.getImag())) {}
+
+    /**
+     * @brief Сужающее преобразование из другой точности (только явное)
+     * @param other Исходное число
+     *
+     * Компоненты округляются к ближайшему представимому значению
+     * (для FixedPoint - с насыщением).
+     */
+    template <class U, std::enable_if_t<!std::is_same<U, T>::value && !isWideningConversion<U, T>, int> = 0>
+    explicit COMPLEX_CONSTEXPR BasicComplex(const BasicComplex<U>& other)
+        : BasicComplex(static_cast<T>(other.getReal()), static_cast<T>(other.getImag())) {}
+
+#ifdef COMPLEX_COUNT_INSTANCES
+    /**
+     * @brief Конструктор копирования (учитывает копию в счетчике)
+     * @param other Копируемое число
+     */
+    BasicComplex(const BasicComplex& other) : real(other.real), imag(other.imag) {
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Присваивание копированием
+     * @param other Присваиваемое число
+     * @return Ссылка на текущий объект
+     */
+    BasicComplex& operator=(const BasicComplex& other) = default;
 
     /**
      * @brief Деструктор
      * 
      * Уменьшает счетчик объектов при уничтожении
      */
-    ~Complex(){count--;}
+    ~BasicComplex() { count.fetch_sub(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief Возвращает количество живых объектов BasicComplex
+     * @return Текущее значение счетчика
+     */
+    static long instanceCount() { return count.load(std::memory_order_relaxed); }
+#endif
     
     /**
      * @brief Возвращает действительную часть
      * @return Действительная часть комплексного числа
      */
-    double getReal() const { return real; }
+    constexpr T getReal() const { return real; }
     
     /**
      * @brief Возвращает мнимую часть
      * @return Мнимая часть комплексного числа
      */
-    double getImag() const { return imag; }
+    constexpr T getImag() const { return imag; }
     
     /**
      * @brief Устанавливает действительную часть
      * @param r Новое значение действительной части
      */
-    void setReal(double r) { real = r; }
+    constexpr void setReal(T r) { real = r; }
     
     /**
      * @brief Устанавливает мнимую часть
      * @param i Новое значение мнимой части
      */
-    void setImag(double i) { imag = i; }
+    constexpr void setImag(T i) { imag = i; }
     
+    /**
+     * @brief Вычисляет квадрат модуля комплексного числа
+     * @return Квадрат модуля (real² + imag²)
+     *
+     * Не требует извлечения корня, поэтому используется везде,
+     * где модули только сравниваются между собой. Для FixedPoint
+     * насыщается до границы диапазона (см. ComplexNorm).
+     */
+    constexpr T squaredModulus() const {
+        return ComplexNorm<T>::narrow(ComplexNorm<T>::squareSum(real, imag));
+    }
+
     /**
      * @brief Вычисляет модуль комплексного числа
      * @return Модуль комплексного числа
      * 
-     * Формула: √(real² + imag²)
+     * Формула: √(real² + imag²); для FixedPoint квадрат не округляется
+     * до T, поэтому модуль верен во всем диапазоне.
      */
-    double modulus() const {
-        return std::sqrt(real * real + imag * imag);
+    T modulus() const {
+        return ComplexNorm<T>::root(ComplexNorm<T>::squareSum(real, imag));
     }
     
     /**
@@ -84,12 +548,12 @@ public:
      * - Если imag > 0: "real + imag i"
      * - Если imag < 0: "real - |imag| i"
      */
-    friend std::ostream& operator<<(std::ostream& os, const Complex& c) {
-        if (c.imag == 0) {
+    friend std::ostream& operator<<(std::ostream& os, const BasicComplex& c) {
+        if (c.imag == T()) {
             os << c.real;
-        } else if (c.real == 0) {
+        } else if (c.real == T()) {
             os << c.imag << "i";
-        } else if (c.imag > 0) {
+        } else if (c.imag > T()) {
             os << c.real << " + " << c.imag << "i";
         } else {
             os << c.real << " - " << -c.imag << "i";
@@ -103,7 +567,7 @@ public:
      * 
      * Увеличивает действительную часть на 1
      */
-    Complex& operator++() {
+    COMPLEX_CONSTEXPR BasicComplex& operator++() {
         ++real;
         return *this;
     }
@@ -115,8 +579,8 @@ public:
      * Увеличивает действительную часть на 1,
      * возвращает старое значение
      */
-    Complex operator++(int) {
-        Complex temp = *this;
+    COMPLEX_CONSTEXPR BasicComplex operator++(int) {
+        BasicComplex temp = *this;
         ++real;
         return temp;
     }
@@ -127,7 +591,7 @@ public:
      * 
      * Уменьшает действительную часть на 1
      */
-    Complex& operator--() {
+    COMPLEX_CONSTEXPR BasicComplex& operator--() {
         --real;
         return *this;
     }
@@ -139,8 +603,8 @@ public:
      * Уменьшает действительную часть на 1,
      * возвращает старое значение
      */
-    Complex operator--(int) {
-        Complex temp = *this;
+    COMPLEX_CONSTEXPR BasicComplex operator--(int) {
+        BasicComplex temp = *this;
         --real;
         return temp;
     }
@@ -149,8 +613,8 @@ public:
      * @brief Унарный минус
      * @return Новый объект с противоположными знаками обеих частей
      */
-    Complex operator-() const {
-        return Complex(-real, -imag);
+    COMPLEX_CONSTEXPR BasicComplex operator-() const {
+        return BasicComplex(-real, -imag);
     }
 
     /**
@@ -158,8 +622,8 @@ public:
      * @param other Второе слагаемое
      * @return Результат сложения
      */
-    Complex operator+(const Complex& other) const {
-        return Complex(real + other.real, imag + other.imag);
+    COMPLEX_CONSTEXPR BasicComplex operator+(const BasicComplex& other) const {
+        return BasicComplex(real + other.real, imag + other.imag);
     }
     
     /**
@@ -167,8 +631,8 @@ public:
      * @param other Вычитаемое
      * @return Результат вычитания
      */
-    Complex operator-(const Complex& other) const {
-        return Complex(real - other.real, imag - other.imag);
+    COMPLEX_CONSTEXPR BasicComplex operator-(const BasicComplex& other) const {
+        return BasicComplex(real - other.real, imag - other.imag);
     }
     
     /**
@@ -178,8 +642,8 @@ public:
      * 
      * Формула: (a+bi)(c+di) = (ac-bd) + (ad+bc)i
      */
-    Complex operator*(const Complex& other) const {
-        return Complex(real * other.real - imag * other.imag,
+    COMPLEX_CONSTEXPR BasicComplex operator*(const BasicComplex& other) const {
+        return BasicComplex(real * other.real - imag * other.imag,
                       real * other.imag + imag * other.real);
     }
     
@@ -190,23 +654,28 @@ public:
      * @throw std::runtime_error При делении на ноль
      * 
      * Формула: (a+bi)/(c+di) = ((ac+bd)/(c²+d²)) + ((bc-ad)/(c²+d²))i
+     * Для FixedPoint числители и знаменатель считаются в типе Wide (см. ComplexNorm).
      */
-    Complex operator/(const Complex& other) const {
-        double denominator = other.real * other.real + other.imag * other.imag;
-        if (denominator == 0) {
+    COMPLEX_CONSTEXPR BasicComplex operator/(const BasicComplex& other) const {
+        using Norm = ComplexNorm<T>;
+        typename Norm::Square denominator = Norm::squareSum(other.real, other.imag);
+        if (denominator == typename Norm::Square()) {
             throw std::runtime_error("Деление на ноль!");
         }
-        return Complex((real * other.real + imag * other.imag) / denominator,
-                      (imag * other.real - real * other.imag) / denominator);
+        return BasicComplex(Norm::quotient(Norm::productSum(real, other.real, imag, other.imag), denominator),
+                            Norm::quotient(Norm::productSum(imag, other.real, -real, other.imag), denominator));
     }
     
     /**
      * @brief Оператор "меньше" (сравнение модулей)
      * @param other Второе комплексное число
      * @return true если модуль текущего числа меньше модуля other
+     *
+     * Сравниваются квадраты модулей: корень монотонен, поэтому результат
+     * тот же, но без двух вызовов std::sqrt. То же для >, <= и >=.
      */
-    bool operator<(const Complex& other) const {
-        return this->modulus() < other.modulus();
+    constexpr bool operator<(const BasicComplex& other) const {
+        return ComplexNorm<T>::squareSum(real, imag) < ComplexNorm<T>::squareSum(other.real, other.imag);
     }
     
     /**
@@ -214,8 +683,8 @@ public:
      * @param other Второе комплексное число
      * @return true если модуль текущего числа больше модуля other
      */
-    bool operator>(const Complex& other) const {
-        return this->modulus() > other.modulus();
+    constexpr bool operator>(const BasicComplex& other) const {
+        return ComplexNorm<T>::squareSum(real, imag) > ComplexNorm<T>::squareSum(other.real, other.imag);
     }
     
     /**
@@ -223,8 +692,8 @@ public:
      * @param other Второе комплексное число
      * @return true если модуль текущего числа ≤ модулю other
      */
-    bool operator<=(const Complex& other) const {
-        return this->modulus() <= other.modulus();
+    constexpr bool operator<=(const BasicComplex& other) const {
+        return ComplexNorm<T>::squareSum(real, imag) <= ComplexNorm<T>::squareSum(other.real, other.imag);
     }
     
     /**
@@ -232,8 +701,8 @@ public:
      * @param other Второе комплексное число
      * @return true если модуль текущего числа ≥ модулю other
      */
-    bool operator>=(const Complex& other) const {
-        return this->modulus() >= other.modulus();
+    constexpr bool operator>=(const BasicComplex& other) const {
+        return ComplexNorm<T>::squareSum(real, imag) >= ComplexNorm<T>::squareSum(other.real, other.imag);
     }
     
     /**
@@ -241,7 +710,7 @@ public:
      * @param other Второе комплексное число
      * @return true если действительные и мнимые части равны
      */
-    bool operator==(const Complex& other) const {
+    constexpr bool operator==(const BasicComplex& other) const {
         return real == other.real && imag == other.imag;
     }
     
@@ -250,118 +719,9521 @@ public:
      * @param other Второе комплексное число
      * @return true если числа не равны
      */
-    bool operator!=(const Complex& other) const {
+    constexpr bool operator!=(const BasicComplex& other) const {
         return !(*this == other);
     }
 };
 
+using Complex = BasicComplex<double>;             ///< Комплексное число двойной точности (основной тип)
+using ComplexFloat = BasicComplex<float>;         ///< Одинарная точность
+using ComplexLongDouble = BasicComplex<long double>; ///< Расширенная точность
+using ComplexFixed16 = BasicComplex<Fixed16>;     ///< Фиксированная точка 16.16
+#ifdef COMPLEX_HAVE_FIXED32
+using ComplexFixed32 = BasicComplex<Fixed32>;     ///< Фиксированная точка 32.32
+#endif
+
+// Смешанная арифметика: оба операнда приводятся к Promoted<A, B>
+template <class A, class B>
+using EnableIfMixed = std::enable_if_t<!std::is_same<A, B>::value, BasicComplex<Promoted<A, B>>>;
+
+template <class A, class B>
+COMPLEX_CONSTEXPR EnableIfMixed<A, B> operator+(const BasicComplex<A>& a, const BasicComplex<B>& b) {
+    return BasicComplex<Promoted<A, B>>(a) + BasicComplex<Promoted<A, B>>(b);
+}
+
+template <class A, class B>
+COMPLEX_CONSTEXPR EnableIfMixed<A, B> operator-(const BasicComplex<A>& a, const BasicComplex<B>& b) {
+    return BasicComplex<Promoted<A, B>>(a) - BasicComplex<Promoted<A, B>>(b);
+}
+
+template <class A, class B>
+COMPLEX_CONSTEXPR EnableIfMixed<A, B> operator*(const BasicComplex<A>& a, const BasicComplex<B>& b) {
+    return BasicComplex<Promoted<A, B>>(a) * BasicComplex<Promoted<A, B>>(b);
+}
+
+template <class A, class B>
+COMPLEX_CONSTEXPR EnableIfMixed<A, B> operator/(const BasicComplex<A>& a, const BasicComplex<B>& b) {
+    return BasicComplex<Promoted<A, B>>(a) / BasicComplex<Promoted<A, B>>(b);
+}
+
 /**
- * @struct OperationRecord
- * @brief Запись об операции для истории вычислений
- * 
- * Хранит информацию об одной выполненной операции:
- * тип операции, операнды и результат.
+ * @brief Явное преобразование точности (в том числе сужающее)
+ * @tparam To Тип компонент результата
+ * @param c Исходное число
+ * @return Число с компонентами типа To
  */
-struct OperationRecord {
-    std::string operation;  ///< Тип операции (+, -, *, / и т.д.)
-    Complex num1;           ///< Первый операнд
-    Complex num2;           ///< Второй операнд (может быть пустым для унарных операций)
-    Complex result;         ///< Результат операции
-    
-    /**
-     * @brief Конструктор для бинарных операций
-     * @param op Тип операции
-     * @param n1 Первый операнд
-     * @param n2 Второй операнд
-     * @param res Результат операции
-     */
-    OperationRecord(const std::string& op, const Complex& n1, const Complex& n2, const Complex& res)
-        : operation(op), num1(n1), num2(n2), result(res) {}
-    
-    /**
-     * @brief Конструктор для унарных операций
-     * @param op Тип операции
-     * @param n1 Операнд
-     * @param res Результат операции
-     */
-    OperationRecord(const std::string& op, const Complex& n1, const Complex& res)
-        : operation(op), num1(n1), num2(0, 0), result(res) {}
-    
-    /**
-     * @brief Вывод информации об операции
-     * 
-     * Формат вывода зависит от типа операции:
-     * - Для унарных: "операция число = результат"
-     * - Для бинарных: "число1 операция число2 = результат"
-     */
-    void display() const {
-        if (num2.getReal() == 0 && num2.getImag() == 0) {
-            std::cout << operation << " " << num1 << " = " << result;
-        } else {
-            std::cout << num1 << " " << operation << " " << num2 << " = " << result;
+template <class To, class From>
+COMPLEX_CONSTEXPR BasicComplex<To> complexCast(const BasicComplex<From>& c) {
+    return BasicComplex<To>(static_cast<To>(c.getReal()), static_cast<To>(c.getImag()));
+}
+
+#ifndef COMPLEX_COUNT_INSTANCES
+static_assert(sizeof(ComplexFloat) == 8, "BasicComplex<float> должен занимать 8 байт");
+static_assert(std::is_trivially_copyable<Complex>::value,
+              "Complex должен копироваться как обычная пара double");
+static_assert(Complex(1, 2) * Complex(3, 4) == Complex(-5, 10),
+              "Арифметика Complex должна вычисляться во время компиляции");
+static_assert((BasicComplex<Fixed16>(Fixed16(1)) / BasicComplex<Fixed16>(Fixed16(200))).getReal() == Fixed16(0.005),
+              "Знаменатель деления Fixed16 не должен переполняться при |b| > 181");
+static_assert((BasicComplex<Fixed16>(Fixed16(1)) / BasicComplex<Fixed16>(Fixed16(0), Fixed16(300))).getImag() ==
+                  Fixed16(-1.0 / 300),
+              "Ненулевой делитель Fixed16 с |b| >= 256 не должен считаться нулем");
+static_assert(BasicComplex<Fixed16>(Fixed16(200)) > BasicComplex<Fixed16>(Fixed16(190)),
+              "Сравнение модулей Fixed16 не должно переполняться при |z| > 181");
+#endif
+
+/// Размер буфера, которого всегда хватает formatComplex()
+const size_t complexTextMaxLength = 64;
+
+/**
+ * @brief Записывает комплексное число в текстовом виде в буфер
+ * @param first Начало буфера
+ * @param last Конец буфера
+ * @param c Комплексное число
+ * @return Указатель за последним записанным символом и код ошибки
+ *         (std::errc::value_too_large, если буфер мал)
+ *
+ * Формы записи те же, что у operator<< ("a", "bi", "a + bi", "a - bi"),
+ * но без потоков и локалей: числа выводятся через std::to_chars в
+ * кратчайшем виде, который читается обратно без потерь.
+ */
+inline std::to_chars_result formatComplex(char* first, char* last, const Complex& c) {
+    const double re = c.getReal();
+    const double im = c.getImag();
+    if (im == 0) {
+        return std::to_chars(first, last, re);
+    }
+    std::to_chars_result r;
+    if (re == 0) {
+        r = std::to_chars(first, last, im);
+    } else {
+        r = std::to_chars(first, last, re);
+        if (r.ec != std::errc()) {
+            return r;
         }
-        std::cout << std::endl;
+        if (last - r.ptr < 3) {
+            return {last, std::errc::value_too_large};
+        }
+        std::memcpy(r.ptr, im > 0 ? " + " : " - ", 3);
+        r = std::to_chars(r.ptr + 3, last, im > 0 ? im : -im);
     }
-};
+    if (r.ec != std::errc()) {
+        return r;
+    }
+    if (r.ptr == last) {
+        return {last, std::errc::value_too_large};
+    }
+    *r.ptr = 'i';
+    return {r.ptr + 1, std::errc()};
+}
 
 /**
- * @class Calculator
- * @brief Калькулятор комплексных чисел с историей операций
- * 
- * Предоставляет интерфейс для выполнения операций над комплексными числами
- * и ведения истории выполненных операций.
+ * @brief Дописывает комплексное число в строку через formatComplex()
+ * @param out Строка-буфер
+ * @param c Комплексное число
  */
-class Calculator {
-private:
-    std::vector<OperationRecord> history;  ///< Вектор для хранения истории операций
-    
-public:
-    /**
-     * @brief Добавляет запись в историю операций
-     * @param record Запись для добавления
-     */
-    void addToHistory(const OperationRecord& record) {
-        history.push_back(record);
+inline void appendComplexText(std::string& out, const Complex& c) {
+    char text[complexTextMaxLength];
+    std::to_chars_result r = formatComplex(text, text + sizeof(text), c);
+    out.append(text, static_cast<size_t>(r.ptr - text));
+}
+
+/**
+ * @brief Разбирает комплексное число из текста
+ * @param first Начало текста
+ * @param last Конец текста
+ * @param value Результат разбора (не меняется при ошибке)
+ * @return Указатель за последним разобранным символом и код ошибки:
+ *         std::errc::invalid_argument, если в начале нет числа,
+ *         std::errc::result_out_of_range, если число не помещается в double
+ *
+ * Принимаются формы "a", "bi", "i", "a + bi", "a - bi", "a+i" и т.п.
+ * (например "3-4i", "2i", "5", "-i", "1e3 + 2.5i"). Перед числом допускается
+ * знак, вокруг знака между частями - пробелы. Как и std::from_chars, функция
+ * не пропускает пробелы в начале и разбирает самый длинный подходящий префикс:
+ * для "5 - 3" будет прочитано только "5".
+ */
+inline std::from_chars_result parseComplex(const char* first, const char* last, Complex& value) {
+    auto isBlank = [](char ch) { return ch == ' ' || ch == '\t'; };
+    const char* p = first;
+    bool negative = false;
+    if (p != last && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        ++p;
+        if (p != last && (*p == '+' || *p == '-')) {
+            return {first, std::errc::invalid_argument};
+        }
     }
-    
-    /**
-     * @brief Просмотр истории операций
-     * 
-     * Выводит все сохраненные операции в порядке их выполнения.
-     * Если история пуста, выводит соответствующее сообщение.
-     */
-    void viewHistory() const {
-        if (history.empty()) {
-            std::cout << "История операций пуста." << std::endl;
-            return;
+
+    double leading = 1;
+    std::from_chars_result r = std::from_chars(p, last, leading);
+    if (r.ec == std::errc::result_out_of_range) {
+        return r;
+    }
+    const bool hasNumber = r.ec == std::errc();
+    if (hasNumber) {
+        p = r.ptr;
+    } else {
+        leading = 1;
+    }
+    if (negative) {
+        leading = -leading;
+    }
+    if (p != last && *p == 'i') {
+        value = Complex(0, leading);
+        return {p + 1, std::errc()};
+    }
+    if (!hasNumber) {
+        return {first, std::errc::invalid_argument};
+    }
+
+    // Необязательная мнимая часть: [пробелы] знак [пробелы] [число] i
+    const char* realEnd = p;
+    while (p != last && isBlank(*p)) {
+        ++p;
+    }
+    if (p == last || (*p != '+' && *p != '-')) {
+        value = Complex(leading, 0);
+        return {realEnd, std::errc()};
+    }
+    const bool imagNegative = *p == '-';
+    ++p;
+    while (p != last && isBlank(*p)) {
+        ++p;
+    }
+    double imag = 1;
+    if (p != last && *p != '+' && *p != '-') {
+        std::from_chars_result ri = std::from_chars(p, last, imag);
+        if (ri.ec == std::errc::result_out_of_range) {
+            return ri;
         }
-        
-        std::cout << "\n=== История операций ===" << std::endl;
-        for (size_t i = 0; i < history.size(); ++i) {
-            std::cout << i + 1 << ". ";
-            history[i].display();
+        if (ri.ec == std::errc()) {
+            p = ri.ptr;
+        } else {
+            imag = 1;
         }
-        std::cout << "========================\n" << std::endl;
     }
-    
-    /**
-     * @brief Очистка истории операций
-     * 
-     * Удаляет все записи из истории.
-     */
-    void clearHistory() {
-        history.clear();
-        std::cout << "История операций очищена." << std::endl;
+    if (p == last || *p != 'i') {
+        value = Complex(leading, 0);
+        return {realEnd, std::errc()};
     }
+    value = Complex(leading, imagNegative ? -imag : imag);
+    return {p + 1, std::errc()};
+}
 
-    /**
-     * @brief Основной цикл работы калькулятора
-     * 
-     * Предоставляет интерактивное меню для выбора операций:
-     * 1. Сложение
-     * 2. Вычитание
-     * 3. Умножение
-     * 4. Деление
+/**
+ * @enum MathAccuracy
+ * @brief Уровень точности трансцендентных функций
+ *
+ * Precise - основной уровень: вычисления через функции libm в long double
+ * с разбором особых значений (нули со знаком, бесконечности, NaN) и
+ * разрезов по правилам C99 (приложение G); модуль у log() вблизи единичной
+ * окружности считается без округления квадратов. Погрешность компоненты
+ * не больше 1 ULP.
+ * Fast - собственные полиномиальные ядра без ветвлений, которые
+ * вычисляются сразу над 2, 4 или 8 элементами (SSE2/AVX2/AVX-512);
+ * погрешность компоненты не больше 4 ULP. Исключение - pow(): у нее не
+ * больше 4 ULP погрешность результата в целом (относительно |a^b|), а
+ * компонента, много меньшая модуля, может ошибаться на тысячи своих ULP,
+ * потому что угол b·log a округляется до double. Элементы с |b·log a| > 2,
+ * где растет и общая погрешность, pow() считает по Precise.
+ * Аргументы вне области ядер (бесконечности, NaN, нули, очень большие и
+ * малые значения) вычисляются по Precise, поэтому особые значения и
+ * разрезы на обоих уровнях одинаковы.
+ */
+enum class MathAccuracy : unsigned char {
+    Precise = 0,  ///< Не больше 1 ULP, через libm в long double
+    Fast = 1      ///< Не больше 4 ULP (у pow() - по модулю результата), векторные ядра
+};
+
+#ifdef __GNUC__
+#define COMPLEX_LANES_INLINE inline __attribute__((always_inline))  ///< Встраивается в ядро любого набора инструкций
+#else
+#define COMPLEX_LANES_INLINE inline
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+/// Запрещает слияние умножения со сложением: быстрые ядра дают одинаковый результат на всех уровнях SIMD
+#define COMPLEX_NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define COMPLEX_NO_FP_CONTRACT
+#endif
+
+#ifdef __GNUC__
+// Векторные типы передаются по значению только во встраиваемых функциях, так
+// что смена ABI их не касается. Шаблоны инстанцируются в конце единицы
+// трансляции, поэтому предупреждение отключается до конца файла
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+/**
+ * @namespace transcendental
+ * @brief Реализация exp, log, sqrt, pow, arg, sin, cos и полярных преобразований
+ *
+ * Каждая функция - структура с двумя статическими методами:
+ * precise<F>() для одного числа в типе F (double или long double) и
+ * fast<V>() для блока из Lanes<V>::width чисел. fast() пишется один раз
+ * через обычную арифметику над V, поэтому один и тот же код работает и для
+ * V = double (скалярный путь), и для векторов GCC (Double2/4/8), которые
+ * компилятор переводит в инструкции того набора, в ядро которого fast()
+ * встроен. fast() возвращает маску элементов, вышедших за область ядра, -
+ * их unaryLoop()/binaryLoop() пересчитывают через precise().
+ */
+namespace transcendental {
+
+/**
+ * @struct Lanes
+ * @brief Свойства блока V: ширина, тип битового представления и маски
+ */
+template <class V> struct Lanes;
+
+template <> struct Lanes<double> {
+    static const size_t width = 1;
+    using Bits = uint64_t;
+    using Mask = bool;
+
+    COMPLEX_LANES_INLINE static double get(double v, size_t) { return v; }
+    COMPLEX_LANES_INLINE static bool test(Mask m, size_t) { return m; }
+    COMPLEX_LANES_INLINE static bool any(Mask m) { return m; }
+    inline static void sqrt(double& v) { v = std::sqrt(v); }
+};
+
+#ifdef COMPLEX_SIMD_X86
+typedef double Double2 __attribute__((vector_size(16)));   ///< 2 числа double (SSE2)
+typedef double Double4 __attribute__((vector_size(32)));   ///< 4 числа double (AVX2)
+typedef double Double8 __attribute__((vector_size(64)));   ///< 8 чисел double (AVX-512)
+typedef uint64_t Bits2 __attribute__((vector_size(16)));
+typedef uint64_t Bits4 __attribute__((vector_size(32)));
+typedef uint64_t Bits8 __attribute__((vector_size(64)));
+
+template <class V, class B>
+struct VectorLanes {
+    static const size_t width = sizeof(V) / sizeof(double);
+    using Bits = B;
+    using Mask = decltype(V() < V());
+
+    COMPLEX_LANES_INLINE static double get(V v, size_t i) { return v[i]; }
+    COMPLEX_LANES_INLINE static bool test(Mask m, size_t i) { return m[i] != 0; }
+};
+
+// Корень и проверка "есть ли в маске истина" не выражаются векторными операторами;
+// эти функции не помечены always_inline и встраиваются уже в ядро с нужным набором инструкций
+template <> struct Lanes<Double2> : VectorLanes<Double2, Bits2> {
+    __attribute__((target("sse2"))) inline static void sqrt(Double2& v) { v = _mm_sqrt_pd(v); }
+    __attribute__((target("sse2"))) inline static bool any(Mask m) {
+        return _mm_movemask_pd(reinterpret_cast<__m128d>(m)) != 0;
+    }
+};
+template <> struct Lanes<Double4> : VectorLanes<Double4, Bits4> {
+    __attribute__((target("avx"))) inline static void sqrt(Double4& v) { v = _mm256_sqrt_pd(v); }
+    __attribute__((target("avx"))) inline static bool any(Mask m) {
+        return _mm256_movemask_pd(reinterpret_cast<__m256d>(m)) != 0;
+    }
+};
+template <> struct Lanes<Double8> : VectorLanes<Double8, Bits8> {
+    __attribute__((target("avx512f"))) inline static void sqrt(Double8& v) {
+        v = _mm512_maskz_sqrt_pd(static_cast<__mmask8>(0xFF), v);
+    }
+    __attribute__((target("avx512f"))) inline static bool any(Mask m) {
+        __m512i bits = reinterpret_cast<__m512i>(m);
+        return _mm512_test_epi64_mask(bits, bits) != 0;
+    }
+};
+#endif
+
+constexpr double roundingShift = 6755399441055744.0;          ///< 1.5·2^52: x + shift округляет x до целого
+constexpr uint64_t roundingShiftBits = 0x4338000000000000ull;  ///< Битовое представление roundingShift
+constexpr uint64_t signBit = 0x8000000000000000ull;
+constexpr double ln2Hi = 6.93147180369123816490e-01;          ///< ln 2, старшие 32 бита
+constexpr double ln2Lo = 1.90821492927058770002e-10;          ///< ln 2 - ln2Hi
+constexpr double invLn2 = 1.44269504088896338700e+00;
+constexpr double pio2Part1 = 1.57079632673412561417e+00;      ///< π/2, первые 33 бита
+constexpr double pio2Part2 = 6.07710050630396597660e-11;      ///< Следующие 33 бита π/2
+constexpr double pio2Part3 = 2.02226624879595063154e-21;      ///< π/2 - pio2Part1 - pio2Part2
+constexpr double twoOverPi = 6.36619772367581382433e-01;
+constexpr double pio4Hi = 7.85398163397448278999e-01;
+constexpr double pio4Lo = 3.06161699786838301793e-17;
+constexpr double pio2Hi = 1.57079632679489655800e+00;
+constexpr double pio2Lo = 6.12323399573676603587e-17;
+constexpr double piHi = 3.14159265358979311600e+00;
+constexpr double piLo = 1.22464679914735317720e-16;
+constexpr double reductionLimit = 1048576.0;                  ///< |x| ≤ 2^20: приведение по модулю π/2 точное
+constexpr double hyperbolicLimit = 700.0;                     ///< e^700 еще не переполняется
+constexpr double rangeHi = 3.2733906078961419e+150;           ///< 2^500: квадраты не переполняются
+constexpr double rangeLo = 3.0549363634996047e-151;           ///< 2^-500: квадраты остаются нормальными
+
+template <class V>
+COMPLEX_LANES_INLINE typename Lanes<V>::Bits bitsOf(V x) {
+    typename Lanes<V>::Bits b;
+    std::memcpy(&b, &x, sizeof(b));
+    return b;
+}
+
+template <class V>
+COMPLEX_LANES_INLINE V fromBits(typename Lanes<V>::Bits b) {
+    V x;
+    std::memcpy(&x, &b, sizeof(x));
+    return x;
+}
+
+template <class V>
+COMPLEX_LANES_INLINE V splat(double c) {
+    return V() + c;
+}
+
+template <class V>
+COMPLEX_LANES_INLINE V magnitude(V x) {
+    return fromBits<V>(bitsOf(x) & ~signBit);
+}
+
+template <class V>
+COMPLEX_LANES_INLINE V withSignOf(V value, V sign) {
+    return fromBits<V>((bitsOf(value) & ~signBit) | (bitsOf(sign) & signBit));
+}
+
+/**
+ * @brief Проверяет, что квадраты |x| и |y| не переполняются и не теряют точность
+ *
+ * |x| + |y| лежит между max(|x|, |y|) и его удвоенным значением, а NaN и
+ * бесконечности проходят через сумму и не попадают в диапазон.
+ */
+template <class V>
+COMPLEX_LANES_INLINE typename Lanes<V>::Mask inRange(V ax, V ay) {
+    V size = ax + ay;
+    return (size >= rangeLo) & (size <= rangeHi);
+}
+
+/**
+ * @brief Сумма без потери младших бит: hi + lo == a + b точно
+ */
+template <class V>
+COMPLEX_LANES_INLINE void twoSum(V a, V b, V& hi, V& lo) {
+    hi = a + b;
+    V bb = hi - a;
+    lo = (a - (hi - bb)) + (b - bb);
+}
+
+/**
+ * @brief Квадрат без округления: hi + lo == x·x точно (разбиение Деккера)
+ */
+template <class V>
+COMPLEX_LANES_INLINE void twoSquare(V x, V& hi, V& lo) {
+    V c = x * 134217729.0;
+    V xh = c - (c - x);
+    V xl = x - xh;
+    hi = x * x;
+    lo = ((xh * xh - hi) + 2.0 * xh * xl) + xl * xl;
+}
+
+/**
+ * @brief e^r - 1 для |r| ≤ ln2/2 (ряд Тейлора до r^14)
+ */
+template <class V>
+COMPLEX_LANES_INLINE V expm1Reduced(V r) {
+    V p = 1.0 / 87178291200.0 + r * 0.0;
+    p = 1.0 / 6227020800.0 + r * p;
+    p = 1.0 / 479001600.0 + r * p;
+    p = 1.0 / 39916800.0 + r * p;
+    p = 1.0 / 3628800.0 + r * p;
+    p = 1.0 / 362880.0 + r * p;
+    p = 1.0 / 40320.0 + r * p;
+    p = 1.0 / 5040.0 + r * p;
+    p = 1.0 / 720.0 + r * p;
+    p = 1.0 / 120.0 + r * p;
+    p = 1.0 / 24.0 + r * p;
+    p = 1.0 / 6.0 + r * p;
+    p = 0.5 + r * p;
+    return r + (r * r) * p;
+}
+
+/**
+ * @brief Приведение x = k·ln2 + r, |r| ≤ ln2/2
+ * @param k Целое k в младших битах (дополнительный код)
+ * @param kd k в виде double
+ */
+template <class V>
+COMPLEX_LANES_INLINE V reduceLn2(V x, typename Lanes<V>::Bits& k, V& kd) {
+    V t = x * invLn2 + roundingShift;
+    kd = t - roundingShift;
+    k = bitsOf(t) - roundingShiftBits;
+    return (x - kd * ln2Hi) - kd * ln2Lo;
+}
+
+/**
+ * @brief e^x для |x| ≤ 1100 (результат может быть бесконечностью или денормализованным)
+ *
+ * 2^k собирается из двух множителей, чтобы и 2^1023, и денормализованные
+ * результаты получались без отдельных ветвей.
+ */
+template <class V>
+COMPLEX_LANES_INLINE V expKernel(V x) {
+    typename Lanes<V>::Bits k;
+    V kd;
+    V r = reduceLn2(x, k, kd);
+    V p = 1.0 + expm1Reduced(r);
+    typename Lanes<V>::Bits k1 = bitsOf(kd * 0.5 + roundingShift) - roundingShiftBits;
+    typename Lanes<V>::Bits k2 = k - k1;
+    return p * fromBits<V>((k1 + 1023) << 52) * fromBits<V>((k2 + 1023) << 52);
+}
+
+/**
+ * @brief e^x - 1 для |x| ≤ 700 без потери точности вблизи нуля
+ *
+ * e^x - 1 = 2^k·(e^r - 1) + (2^k - 1): оба слагаемых точные, погрешность
+ * вносит только их сложение.
+ */
+template <class V>
+COMPLEX_LANES_INLINE V expm1Kernel(V x) {
+    typename Lanes<V>::Bits k;
+    V kd;
+    V r = reduceLn2(x, k, kd);
+    V scale = fromBits<V>((k + 1023) << 52);
+    return scale * expm1Reduced(r) + (scale - 1.0);
+}
+
+/**
+ * @brief ln x для положительных нормализованных x (схема fdlibm)
+ */
+template <class V>
+COMPLEX_LANES_INLINE V logKernel(V x) {
+    // Мантисса приводится к [√2/2, √2), порядок - к соответствующему k
+    typename Lanes<V>::Bits hx = bitsOf(x) + 0x00095f6200000000ull;
+    V dk = fromBits<V>((hx >> 52) + roundingShiftBits) - (roundingShift + 1023.0);
+    V m = fromBits<V>((hx & 0x000fffffffffffffull) + 0x3fe6a09e00000000ull);
+    V f = m - 1.0;
+    V hfsq = 0.5 * f * f;
+    V s = f / (2.0 + f);
+    V z = s * s;
+    V w = z * z;
+    V t1 = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+    V t2 = z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01 +
+                w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+    V R = t2 + t1;
+    return s * (hfsq + R) + dk * ln2Lo - hfsq + f + dk * ln2Hi;
+}
+
+/**
+ * @brief ln(1 + u) для u из (-0.5, 1)
+ */
+template <class V>
+COMPLEX_LANES_INLINE V log1pKernel(V u) {
+    V v = 1.0 + u;
+    V correction = (u - (v - 1.0)) / v;
+    return logKernel(v) + correction;
+}
+
+/**
+ * @brief sin и cos для |x| ≤ reductionLimit
+ *
+ * x приводится к r = x - n·π/2 в виде суммы hi + lo (π/2 взято с точностью
+ * ~119 бит), затем вычисляются многочлены fdlibm на [-π/4, π/4] и
+ * выбирается четверть по младшим битам n.
+ */
+template <class V>
+COMPLEX_LANES_INLINE void sinCosKernel(V x, V& sine, V& cosine) {
+    V q = x * twoOverPi + roundingShift;
+    V nd = q - roundingShift;
+    typename Lanes<V>::Bits n = bitsOf(q) - roundingShiftBits;
+    V t = x - nd * pio2Part1;
+    V w = nd * pio2Part2;
+    V hi, err;
+    twoSum(t, -w, hi, err);
+    V lo = err - nd * pio2Part3;
+
+    V z = hi * hi;
+    V v = z * hi;
+    V rs = 8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06 +
+           z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)));
+    V s = hi - ((z * (0.5 * lo - v * rs) - lo) - v * -1.66666666666666324348e-01);
+
+    V zz = z * z;
+    V rc = z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * 2.48015872894767294178e-05)) +
+           zz * zz * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11));
+    V hz = 0.5 * z;
+    V one = 1.0 - hz;
+    V c = one + (((1.0 - one) - hz) + (z * rc - hi * lo));
+
+    auto swap = (n & 1) != 0;
+    V sv = swap ? c : s;
+    V cv = swap ? s : c;
+    sine = fromBits<V>(bitsOf(sv) ^ ((n & 2) << 62));
+    cosine = fromBits<V>(bitsOf(cv) ^ (((n + 1) & 2) << 62));
+}
+
+/**
+ * @brief atan2(y, x) для конечных x, y, не равных нулю одновременно
+ */
+template <class V>
+COMPLEX_LANES_INLINE V atan2Kernel(V y, V x) {
+    V ax = magnitude(x);
+    V ay = magnitude(y);
+    auto swap = ay > ax;
+    V a = (swap ? ax : ay) / (swap ? ay : ax);
+    auto big = a > 0.41421356237309503;  // tg(π/8)
+    V t = big ? (a - 1.0) / (a + 1.0) : a;
+    V z = t * t;
+    V w = z * z;
+    V s1 = z * (3.33333333333329318027e-01 + w * (1.42857142725034663711e-01 + w * (9.09088713343650656196e-02 +
+           w * (6.66107313738753120669e-02 + w * (4.97687799461593236017e-02 + w * 1.62858201153657823623e-02)))));
+    V s2 = w * (-1.99999999998764832476e-01 + w * (-1.11111104054623557880e-01 + w * (-7.69187620504482999495e-02 +
+           w * (-5.83357013379057348645e-02 + w * -3.65315727442169155270e-02))));
+    V hi = big ? splat<V>(pio4Hi) : V();
+    V lo = big ? splat<V>(pio4Lo) : V();
+    V r = hi - ((t * (s1 + s2) - lo) - t);
+    r = swap ? (pio2Hi - r) + pio2Lo : r;
+    r = x < 0.0 ? (piHi - r) + piLo : r;
+    return withSignOf(r, y);
+}
+
+/**
+ * @brief ln|x + iy|; вблизи единичной окружности x² + y² - 1 считается без округления
+ */
+template <class F>
+F logModulus(F x, F y) {
+    F a = std::fabs(x), b = std::fabs(y);
+    if (std::isinf(a) || std::isinf(b)) {
+        return std::numeric_limits<F>::infinity();
+    }
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::numeric_limits<F>::quiet_NaN();
+    }
+    if (a < b) {
+        std::swap(a, b);
+    }
+    if (a == 0) {
+        return -std::numeric_limits<F>::infinity();
+    }
+    if (a < 2) {
+        F a2 = a * a, b2 = b * b;
+        F s = a2 + b2;
+        if (s > F(0.5) && s < 2) {
+            F p, ep, q, eq;
+            twoSum(a2, F(-1), p, ep);
+            twoSum(p, b2, q, eq);
+            F d = q + ((ep + eq) + (std::fma(a, a, -a2) + std::fma(b, b, -b2)));
+            return std::log1p(d) / 2;
+        }
+    }
+    F h = std::hypot(a, b);
+    if (std::isfinite(h) && h >= std::numeric_limits<F>::min()) {
+        return std::log(h);
+    }
+    F ratio = b / a;
+    return std::log(a) + std::log1p(ratio * ratio) / 2;
+}
+
+/**
+ * @struct Exp
+ * @brief e^z = e^x·(cos y + i·sin y)
+ */
+struct Exp {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        if (y == 0) {
+            re = std::exp(x);  // Вещественная ось, в том числе NaN + 0i
+            im = y;
+            return;
+        }
+        if (std::isinf(x)) {
+            if (x < 0) {
+                re = 0;
+                im = std::copysign(F(0), y);
+                if (std::isfinite(y)) {
+                    re = F(0) * std::cos(y);
+                    im = F(0) * std::sin(y);
+                }
+            } else if (!std::isfinite(y)) {
+                re = x;
+                im = std::numeric_limits<F>::quiet_NaN();
+            } else {
+                re = x * std::cos(y);
+                im = x * std::sin(y);
+            }
+            return;
+        }
+        if (!std::isfinite(y)) {
+            re = im = std::numeric_limits<F>::quiet_NaN();
+            return;
+        }
+        F c = std::cos(y), s = std::sin(y);
+        F e = std::exp(x);
+        if (std::isinf(e)) {
+            // e^x переполняется, а e^x·cos y может быть конечным
+            F half = std::exp(x / 2);
+            re = (half * c) * half;
+            im = (half * s) * half;
+            return;
+        }
+        re = e * c;
+        im = e * s;
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        V s, c;
+        sinCosKernel(y, s, c);
+        V e = expKernel(x);
+        re = e * c;
+        im = e * s;
+        return ((magnitude(x) <= 708.0) & (magnitude(y) <= reductionLimit)) == 0;
+    }
+};
+
+/**
+ * @struct Log
+ * @brief Главное значение логарифма: ln|z| + i·arg z, arg z ∈ (-π, π]
+ *
+ * Разрез - отрицательная вещественная полуось: знак нуля в мнимой части
+ * выбирает берег (log(-1 + 0i) = iπ, log(-1 - 0i) = -iπ).
+ */
+struct Log {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        re = logModulus(x, y);
+        im = std::atan2(y, x);
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        V ax = magnitude(x), ay = magnitude(y);
+        V big = ax > ay ? ax : ay;
+        V small = ax > ay ? ay : ax;
+        V big2, big2Lo, small2, small2Lo;
+        twoSquare(big, big2, big2Lo);
+        twoSquare(small, small2, small2Lo);
+        V sum = big2 + small2;
+        // Вблизи |z| = 1: ln|z| = log1p(x² + y² - 1) / 2 с точной разностью
+        V p, ep, q, eq;
+        twoSum(big2, splat<V>(-1.0), p, ep);
+        twoSum(p, small2, q, eq);
+        V d = q + ((ep + eq) + (big2Lo + small2Lo));
+        auto nearOne = (sum > 0.5) & (sum < 2.0);
+        re = nearOne ? 0.5 * log1pKernel(d) : 0.5 * logKernel(sum);
+        im = atan2Kernel(y, x);
+        return inRange(ax, ay) == 0;
+    }
+};
+
+/**
+ * @struct Sqrt
+ * @brief Главное значение корня: Re √z ≥ 0, разрез по отрицательной полуоси
+ */
+struct Sqrt {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        if (std::isinf(y)) {
+            re = std::numeric_limits<F>::infinity();
+            im = y;
+            return;
+        }
+        if (std::isinf(x)) {
+            if (x > 0) {
+                re = x;
+                im = std::isnan(y) ? y : std::copysign(F(0), y);
+            } else {
+                re = std::isnan(y) ? y : F(0);
+                im = std::copysign(std::numeric_limits<F>::infinity(), y);
+            }
+            return;
+        }
+        if (std::isnan(x) || std::isnan(y)) {
+            re = im = std::numeric_limits<F>::quiet_NaN();
+            return;
+        }
+        if (x == 0 && y == 0) {
+            re = 0;
+            im = y;
+            return;
+        }
+        // Масштабирование на четную степень двойки: |x| + |z| не переполняется,
+        // а у малых аргументов не теряются биты денормализованных чисел
+        const int digits = std::numeric_limits<F>::digits;
+        int scale = 0;
+        F m = std::max(std::fabs(x), std::fabs(y));
+        if (m > std::numeric_limits<F>::max() / 4) {
+            x = std::ldexp(x, -2);
+            y = std::ldexp(y, -2);
+            scale = 1;
+        } else if (m < std::ldexp(F(1), std::numeric_limits<F>::min_exponent + digits)) {
+            x = std::ldexp(x, 2 * digits);
+            y = std::ldexp(y, 2 * digits);
+            scale = -digits;
+        }
+        F t = std::sqrt((std::fabs(x) + std::hypot(x, y)) / 2);
+        if (x >= 0) {
+            re = t;
+            im = y / (2 * t);
+        } else {
+            re = std::fabs(y) / (2 * t);
+            im = std::copysign(t, y);
+        }
+        re = std::ldexp(re, scale);
+        im = std::ldexp(im, scale);
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        V ax = magnitude(x), ay = magnitude(y);
+        V h = x * x + y * y;
+        Lanes<V>::sqrt(h);
+        V t = (ax + h) * 0.5;
+        Lanes<V>::sqrt(t);
+        V u = y / (t + t);
+        auto right = x >= 0.0;
+        re = right ? t : magnitude(u);
+        im = right ? u : withSignOf(t, y);
+        return inRange(ax, ay) == 0;
+    }
+};
+
+/**
+ * @struct Sin
+ * @brief sin z = sin x·ch y + i·cos x·sh y
+ */
+struct Sin {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        if (!std::isfinite(x) || !std::isfinite(y)) {
+            // Бесконечности и NaN - по таблицам приложения G, как в libm
+            std::complex<F> r = std::sin(std::complex<F>(x, y));
+            re = r.real();
+            im = r.imag();
+            return;
+        }
+        F s = std::sin(x), c = std::cos(x);
+        if (std::fabs(y) > std::log(std::numeric_limits<F>::max()) - 1) {
+            F half = std::exp(std::fabs(y) / 2) / 2;  // ch y ≈ |sh y| ≈ e^|y| / 2
+            re = (s * half) * (2 * half);
+            im = (c * std::copysign(half, y)) * (2 * half);
+        } else {
+            re = s * std::cosh(y);
+            im = c * std::sinh(y);
+        }
+        if (x == 0) {
+            re = x;
+        }
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        V s, c, sh, ch;
+        sinCosKernel(x, s, c);
+        hyperbolic(y, sh, ch);
+        re = s * ch;
+        im = c * sh;
+        return ((magnitude(x) <= reductionLimit) & (magnitude(y) <= hyperbolicLimit)) == 0;
+    }
+
+    /**
+     * @brief sh y и ch y для |y| ≤ hyperbolicLimit
+     */
+    template <class V>
+    COMPLEX_LANES_INLINE static void hyperbolic(V y, V& sh, V& ch) {
+        V em = expm1Kernel(magnitude(y));
+        V e = em + 1.0;
+        sh = withSignOf(0.5 * (em + em / e), y);
+        ch = 0.5 * (e + 1.0 / e);
+    }
+};
+
+/**
+ * @struct Cos
+ * @brief cos z = cos x·ch y - i·sin x·sh y
+ */
+struct Cos {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        if (!std::isfinite(x) || !std::isfinite(y)) {
+            std::complex<F> r = std::cos(std::complex<F>(x, y));
+            re = r.real();
+            im = r.imag();
+            return;
+        }
+        F s = std::sin(x), c = std::cos(x);
+        if (std::fabs(y) > std::log(std::numeric_limits<F>::max()) - 1) {
+            F half = std::exp(std::fabs(y) / 2) / 2;
+            re = (c * half) * (2 * half);
+            im = -(s * std::copysign(half, y)) * (2 * half);
+        } else {
+            re = c * std::cosh(y);
+            im = -(s * std::sinh(y));
+        }
+        if (x == 0) {
+            im = -(x * std::copysign(F(1), y));
+        }
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        V s, c, sh, ch;
+        sinCosKernel(x, s, c);
+        Sin::hyperbolic(y, sh, ch);
+        re = c * ch;
+        im = -(s * sh);
+        return ((magnitude(x) <= reductionLimit) & (magnitude(y) <= hyperbolicLimit)) == 0;
+    }
+};
+
+/**
+ * @struct Arg
+ * @brief Аргумент z в (-π, π] (результат - в действительной части)
+ */
+struct Arg {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        re = std::atan2(y, x);
+        im = 0;
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        V size = magnitude(x) + magnitude(y);
+        re = atan2Kernel(y, x);
+        im = V();
+        return ((size > 0.0) & (size <= std::numeric_limits<double>::max())) == 0;
+    }
+};
+
+/**
+ * @struct ToPolar
+ * @brief (x, y) -> (|z|, arg z)
+ */
+struct ToPolar {
+    template <class F>
+    static void precise(F x, F y, F& re, F& im) {
+        re = std::hypot(x, y);
+        im = std::atan2(y, x);
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V x, V y, V& re, V& im) {
+        re = x * x + y * y;
+        Lanes<V>::sqrt(re);
+        im = atan2Kernel(y, x);
+        return inRange(magnitude(x), magnitude(y)) == 0;
+    }
+};
+
+/**
+ * @struct FromPolar
+ * @brief (r, θ) -> r·(cos θ + i·sin θ)
+ */
+struct FromPolar {
+    template <class F>
+    static void precise(F r, F theta, F& re, F& im) {
+        re = r * std::cos(theta);
+        im = r * std::sin(theta);
+    }
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V r, V theta, V& re, V& im) {
+        V s, c;
+        sinCosKernel(theta, s, c);
+        re = r * c;
+        im = r * s;
+        return ((magnitude(r) <= std::numeric_limits<double>::max()) & (magnitude(theta) <= reductionLimit)) == 0;
+    }
+};
+
+/**
+ * @brief cos(πt) и sin(πt); при t, кратном 1/2, результат точный
+ */
+template <class F>
+void sinCosPi(F t, F& c, F& s) {
+    F q = 2 * t;
+    if (q == std::nearbyint(q)) {
+        static const signed char cosTable[4] = {1, 0, -1, 0};
+        long k = static_cast<long>(std::fmod(q, F(4)));
+        k = (k + 4) % 4;
+        c = cosTable[k];
+        s = cosTable[(k + 3) % 4];
+        return;
+    }
+    const F pi = static_cast<F>(3.14159265358979323846264338327950288L);
+    c = std::cos(pi * t);
+    s = std::sin(pi * t);
+}
+
+/**
+ * @struct Pow
+ * @brief Главное значение a^b = e^(b·log a)
+ *
+ * a^0 = 1 для любого a; 0^b = 0 при Re b > 0 и бесконечность при Re b < 0;
+ * вещественное основание с вещественным показателем вычисляется через
+ * std::pow, для отрицательного основания - как |a|^b·e^(±iπb), причем углы,
+ * кратные π/2, берутся точно ((-1)^0.5 = i, а не 6e-17 + i).
+ * В остальных случаях b·log a и экспонента считаются в long double, чтобы
+ * погрешность log a не умножалась на |b·log a|.
+ *
+ * Быстрое ядро считает b·log a в double, и погрешность log a растет вместе
+ * с |b·log a|; поэтому элементы, у которых любая компонента b·log a по
+ * модулю больше fastExponentLimit, вычисляются по Precise.
+ */
+struct Pow {
+    template <class F>
+    static void precise(F ar, F ai, F br, F bi, F& re, F& im) {
+        if (br == 0 && bi == 0) {
+            re = 1;
+            im = 0;
+            return;
+        }
+        if (ar == 0 && ai == 0) {
+            if (br > 0) {
+                re = im = 0;
+            } else if (br < 0) {
+                re = std::numeric_limits<F>::infinity();
+                im = 0;
+            } else {
+                re = im = std::numeric_limits<F>::quiet_NaN();
+            }
+            return;
+        }
+        if (ai == 0 && bi == 0 && (ar > 0 || br == std::nearbyint(br))) {
+            re = std::pow(ar, br);
+            im = 0;
+            return;
+        }
+        if (ai == 0 && bi == 0 && ar < 0) {
+            F modulus = std::pow(-ar, br);
+            F c, s;
+            sinCosPi(std::fmod(br, F(2)), c, s);
+            re = c == 0 ? F(0) : modulus * c;
+            im = s == 0 ? F(0) : std::copysign(F(1), ai) * (modulus * s);
+            return;
+        }
+        using W = long double;
+        W lr, li, er, ei;
+        Log::precise<W>(ar, ai, lr, li);
+        Exp::precise<W>(W(br) * lr - W(bi) * li, W(br) * li + W(bi) * lr, er, ei);
+        re = static_cast<F>(er);
+        im = static_cast<F>(ei);
+    }
+
+    static constexpr double fastExponentLimit = 2;  ///< Граница |b·log a| для быстрого ядра
+
+    template <class V>
+    COMPLEX_LANES_INLINE static typename Lanes<V>::Mask fast(V ar, V ai, V br, V bi, V& re, V& im) {
+        V lr, li;
+        auto logFallback = Log::fast(ar, ai, lr, li);
+        V xr = br * lr - bi * li;
+        V xi = br * li + bi * lr;
+        auto expFallback = Exp::fast(xr, xi, re, im);
+        auto inexact = (xr > fastExponentLimit) | (xr < -fastExponentLimit) |
+                       (xi > fastExponentLimit) | (xi < -fastExponentLimit);
+        return logFallback | expFallback | inexact | ((br == 0.0) & (bi == 0.0));
+    }
+};
+
+/**
+ * @brief Уровень Precise для double: вычисление в long double с одним округлением
+ *
+ * Промежуточные произведения (e^x·cos y, sin x·ch y и т.п.) в double
+ * накапливали бы до 2-3 ULP; на x86 long double имеет 64-битную мантиссу,
+ * и итог остается в пределах 1 ULP.
+ */
+template <class Kernel>
+inline void evaluatePrecise(double x, double y, double& re, double& im) {
+    long double r, i;
+    Kernel::template precise<long double>(x, y, r, i);
+    re = static_cast<double>(r);
+    im = static_cast<double>(i);
+}
+
+template <class Kernel>
+inline void evaluatePrecise(double ar, double ai, double br, double bi, double& re, double& im) {
+    long double r, i;
+    Kernel::template precise<long double>(ar, ai, br, bi, r, i);
+    re = static_cast<double>(r);
+    im = static_cast<double>(i);
+}
+
+/**
+ * @brief Обрабатывает блок из m ≤ width элементов функции одного аргумента
+ * @param outi Мнимые части результата (nullptr - не нужны, как у Arg)
+ */
+template <class V, class Kernel>
+COMPLEX_LANES_INLINE void unaryBlock(const double* ar, const double* ai, double* outr, double* outi, size_t m) {
+    V x = V(), y = V(), re, im;
+    std::memcpy(&x, ar, m * sizeof(double));
+    std::memcpy(&y, ai, m * sizeof(double));
+    typename Lanes<V>::Mask fallback = Kernel::fast(x, y, re, im);
+    std::memcpy(outr, &re, m * sizeof(double));
+    if (outi) {
+        std::memcpy(outi, &im, m * sizeof(double));
+    }
+    for (size_t j = 0; j < m; ++j) {
+        if (Lanes<V>::test(fallback, j)) {
+            double r, i;
+            evaluatePrecise<Kernel>(Lanes<V>::get(x, j), Lanes<V>::get(y, j), r, i);
+            outr[j] = r;
+            if (outi) {
+                outi[j] = i;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Применяет Kernel::fast() к массивам SoA блоками по Lanes<V>::width
+ *
+ * Выход может совпадать со входом: элементы, пересчитываемые через
+ * precise(), берутся из уже загруженного блока.
+ */
+template <class V, class Kernel>
+COMPLEX_LANES_INLINE void unaryLoop(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    const size_t width = Lanes<V>::width;
+    size_t k = 0;
+    for (; k + width <= n; k += width) {
+        unaryBlock<V, Kernel>(ar + k, ai + k, outr + k, outi ? outi + k : nullptr, width);
+    }
+    if (k < n) {
+        unaryBlock<V, Kernel>(ar + k, ai + k, outr + k, outi ? outi + k : nullptr, n - k);
+    }
+}
+
+template <class V, class Kernel>
+COMPLEX_LANES_INLINE void binaryBlock(const double* ar, const double* ai, const double* br, const double* bi,
+                                      double* outr, double* outi, size_t m) {
+    V a = V(), b = V(), c = V(), d = V(), re, im;
+    std::memcpy(&a, ar, m * sizeof(double));
+    std::memcpy(&b, ai, m * sizeof(double));
+    std::memcpy(&c, br, m * sizeof(double));
+    std::memcpy(&d, bi, m * sizeof(double));
+    typename Lanes<V>::Mask fallback = Kernel::fast(a, b, c, d, re, im);
+    std::memcpy(outr, &re, m * sizeof(double));
+    std::memcpy(outi, &im, m * sizeof(double));
+    for (size_t j = 0; j < m; ++j) {
+        if (Lanes<V>::test(fallback, j)) {
+            evaluatePrecise<Kernel>(Lanes<V>::get(a, j), Lanes<V>::get(b, j), Lanes<V>::get(c, j),
+                                    Lanes<V>::get(d, j), outr[j], outi[j]);
+        }
+    }
+}
+
+/**
+ * @brief Применяет Kernel::fast() функции двух аргументов к массивам SoA
+ */
+template <class V, class Kernel>
+COMPLEX_LANES_INLINE void binaryLoop(const double* ar, const double* ai, const double* br, const double* bi,
+                                     double* outr, double* outi, size_t n) {
+    const size_t width = Lanes<V>::width;
+    size_t k = 0;
+    for (; k + width <= n; k += width) {
+        binaryBlock<V, Kernel>(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, width);
+    }
+    if (k < n) {
+        binaryBlock<V, Kernel>(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+    }
+}
+
+/**
+ * @brief Применяет Kernel::precise() к массивам SoA поэлементно
+ * @param outi Мнимые части результата (nullptr - не нужны)
+ */
+template <class Kernel>
+inline void preciseLoop(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        double re, im;
+        evaluatePrecise<Kernel>(ar[k], ai[k], re, im);
+        outr[k] = re;
+        if (outi) {
+            outi[k] = im;
+        }
+    }
+}
+
+template <class Kernel>
+inline void preciseBinaryLoop(const double* ar, const double* ai, const double* br, const double* bi,
+                              double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        double re, im;
+        evaluatePrecise<Kernel>(ar[k], ai[k], br[k], bi[k], re, im);
+        outr[k] = re;
+        outi[k] = im;
+    }
+}
+
+/**
+ * @brief Быстрый уровень для одного числа (тот же код, что в векторных ядрах)
+ */
+template <class Kernel>
+COMPLEX_NO_FP_CONTRACT void fastScalar(double x, double y, double& re, double& im) {
+    unaryLoop<double, Kernel>(&x, &y, &re, &im, 1);
+}
+
+template <class Kernel>
+COMPLEX_NO_FP_CONTRACT void fastScalar(double ar, double ai, double br, double bi, double& re, double& im) {
+    binaryLoop<double, Kernel>(&ar, &ai, &br, &bi, &re, &im, 1);
+}
+
+/**
+ * @brief Нужно ли считать тип T через long double
+ *
+ * long double и фиксированная точка (32.32 не помещается в мантиссу
+ * double) вычисляются только на уровне Precise.
+ */
+template <class T>
+struct ComputesInLongDouble
+    : std::integral_constant<bool, !std::is_same<T, double>::value && !std::is_same<T, float>::value> {};
+
+/**
+ * @brief Вычисляет функцию одного аргумента в точности T
+ *
+ * float и double идут через ядра double с округлением результата до T,
+ * остальные типы - через long double.
+ */
+template <class Kernel, class T>
+BasicComplex<T> apply(const BasicComplex<T>& z, MathAccuracy accuracy) {
+    if constexpr (ComputesInLongDouble<T>::value) {
+        long double re, im;
+        Kernel::precise(static_cast<long double>(z.getReal()), static_cast<long double>(z.getImag()), re, im);
+        return BasicComplex<T>(static_cast<T>(re), static_cast<T>(im));
+    } else {
+        double x = static_cast<double>(z.getReal()), y = static_cast<double>(z.getImag()), re, im;
+        if (accuracy == MathAccuracy::Fast) {
+            fastScalar<Kernel>(x, y, re, im);
+        } else {
+            evaluatePrecise<Kernel>(x, y, re, im);
+        }
+        return BasicComplex<T>(static_cast<T>(re), static_cast<T>(im));
+    }
+}
+
+template <class Kernel, class T>
+BasicComplex<T> apply(const BasicComplex<T>& a, const BasicComplex<T>& b, MathAccuracy accuracy) {
+    if constexpr (ComputesInLongDouble<T>::value) {
+        using W = long double;
+        W re, im;
+        Kernel::precise(static_cast<W>(a.getReal()), static_cast<W>(a.getImag()),
+                        static_cast<W>(b.getReal()), static_cast<W>(b.getImag()), re, im);
+        return BasicComplex<T>(static_cast<T>(re), static_cast<T>(im));
+    } else {
+        double re, im;
+        double ar = static_cast<double>(a.getReal()), ai = static_cast<double>(a.getImag());
+        double br = static_cast<double>(b.getReal()), bi = static_cast<double>(b.getImag());
+        if (accuracy == MathAccuracy::Fast) {
+            fastScalar<Kernel>(ar, ai, br, bi, re, im);
+        } else {
+            evaluatePrecise<Kernel>(ar, ai, br, bi, re, im);
+        }
+        return BasicComplex<T>(static_cast<T>(re), static_cast<T>(im));
+    }
+}
+
+} // namespace transcendental
+
+/**
+ * @brief Экспонента e^z
+ * @param z Показатель
+ * @param accuracy Уровень точности (см. MathAccuracy)
+ * @return e^z
+ */
+template <class T>
+BasicComplex<T> exp(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Exp>(z, accuracy);
+}
+
+/**
+ * @brief Главное значение натурального логарифма
+ * @param z Аргумент
+ * @param accuracy Уровень точности
+ * @return ln|z| + i·arg z; log(0) = -∞ + i·arg(0)
+ */
+template <class T>
+BasicComplex<T> log(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Log>(z, accuracy);
+}
+
+/**
+ * @brief Главное значение квадратного корня
+ * @param z Аргумент
+ * @param accuracy Уровень точности
+ * @return √z с неотрицательной действительной частью
+ */
+template <class T>
+BasicComplex<T> sqrt(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Sqrt>(z, accuracy);
+}
+
+/**
+ * @brief Главное значение степени a^b
+ * @param a Основание
+ * @param b Показатель
+ * @param accuracy Уровень точности
+ * @return e^(b·log a) (особые случаи - см. transcendental::Pow)
+ *
+ * На уровне Fast граница 4 ULP относится к |a^b|, а не к каждой компоненте
+ * (см. MathAccuracy).
+ */
+template <class T>
+BasicComplex<T> pow(const BasicComplex<T>& a, const BasicComplex<T>& b,
+                    MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Pow>(a, b, accuracy);
+}
+
+/**
+ * @brief Синус
+ * @param z Аргумент
+ * @param accuracy Уровень точности
+ * @return sin z
+ */
+template <class T>
+BasicComplex<T> sin(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Sin>(z, accuracy);
+}
+
+/**
+ * @brief Косинус
+ * @param z Аргумент
+ * @param accuracy Уровень точности
+ * @return cos z
+ */
+template <class T>
+BasicComplex<T> cos(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Cos>(z, accuracy);
+}
+
+/**
+ * @brief Аргумент (фаза) комплексного числа
+ * @param z Число
+ * @param accuracy Уровень точности
+ * @return atan2(Im z, Re z) в (-π, π]
+ */
+template <class T>
+T arg(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::Arg>(z, accuracy).getReal();
+}
+
+/**
+ * @brief Переводит число в полярную форму
+ * @param z Число
+ * @param accuracy Уровень точности
+ * @return Число (|z|, arg z)
+ */
+template <class T>
+BasicComplex<T> toPolar(const BasicComplex<T>& z, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::ToPolar>(z, accuracy);
+}
+
+/**
+ * @brief Строит число по модулю и аргументу
+ * @param r Модуль
+ * @param theta Аргумент в радианах
+ * @param accuracy Уровень точности
+ * @return r·(cos θ + i·sin θ)
+ */
+template <class T>
+BasicComplex<T> polar(T r, T theta, MathAccuracy accuracy = MathAccuracy::Precise) {
+    return transcendental::apply<transcendental::FromPolar>(BasicComplex<T>(r, theta), accuracy);
+}
+
+/**
+ * @namespace reduction
+ * @brief Свертки комплексных массивов: сумма, скалярное произведение, норма, максимум модуля
+ *
+ * Каждое ядро ведет laneCount независимых сумм (элементы с одинаковым
+ * k mod laneCount) в виде пары hi + lo: hi - обычная сумма, lo - накопленные
+ * ошибки округления (TwoSum), а произведения раскладываются в сумму двух
+ * double без округления (TwoProduct). Итог эквивалентен вычислению в
+ * удвоенной точности с одним округлением в конце: погрешность не больше
+ * eps·|S| + n·eps²·Σ|x|, тогда как у последовательного operator+ она
+ * растет как n·eps·Σ|x|.
+ *
+ * Массив делится на блоки по chunkSize элементов, которые раздаются потокам
+ * пула, а частичные результаты блоков складываются попарным деревом в
+ * фиксированном порядке. Разбиение не зависит ни от числа потоков, ни от
+ * уровня SIMD (ширина вектора лишь делит laneCount сумм на группы), поэтому
+ * результат побитово одинаков при любом числе потоков и любом наборе
+ * инструкций.
+ */
+namespace reduction {
+
+using transcendental::Lanes;
+
+const size_t laneCount = 8;         ///< Независимых сумм в ядре (кратно ширине любого уровня SIMD)
+const size_t chunkSize = 1 << 15;   ///< Элементов в блоке, который обрабатывает один поток
+
+/**
+ * @struct Accumulator
+ * @brief Сумма в удвоенной точности: hi + lo, |lo| ≤ ulp(hi) / 2
+ */
+struct Accumulator {
+    double hi;  ///< Старшая часть
+    double lo;  ///< Поправка
+};
+
+/**
+ * @struct Partial
+ * @brief Частичный результат суммы по действительной и мнимой частям
+ */
+struct Partial {
+    Accumulator re;
+    Accumulator im;
+};
+
+/**
+ * @struct Peak
+ * @brief Частичный результат поиска максимума модуля
+ */
+struct Peak {
+    double squared;  ///< Наибольший x² + y² (-1, если сравнимых элементов не было)
+    size_t index;    ///< Номер первого элемента с этим значением
+};
+
+/**
+ * @brief Складывает две суммы удвоенной точности
+ */
+inline Accumulator combine(Accumulator a, Accumulator b) {
+    double s, e;
+    transcendental::twoSum(a.hi, b.hi, s, e);
+    e += a.lo + b.lo;
+    double hi = s + e;
+    return Accumulator{hi, e - (hi - s)};
+}
+
+inline Partial combine(const Partial& a, const Partial& b) {
+    return Partial{combine(a.re, b.re), combine(a.im, b.im)};
+}
+
+/**
+ * @brief Выбирает больший максимум, при равенстве - с меньшим номером
+ */
+inline Peak combine(const Peak& a, const Peak& b) {
+    if (b.squared > a.squared || (b.squared == a.squared && b.index < a.index)) {
+        return b;
+    }
+    return a;
+}
+
+/**
+ * @brief Произведение без округления: p + e == a·b точно (разбиение Деккера)
+ *
+ * Без FMA, чтобы результат не зависел от набора инструкций; точно, пока
+ * |a|, |b| < 2^996 и произведение не денормализовано.
+ */
+template <class V>
+COMPLEX_LANES_INLINE void twoProduct(V a, V b, V& p, V& e) {
+    V ca = a * 134217729.0;
+    V ah = ca - (ca - a);
+    V al = a - ah;
+    V cb = b * 134217729.0;
+    V bh = cb - (cb - b);
+    V bl = b - bh;
+    p = a * b;
+    e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+}
+
+/**
+ * @brief Добавляет x к сумме hi + lo
+ */
+template <class V>
+COMPLEX_LANES_INLINE void accumulate(V& hi, V& lo, V x) {
+    V s, e;
+    transcendental::twoSum(hi, x, s, e);
+    hi = s;
+    lo = lo + e;
+}
+
+/**
+ * @struct SumStep
+ * @brief Σ a: acc = (re.hi, re.lo, im.hi, im.lo)
+ */
+struct SumStep {
+    static const size_t inputs = 2;
+
+    template <class V>
+    COMPLEX_LANES_INLINE static void apply(const V* x, V* acc) {
+        accumulate(acc[0], acc[1], x[0]);
+        accumulate(acc[2], acc[3], x[1]);
+    }
+};
+
+/**
+ * @struct Norm2Step
+ * @brief Σ |a|² (используется только действительная часть)
+ */
+struct Norm2Step {
+    static const size_t inputs = 2;
+
+    template <class V>
+    COMPLEX_LANES_INLINE static void apply(const V* x, V* acc) {
+        V p, e, q, f;
+        transcendental::twoSquare(x[0], p, e);
+        transcendental::twoSquare(x[1], q, f);
+        accumulate(acc[0], acc[1], p);
+        accumulate(acc[0], acc[1], q);
+        acc[1] = acc[1] + (e + f);
+    }
+};
+
+/**
+ * @struct DotStep
+ * @brief Σ conj(a)·b = Σ (ar·br + ai·bi) + i·(ar·bi - ai·br)
+ */
+struct DotStep {
+    static const size_t inputs = 4;
+
+    template <class V>
+    COMPLEX_LANES_INLINE static void apply(const V* x, V* acc) {
+        V p1, e1, p2, e2, p3, e3, p4, e4;
+        twoProduct(x[0], x[2], p1, e1);
+        twoProduct(x[1], x[3], p2, e2);
+        twoProduct(x[0], x[3], p3, e3);
+        twoProduct(x[1], x[2], p4, e4);
+        accumulate(acc[0], acc[1], p1);
+        accumulate(acc[0], acc[1], p2);
+        acc[1] = acc[1] + (e1 + e2);
+        accumulate(acc[2], acc[3], p3);
+        accumulate(acc[2], acc[3], -p4);
+        acc[3] = acc[3] + (e3 - e4);
+    }
+};
+
+/**
+ * @brief Сворачивает n элементов: laneCount сумм, затем их сложение по порядку
+ * @param data Step::inputs массивов
+ * @param n Количество элементов
+ * @param out Частичный результат
+ *
+ * Неполный последний блок дополняется нулями, одинаково на всех уровнях SIMD.
+ */
+template <class V, class Step>
+COMPLEX_LANES_INLINE void reduceLoop(const double* const* data, size_t n, Partial& out) {
+    const size_t width = Lanes<V>::width;
+    const size_t groups = laneCount / width;
+    V acc[groups][4];
+    for (size_t g = 0; g < groups; ++g) {
+        for (size_t c = 0; c < 4; ++c) {
+            acc[g][c] = V();
+        }
+    }
+    double pad[Step::inputs][laneCount];
+    for (size_t k = 0; k < n; k += laneCount) {
+        const double* block[Step::inputs];
+        for (size_t i = 0; i < Step::inputs; ++i) {
+            if (n - k >= laneCount) {
+                block[i] = data[i] + k;
+            } else {
+                std::fill(pad[i], pad[i] + laneCount, 0.0);
+                std::memcpy(pad[i], data[i] + k, (n - k) * sizeof(double));
+                block[i] = pad[i];
+            }
+        }
+        for (size_t g = 0; g < groups; ++g) {
+            V x[Step::inputs];
+            for (size_t i = 0; i < Step::inputs; ++i) {
+                std::memcpy(&x[i], block[i] + g * width, sizeof(V));
+            }
+            Step::apply(x, acc[g]);
+        }
+    }
+    double lanes[4][laneCount];
+    for (size_t g = 0; g < groups; ++g) {
+        for (size_t c = 0; c < 4; ++c) {
+            std::memcpy(&lanes[c][g * width], &acc[g][c], sizeof(V));
+        }
+    }
+    out = Partial{{lanes[0][0], lanes[1][0]}, {lanes[2][0], lanes[3][0]}};
+    for (size_t j = 1; j < laneCount; ++j) {
+        out.re = combine(out.re, Accumulator{lanes[0][j], lanes[1][j]});
+        out.im = combine(out.im, Accumulator{lanes[2][j], lanes[3][j]});
+    }
+}
+
+/**
+ * @brief Ищет элемент с наибольшим x² + y²
+ * @param first Номер элемента ar[0] во всем массиве
+ *
+ * Элементы с NaN не сравниваются и пропускаются; при равенстве побеждает
+ * меньший номер.
+ */
+template <class V>
+COMPLEX_LANES_INLINE void peakLoop(const double* ar, const double* ai, size_t n, size_t first, Peak& out) {
+    const size_t width = Lanes<V>::width;
+    const size_t groups = laneCount / width;
+    static const double offsets[laneCount] = {0, 1, 2, 3, 4, 5, 6, 7};
+    V best[groups], index[groups], offset[groups];
+    for (size_t g = 0; g < groups; ++g) {
+        best[g] = transcendental::splat<V>(-1.0);
+        index[g] = V();
+        std::memcpy(&offset[g], offsets + g * width, sizeof(V));
+    }
+    double pad[2][laneCount];
+    for (size_t k = 0; k < n; k += laneCount) {
+        const double* x = ar + k;
+        const double* y = ai + k;
+        if (n - k < laneCount) {
+            std::fill(pad[0], pad[0] + laneCount, std::numeric_limits<double>::quiet_NaN());
+            std::memcpy(pad[0], ar + k, (n - k) * sizeof(double));
+            std::memcpy(pad[1], ai + k, (n - k) * sizeof(double));
+            x = pad[0];
+            y = pad[1];
+        }
+        V base = transcendental::splat<V>(static_cast<double>(first + k));
+        for (size_t g = 0; g < groups; ++g) {
+            V re, im;
+            std::memcpy(&re, x + g * width, sizeof(V));
+            std::memcpy(&im, y + g * width, sizeof(V));
+            V squared = re * re + im * im;
+            auto better = squared > best[g];
+            best[g] = better ? squared : best[g];
+            index[g] = better ? base + offset[g] : index[g];
+        }
+    }
+    out = Peak{-1.0, first + n};
+    for (size_t g = 0; g < groups; ++g) {
+        for (size_t j = 0; j < width; ++j) {
+            Peak lane{Lanes<V>::get(best[g], j), static_cast<size_t>(Lanes<V>::get(index[g], j))};
+            if (lane.squared >= 0) {
+                out = combine(out, lane);
+            }
+        }
+    }
+}
+
+} // namespace reduction
+
+/**
+ * @namespace gemm
+ * @brief Микроядра умножения матриц и матрицы на вектор (см. ComplexMatrix)
+ *
+ * Умножение разбито по схеме GotoBLAS/BLIS: блоки A и B упаковываются в
+ * непрерывные полосы (A - по tileRows строк, B - по tileCols столбцов), а
+ * микроядро накапливает в регистрах плитку C размером tileRows × tileCols.
+ * Действительные и мнимые части хранятся раздельно, поэтому
+ * комплексное умножение сводится к четырем вещественным умножениям-сложениям
+ * над векторами без перестановок. Ширина tileCols фиксирована, а вектор
+ * уровня SIMD покрывает ее за tileCols / ширина шагов.
+ */
+namespace gemm {
+
+using transcendental::Lanes;
+
+const size_t tileRows = 4;  ///< Строк в плитке микроядра
+const size_t tileCols = 16; ///< Столбцов в плитке микроядра
+
+/**
+ * @brief Микроядро: C[0..rows, 0..cols] += alpha · A·B для упакованных полос
+ * @param depth Длина полос (общая размерность)
+ * @param a Полоса A: на шаг k - tileRows действительных, затем tileRows мнимых частей
+ * @param b Полоса B: на шаг k - tileCols действительных, затем tileCols мнимых частей
+ * @param cr Действительные части C (строки через ldc)
+ * @param ci Мнимые части C
+ * @param ldc Шаг строк C
+ * @param rows Сколько строк плитки записывать (≤ tileRows)
+ * @param cols Сколько столбцов плитки записывать (≤ tileCols)
+ * @param alphaRe Действительная часть множителя
+ * @param alphaIm Мнимая часть множителя
+ */
+template <class V>
+COMPLEX_LANES_INLINE void tile(size_t depth, const double* a, const double* b, double* cr, double* ci, size_t ldc,
+                               size_t rows, size_t cols, double alphaRe, double alphaIm) {
+    const size_t width = Lanes<V>::width;
+    const size_t groups = tileCols / width;
+    // Накопители прохода должны остаться в регистрах: у AVX-512 их 32, у остальных уровней 16,
+    // поэтому узкие векторы проходят полосу A несколько раз, по passGroups векторов столбцов
+    const size_t passGroups = width >= 8 ? groups : 1;
+    for (size_t g0 = 0; g0 < groups && g0 * width < cols; g0 += passGroups) {
+        V accRe[tileRows][passGroups], accIm[tileRows][passGroups];
+        for (size_t i = 0; i < tileRows; ++i) {
+            for (size_t g = 0; g < passGroups; ++g) {
+                accRe[i][g] = V();
+                accIm[i][g] = V();
+            }
+        }
+        const double* pa = a;
+        const double* pb = b + g0 * width;
+        for (size_t k = 0; k < depth; ++k) {
+            V br[passGroups], bi[passGroups];
+            for (size_t g = 0; g < passGroups; ++g) {
+                std::memcpy(&br[g], pb + g * width, sizeof(V));
+                std::memcpy(&bi[g], pb + tileCols + g * width, sizeof(V));
+            }
+            for (size_t i = 0; i < tileRows; ++i) {
+                const double ar = pa[i], ai = pa[tileRows + i];
+                for (size_t g = 0; g < passGroups; ++g) {
+                    accRe[i][g] = accRe[i][g] + ar * br[g];
+                    accRe[i][g] = accRe[i][g] - ai * bi[g];
+                    accIm[i][g] = accIm[i][g] + ar * bi[g];
+                    accIm[i][g] = accIm[i][g] + ai * br[g];
+                }
+            }
+            pa += 2 * tileRows;
+            pb += 2 * tileCols;
+        }
+        const size_t first = g0 * width;
+        const size_t count = std::min(passGroups * width, cols - first);
+        for (size_t i = 0; i < rows; ++i) {
+            double re[passGroups * width], im[passGroups * width];
+            for (size_t g = 0; g < passGroups; ++g) {
+                V r = accRe[i][g] * alphaRe - accIm[i][g] * alphaIm;
+                V m = accRe[i][g] * alphaIm + accIm[i][g] * alphaRe;
+                std::memcpy(re + g * width, &r, sizeof(V));
+                std::memcpy(im + g * width, &m, sizeof(V));
+            }
+            double* rowRe = cr + i * ldc + first;
+            double* rowIm = ci + i * ldc + first;
+            for (size_t j = 0; j < count; ++j) {
+                rowRe[j] += re[j];
+                rowIm[j] += im[j];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Скалярное произведение без сопряжения: out = Σ a[k]·x[k]
+ * @param out out[0] - действительная, out[1] - мнимая часть
+ */
+template <class V>
+COMPLEX_LANES_INLINE void dot(const double* ar, const double* ai, const double* xr, const double* xi, size_t n,
+                              double* out) {
+    const size_t width = Lanes<V>::width;
+    V sumRe[2] = {V(), V()}, sumIm[2] = {V(), V()};
+    size_t k = 0;
+    for (; k + 2 * width <= n; k += 2 * width) {
+        for (size_t u = 0; u < 2; ++u) {
+            V a, b, x, y;
+            std::memcpy(&a, ar + k + u * width, sizeof(V));
+            std::memcpy(&b, ai + k + u * width, sizeof(V));
+            std::memcpy(&x, xr + k + u * width, sizeof(V));
+            std::memcpy(&y, xi + k + u * width, sizeof(V));
+            sumRe[u] = sumRe[u] + a * x;
+            sumRe[u] = sumRe[u] - b * y;
+            sumIm[u] = sumIm[u] + a * y;
+            sumIm[u] = sumIm[u] + b * x;
+        }
+    }
+    V re = sumRe[0] + sumRe[1], im = sumIm[0] + sumIm[1];
+    double totalRe = 0, totalIm = 0;
+    for (size_t j = 0; j < width; ++j) {
+        totalRe += Lanes<V>::get(re, j);
+        totalIm += Lanes<V>::get(im, j);
+    }
+    for (; k < n; ++k) {
+        totalRe += ar[k] * xr[k] - ai[k] * xi[k];
+        totalIm += ar[k] * xi[k] + ai[k] * xr[k];
+    }
+    out[0] = totalRe;
+    out[1] = totalIm;
+}
+
+/**
+ * @brief y += alpha · x или y += alpha · conj(x)
+ */
+template <class V>
+COMPLEX_LANES_INLINE void axpy(double alphaRe, double alphaIm, const double* xr, const double* xi,
+                               double* yr, double* yi, size_t n, bool conjugate) {
+    const size_t width = Lanes<V>::width;
+    // conj(x) отличается от x только знаком мнимой части
+    const double sign = conjugate ? -1.0 : 1.0;
+    const double ar = alphaRe, ai = alphaIm;
+    size_t k = 0;
+    for (; k + width <= n; k += width) {
+        V x, y, u, v;
+        std::memcpy(&x, xr + k, sizeof(V));
+        std::memcpy(&y, xi + k, sizeof(V));
+        std::memcpy(&u, yr + k, sizeof(V));
+        std::memcpy(&v, yi + k, sizeof(V));
+        y = y * sign;
+        u = u + ar * x;
+        u = u - ai * y;
+        v = v + ar * y;
+        v = v + ai * x;
+        std::memcpy(yr + k, &u, sizeof(V));
+        std::memcpy(yi + k, &v, sizeof(V));
+    }
+    for (; k < n; ++k) {
+        double y = xi[k] * sign;
+        yr[k] += ar * xr[k] - ai * y;
+        yi[k] += ar * y + ai * xr[k];
+    }
+}
+
+} // namespace gemm
+
+/**
+ * @namespace escape
+ * @brief Итерации z -> z² + c до выхода из круга |z| ≤ 2 (escape time)
+ *
+ * Ядро ведет сразу groupCount векторов точек, чтобы цепочки зависимостей
+ * соседних точек перекрывались. Выход проверяется по |z|² > 4 без корня;
+ * вышедшие элементы исключаются маской: их z и счетчик больше не меняются,
+ * так что итог не зависит от соседей по вектору и совпадает с
+ * последовательным циклом на операторах Complex. Блок завершается, когда
+ * в маске не осталось ни одного активного элемента.
+ */
+namespace escape {
+
+using transcendental::Lanes;
+
+const size_t groupCount = 6;        ///< Независимых векторов точек в ядре (подобрано замером)
+const uint32_t checkInterval = 4;   ///< Шагов между проверками "остались ли активные точки"
+
+/**
+ * @brief Итерирует n точек
+ * @param cr Действительные части c
+ * @param ci Мнимые части c
+ * @param n Количество точек
+ * @param maxIterations Наибольшее число шагов
+ * @param counts Число выполненных шагов для каждой точки
+ * @param zr Действительные части последнего z (nullptr - не нужны)
+ * @param zi Мнимые части последнего z
+ *
+ * Шаг z = z² + c выполняется, пока |z| ≤ 2 и шагов меньше maxIterations.
+ * Неполный последний блок дополняется c = NaN: такие элементы выходят
+ * после первого шага и не задерживают блок.
+ */
+template <class V>
+COMPLEX_LANES_INLINE void iterationLoop(const double* cr, const double* ci, size_t n, uint32_t maxIterations,
+                                        uint32_t* counts, double* zr, double* zi) {
+    using Mask = typename Lanes<V>::Mask;
+    const size_t width = Lanes<V>::width;
+    const size_t block = groupCount * width;
+    const V limit = transcendental::splat<V>(4.0);
+    const V one = transcendental::splat<V>(1.0);
+    double padRe[block], padIm[block], outRe[block], outIm[block], outCount[block];
+    for (size_t k = 0; k < n; k += block) {
+        const double* pr = cr + k;
+        const double* pi = ci + k;
+        const size_t count = std::min(block, n - k);
+        if (count < block) {
+            std::fill(padRe, padRe + block, std::numeric_limits<double>::quiet_NaN());
+            std::fill(padIm, padIm + block, std::numeric_limits<double>::quiet_NaN());
+            std::memcpy(padRe, pr, count * sizeof(double));
+            std::memcpy(padIm, pi, count * sizeof(double));
+            pr = padRe;
+            pi = padIm;
+        }
+        V x[groupCount], y[groupCount], cx[groupCount], cy[groupCount], steps[groupCount];
+        Mask active[groupCount];
+        for (size_t g = 0; g < groupCount; ++g) {
+            std::memcpy(&cx[g], pr + g * width, sizeof(V));
+            std::memcpy(&cy[g], pi + g * width, sizeof(V));
+            x[g] = y[g] = steps[g] = V();
+            active[g] = x[g] == x[g];
+        }
+        for (uint32_t done = 0; done < maxIterations;) {
+            const uint32_t run = std::min(checkInterval, maxIterations - done);
+            for (uint32_t s = 0; s < run; ++s) {
+                for (size_t g = 0; g < groupCount; ++g) {
+                    V x2 = x[g] * x[g];
+                    V y2 = y[g] * y[g];
+                    V xy = x[g] * y[g];
+                    active[g] = active[g] & (x2 + y2 <= limit);
+                    x[g] = active[g] ? (x2 - y2) + cx[g] : x[g];
+                    y[g] = active[g] ? (xy + xy) + cy[g] : y[g];
+                    steps[g] = active[g] ? steps[g] + one : steps[g];
+                }
+            }
+            done += run;
+            bool any = false;
+            for (size_t g = 0; g < groupCount; ++g) {
+                any = any || Lanes<V>::any(active[g]);
+            }
+            if (!any) {
+                break;
+            }
+        }
+        for (size_t g = 0; g < groupCount; ++g) {
+            std::memcpy(outCount + g * width, &steps[g], sizeof(V));
+            std::memcpy(outRe + g * width, &x[g], sizeof(V));
+            std::memcpy(outIm + g * width, &y[g], sizeof(V));
+        }
+        for (size_t j = 0; j < count; ++j) {
+            counts[k + j] = static_cast<uint32_t>(outCount[j]);
+        }
+        if (zr != nullptr) {
+            std::memcpy(zr + k, outRe, count * sizeof(double));
+            std::memcpy(zi + k, outIm, count * sizeof(double));
+        }
+    }
+}
+
+} // namespace escape
+
+/**
+ * @enum OpCode
+ * @brief Коды операций калькулятора
+ *
+ * Значения совпадают с номерами пунктов меню performOperations(),
+ * поэтому один и тот же код используется и в интерактивном, и в пакетном режиме.
+ * Пункты 10 и 11 (история) операциями не являются, поэтому кодов 10 и 11 нет.
+ */
+enum class OpCode : unsigned char {
+    Custom = 0,     ///< Операция вне меню: запись истории с произвольным обозначением
+    Add = 1,        ///< Сложение
+    Subtract = 2,   ///< Вычитание
+    Multiply = 3,   ///< Умножение
+    Divide = 4,     ///< Деление
+    Increment = 5,  ///< Инкремент (++x)
+    Decrement = 6,  ///< Декремент (--x)
+    Compare = 7,    ///< Сравнение модулей
+    Negate = 8,     ///< Унарный минус
+    Modulus = 9,    ///< Вычисление модуля
+    Exp = 12,       ///< Экспонента
+    Log = 13,       ///< Натуральный логарифм
+    Sqrt = 14,      ///< Квадратный корень
+    Pow = 15,       ///< Степень a^b
+    Arg = 16,       ///< Аргумент
+    Sin = 17,       ///< Синус
+    Cos = 18,       ///< Косинус
+    ToPolar = 19,   ///< Перевод в полярную форму (|z|, arg z)
+    FromPolar = 20  ///< Число по модулю и аргументу
+};
+
+/**
+ * @brief Проверяет, соответствует ли число коду операции
+ * @param code Число из истории, журнала или пакетного файла
+ * @return true для 1-9 и 12-20
+ */
+inline bool isKnownOperation(int code) {
+    return (code >= static_cast<int>(OpCode::Add) && code <= static_cast<int>(OpCode::Modulus)) ||
+           (code >= static_cast<int>(OpCode::Exp) && code <= static_cast<int>(OpCode::FromPolar));
+}
+
+/**
+ * @brief Проверяет, является ли операция бинарной
+ * @param op Код операции
+ * @return true если операции нужны два операнда
+ */
+inline bool isBinaryOperation(OpCode op) {
+    return op == OpCode::Add || op == OpCode::Subtract || op == OpCode::Multiply ||
+           op == OpCode::Divide || op == OpCode::Compare || op == OpCode::Pow;
+}
+
+/**
+ * @brief Выполняет операцию над комплексными числами
+ * @param op Код операции
+ * @param a Первый операнд
+ * @param b Второй операнд (игнорируется для унарных операций)
+ * @return Результат операции
+ * @throw std::runtime_error При делении на ноль
+ * @throw std::invalid_argument При неизвестном коде операции
+ *
+ * Результаты совпадают с теми, что записываются в историю в performOperations():
+ * для сравнения возвращается больший из модулей, для модуля и аргумента -
+ * число (|a|, 0) и (arg a, 0), для перевода из полярной формы модуль и
+ * аргумент берутся из действительной и мнимой частей a.
+ * Вычисления выполняются в точности T операндов, трансцендентные функции -
+ * на уровне MathAccuracy::Precise.
+ */
+template <class T>
+BasicComplex<T> applyOperation(OpCode op, const BasicComplex<T>& a, const BasicComplex<T>& b) {
+    using std::sqrt;
+    switch (op) {
+        case OpCode::Add:       return a + b;
+        case OpCode::Subtract:  return a - b;
+        case OpCode::Multiply:  return a * b;
+        case OpCode::Divide:    return a / b;
+        case OpCode::Increment: return BasicComplex<T>(a.getReal() + T(1), a.getImag());
+        case OpCode::Decrement: return BasicComplex<T>(a.getReal() - T(1), a.getImag());
+        case OpCode::Compare:   return BasicComplex<T>((a < b ? b : a).modulus(), T());
+        case OpCode::Negate:    return -a;
+        case OpCode::Modulus:   return BasicComplex<T>(a.modulus(), T());
+        case OpCode::Exp:       return ::exp(a);
+        case OpCode::Log:       return ::log(a);
+        case OpCode::Sqrt:      return ::sqrt(a);
+        case OpCode::Pow:       return ::pow(a, b);
+        case OpCode::Arg:       return BasicComplex<T>(::arg(a), T());
+        case OpCode::Sin:       return ::sin(a);
+        case OpCode::Cos:       return ::cos(a);
+        case OpCode::ToPolar:   return ::toPolar(a);
+        case OpCode::FromPolar: return ::polar(a.getReal(), a.getImag());
+        case OpCode::Custom:    break;
+    }
+    throw std::invalid_argument("Неизвестный код операции");
+}
+
+/**
+ * @enum Precision
+ * @brief Точность, в которой калькулятор выполняет операции
+ *
+ * Значение хранится в истории и журнале рядом с кодом операции, поэтому
+ * Double равно 0: записи, сделанные до появления выбора точности, читаются
+ * как вычисленные в double.
+ */
+enum class Precision : unsigned char {
+    Double = 0,      ///< double (по умолчанию)
+    Float = 1,       ///< float
+    LongDouble = 2,  ///< long double
+    Fixed16 = 3,     ///< Фиксированная точка 16.16
+    Fixed32 = 4      ///< Фиксированная точка 32.32 (если есть 128-битные целые)
+};
+
+/**
+ * @struct PrecisionOf
+ * @brief Значение Precision для типа компонент T
+ */
+template <class T> struct PrecisionOf;
+template <> struct PrecisionOf<double> { static constexpr Precision value = Precision::Double; };
+template <> struct PrecisionOf<float> { static constexpr Precision value = Precision::Float; };
+template <> struct PrecisionOf<long double> { static constexpr Precision value = Precision::LongDouble; };
+template <> struct PrecisionOf<Fixed16> { static constexpr Precision value = Precision::Fixed16; };
+#ifdef COMPLEX_HAVE_FIXED32
+template <> struct PrecisionOf<Fixed32> { static constexpr Precision value = Precision::Fixed32; };
+#endif
+
+/**
+ * @brief Название точности (как в параметре --precision)
+ * @param precision Точность
+ * @return "double", "float", "long-double", "fixed16" или "fixed32"
+ */
+inline const char* precisionName(Precision precision) {
+    switch (precision) {
+        case Precision::Double:     return "double";
+        case Precision::Float:      return "float";
+        case Precision::LongDouble: return "long-double";
+        case Precision::Fixed16:    return "fixed16";
+        case Precision::Fixed32:    return "fixed32";
+    }
+    return "?";
+}
+
+/**
+ * @brief Проверяет, поддерживается ли точность в этой сборке
+ * @param precision Точность
+ * @return false для Fixed32 без 128-битных целых и для недопустимых значений
+ */
+inline bool isPrecisionSupported(Precision precision) {
+#ifdef COMPLEX_HAVE_FIXED32
+    return precision <= Precision::Fixed32;
+#else
+    return precision <= Precision::Fixed16;
+#endif
+}
+
+/**
+ * @brief Определяет точность по названию
+ * @param name Название (см. precisionName())
+ * @return Точность
+ * @throw std::invalid_argument Если название неизвестно или точность не поддерживается
+ */
+inline Precision precisionFromName(const std::string& name) {
+    for (int code = 0; code <= static_cast<int>(Precision::Fixed32); ++code) {
+        Precision precision = static_cast<Precision>(code);
+        if (name == precisionName(precision) && isPrecisionSupported(precision)) {
+            return precision;
+        }
+    }
+    throw std::invalid_argument("Неизвестная точность: " + name);
+}
+
+/**
+ * @brief Вызывает action с нулевым значением типа компонент выбранной точности
+ * @throw std::invalid_argument Если точность не поддерживается
+ */
+template <class Action>
+auto visitPrecision(Precision precision, Action&& action) {
+    switch (precision) {
+        case Precision::Double:     return action(double());
+        case Precision::Float:      return action(float());
+        case Precision::LongDouble: return action(static_cast<long double>(0));
+        case Precision::Fixed16:    return action(Fixed16());
+#ifdef COMPLEX_HAVE_FIXED32
+        case Precision::Fixed32:    return action(Fixed32());
+#else
+        case Precision::Fixed32:    break;
+#endif
+    }
+    throw std::invalid_argument("Точность не поддерживается");
+}
+
+/**
+ * @brief Округляет число до выбранной точности
+ * @param precision Точность
+ * @param value Число
+ * @return Ближайшее представимое в этой точности значение (в double)
+ */
+inline Complex roundToPrecision(Precision precision, const Complex& value) {
+    return visitPrecision(precision, [&](auto zero) {
+        using T = decltype(zero);
+        return complexCast<double>(complexCast<T>(value));
+    });
+}
+
+/**
+ * @brief Обращается ли делитель в ноль в выбранной точности
+ * @param precision Точность
+ * @param b Делитель
+ * @return true если c² + d² в этой точности равно нулю
+ *
+ * Делитель сначала округляется до выбранной точности, поэтому проверки
+ * b == 0 недостаточно. Условие то же, что в BasicComplex::operator/().
+ */
+inline bool isZeroDivisor(Precision precision, const Complex& b) {
+    return visitPrecision(precision, [&](auto zero) {
+        using T = decltype(zero);
+        BasicComplex<T> divisor = complexCast<T>(b);
+        return ComplexNorm<T>::squareSum(divisor.getReal(), divisor.getImag()) == typename ComplexNorm<T>::Square();
+    });
+}
+
+/**
+ * @brief Выполняет операцию в выбранной точности
+ * @param precision Точность вычислений
+ * @param op Код операции
+ * @param a Первый операнд (округляется до точности)
+ * @param b Второй операнд (округляется до точности)
+ * @return Результат, переведенный в double
+ * @throw std::runtime_error При делении на ноль (в том числе из-за округления делителя)
+ * @throw std::invalid_argument При неизвестном коде операции или неподдерживаемой точности
+ */
+inline Complex applyOperation(Precision precision, OpCode op, const Complex& a, const Complex& b) {
+    if (precision == Precision::Double) {
+        return applyOperation(op, a, b);
+    }
+    return visitPrecision(precision, [&](auto zero) {
+        using T = decltype(zero);
+        return complexCast<double>(applyOperation(op, complexCast<T>(a), complexCast<T>(b)));
+    });
+}
+
+/**
+ * @brief Возвращает обозначение операции для истории
+ * @param op Код операции
+ * @return Строка, под которой операция записывается в историю
+ */
+inline const char* operationName(OpCode op) {
+    switch (op) {
+        case OpCode::Add:       return "+";
+        case OpCode::Subtract:  return "-";
+        case OpCode::Multiply:  return "*";
+        case OpCode::Divide:    return "/";
+        case OpCode::Increment: return "++(префикс)";
+        case OpCode::Decrement: return "--(префикс)";
+        case OpCode::Compare:   return "сравнение";
+        case OpCode::Negate:    return "унарный -";
+        case OpCode::Modulus:   return "модуль";
+        case OpCode::Exp:       return "exp";
+        case OpCode::Log:       return "log";
+        case OpCode::Sqrt:      return "sqrt";
+        case OpCode::Pow:       return "pow";
+        case OpCode::Arg:       return "arg";
+        case OpCode::Sin:       return "sin";
+        case OpCode::Cos:       return "cos";
+        case OpCode::ToPolar:   return "в полярную";
+        case OpCode::FromPolar: return "из полярной";
+        case OpCode::Custom:    break;
+    }
+    return "?";
+}
+
+/**
+ * @def COMPLEX_METRICS
+ * @brief Включает сбор метрик: счетчики и гистограммы задержек операций
+ *
+ * По умолчанию не определен, и макросы COMPLEX_METRICS_* раскрываются в
+ * пустые инструкции - в коде не остается ни счетчиков, ни вызовов часов.
+ * При сборке с -DCOMPLEX_METRICS каждая операция увеличивает счетчики
+ * своего потока, а задержка измеряется у каждой metrics::sampleInterval-й
+ * операции, так что вызов часов приходится лишь на малую долю операций.
+ */
+#ifdef COMPLEX_METRICS
+
+/**
+ * @namespace metrics
+ * @brief Счетчики операций, ошибок и времени этапов
+ *
+ * У каждого потока свой блок счетчиков: владелец пишет в него без
+ * атомарных read-modify-write и без блокировок, а snapshot() суммирует
+ * блоки всех потоков. Блок завершившегося потока остается в реестре
+ * (его счетчики входят в сумму) и переиспользуется следующим потоком.
+ */
+namespace metrics {
+
+const size_t opcodeSlots = 32;       ///< Число ячеек под коды операций
+const size_t bucketCount = 40;       ///< Корзин гистограммы: [2^k, 2^(k+1)) нс
+const uint32_t sampleInterval = 16;  ///< Задержка измеряется у каждой 16-й операции потока
+
+/**
+ * @enum Phase
+ * @brief Этапы, время которых измеряется целиком (не выборочно)
+ */
+enum class Phase {
+    HistoryAppend,  ///< Добавление в HistoryStore (выборочно, как операции)
+    LogAppend,      ///< Добавление в HistoryLog (выборочно, как операции)
+    LogFlush,       ///< Сброс журнала на диск
+    BatchRead,      ///< Чтение входа пакетного режима
+    BatchWrite,     ///< Запись выхода пакетного режима
+    HistoryWrite,   ///< Выгрузка истории (writeHistory)
+    Count           ///< Количество этапов
+};
+
+/**
+ * @brief Название этапа (для отчетов)
+ * @param phase Этап
+ * @return Название в snake_case
+ */
+inline const char* phaseName(Phase phase) {
+    switch (phase) {
+        case Phase::HistoryAppend: return "history_append";
+        case Phase::LogAppend:     return "log_append";
+        case Phase::LogFlush:      return "log_flush";
+        case Phase::BatchRead:     return "batch_read";
+        case Phase::BatchWrite:    return "batch_write";
+        case Phase::HistoryWrite:  return "history_write";
+        case Phase::Count:         break;
+    }
+    return "?";
+}
+
+const size_t phaseCount = static_cast<size_t>(Phase::Count);
+
+/**
+ * @struct Counter
+ * @brief Итоговые значения одного счетчика
+ */
+struct Counter {
+    uint64_t calls = 0;                   ///< Количество вызовов
+    uint64_t errors = 0;                  ///< Количество ошибок
+    uint64_t samples = 0;                 ///< Количество измерений задержки
+    uint64_t totalNanos = 0;              ///< Суммарная измеренная задержка
+    uint64_t buckets[bucketCount] = {};   ///< Гистограмма задержек
+
+    /**
+     * @brief Оценка квантиля задержки по гистограмме
+     * @param q Квантиль (0..1)
+     * @return Верхняя граница корзины, в которую попал квантиль, нс (0 без измерений)
+     */
+    uint64_t percentile(double q) const {
+        uint64_t target = static_cast<uint64_t>(q * static_cast<double>(samples) + 0.5);
+        uint64_t seen = 0;
+        for (size_t k = 0; k < bucketCount; ++k) {
+            seen += buckets[k];
+            if (seen != 0 && seen >= target) {
+                return (uint64_t(1) << (k + 1)) - 1;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Средняя измеренная задержка
+     * @return Наносекунды (0 без измерений)
+     */
+    double meanNanos() const {
+        return samples == 0 ? 0.0 : static_cast<double>(totalNanos) / static_cast<double>(samples);
+    }
+
+    /**
+     * @brief Вычитает другой счетчик (значения на момент reset())
+     */
+    void subtract(const Counter& other) {
+        calls -= other.calls;
+        errors -= other.errors;
+        samples -= other.samples;
+        totalNanos -= other.totalNanos;
+        for (size_t k = 0; k < bucketCount; ++k) {
+            buckets[k] -= other.buckets[k];
+        }
+    }
+};
+
+/**
+ * @struct Snapshot
+ * @brief Сводка метрик всех потоков на момент вызова snapshot()
+ */
+struct Snapshot {
+    Counter operations[opcodeSlots];  ///< По кодам операций (индекс - значение OpCode)
+    Counter phases[phaseCount];       ///< По этапам
+    size_t threads = 0;               ///< Сколько потоков когда-либо записывали метрики
+
+    /**
+     * @brief Отчет в виде таблицы
+     * @return Текст: по строке на каждую вызывавшуюся операцию и этап
+     */
+    std::string toText() const {
+        std::string out;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-16s %12s %10s %10s %10s %10s %10s\n",
+                      "operation", "calls", "errors", "samples", "mean_ns", "p50_ns", "p99_ns");
+        out += line;
+        auto row = [&](const char* name, const Counter& c) {
+            // Ширина первого столбца - в символах, а не в байтах UTF-8
+            size_t width = 0;
+            for (const char* p = name; *p; ++p) {
+                width += (static_cast<unsigned char>(*p) & 0xC0) != 0x80;
+            }
+            out += name;
+            out.append(width < 16 ? 16 - width : 0, ' ');
+            std::snprintf(line, sizeof(line), " %12llu %10llu %10llu %10.1f %10llu %10llu\n",
+                          static_cast<unsigned long long>(c.calls), static_cast<unsigned long long>(c.errors),
+                          static_cast<unsigned long long>(c.samples), c.meanNanos(),
+                          static_cast<unsigned long long>(c.percentile(0.5)),
+                          static_cast<unsigned long long>(c.percentile(0.99)));
+            out += line;
+        };
+        for (size_t code = 0; code < opcodeSlots; ++code) {
+            if (operations[code].calls != 0) {
+                row(operationName(static_cast<OpCode>(code)), operations[code]);
+            }
+        }
+        for (size_t k = 0; k < phaseCount; ++k) {
+            if (phases[k].calls != 0) {
+                row(phaseName(static_cast<Phase>(k)), phases[k]);
+            }
+        }
+        return out;
+    }
+
+    /**
+     * @brief Отчет в формате JSON
+     * @return Объект {"threads", "sample_interval", "operations": [...], "phases": [...]};
+     *         гистограммы - массивы по корзинам [2^k, 2^(k+1)) нс
+     */
+    std::string toJson() const {
+        std::string out = "{\"threads\":" + std::to_string(threads) +
+                          ",\"sample_interval\":" + std::to_string(sampleInterval) + ",\"operations\":[";
+        auto entry = [&](const Counter& c) {
+            out += ",\"calls\":" + std::to_string(c.calls) + ",\"errors\":" + std::to_string(c.errors) +
+                   ",\"samples\":" + std::to_string(c.samples) + ",\"total_ns\":" + std::to_string(c.totalNanos) +
+                   ",\"p50_ns\":" + std::to_string(c.percentile(0.5)) +
+                   ",\"p99_ns\":" + std::to_string(c.percentile(0.99)) + ",\"histogram\":[";
+            for (size_t k = 0; k < bucketCount; ++k) {
+                out += (k ? "," : "") + std::to_string(c.buckets[k]);
+            }
+            out += "]}";
+        };
+        bool first = true;
+        for (size_t code = 0; code < opcodeSlots; ++code) {
+            if (operations[code].calls != 0) {
+                out += first ? "" : ",";
+                out += "{\"code\":" + std::to_string(code) + ",\"name\":\"" +
+                       operationName(static_cast<OpCode>(code)) + "\"";
+                entry(operations[code]);
+                first = false;
+            }
+        }
+        out += "],\"phases\":[";
+        first = true;
+        for (size_t k = 0; k < phaseCount; ++k) {
+            if (phases[k].calls != 0) {
+                out += first ? "" : ",";
+                out += std::string("{\"name\":\"") + phaseName(static_cast<Phase>(k)) + "\"";
+                entry(phases[k]);
+                first = false;
+            }
+        }
+        out += "]}\n";
+        return out;
+    }
+
+    /**
+     * @brief Записывает отчет в файл
+     * @param path Путь; при расширении ".json" пишется JSON, иначе таблица
+     * @throw std::runtime_error Если файл не удалось записать
+     */
+    void writeFile(const std::string& path) const {
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        std::string text = json ? toJson() : toText();
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (!file) {
+            throw std::runtime_error("Не удалось записать метрики в " + path);
+        }
+    }
+};
+
+/**
+ * @struct ThreadCounters
+ * @brief Счетчики одного потока
+ *
+ * Пишет только поток-владелец (load + store без read-modify-write),
+ * читает snapshot() из любого потока.
+ */
+struct ThreadCounters {
+    struct Slot {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> samples{0};
+        std::atomic<uint64_t> totalNanos{0};
+        std::atomic<uint64_t> buckets[bucketCount] = {};
+    };
+
+    Slot operations[opcodeSlots];
+    Slot phases[phaseCount];
+    uint32_t tick = 0;                ///< Счетчик для выбора измеряемых операций
+    std::atomic<bool> inUse{true};    ///< Занят ли блок живым потоком
+
+    static void bump(std::atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    static void addSample(Slot& slot, uint64_t nanos) {
+        size_t bucket = 0;
+        while (bucket + 1 < bucketCount && (nanos >> (bucket + 1)) != 0) {
+            ++bucket;
+        }
+        bump(slot.samples, 1);
+        bump(slot.totalNanos, nanos);
+        bump(slot.buckets[bucket], 1);
+    }
+
+    void collect(Counter& out, const Slot& slot) const {
+        out.calls += slot.calls.load(std::memory_order_relaxed);
+        out.errors += slot.errors.load(std::memory_order_relaxed);
+        out.samples += slot.samples.load(std::memory_order_relaxed);
+        out.totalNanos += slot.totalNanos.load(std::memory_order_relaxed);
+        for (size_t k = 0; k < bucketCount; ++k) {
+            out.buckets[k] += slot.buckets[k].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * @brief Реестр блоков счетчиков всех потоков
+ */
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadCounters>> blocks;
+    Snapshot baseline;  ///< Значения на момент последнего reset()
+
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    ThreadCounters* acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& block : blocks) {
+            bool expected = false;
+            if (block->inUse.compare_exchange_strong(expected, true)) {
+                return block.get();
+            }
+        }
+        blocks.push_back(std::unique_ptr<ThreadCounters>(new ThreadCounters));
+        return blocks.back().get();
+    }
+
+    Snapshot total() {
+        Snapshot result;
+        result.threads = blocks.size();
+        for (const auto& block : blocks) {
+            for (size_t code = 0; code < opcodeSlots; ++code) {
+                block->collect(result.operations[code], block->operations[code]);
+            }
+            for (size_t k = 0; k < phaseCount; ++k) {
+                block->collect(result.phases[k], block->phases[k]);
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief Блок счетчиков текущего потока (выделяется при первом обращении)
+ */
+inline ThreadCounters& local() {
+    struct Holder {
+        ThreadCounters* block = Registry::instance().acquire();
+        ~Holder() { block->inUse.store(false); }
+    };
+    thread_local Holder holder;
+    return *holder.block;
+}
+
+/**
+ * @brief Сводка метрик всех потоков
+ * @return Значения, накопленные с последнего reset()
+ */
+inline Snapshot snapshot() {
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    Snapshot result = registry.total();
+    for (size_t code = 0; code < opcodeSlots; ++code) {
+        result.operations[code].subtract(registry.baseline.operations[code]);
+    }
+    for (size_t k = 0; k < phaseCount; ++k) {
+        result.phases[k].subtract(registry.baseline.phases[k]);
+    }
+    return result;
+}
+
+/**
+ * @brief Обнуляет метрики
+ *
+ * Счетчики потоков не трогаются (их пишут владельцы): запоминаются текущие
+ * суммы, и последующие snapshot() отсчитываются от них.
+ */
+inline void reset() {
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.baseline = registry.total();
+}
+
+/**
+ * @brief Учитывает ошибку операции
+ * @param op Код операции
+ */
+inline void countError(OpCode op) {
+    ThreadCounters::bump(local().operations[static_cast<size_t>(op) % opcodeSlots].errors, 1);
+}
+
+/**
+ * @class OperationScope
+ * @brief Учитывает вызов операции; у выбранных вызовов измеряет задержку до конца области
+ */
+class OperationScope {
+private:
+    ThreadCounters::Slot* slot;
+    std::chrono::steady_clock::time_point start;
+    bool timed;
+
+public:
+    explicit OperationScope(OpCode op) {
+        ThreadCounters& counters = local();
+        slot = &counters.operations[static_cast<size_t>(op) % opcodeSlots];
+        ThreadCounters::bump(slot->calls, 1);
+        timed = ++counters.tick % sampleInterval == 0;
+        if (timed) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~OperationScope() {
+        if (timed) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            ThreadCounters::addSample(*slot, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+
+    OperationScope(const OperationScope&) = delete;
+    OperationScope& operator=(const OperationScope&) = delete;
+};
+
+/**
+ * @class PhaseScope
+ * @brief Учитывает этап; время измеряется всегда или выборочно
+ */
+class PhaseScope {
+private:
+    ThreadCounters::Slot* slot;
+    std::chrono::steady_clock::time_point start;
+    bool timed;
+
+public:
+    /**
+     * @param phase Этап
+     * @param sampled true - измерять только каждый sampleInterval-й вызов
+     */
+    explicit PhaseScope(Phase phase, bool sampled = false) {
+        ThreadCounters& counters = local();
+        slot = &counters.phases[static_cast<size_t>(phase)];
+        ThreadCounters::bump(slot->calls, 1);
+        timed = !sampled || ++counters.tick % sampleInterval == 0;
+        if (timed) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseScope() {
+        if (timed) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            ThreadCounters::addSample(*slot, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+};
+
+} // namespace metrics
+
+#define COMPLEX_METRICS_OPERATION(op) metrics::OperationScope complexMetricsOperation(op)
+#define COMPLEX_METRICS_ERROR(op) metrics::countError(op)
+#define COMPLEX_METRICS_PHASE(phase) metrics::PhaseScope complexMetricsPhase(metrics::Phase::phase)
+#define COMPLEX_METRICS_SAMPLED_PHASE(phase) \
+    metrics::PhaseScope complexMetricsPhase(metrics::Phase::phase, true)
+
+#else
+
+#define COMPLEX_METRICS_OPERATION(op) ((void)0)
+#define COMPLEX_METRICS_ERROR(op) ((void)0)
+#define COMPLEX_METRICS_PHASE(phase) ((void)0)
+#define COMPLEX_METRICS_SAMPLED_PHASE(phase) ((void)0)
+
+#endif // COMPLEX_METRICS
+
+/**
+ * @enum SimdLevel
+ * @brief Набор векторных инструкций, которым пользуются ядра ComplexArray
+ */
+enum class SimdLevel {
+    Scalar = 0,  ///< Обычный скалярный цикл
+    SSE2 = 1,    ///< 2 числа double за инструкцию
+    AVX2 = 2,    ///< 4 числа double за инструкцию (процессор с AVX2 и FMA)
+    AVX512 = 3   ///< 8 чисел double за инструкцию
+};
+
+/**
+ * @struct ComplexKernels
+ * @brief Таблица ядер поэлементной арифметики над комплексными массивами
+ *
+ * Ядра работают с раздельными массивами действительных и мнимых частей (SoA).
+ * Выходной массив может совпадать с входным (обработка "на месте").
+ * Формулы и порядок операций повторяют скалярные операторы Complex,
+ * а FMA не используется, поэтому результаты совпадают с ними побитово.
+ * Оговорка: если вся программа собрана с FMA (например, -march=native) без
+ * -ffp-contract=off, компилятор может слить умножение со сложением уже в самих
+ * операторах Complex, и тогда расхождение в умножении/делении/модуле возможно
+ * в пределах погрешности одной операции FMA.
+ * Трансцендентные функции (exp ... arg) - уровень MathAccuracy::Fast: все
+ * уровни SIMD дают побитово тот же результат, что и скалярный exp(z, Fast).
+ * Свертки (sum ... maxModulus) обрабатывают один блок reduction::chunkSize
+ * и тоже не зависят от уровня SIMD (см. reduction).
+ * Ядра матриц (gemmTile, dotu, axpy) на уровнях AVX2 и AVX-512 используют
+ * FMA, поэтому их результаты на разных уровнях могут различаться в
+ * последних битах.
+ */
+struct ComplexKernels {
+    /// Бинарное ядро: out = a (op) b
+    using Binary = void (*)(const double* ar, const double* ai, const double* br, const double* bi,
+                            double* outr, double* outi, size_t n);
+    /// Деление: возвращает true, если среди делителей встретился ноль
+    using Divide = bool (*)(const double* ar, const double* ai, const double* br, const double* bi,
+                            double* outr, double* outi, size_t n);
+    /// Унарное ядро: out = op(a)
+    using Unary = void (*)(const double* ar, const double* ai, double* outr, double* outi, size_t n);
+    /// Модуль: out[k] = |a[k]|
+    using Modulus = void (*)(const double* ar, const double* ai, double* out, size_t n);
+    /// Деление без исключений: бит k в errors ставится, если делитель k равен нулю.
+    /// Если ar == nullptr, делимое считается равным 1 (вычисляется обратное число)
+    using DivideMasked = void (*)(const double* ar, const double* ai, const double* br, const double* bi,
+                                  double* outr, double* outi, size_t n, uint64_t* errors);
+    /// Свертка одного массива в сумму удвоенной точности
+    using Reduce = void (*)(const double* ar, const double* ai, size_t n, reduction::Partial& out);
+    /// Свертка пары массивов
+    using ReducePair = void (*)(const double* ar, const double* ai, const double* br, const double* bi,
+                                size_t n, reduction::Partial& out);
+    /// Максимум модуля; first - номер ar[0] во всем массиве
+    using FindPeak = void (*)(const double* ar, const double* ai, size_t n, size_t first, reduction::Peak& out);
+    /// Микроядро умножения матриц (см. gemm::tile())
+    using GemmTile = void (*)(size_t depth, const double* a, const double* b, double* cr, double* ci, size_t ldc,
+                              size_t rows, size_t cols, double alphaRe, double alphaIm);
+    /// Скалярное произведение без сопряжения: out[0] + i·out[1] = Σ a·x
+    using Dot = void (*)(const double* ar, const double* ai, const double* xr, const double* xi, size_t n,
+                         double* out);
+    /// y += alpha·x (или alpha·conj(x))
+    using Axpy = void (*)(double alphaRe, double alphaIm, const double* xr, const double* xi,
+                          double* yr, double* yi, size_t n, bool conjugate);
+    /// Итерации z -> z² + c (см. escape::iterationLoop()); zr == nullptr - последний z не нужен
+    using EscapeTime = void (*)(const double* cr, const double* ci, size_t n, uint32_t maxIterations,
+                                uint32_t* counts, double* zr, double* zi);
+
+    SimdLevel level;    ///< Набор инструкций
+    const char* name;   ///< Название набора для диагностики
+    Binary add;         ///< Сложение
+    Binary subtract;    ///< Вычитание
+    Binary multiply;    ///< Умножение
+    Divide divide;      ///< Деление
+    Unary conjugate;    ///< Сопряжение
+    Unary negate;       ///< Унарный минус
+    Modulus modulus;    ///< Модуль
+    DivideMasked divideRobust;  ///< Деление по Смиту с маской ошибок
+    Unary exp;          ///< Экспонента
+    Unary log;          ///< Главное значение логарифма
+    Unary sqrt;         ///< Главное значение корня
+    Unary sin;          ///< Синус
+    Unary cos;          ///< Косинус
+    Unary toPolar;      ///< (x, y) -> (|z|, arg z)
+    Unary fromPolar;    ///< (r, θ) -> r·e^(iθ)
+    Binary pow;         ///< Главное значение a^b
+    Modulus arg;        ///< Аргумент
+    Reduce sum;         ///< Σ a
+    ReducePair dotc;    ///< Σ conj(a)·b
+    Reduce norm2;       ///< Σ |a|²
+    FindPeak maxModulus;  ///< max |a|
+    GemmTile gemmTile;  ///< Плитка умножения матриц
+    Dot dotu;           ///< Σ a·x (строка матрицы на вектор)
+    Axpy axpy;          ///< y += alpha·x
+    EscapeTime escapeTime;  ///< Число шагов z -> z² + c до выхода из круга |z| ≤ 2
+};
+
+/**
+ * @def COMPLEX_TRANSCENDENTAL_KERNELS
+ * @brief Объявляет ядра трансцендентных функций для блока V
+ * @param ATTRIBUTES Атрибуты функций (набор инструкций)
+ * @param V Тип блока из transcendental::Lanes
+ *
+ * Сами вычисления - transcendental::unaryLoop()/binaryLoop(); ядра лишь
+ * встраивают их в функцию с нужным набором инструкций.
+ */
+#define COMPLEX_TRANSCENDENTAL_KERNELS(ATTRIBUTES, V) \
+    ATTRIBUTES inline void exp(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::Exp>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void log(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::Log>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void sqrt(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::Sqrt>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void sin(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::Sin>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void cos(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::Cos>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void toPolar(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::ToPolar>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void fromPolar(const double* ar, const double* ai, double* outr, double* outi, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::FromPolar>(ar, ai, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void pow(const double* ar, const double* ai, const double* br, const double* bi, \
+                               double* outr, double* outi, size_t n) { \
+        transcendental::binaryLoop<V, transcendental::Pow>(ar, ai, br, bi, outr, outi, n); \
+    } \
+    ATTRIBUTES inline void arg(const double* ar, const double* ai, double* out, size_t n) { \
+        transcendental::unaryLoop<V, transcendental::Arg>(ar, ai, out, nullptr, n); \
+    }
+
+/**
+ * @def COMPLEX_REDUCTION_KERNELS
+ * @brief Объявляет ядра сверток для блока V (см. reduction::reduceLoop())
+ * @param ATTRIBUTES Атрибуты функций (набор инструкций)
+ * @param V Тип блока из transcendental::Lanes
+ */
+#define COMPLEX_REDUCTION_KERNELS(ATTRIBUTES, V) \
+    ATTRIBUTES inline void sum(const double* ar, const double* ai, size_t n, reduction::Partial& out) { \
+        const double* data[] = {ar, ai}; \
+        reduction::reduceLoop<V, reduction::SumStep>(data, n, out); \
+    } \
+    ATTRIBUTES inline void dotc(const double* ar, const double* ai, const double* br, const double* bi, \
+                                size_t n, reduction::Partial& out) { \
+        const double* data[] = {ar, ai, br, bi}; \
+        reduction::reduceLoop<V, reduction::DotStep>(data, n, out); \
+    } \
+    ATTRIBUTES inline void norm2(const double* ar, const double* ai, size_t n, reduction::Partial& out) { \
+        const double* data[] = {ar, ai}; \
+        reduction::reduceLoop<V, reduction::Norm2Step>(data, n, out); \
+    } \
+    ATTRIBUTES inline void maxModulus(const double* ar, const double* ai, size_t n, size_t first, \
+                                      reduction::Peak& out) { \
+        reduction::peakLoop<V>(ar, ai, n, first, out); \
+    }
+
+/**
+ * @def COMPLEX_MATRIX_KERNELS
+ * @brief Объявляет ядра матриц для блока V (см. gemm)
+ * @param ATTRIBUTES Атрибуты функций (набор инструкций)
+ * @param V Тип блока из transcendental::Lanes
+ */
+#define COMPLEX_MATRIX_KERNELS(ATTRIBUTES, V) \
+    ATTRIBUTES inline void gemmTile(size_t depth, const double* a, const double* b, double* cr, double* ci, \
+                                    size_t ldc, size_t rows, size_t cols, double alphaRe, double alphaIm) { \
+        gemm::tile<V>(depth, a, b, cr, ci, ldc, rows, cols, alphaRe, alphaIm); \
+    } \
+    ATTRIBUTES inline void dotu(const double* ar, const double* ai, const double* xr, const double* xi, size_t n, \
+                                double* out) { \
+        gemm::dot<V>(ar, ai, xr, xi, n, out); \
+    } \
+    ATTRIBUTES inline void axpy(double alphaRe, double alphaIm, const double* xr, const double* xi, \
+                                double* yr, double* yi, size_t n, bool conjugate) { \
+        gemm::axpy<V>(alphaRe, alphaIm, xr, xi, yr, yi, n, conjugate); \
+    }
+
+/**
+ * @def COMPLEX_ESCAPE_KERNELS
+ * @brief Объявляет ядро escape::iterationLoop() для блока V
+ * @param ATTRIBUTES Атрибуты функций (набор инструкций)
+ * @param V Тип блока из transcendental::Lanes
+ *
+ * Без FMA: граница выхода чувствительна к округлению, а так число шагов
+ * одинаково на всех уровнях SIMD и у цикла на операторах Complex.
+ */
+#define COMPLEX_ESCAPE_KERNELS(ATTRIBUTES, V) \
+    ATTRIBUTES inline void escapeTime(const double* cr, const double* ci, size_t n, uint32_t maxIterations, \
+                                      uint32_t* counts, double* zr, double* zi) { \
+        escape::iterationLoop<V>(cr, ci, n, maxIterations, counts, zr, zi); \
+    }
+
+namespace kernels {
+
+/**
+ * @brief Скалярные ядра, они же обработка хвостов в векторных версиях
+ */
+namespace scalar {
+
+inline void add(const double* ar, const double* ai, const double* br, const double* bi,
+                double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        outr[k] = ar[k] + br[k];
+        outi[k] = ai[k] + bi[k];
+    }
+}
+
+inline void subtract(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        outr[k] = ar[k] - br[k];
+        outi[k] = ai[k] - bi[k];
+    }
+}
+
+inline void multiply(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        double re = ar[k] * br[k] - ai[k] * bi[k];
+        double im = ar[k] * bi[k] + ai[k] * br[k];
+        outr[k] = re;
+        outi[k] = im;
+    }
+}
+
+inline bool divide(const double* ar, const double* ai, const double* br, const double* bi,
+                   double* outr, double* outi, size_t n) {
+    bool zero = false;
+    for (size_t k = 0; k < n; ++k) {
+        double denominator = br[k] * br[k] + bi[k] * bi[k];
+        zero |= (denominator == 0);
+        double re = (ar[k] * br[k] + ai[k] * bi[k]) / denominator;
+        double im = (ai[k] * br[k] - ar[k] * bi[k]) / denominator;
+        outr[k] = re;
+        outi[k] = im;
+    }
+    return zero;
+}
+
+inline void conjugate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        outr[k] = ar[k];
+        outi[k] = -ai[k];
+    }
+}
+
+inline void negate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        outr[k] = -ar[k];
+        outi[k] = -ai[k];
+    }
+}
+
+inline void modulus(const double* ar, const double* ai, double* out, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        out[k] = std::sqrt(ar[k] * ar[k] + ai[k] * ai[k]);
+    }
+}
+
+
+/**
+ * @brief Деление по алгоритму Смита для одного элемента
+ *
+ * Знаменатель c² + d² не вычисляется: делитель нормируется на большую по
+ * модулю часть, поэтому промежуточные значения не переполняются и не
+ * исчезают там, где это случается с формулой из operator/.
+ * При нулевом делителе получается (NaN, NaN).
+ */
+inline void smithDivide(double a, double b, double c, double d, double& re, double& im) {
+    if (std::fabs(c) >= std::fabs(d)) {
+        double r = d / c;
+        double denominator = c + d * r;
+        re = (a + b * r) / denominator;
+        im = (b - a * r) / denominator;
+    } else {
+        double r = c / d;
+        double denominator = d + c * r;
+        re = (a * r + b) / denominator;
+        im = (b * r - a) / denominator;
+    }
+}
+
+inline void divideRobust(const double* ar, const double* ai, const double* br, const double* bi,
+                         double* outr, double* outi, size_t n, uint64_t* errors) {
+    for (size_t k = 0; k < n; ++k) {
+        double a = ar ? ar[k] : 1.0;
+        double b = ar ? ai[k] : 0.0;
+        double c = br[k], d = bi[k];
+        if (c == 0 && d == 0) {
+            errors[k / 64] |= uint64_t(1) << (k % 64);
+        }
+        smithDivide(a, b, c, d, outr[k], outi[k]);
+    }
+}
+
+COMPLEX_TRANSCENDENTAL_KERNELS(COMPLEX_NO_FP_CONTRACT, double)
+COMPLEX_REDUCTION_KERNELS(COMPLEX_NO_FP_CONTRACT, double)
+COMPLEX_MATRIX_KERNELS(, double)
+COMPLEX_ESCAPE_KERNELS(COMPLEX_NO_FP_CONTRACT, double)
+
+} // namespace scalar
+
+#ifdef COMPLEX_SIMD_X86
+
+/**
+ * @brief Ядра SSE2 (по 2 элемента)
+ */
+namespace sse2 {
+
+__attribute__((target("sse2")))
+inline void add(const double* ar, const double* ai, const double* br, const double* bi,
+                double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        _mm_storeu_pd(outr + k, _mm_add_pd(_mm_loadu_pd(ar + k), _mm_loadu_pd(br + k)));
+        _mm_storeu_pd(outi + k, _mm_add_pd(_mm_loadu_pd(ai + k), _mm_loadu_pd(bi + k)));
+    }
+    scalar::add(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("sse2")))
+inline void subtract(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        _mm_storeu_pd(outr + k, _mm_sub_pd(_mm_loadu_pd(ar + k), _mm_loadu_pd(br + k)));
+        _mm_storeu_pd(outi + k, _mm_sub_pd(_mm_loadu_pd(ai + k), _mm_loadu_pd(bi + k)));
+    }
+    scalar::subtract(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("sse2")))
+inline void multiply(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m128d a = _mm_loadu_pd(ar + k), b = _mm_loadu_pd(ai + k);
+        __m128d c = _mm_loadu_pd(br + k), d = _mm_loadu_pd(bi + k);
+        _mm_storeu_pd(outr + k, _mm_sub_pd(_mm_mul_pd(a, c), _mm_mul_pd(b, d)));
+        _mm_storeu_pd(outi + k, _mm_add_pd(_mm_mul_pd(a, d), _mm_mul_pd(b, c)));
+    }
+    scalar::multiply(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("sse2")))
+inline bool divide(const double* ar, const double* ai, const double* br, const double* bi,
+                   double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    __m128d zero = _mm_setzero_pd();
+    __m128d zeroFound = _mm_setzero_pd();
+    for (; k + 2 <= n; k += 2) {
+        __m128d a = _mm_loadu_pd(ar + k), b = _mm_loadu_pd(ai + k);
+        __m128d c = _mm_loadu_pd(br + k), d = _mm_loadu_pd(bi + k);
+        __m128d denominator = _mm_add_pd(_mm_mul_pd(c, c), _mm_mul_pd(d, d));
+        zeroFound = _mm_or_pd(zeroFound, _mm_cmpeq_pd(denominator, zero));
+        __m128d re = _mm_add_pd(_mm_mul_pd(a, c), _mm_mul_pd(b, d));
+        __m128d im = _mm_sub_pd(_mm_mul_pd(b, c), _mm_mul_pd(a, d));
+        _mm_storeu_pd(outr + k, _mm_div_pd(re, denominator));
+        _mm_storeu_pd(outi + k, _mm_div_pd(im, denominator));
+    }
+    bool tailZero = scalar::divide(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+    return tailZero || _mm_movemask_pd(zeroFound) != 0;
+}
+
+__attribute__((target("sse2")))
+inline void conjugate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    __m128d sign = _mm_set1_pd(-0.0);
+    for (; k + 2 <= n; k += 2) {
+        _mm_storeu_pd(outr + k, _mm_loadu_pd(ar + k));
+        _mm_storeu_pd(outi + k, _mm_xor_pd(_mm_loadu_pd(ai + k), sign));
+    }
+    scalar::conjugate(ar + k, ai + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("sse2")))
+inline void negate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    __m128d sign = _mm_set1_pd(-0.0);
+    for (; k + 2 <= n; k += 2) {
+        _mm_storeu_pd(outr + k, _mm_xor_pd(_mm_loadu_pd(ar + k), sign));
+        _mm_storeu_pd(outi + k, _mm_xor_pd(_mm_loadu_pd(ai + k), sign));
+    }
+    scalar::negate(ar + k, ai + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("sse2")))
+inline void modulus(const double* ar, const double* ai, double* out, size_t n) {
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m128d a = _mm_loadu_pd(ar + k), b = _mm_loadu_pd(ai + k);
+        _mm_storeu_pd(out + k, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(a, a), _mm_mul_pd(b, b))));
+    }
+    scalar::modulus(ar + k, ai + k, out + k, n - k);
+}
+
+COMPLEX_TRANSCENDENTAL_KERNELS(__attribute__((target("sse2"), optimize("fp-contract=off"))), transcendental::Double2)
+COMPLEX_REDUCTION_KERNELS(__attribute__((target("sse2"), optimize("fp-contract=off"))), transcendental::Double2)
+COMPLEX_MATRIX_KERNELS(__attribute__((target("sse2"))), transcendental::Double2)
+COMPLEX_ESCAPE_KERNELS(__attribute__((target("sse2"), optimize("fp-contract=off"))), transcendental::Double2)
+
+} // namespace sse2
+
+/**
+ * @brief Ядра AVX2 (по 4 элемента)
+ */
+namespace avx2 {
+
+__attribute__((target("avx2")))
+inline void add(const double* ar, const double* ai, const double* br, const double* bi,
+                double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        _mm256_storeu_pd(outr + k, _mm256_add_pd(_mm256_loadu_pd(ar + k), _mm256_loadu_pd(br + k)));
+        _mm256_storeu_pd(outi + k, _mm256_add_pd(_mm256_loadu_pd(ai + k), _mm256_loadu_pd(bi + k)));
+    }
+    scalar::add(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("avx2")))
+inline void subtract(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        _mm256_storeu_pd(outr + k, _mm256_sub_pd(_mm256_loadu_pd(ar + k), _mm256_loadu_pd(br + k)));
+        _mm256_storeu_pd(outi + k, _mm256_sub_pd(_mm256_loadu_pd(ai + k), _mm256_loadu_pd(bi + k)));
+    }
+    scalar::subtract(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("avx2")))
+inline void multiply(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256d a = _mm256_loadu_pd(ar + k), b = _mm256_loadu_pd(ai + k);
+        __m256d c = _mm256_loadu_pd(br + k), d = _mm256_loadu_pd(bi + k);
+        _mm256_storeu_pd(outr + k, _mm256_sub_pd(_mm256_mul_pd(a, c), _mm256_mul_pd(b, d)));
+        _mm256_storeu_pd(outi + k, _mm256_add_pd(_mm256_mul_pd(a, d), _mm256_mul_pd(b, c)));
+    }
+    scalar::multiply(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("avx2")))
+inline bool divide(const double* ar, const double* ai, const double* br, const double* bi,
+                   double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    __m256d zero = _mm256_setzero_pd();
+    __m256d zeroFound = _mm256_setzero_pd();
+    for (; k + 4 <= n; k += 4) {
+        __m256d a = _mm256_loadu_pd(ar + k), b = _mm256_loadu_pd(ai + k);
+        __m256d c = _mm256_loadu_pd(br + k), d = _mm256_loadu_pd(bi + k);
+        __m256d denominator = _mm256_add_pd(_mm256_mul_pd(c, c), _mm256_mul_pd(d, d));
+        zeroFound = _mm256_or_pd(zeroFound, _mm256_cmp_pd(denominator, zero, _CMP_EQ_OQ));
+        __m256d re = _mm256_add_pd(_mm256_mul_pd(a, c), _mm256_mul_pd(b, d));
+        __m256d im = _mm256_sub_pd(_mm256_mul_pd(b, c), _mm256_mul_pd(a, d));
+        _mm256_storeu_pd(outr + k, _mm256_div_pd(re, denominator));
+        _mm256_storeu_pd(outi + k, _mm256_div_pd(im, denominator));
+    }
+    bool tailZero = scalar::divide(ar + k, ai + k, br + k, bi + k, outr + k, outi + k, n - k);
+    return tailZero || _mm256_movemask_pd(zeroFound) != 0;
+}
+
+__attribute__((target("avx2")))
+inline void conjugate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    __m256d sign = _mm256_set1_pd(-0.0);
+    for (; k + 4 <= n; k += 4) {
+        _mm256_storeu_pd(outr + k, _mm256_loadu_pd(ar + k));
+        _mm256_storeu_pd(outi + k, _mm256_xor_pd(_mm256_loadu_pd(ai + k), sign));
+    }
+    scalar::conjugate(ar + k, ai + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("avx2")))
+inline void negate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    size_t k = 0;
+    __m256d sign = _mm256_set1_pd(-0.0);
+    for (; k + 4 <= n; k += 4) {
+        _mm256_storeu_pd(outr + k, _mm256_xor_pd(_mm256_loadu_pd(ar + k), sign));
+        _mm256_storeu_pd(outi + k, _mm256_xor_pd(_mm256_loadu_pd(ai + k), sign));
+    }
+    scalar::negate(ar + k, ai + k, outr + k, outi + k, n - k);
+}
+
+__attribute__((target("avx2")))
+inline void modulus(const double* ar, const double* ai, double* out, size_t n) {
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256d a = _mm256_loadu_pd(ar + k), b = _mm256_loadu_pd(ai + k);
+        _mm256_storeu_pd(out + k, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b))));
+    }
+    scalar::modulus(ar + k, ai + k, out + k, n - k);
+}
+
+
+__attribute__((target("avx2")))
+inline void divideRobust(const double* ar, const double* ai, const double* br, const double* bi,
+                         double* outr, double* outi, size_t n, uint64_t* errors) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256d a = ar ? _mm256_loadu_pd(ar + k) : one;
+        __m256d b = ar ? _mm256_loadu_pd(ai + k) : zero;
+        __m256d c = _mm256_loadu_pd(br + k), d = _mm256_loadu_pd(bi + k);
+        __m256d useC = _mm256_cmp_pd(_mm256_andnot_pd(sign, c), _mm256_andnot_pd(sign, d), _CMP_GE_OQ);
+        __m256d big = _mm256_blendv_pd(d, c, useC);
+        __m256d small = _mm256_blendv_pd(c, d, useC);
+        __m256d r = _mm256_div_pd(small, big);
+        __m256d denominator = _mm256_add_pd(big, _mm256_mul_pd(small, r));
+        __m256d re = _mm256_blendv_pd(_mm256_add_pd(_mm256_mul_pd(a, r), b),
+                                      _mm256_add_pd(a, _mm256_mul_pd(b, r)), useC);
+        __m256d im = _mm256_blendv_pd(_mm256_sub_pd(_mm256_mul_pd(b, r), a),
+                                      _mm256_sub_pd(b, _mm256_mul_pd(a, r)), useC);
+        _mm256_storeu_pd(outr + k, _mm256_div_pd(re, denominator));
+        _mm256_storeu_pd(outi + k, _mm256_div_pd(im, denominator));
+        __m256d isZero = _mm256_and_pd(_mm256_cmp_pd(c, zero, _CMP_EQ_OQ), _mm256_cmp_pd(d, zero, _CMP_EQ_OQ));
+        errors[k / 64] |= uint64_t(_mm256_movemask_pd(isZero)) << (k % 64);
+    }
+    for (; k < n; ++k) {
+        double a = ar ? ar[k] : 1.0;
+        double b = ar ? ai[k] : 0.0;
+        if (br[k] == 0 && bi[k] == 0) {
+            errors[k / 64] |= uint64_t(1) << (k % 64);
+        }
+        scalar::smithDivide(a, b, br[k], bi[k], outr[k], outi[k]);
+    }
+}
+
+COMPLEX_TRANSCENDENTAL_KERNELS(__attribute__((target("avx2"), optimize("fp-contract=off"))), transcendental::Double4)
+COMPLEX_REDUCTION_KERNELS(__attribute__((target("avx2"), optimize("fp-contract=off"))), transcendental::Double4)
+COMPLEX_MATRIX_KERNELS(__attribute__((target("avx2,fma"), optimize("fp-contract=fast"))), transcendental::Double4)
+COMPLEX_ESCAPE_KERNELS(__attribute__((target("avx2"), optimize("fp-contract=off"))), transcendental::Double4)
+
+} // namespace avx2
+
+/**
+ * @brief Ядра AVX-512 (по 8 элементов, хвост обрабатывается маскированными операциями)
+ *
+ * AVX-512F сам по себе содержит инструкции FMA, поэтому слияние умножения
+ * со сложением явно отключено - иначе результат разошелся бы со скалярным.
+ */
+namespace avx512 {
+
+/// Маска для последних n < 8 элементов
+#define COMPLEX_AVX512_TAIL_MASK(n) static_cast<__mmask8>((1u << (n)) - 1u)
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void add(const double* ar, const double* ai, const double* br, const double* bi,
+                double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, ar + k), _mm512_maskz_loadu_pd(m, br + k)));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_add_pd(_mm512_maskz_loadu_pd(m, ai + k), _mm512_maskz_loadu_pd(m, bi + k)));
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void subtract(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_sub_pd(_mm512_maskz_loadu_pd(m, ar + k), _mm512_maskz_loadu_pd(m, br + k)));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_sub_pd(_mm512_maskz_loadu_pd(m, ai + k), _mm512_maskz_loadu_pd(m, bi + k)));
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void multiply(const double* ar, const double* ai, const double* br, const double* bi,
+                     double* outr, double* outi, size_t n) {
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        __m512d a = _mm512_maskz_loadu_pd(m, ar + k), b = _mm512_maskz_loadu_pd(m, ai + k);
+        __m512d c = _mm512_maskz_loadu_pd(m, br + k), d = _mm512_maskz_loadu_pd(m, bi + k);
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_sub_pd(_mm512_mul_pd(a, c), _mm512_mul_pd(b, d)));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_add_pd(_mm512_mul_pd(a, d), _mm512_mul_pd(b, c)));
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline bool divide(const double* ar, const double* ai, const double* br, const double* bi,
+                   double* outr, double* outi, size_t n) {
+    __m512d zero = _mm512_setzero_pd();
+    __mmask8 zeroFound = 0;
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        __m512d a = _mm512_maskz_loadu_pd(m, ar + k), b = _mm512_maskz_loadu_pd(m, ai + k);
+        __m512d c = _mm512_maskz_loadu_pd(m, br + k), d = _mm512_maskz_loadu_pd(m, bi + k);
+        __m512d denominator = _mm512_add_pd(_mm512_mul_pd(c, c), _mm512_mul_pd(d, d));
+        zeroFound |= _mm512_mask_cmp_pd_mask(m, denominator, zero, _CMP_EQ_OQ);
+        __m512d re = _mm512_add_pd(_mm512_mul_pd(a, c), _mm512_mul_pd(b, d));
+        __m512d im = _mm512_sub_pd(_mm512_mul_pd(b, c), _mm512_mul_pd(a, d));
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_div_pd(re, denominator));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_div_pd(im, denominator));
+    }
+    return zeroFound != 0;
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void conjugate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    __m512i sign = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull));
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        __m512i b = _mm512_castpd_si512(_mm512_maskz_loadu_pd(m, ai + k));
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_maskz_loadu_pd(m, ar + k));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_castsi512_pd(_mm512_xor_si512(b, sign)));
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void negate(const double* ar, const double* ai, double* outr, double* outi, size_t n) {
+    __m512i sign = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull));
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        __m512i a = _mm512_castpd_si512(_mm512_maskz_loadu_pd(m, ar + k));
+        __m512i b = _mm512_castpd_si512(_mm512_maskz_loadu_pd(m, ai + k));
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_castsi512_pd(_mm512_xor_si512(a, sign)));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_castsi512_pd(_mm512_xor_si512(b, sign)));
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void modulus(const double* ar, const double* ai, double* out, size_t n) {
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        __m512d a = _mm512_maskz_loadu_pd(m, ar + k), b = _mm512_maskz_loadu_pd(m, ai + k);
+        _mm512_mask_storeu_pd(out + k, m, _mm512_maskz_sqrt_pd(m, _mm512_add_pd(_mm512_mul_pd(a, a), _mm512_mul_pd(b, b))));
+    }
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void divideRobust(const double* ar, const double* ai, const double* br, const double* bi,
+                         double* outr, double* outi, size_t n, uint64_t* errors) {
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d one = _mm512_set1_pd(1.0);
+    for (size_t k = 0; k < n; k += 8) {
+        __mmask8 m = n - k >= 8 ? static_cast<__mmask8>(0xFF) : COMPLEX_AVX512_TAIL_MASK(n - k);
+        __m512d a = ar ? _mm512_maskz_loadu_pd(m, ar + k) : one;
+        __m512d b = ar ? _mm512_maskz_loadu_pd(m, ai + k) : zero;
+        __m512d c = _mm512_maskz_loadu_pd(m, br + k), d = _mm512_maskz_loadu_pd(m, bi + k);
+        __mmask8 useC = _mm512_cmp_pd_mask(_mm512_abs_pd(c), _mm512_abs_pd(d), _CMP_GE_OQ);
+        __m512d big = _mm512_mask_blend_pd(useC, d, c);
+        __m512d small = _mm512_mask_blend_pd(useC, c, d);
+        __m512d r = _mm512_maskz_div_pd(m, small, big);
+        __m512d denominator = _mm512_add_pd(big, _mm512_mul_pd(small, r));
+        __m512d re = _mm512_mask_blend_pd(useC, _mm512_add_pd(_mm512_mul_pd(a, r), b),
+                                          _mm512_add_pd(a, _mm512_mul_pd(b, r)));
+        __m512d im = _mm512_mask_blend_pd(useC, _mm512_sub_pd(_mm512_mul_pd(b, r), a),
+                                          _mm512_sub_pd(b, _mm512_mul_pd(a, r)));
+        _mm512_mask_storeu_pd(outr + k, m, _mm512_maskz_div_pd(m, re, denominator));
+        _mm512_mask_storeu_pd(outi + k, m, _mm512_maskz_div_pd(m, im, denominator));
+        __mmask8 isZero = _mm512_mask_cmp_pd_mask(_mm512_mask_cmp_pd_mask(m, c, zero, _CMP_EQ_OQ), d, zero, _CMP_EQ_OQ);
+        errors[k / 64] |= uint64_t(isZero) << (k % 64);
+    }
+}
+
+#undef COMPLEX_AVX512_TAIL_MASK
+
+COMPLEX_TRANSCENDENTAL_KERNELS(__attribute__((target("avx512f"), optimize("fp-contract=off"))), transcendental::Double8)
+COMPLEX_REDUCTION_KERNELS(__attribute__((target("avx512f"), optimize("fp-contract=off"))), transcendental::Double8)
+COMPLEX_MATRIX_KERNELS(__attribute__((target("avx512f"), optimize("fp-contract=fast"))), transcendental::Double8)
+COMPLEX_ESCAPE_KERNELS(__attribute__((target("avx512f"), optimize("fp-contract=off"))), transcendental::Double8)
+
+} // namespace avx512
+
+#endif // COMPLEX_SIMD_X86
+
+} // namespace kernels
+
+#undef COMPLEX_TRANSCENDENTAL_KERNELS
+#undef COMPLEX_REDUCTION_KERNELS
+#undef COMPLEX_MATRIX_KERNELS
+#undef COMPLEX_ESCAPE_KERNELS
+
+/**
+ * @enum DivisionStatus
+ * @brief Результат деления без исключений
+ */
+enum class DivisionStatus : uint8_t {
+    Ok = 0,             ///< Деление выполнено
+    DivisionByZero = 1  ///< Делитель равен нулю, результат (NaN, NaN)
+};
+
+/**
+ * @brief Деление без исключений с устойчивым масштабированием
+ * @param a Делимое
+ * @param b Делитель
+ * @param out Результат
+ * @return Статус операции
+ *
+ * В отличие от operator/, не вычисляет c² + d² напрямую (алгоритм Смита),
+ * поэтому не переполняется для больших и не теряет точность для малых
+ * делителей, и не бросает исключение при делении на ноль. operator/
+ * сохраняется для интерактивного режима.
+ */
+inline DivisionStatus divideChecked(const Complex& a, const Complex& b, Complex& out) noexcept {
+    double re, im;
+    kernels::scalar::smithDivide(a.getReal(), a.getImag(), b.getReal(), b.getImag(), re, im);
+    out = Complex(re, im);
+    return (b.getReal() == 0 && b.getImag() == 0) ? DivisionStatus::DivisionByZero : DivisionStatus::Ok;
+}
+
+/**
+ * @brief Обратное число без исключений: out = 1 / b
+ * @param b Число
+ * @param out Результат
+ * @return Статус операции
+ */
+inline DivisionStatus reciprocalChecked(const Complex& b, Complex& out) noexcept {
+    return divideChecked(Complex(1, 0), b, out);
+}
+
+/**
+ * @brief Определяет лучший набор инструкций, поддерживаемый процессором
+ * @return Уровень SIMD, доступный во время выполнения
+ */
+inline SimdLevel detectSimdLevel() {
+#ifdef COMPLEX_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdLevel::AVX2;  // Ядра матриц этого уровня используют FMA
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SimdLevel::SSE2;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+/**
+ * @brief Возвращает таблицу ядер для заданного уровня SIMD
+ * @param level Уровень SIMD
+ * @return Таблица ядер (для неподдерживаемой сборкой платформы - скалярная)
+ */
+inline const ComplexKernels& kernelsFor(SimdLevel level) {
+    static const ComplexKernels scalarKernels = {
+        SimdLevel::Scalar, "scalar",
+        kernels::scalar::add, kernels::scalar::subtract, kernels::scalar::multiply,
+        kernels::scalar::divide, kernels::scalar::conjugate, kernels::scalar::negate,
+        kernels::scalar::modulus, kernels::scalar::divideRobust,
+        kernels::scalar::exp, kernels::scalar::log, kernels::scalar::sqrt, kernels::scalar::sin,
+        kernels::scalar::cos, kernels::scalar::toPolar, kernels::scalar::fromPolar, kernels::scalar::pow,
+        kernels::scalar::arg, kernels::scalar::sum, kernels::scalar::dotc, kernels::scalar::norm2,
+        kernels::scalar::maxModulus, kernels::scalar::gemmTile, kernels::scalar::dotu, kernels::scalar::axpy,
+        kernels::scalar::escapeTime
+    };
+#ifdef COMPLEX_SIMD_X86
+    // Без blendv (SSE4.1) векторное деление по Смиту не выигрывает у скалярного
+    static const ComplexKernels sse2Kernels = {
+        SimdLevel::SSE2, "sse2",
+        kernels::sse2::add, kernels::sse2::subtract, kernels::sse2::multiply,
+        kernels::sse2::divide, kernels::sse2::conjugate, kernels::sse2::negate,
+        kernels::sse2::modulus, kernels::scalar::divideRobust,
+        kernels::sse2::exp, kernels::sse2::log, kernels::sse2::sqrt, kernels::sse2::sin,
+        kernels::sse2::cos, kernels::sse2::toPolar, kernels::sse2::fromPolar, kernels::sse2::pow,
+        kernels::sse2::arg, kernels::sse2::sum, kernels::sse2::dotc, kernels::sse2::norm2,
+        kernels::sse2::maxModulus, kernels::sse2::gemmTile, kernels::sse2::dotu, kernels::sse2::axpy,
+        kernels::sse2::escapeTime
+    };
+    static const ComplexKernels avx2Kernels = {
+        SimdLevel::AVX2, "avx2",
+        kernels::avx2::add, kernels::avx2::subtract, kernels::avx2::multiply,
+        kernels::avx2::divide, kernels::avx2::conjugate, kernels::avx2::negate,
+        kernels::avx2::modulus, kernels::avx2::divideRobust,
+        kernels::avx2::exp, kernels::avx2::log, kernels::avx2::sqrt, kernels::avx2::sin,
+        kernels::avx2::cos, kernels::avx2::toPolar, kernels::avx2::fromPolar, kernels::avx2::pow,
+        kernels::avx2::arg, kernels::avx2::sum, kernels::avx2::dotc, kernels::avx2::norm2,
+        kernels::avx2::maxModulus, kernels::avx2::gemmTile, kernels::avx2::dotu, kernels::avx2::axpy,
+        kernels::avx2::escapeTime
+    };
+    static const ComplexKernels avx512Kernels = {
+        SimdLevel::AVX512, "avx512",
+        kernels::avx512::add, kernels::avx512::subtract, kernels::avx512::multiply,
+        kernels::avx512::divide, kernels::avx512::conjugate, kernels::avx512::negate,
+        kernels::avx512::modulus, kernels::avx512::divideRobust,
+        kernels::avx512::exp, kernels::avx512::log, kernels::avx512::sqrt, kernels::avx512::sin,
+        kernels::avx512::cos, kernels::avx512::toPolar, kernels::avx512::fromPolar, kernels::avx512::pow,
+        kernels::avx512::arg, kernels::avx512::sum, kernels::avx512::dotc, kernels::avx512::norm2,
+        kernels::avx512::maxModulus, kernels::avx512::gemmTile, kernels::avx512::dotu, kernels::avx512::axpy,
+        kernels::avx512::escapeTime
+    };
+    switch (level) {
+        case SimdLevel::SSE2:   return sse2Kernels;
+        case SimdLevel::AVX2:   return avx2Kernels;
+        case SimdLevel::AVX512: return avx512Kernels;
+        case SimdLevel::Scalar: break;
+    }
+#else
+    (void)level;
+#endif
+    return scalarKernels;
+}
+
+/**
+ * @brief Слот с таблицей ядер, которой пользуется ComplexArray
+ *
+ * При первом обращении заполняется лучшим доступным набором инструкций.
+ */
+inline std::atomic<const ComplexKernels*>& activeKernelsSlot() {
+    static std::atomic<const ComplexKernels*> slot(&kernelsFor(detectSimdLevel()));
+    return slot;
+}
+
+/**
+ * @brief Возвращает активную таблицу ядер
+ * @return Таблица ядер, выбранная при запуске или через setSimdLevel()
+ */
+inline const ComplexKernels& activeKernels() {
+    return *activeKernelsSlot().load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Принудительно выбирает уровень SIMD
+ * @param level Желаемый уровень
+ * @return Фактически установленный уровень
+ *
+ * Уровень ограничивается тем, что поддерживает процессор. Полезно для
+ * сравнения путей между собой и для отладки.
+ */
+inline SimdLevel setSimdLevel(SimdLevel level) {
+    SimdLevel supported = detectSimdLevel();
+    if (static_cast<int>(level) > static_cast<int>(supported)) {
+        level = supported;
+    }
+    activeKernelsSlot().store(&kernelsFor(level), std::memory_order_relaxed);
+    return level;
+}
+
+/**
+ * @class ComplexArray
+ * @brief Массив комплексных чисел в формате "структура массивов" (SoA)
+ *
+ * Действительные и мнимые части хранятся в двух отдельных массивах,
+ * выровненных на 64 байта. Поэлементные операции выполняются векторными
+ * ядрами (SSE2/AVX2/AVX-512), набор инструкций выбирается во время выполнения.
+ * Результаты побитово совпадают с соответствующими операторами Complex.
+ */
+class ComplexArray {
+private:
+    double* re;     ///< Действительные части
+    double* im;     ///< Мнимые части
+    size_t count;   ///< Количество элементов
+
+    /**
+     * @brief Выделяет выровненный и обнуленный массив
+     * @param n Количество элементов
+     * @return Указатель на массив или nullptr при n = 0
+     */
+    static double* allocate(size_t n) {
+        if (n == 0) {
+            return nullptr;
+        }
+        double* data = static_cast<double*>(::operator new(n * sizeof(double), std::align_val_t(alignment)));
+        std::memset(data, 0, n * sizeof(double));
+        return data;
+    }
+
+    /**
+     * @brief Освобождает массив, выделенный allocate()
+     * @param data Указатель на массив
+     */
+    static void release(double* data) {
+        if (data) {
+            ::operator delete(data, std::align_val_t(alignment));
+        }
+    }
+
+    /**
+     * @brief Считает установленные биты маски ошибок
+     * @param errors Маска ошибок
+     * @return Количество ошибок
+     */
+    static size_t countErrors(const std::vector<uint64_t>& errors) {
+        size_t total = 0;
+        for (uint64_t word : errors) {
+            for (; word != 0; word &= word - 1) {
+                ++total;
+            }
+        }
+        return total;
+    }
+
+    /**
+     * @brief Проверяет совпадение размеров и готовит выходной массив
+     * @param n Требуемый размер
+     * @param other Размер второго операнда
+     * @param out Выходной массив
+     * @throw std::invalid_argument Если размеры операндов различаются
+     */
+    static void prepare(size_t n, size_t other, ComplexArray& out) {
+        if (n != other) {
+            throw std::invalid_argument("Размеры массивов не совпадают");
+        }
+        if (out.count != n) {
+            out = ComplexArray(n);
+        }
+    }
+
+    /**
+     * @brief Применяет трансцендентную функцию одного аргумента
+     * @param fast Ядро уровня Fast в таблице ядер
+     * @param precise Поэлементный цикл уровня Precise
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void transform(ComplexKernels::Unary ComplexKernels::*fast, ComplexKernels::Unary precise,
+                          const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy) {
+        prepare(a.count, a.count, out);
+        ComplexKernels::Unary kernel = accuracy == MathAccuracy::Fast ? activeKernels().*fast : precise;
+        kernel(a.re, a.im, out.re, out.im, a.count);
+    }
+
+public:
+    static const size_t alignment = 64;  ///< Выравнивание массивов в байтах
+
+    /**
+     * @brief Конструктор по умолчанию (пустой массив)
+     */
+    ComplexArray() : re(nullptr), im(nullptr), count(0) {}
+
+    /**
+     * @brief Создает массив из n нулей
+     * @param n Количество элементов
+     */
+    explicit ComplexArray(size_t n) : re(allocate(n)), im(allocate(n)), count(n) {}
+
+    /**
+     * @brief Создает массив из вектора комплексных чисел
+     * @param values Исходные значения
+     */
+    explicit ComplexArray(const std::vector<Complex>& values) : ComplexArray(values.size()) {
+        for (size_t k = 0; k < count; ++k) {
+            re[k] = values[k].getReal();
+            im[k] = values[k].getImag();
+        }
+    }
+
+    /**
+     * @brief Конструктор копирования
+     * @param other Копируемый массив
+     */
+    ComplexArray(const ComplexArray& other) : ComplexArray(other.count) {
+        if (count) {
+            std::memcpy(re, other.re, count * sizeof(double));
+            std::memcpy(im, other.im, count * sizeof(double));
+        }
+    }
+
+    /**
+     * @brief Конструктор перемещения
+     * @param other Перемещаемый массив
+     */
+    ComplexArray(ComplexArray&& other) noexcept : re(other.re), im(other.im), count(other.count) {
+        other.re = other.im = nullptr;
+        other.count = 0;
+    }
+
+    /**
+     * @brief Присваивание (копированием или перемещением)
+     * @param other Присваиваемый массив
+     * @return Ссылка на текущий объект
+     */
+    ComplexArray& operator=(ComplexArray other) noexcept {
+        std::swap(re, other.re);
+        std::swap(im, other.im);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    /**
+     * @brief Деструктор
+     */
+    ~ComplexArray() {
+        release(re);
+        release(im);
+    }
+
+    /**
+     * @brief Возвращает количество элементов
+     * @return Размер массива
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Проверяет, пуст ли массив
+     * @return true если элементов нет
+     */
+    bool empty() const { return count == 0; }
+
+    /**
+     * @brief Доступ к массиву действительных частей
+     * @return Указатель на выровненный массив
+     */
+    double* real() { return re; }
+    const double* real() const { return re; }
+
+    /**
+     * @brief Доступ к массиву мнимых частей
+     * @return Указатель на выровненный массив
+     */
+    double* imag() { return im; }
+    const double* imag() const { return im; }
+
+    /**
+     * @brief Возвращает элемент как Complex
+     * @param k Индекс элемента
+     * @return Комплексное число
+     */
+    Complex get(size_t k) const { return Complex(re[k], im[k]); }
+
+    /**
+     * @brief Записывает элемент
+     * @param k Индекс элемента
+     * @param c Новое значение
+     */
+    void set(size_t k, const Complex& c) {
+        re[k] = c.getReal();
+        im[k] = c.getImag();
+    }
+
+    /**
+     * @brief Преобразует массив в вектор Complex
+     * @return Вектор с теми же значениями
+     */
+    std::vector<Complex> toVector() const {
+        std::vector<Complex> values;
+        values.reserve(count);
+        for (size_t k = 0; k < count; ++k) {
+            values.emplace_back(re[k], im[k]);
+        }
+        return values;
+    }
+
+    /**
+     * @brief Поэлементное сложение: out = a + b
+     * @param a Первый массив
+     * @param b Второй массив
+     * @param out Результат (может совпадать с a или b)
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void add(const ComplexArray& a, const ComplexArray& b, ComplexArray& out) {
+        prepare(a.count, b.count, out);
+        activeKernels().add(a.re, a.im, b.re, b.im, out.re, out.im, a.count);
+    }
+
+    /**
+     * @brief Поэлементное вычитание: out = a - b
+     * @param a Уменьшаемое
+     * @param b Вычитаемое
+     * @param out Результат (может совпадать с a или b)
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void subtract(const ComplexArray& a, const ComplexArray& b, ComplexArray& out) {
+        prepare(a.count, b.count, out);
+        activeKernels().subtract(a.re, a.im, b.re, b.im, out.re, out.im, a.count);
+    }
+
+    /**
+     * @brief Поэлементное умножение: out = a * b
+     * @param a Первый множитель
+     * @param b Второй множитель
+     * @param out Результат (может совпадать с a или b)
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void multiply(const ComplexArray& a, const ComplexArray& b, ComplexArray& out) {
+        prepare(a.count, b.count, out);
+        activeKernels().multiply(a.re, a.im, b.re, b.im, out.re, out.im, a.count);
+    }
+
+    /**
+     * @brief Поэлементное деление: out = a / b
+     * @param a Делимое
+     * @param b Делитель
+     * @param out Результат (может совпадать с a или b)
+     * @throw std::invalid_argument Если размеры a и b различаются
+     * @throw std::runtime_error Если хотя бы один делитель равен нулю
+     *
+     * Проверка на ноль не прерывает векторный цикл: ошибка сообщается после
+     * обработки всего массива, элементы с нулевым делителем содержат inf/nan.
+     */
+    static void divide(const ComplexArray& a, const ComplexArray& b, ComplexArray& out) {
+        prepare(a.count, b.count, out);
+        if (activeKernels().divide(a.re, a.im, b.re, b.im, out.re, out.im, a.count)) {
+            throw std::runtime_error("Деление на ноль!");
+        }
+    }
+
+    /**
+     * @brief Поэлементное деление без исключений: out = a / b
+     * @param a Делимое
+     * @param b Делитель
+     * @param out Результат (может совпадать с a или b)
+     * @param errors Маска ошибок: бит k слова k / 64 установлен, если b[k] = 0
+     * @return Количество элементов с нулевым делителем
+     * @throw std::invalid_argument Если размеры a и b различаются
+     *
+     * Используется алгоритм Смита (см. divideChecked()). Ветвление по
+     * элементам заменено смешиванием векторов, поэтому нулевые делители
+     * не прерывают векторный цикл - в этих элементах получается (NaN, NaN).
+     */
+    static size_t divideRobust(const ComplexArray& a, const ComplexArray& b, ComplexArray& out,
+                               std::vector<uint64_t>& errors) {
+        prepare(a.count, b.count, out);
+        errors.assign((a.count + 63) / 64, 0);
+        activeKernels().divideRobust(a.re, a.im, b.re, b.im, out.re, out.im, a.count, errors.data());
+        return countErrors(errors);
+    }
+
+    /**
+     * @brief Поэлементное обратное число без исключений: out = 1 / b
+     * @param b Массив
+     * @param out Результат (может совпадать с b)
+     * @param errors Маска ошибок (как в divideRobust())
+     * @return Количество нулевых элементов
+     */
+    static size_t reciprocal(const ComplexArray& b, ComplexArray& out, std::vector<uint64_t>& errors) {
+        prepare(b.count, b.count, out);
+        errors.assign((b.count + 63) / 64, 0);
+        activeKernels().divideRobust(nullptr, nullptr, b.re, b.im, out.re, out.im, b.count, errors.data());
+        return countErrors(errors);
+    }
+
+    /**
+     * @brief Поэлементное сопряжение: out = conj(a)
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     */
+    static void conjugate(const ComplexArray& a, ComplexArray& out) {
+        prepare(a.count, a.count, out);
+        activeKernels().conjugate(a.re, a.im, out.re, out.im, a.count);
+    }
+
+    /**
+     * @brief Поэлементный унарный минус: out = -a
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     */
+    static void negate(const ComplexArray& a, ComplexArray& out) {
+        prepare(a.count, a.count, out);
+        activeKernels().negate(a.re, a.im, out.re, out.im, a.count);
+    }
+
+    /**
+     * @brief Поэлементный модуль: out[k] = |a[k]|
+     * @param a Исходный массив
+     * @param out Вектор модулей (размер подгоняется под a)
+     */
+    static void modulus(const ComplexArray& a, std::vector<double>& out) {
+        out.resize(a.count);
+        activeKernels().modulus(a.re, a.im, out.data(), a.count);
+    }
+
+    /**
+     * @brief Поэлементная экспонента: out = e^a
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности (Fast - векторные ядра)
+     */
+    static void exp(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::exp, transcendental::preciseLoop<transcendental::Exp>, a, out, accuracy);
+    }
+
+    /**
+     * @brief Поэлементный логарифм (главное значение): out = log a
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void log(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::log, transcendental::preciseLoop<transcendental::Log>, a, out, accuracy);
+    }
+
+    /**
+     * @brief Поэлементный квадратный корень (главное значение): out = √a
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void sqrt(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::sqrt, transcendental::preciseLoop<transcendental::Sqrt>, a, out, accuracy);
+    }
+
+    /**
+     * @brief Поэлементный синус: out = sin a
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void sin(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::sin, transcendental::preciseLoop<transcendental::Sin>, a, out, accuracy);
+    }
+
+    /**
+     * @brief Поэлементный косинус: out = cos a
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void cos(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::cos, transcendental::preciseLoop<transcendental::Cos>, a, out, accuracy);
+    }
+
+    /**
+     * @brief Переводит элементы в полярную форму: out[k] = (|a[k]|, arg a[k])
+     * @param a Исходный массив
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void toPolar(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::toPolar, transcendental::preciseLoop<transcendental::ToPolar>, a, out, accuracy);
+    }
+
+    /**
+     * @brief Строит числа по полярной форме: out[k] = r·e^(iθ), где a[k] = (r, θ)
+     * @param a Модули (действительные части) и аргументы (мнимые части)
+     * @param out Результат (может совпадать с a)
+     * @param accuracy Уровень точности
+     */
+    static void fromPolar(const ComplexArray& a, ComplexArray& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        transform(&ComplexKernels::fromPolar, transcendental::preciseLoop<transcendental::FromPolar>, a, out,
+                  accuracy);
+    }
+
+    /**
+     * @brief Поэлементная степень (главное значение): out = a^b
+     * @param a Основания
+     * @param b Показатели
+     * @param out Результат (может совпадать с a или b)
+     * @param accuracy Уровень точности
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void pow(const ComplexArray& a, const ComplexArray& b, ComplexArray& out,
+                    MathAccuracy accuracy = MathAccuracy::Precise) {
+        prepare(a.count, b.count, out);
+        ComplexKernels::Binary kernel = accuracy == MathAccuracy::Fast
+            ? activeKernels().pow : transcendental::preciseBinaryLoop<transcendental::Pow>;
+        kernel(a.re, a.im, b.re, b.im, out.re, out.im, a.count);
+    }
+
+    /**
+     * @brief Поэлементный аргумент: out[k] = arg a[k]
+     * @param a Исходный массив
+     * @param out Вектор аргументов в (-π, π] (размер подгоняется под a)
+     * @param accuracy Уровень точности
+     */
+    static void arg(const ComplexArray& a, std::vector<double>& out, MathAccuracy accuracy = MathAccuracy::Precise) {
+        out.resize(a.count);
+        if (accuracy == MathAccuracy::Fast) {
+            activeKernels().arg(a.re, a.im, out.data(), a.count);
+        } else {
+            transcendental::preciseLoop<transcendental::Arg>(a.re, a.im, out.data(), nullptr, a.count);
+        }
+    }
+};
+
+/**
+ * @namespace fused
+ * @brief Шаблоны выражений над Complex (подключаются явно через lazy())
+ *
+ * Операторы Complex возвращают новый объект на каждом шаге, так что
+ * a * b + c * d - e создает четыре промежуточных Complex. Здесь операнды,
+ * обернутые в lazy(), образуют дерево выражения, которое вычисляется за один
+ * проход без промежуточных объектов. Сумма и разность с произведением
+ * сливаются в умножение-сложение, которое при наличии FMA (__FMA__)
+ * выполняется через std::fma. Поэтому результаты могут отличаться от
+ * операторов Complex в последнем бите.
+ *
+ * Листья-массивы (std::vector<Complex> и ComplexArray) вычисляются
+ * поэлементно, а листья-числа подставляются в каждый элемент. Например,
+ * assign(y, lazy(a) * lazy(x) + b) выполняется одним циклом без
+ * промежуточных массивов. Выход может совпадать с одним из входов.
+ *
+ * Узлы хранят листья-массивы по указателю: выражение нельзя переживать
+ * дольше массивов, из которых оно построено.
+ */
+namespace fused {
+
+/**
+ * @struct Value
+ * @brief Значение узла выражения (без конструктора и деструктора Complex)
+ */
+struct Value {
+    double re;  ///< Действительная часть
+    double im;  ///< Мнимая часть
+};
+
+/**
+ * @brief a·b + c, одним округлением при наличии FMA
+ */
+inline double mulAdd(double a, double b, double c) {
+#ifdef __FMA__
+    return std::fma(a, b, c);
+#else
+    return a * b + c;
+#endif
+}
+
+/**
+ * @class Expression
+ * @brief CRTP-база всех узлов выражения
+ *
+ * Каждый узел предоставляет:
+ * - at(i) - значение i-го элемента;
+ * - accumulate(i, acc, subtract) - acc ± значение (произведение
+ *   переопределяет его слитым умножением-сложением);
+ * - length() - длина массивов в поддереве (0, если массивов нет);
+ * - fits(n) - все ли массивы в поддереве имеют длину n.
+ */
+template <class Derived>
+struct Expression {
+    /**
+     * @brief Приведение к конкретному типу узла
+     */
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+
+    /**
+     * @brief acc ± at(i)
+     */
+    Value accumulate(size_t i, Value acc, bool subtract) const {
+        Value v = self().at(i);
+        return subtract ? Value{acc.re - v.re, acc.im - v.im} : Value{acc.re + v.re, acc.im + v.im};
+    }
+};
+
+/**
+ * @brief Является ли T узлом выражения
+ */
+template <class T>
+constexpr bool isExpression = std::is_base_of<Expression<T>, T>::value;
+
+/**
+ * @struct Scalar
+ * @brief Лист-число, одинаковый для всех элементов
+ */
+struct Scalar : Expression<Scalar> {
+    double re, im;
+
+    Scalar(double r, double i) : re(r), im(i) {}
+    Value at(size_t) const { return Value{re, im}; }
+    size_t length() const { return 0; }
+    bool fits(size_t) const { return true; }
+};
+
+/**
+ * @struct VectorRef
+ * @brief Лист-ссылка на std::vector<Complex>
+ */
+struct VectorRef : Expression<VectorRef> {
+    const std::vector<Complex>* values;
+
+    explicit VectorRef(const std::vector<Complex>& v) : values(&v) {}
+    Value at(size_t i) const {
+        const Complex& c = (*values)[i];
+        return Value{c.getReal(), c.getImag()};
+    }
+    size_t length() const { return values->size(); }
+    bool fits(size_t n) const { return values->size() == n; }
+};
+
+/**
+ * @struct ArrayRef
+ * @brief Лист-ссылка на ComplexArray
+ */
+struct ArrayRef : Expression<ArrayRef> {
+    const double* re;
+    const double* im;
+    size_t count;
+
+    explicit ArrayRef(const ComplexArray& a) : re(a.real()), im(a.imag()), count(a.size()) {}
+    Value at(size_t i) const { return Value{re[i], im[i]}; }
+    size_t length() const { return count; }
+    bool fits(size_t n) const { return count == n; }
+};
+
+/**
+ * @struct Binary
+ * @brief Общая часть двуместных узлов: операнды и проверка размеров
+ */
+template <class Derived, class L, class R>
+struct Binary : Expression<Derived> {
+    L left;
+    R right;
+
+    Binary(const L& l, const R& r) : left(l), right(r) {}
+    size_t length() const { return std::max(left.length(), right.length()); }
+    bool fits(size_t n) const { return left.fits(n) && right.fits(n); }
+};
+
+template <class L, class R> struct Product;
+
+/**
+ * @brief Является ли T узлом-произведением
+ */
+template <class T> struct IsProduct : std::false_type {};
+template <class L, class R> struct IsProduct<Product<L, R>> : std::true_type {};
+
+/**
+ * @struct Product
+ * @brief Произведение; внутри суммы или разности сливается со сложением
+ */
+template <class L, class R>
+struct Product : Binary<Product<L, R>, L, R> {
+    using Binary<Product<L, R>, L, R>::Binary;
+
+    Value at(size_t i) const {
+        Value a = this->left.at(i), b = this->right.at(i);
+        return Value{mulAdd(a.re, b.re, -(a.im * b.im)), mulAdd(a.re, b.im, a.im * b.re)};
+    }
+
+    Value accumulate(size_t i, Value acc, bool subtract) const {
+        Value a = this->left.at(i), b = this->right.at(i);
+        if (subtract) {
+            return Value{mulAdd(-a.re, b.re, mulAdd(a.im, b.im, acc.re)),
+                         mulAdd(-a.re, b.im, mulAdd(-a.im, b.re, acc.im))};
+        }
+        return Value{mulAdd(a.re, b.re, mulAdd(-a.im, b.im, acc.re)),
+                     mulAdd(a.re, b.im, mulAdd(a.im, b.re, acc.im))};
+    }
+};
+
+/**
+ * @struct Sum
+ * @brief Сумма; если один из операндов - произведение, второй становится его аккумулятором
+ */
+template <class L, class R>
+struct Sum : Binary<Sum<L, R>, L, R> {
+    using Binary<Sum<L, R>, L, R>::Binary;
+
+    Value at(size_t i) const {
+        if constexpr (IsProduct<L>::value) {
+            return this->left.accumulate(i, this->right.at(i), false);
+        } else {
+            return this->right.accumulate(i, this->left.at(i), false);
+        }
+    }
+};
+
+/**
+ * @struct Difference
+ * @brief Разность; вычитаемое-произведение вычитается слитно
+ */
+template <class L, class R>
+struct Difference : Binary<Difference<L, R>, L, R> {
+    using Binary<Difference<L, R>, L, R>::Binary;
+
+    Value at(size_t i) const {
+        if constexpr (IsProduct<L>::value && !IsProduct<R>::value) {
+            Value b = this->right.at(i);
+            return this->left.accumulate(i, Value{-b.re, -b.im}, false);
+        } else {
+            return this->right.accumulate(i, this->left.at(i), true);
+        }
+    }
+};
+
+/**
+ * @struct Quotient
+ * @brief Частное по той же формуле, что и Complex::operator/
+ */
+template <class L, class R>
+struct Quotient : Binary<Quotient<L, R>, L, R> {
+    using Binary<Quotient<L, R>, L, R>::Binary;
+
+    /**
+     * @throw std::runtime_error При делении на ноль
+     */
+    Value at(size_t i) const {
+        Value a = this->left.at(i), b = this->right.at(i);
+        double denominator = b.re * b.re + b.im * b.im;
+        if (denominator == 0) {
+            throw std::runtime_error("Деление на ноль!");
+        }
+        return Value{(a.re * b.re + a.im * b.im) / denominator, (a.im * b.re - a.re * b.im) / denominator};
+    }
+};
+
+/**
+ * @struct Negation
+ * @brief Унарный минус
+ */
+template <class E>
+struct Negation : Expression<Negation<E>> {
+    E operand;
+
+    explicit Negation(const E& e) : operand(e) {}
+    Value at(size_t i) const {
+        Value v = operand.at(i);
+        return Value{-v.re, -v.im};
+    }
+    size_t length() const { return operand.length(); }
+    bool fits(size_t n) const { return operand.fits(n); }
+};
+
+/**
+ * @struct Conjugate
+ * @brief Комплексное сопряжение
+ */
+template <class E>
+struct Conjugate : Expression<Conjugate<E>> {
+    E operand;
+
+    explicit Conjugate(const E& e) : operand(e) {}
+    Value at(size_t i) const {
+        Value v = operand.at(i);
+        return Value{v.re, -v.im};
+    }
+    size_t length() const { return operand.length(); }
+    bool fits(size_t n) const { return operand.fits(n); }
+};
+
+/**
+ * @brief Оборачивает число в лист выражения
+ */
+inline Scalar lazy(const Complex& value) { return Scalar(value.getReal(), value.getImag()); }
+
+/**
+ * @brief Оборачивает вектор в лист выражения (по ссылке)
+ */
+inline VectorRef lazy(const std::vector<Complex>& values) { return VectorRef(values); }
+
+/**
+ * @brief Оборачивает ComplexArray в лист выражения (по ссылке)
+ */
+inline ArrayRef lazy(const ComplexArray& values) { return ArrayRef(values); }
+
+// Приведение операндов смешанных выражений (узел, Complex или вещественное число) к узлу
+template <class E>
+const E& lift(const Expression<E>& e) { return e.self(); }
+inline Scalar lift(const Complex& value) { return lazy(value); }
+inline Scalar lift(double value) { return Scalar(value, 0); }
+
+template <class T>
+using Lifted = std::decay_t<decltype(lift(std::declval<const T&>()))>;
+
+template <class T>
+constexpr bool isOperand = isExpression<T> || std::is_same<T, Complex>::value || std::is_arithmetic<T>::value;
+
+// Операторы участвуют в перегрузке, только если хотя бы один операнд - узел выражения
+template <class L, class R>
+using EnableIfExpression = std::enable_if_t<(isExpression<L> || isExpression<R>) && isOperand<L> && isOperand<R>>;
+
+template <class L, class R, class = EnableIfExpression<L, R>>
+Sum<Lifted<L>, Lifted<R>> operator+(const L& l, const R& r) {
+    return Sum<Lifted<L>, Lifted<R>>(lift(l), lift(r));
+}
+
+template <class L, class R, class = EnableIfExpression<L, R>>
+Difference<Lifted<L>, Lifted<R>> operator-(const L& l, const R& r) {
+    return Difference<Lifted<L>, Lifted<R>>(lift(l), lift(r));
+}
+
+template <class L, class R, class = EnableIfExpression<L, R>>
+Product<Lifted<L>, Lifted<R>> operator*(const L& l, const R& r) {
+    return Product<Lifted<L>, Lifted<R>>(lift(l), lift(r));
+}
+
+template <class L, class R, class = EnableIfExpression<L, R>>
+Quotient<Lifted<L>, Lifted<R>> operator/(const L& l, const R& r) {
+    return Quotient<Lifted<L>, Lifted<R>>(lift(l), lift(r));
+}
+
+template <class E>
+Negation<E> operator-(const Expression<E>& e) { return Negation<E>(e.self()); }
+
+/**
+ * @brief Сопряжение узла выражения
+ */
+template <class E>
+Conjugate<E> conj(const Expression<E>& e) { return Conjugate<E>(e.self()); }
+
+/**
+ * @brief Длина массивов выражения с проверкой согласованности
+ * @throw std::invalid_argument Если массивов нет или их длины различаются
+ */
+template <class E>
+size_t checkedLength(const Expression<E>& e) {
+    size_t n = e.self().length();
+    if (n == 0) {
+        throw std::invalid_argument("Выражение не содержит массивов");
+    }
+    if (!e.self().fits(n)) {
+        throw std::invalid_argument("Размеры массивов в выражении не совпадают");
+    }
+    return n;
+}
+
+/**
+ * @brief Вычисляет выражение без массивов
+ * @param e Выражение
+ * @return Результат
+ * @throw std::invalid_argument Если выражение содержит массивы
+ * @throw std::runtime_error При делении на ноль
+ */
+template <class E>
+Complex evaluate(const Expression<E>& e) {
+    if (e.self().length() != 0) {
+        throw std::invalid_argument("Выражение над массивами вычисляется через assign()");
+    }
+    Value v = e.self().at(0);
+    return Complex(v.re, v.im);
+}
+
+/**
+ * @brief Поэлементно вычисляет выражение в ComplexArray одним циклом
+ * @param out Результат (размер подгоняется под выражение; может быть входом выражения)
+ * @param e Выражение
+ * @throw std::invalid_argument При несогласованных размерах
+ * @throw std::runtime_error При делении на ноль
+ */
+template <class E>
+void assign(ComplexArray& out, const Expression<E>& e) {
+    const size_t n = checkedLength(e);
+    if (out.size() != n) {
+        out = ComplexArray(n);
+    }
+    double* re = out.real();
+    double* im = out.imag();
+    for (size_t i = 0; i < n; ++i) {
+        Value v = e.self().at(i);
+        re[i] = v.re;
+        im[i] = v.im;
+    }
+}
+
+/**
+ * @brief Поэлементно вычисляет выражение в std::vector<Complex> одним циклом
+ * @param out Результат (размер подгоняется под выражение; может быть входом выражения)
+ * @param e Выражение
+ * @throw std::invalid_argument При несогласованных размерах
+ * @throw std::runtime_error При делении на ноль
+ */
+template <class E>
+void assign(std::vector<Complex>& out, const Expression<E>& e) {
+    const size_t n = checkedLength(e);
+    out.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        Value v = e.self().at(i);
+        out[i] = Complex(v.re, v.im);
+    }
+}
+
+} // namespace fused
+
+/**
+ * @class WorkStealingPool
+ * @brief Пул потоков с перехватом работы (work stealing)
+ *
+ * parallelFor() делит задачи 0..n-1 на непрерывные диапазоны - по одному на
+ * поток. Владелец берет задачи с начала своего диапазона, а освободившиеся
+ * потоки перехватывают их с конца чужих. Границы диапазона упакованы в одно
+ * 64-битное атомарное слово и меняются через compare_exchange, так что раздача
+ * задач обходится без блокировок. Мьютекс используется только для того, чтобы
+ * будить и усыплять потоки между вызовами.
+ *
+ * Вызывающий поток сам работает как поток 0, поэтому пул из одного потока
+ * не создает дополнительных потоков вовсе. Вложенный parallelFor() из тела
+ * цикла того же пула выполняется в вызвавшем его потоке последовательно.
+ */
+class WorkStealingPool {
+private:
+    /**
+     * @struct Range
+     * @brief Диапазон задач потока: старшие 32 бита - начало, младшие - конец
+     */
+    struct alignas(64) Range {
+        std::atomic<uint64_t> bounds{0};
+    };
+
+    std::vector<std::thread> threads;           ///< Рабочие потоки 1..size()-1
+    std::unique_ptr<Range[]> ranges;            ///< Диапазоны задач всех потоков
+    size_t workerCount;                         ///< Количество потоков вместе с вызывающим
+    std::function<void(size_t, size_t)> job;    ///< Текущее тело цикла
+    std::mutex callMutex;                       ///< Сериализует вызовы parallelFor()
+    std::mutex mutex;                           ///< Защищает поля ниже
+    std::condition_variable wake;               ///< Сигнал о новом задании
+    std::condition_variable finished;           ///< Сигнал о завершении задания
+    uint64_t generation;                        ///< Номер текущего задания
+    size_t running;                             ///< Сколько рабочих потоков еще заняты
+    bool stopping;                              ///< Пул уничтожается
+    std::exception_ptr failure;                 ///< Первое исключение из тела цикла
+
+    /**
+     * @struct Caller
+     * @brief Пул, задачу которого выполняет поток, и номер потока в нем
+     */
+    struct Caller {
+        const WorkStealingPool* pool;   ///< Пул (nullptr - поток вне пулов)
+        size_t worker;                  ///< Номер потока в пуле
+    };
+
+    /**
+     * @brief Состояние текущего потока
+     * @return Ссылка на потоколокальную запись
+     */
+    static Caller& caller() {
+        static thread_local Caller current{nullptr, 0};
+        return current;
+    }
+
+    static uint64_t pack(uint64_t begin, uint64_t end) { return (begin << 32) | end; }
+
+    /**
+     * @brief Берет задачу с начала диапазона (для владельца)
+     */
+    static bool popFront(Range& range, size_t& task) {
+        uint64_t current = range.bounds.load(std::memory_order_acquire);
+        for (;;) {
+            uint64_t begin = current >> 32, end = current & 0xFFFFFFFFu;
+            if (begin >= end) {
+                return false;
+            }
+            if (range.bounds.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel)) {
+                task = static_cast<size_t>(begin);
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @brief Берет задачу с конца диапазона (для перехвата)
+     */
+    static bool popBack(Range& range, size_t& task) {
+        uint64_t current = range.bounds.load(std::memory_order_acquire);
+        for (;;) {
+            uint64_t begin = current >> 32, end = current & 0xFFFFFFFFu;
+            if (begin >= end) {
+                return false;
+            }
+            if (range.bounds.compare_exchange_weak(current, pack(begin, end - 1), std::memory_order_acq_rel)) {
+                task = static_cast<size_t>(end - 1);
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @brief Выполняет свои задачи, затем перехватывает чужие
+     * @param worker Номер потока
+     */
+    void drain(size_t worker) {
+        const Caller outer = caller();
+        caller() = Caller{this, worker};
+        size_t task;
+        try {
+            while (popFront(ranges[worker], task)) {
+                job(task, worker);
+            }
+            for (size_t shift = 1; shift < workerCount; ++shift) {
+                Range& victim = ranges[(worker + shift) % workerCount];
+                while (popBack(victim, task)) {
+                    job(task, worker);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+        caller() = outer;
+    }
+
+    /**
+     * @brief Цикл рабочего потока
+     * @param worker Номер потока
+     */
+    void workerLoop(size_t worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            drain(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0) {
+                finished.notify_one();
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Конструктор
+     * @param threadCount Количество потоков (0 - по числу ядер)
+     */
+    explicit WorkStealingPool(size_t threadCount = 0)
+        : workerCount(threadCount ? threadCount : std::max<size_t>(1, std::thread::hardware_concurrency())),
+          generation(0), running(0), stopping(false) {
+        ranges.reset(new Range[workerCount]);
+        for (size_t worker = 1; worker < workerCount; ++worker) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, worker);
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Деструктор: останавливает и дожидается потоков
+     */
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Общий пул по числу ядер, создаваемый при первом обращении
+     * @return Ссылка на пул
+     */
+    static WorkStealingPool& shared() {
+        static WorkStealingPool pool;
+        return pool;
+    }
+
+    /**
+     * @brief Количество потоков вместе с вызывающим
+     * @return Размер пула
+     */
+    size_t size() const { return workerCount; }
+
+    /**
+     * @brief Параллельный цикл по задачам
+     * @param tasks Количество задач
+     * @param body Тело: body(номер задачи, номер потока)
+     * @throw Первое исключение, выброшенное телом (остальные задачи дорабатываются)
+     *
+     * Возвращает управление, когда выполнены все задачи. Номер потока
+     * лежит в диапазоне [0, size()) и годится для индексации
+     * потоколокальных буферов. Вызовы из разных потоков сериализуются.
+     * Вызов из тела цикла этого же пула выполняет все задачи сразу в
+     * текущем потоке под его номером, не дожидаясь внешнего вызова.
+     */
+    void parallelFor(size_t tasks, const std::function<void(size_t, size_t)>& body) {
+        if (tasks == 0) {
+            return;
+        }
+        if (tasks > 0xFFFFFFFFu) {
+            throw std::invalid_argument("Слишком много задач для одного вызова");
+        }
+        if (caller().pool == this) {
+            const size_t worker = caller().worker;
+            std::exception_ptr nestedFailure;
+            for (size_t task = 0; task < tasks; ++task) {
+                try {
+                    body(task, worker);
+                } catch (...) {
+                    if (!nestedFailure) {
+                        nestedFailure = std::current_exception();
+                    }
+                }
+            }
+            if (nestedFailure) {
+                std::rethrow_exception(nestedFailure);
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> call(callMutex);
+
+        job = body;
+        for (size_t worker = 0; worker < workerCount; ++worker) {
+            uint64_t begin = tasks * worker / workerCount;
+            uint64_t end = tasks * (worker + 1) / workerCount;
+            ranges[worker].bounds.store(pack(begin, end), std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            failure = nullptr;
+            running = workerCount - 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        drain(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return running == 0; });
+        job = nullptr;
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+};
+
+/**
+ * @struct BatchOperation
+ * @brief Операция для пакетного вычисления: код и операнды
+ */
+struct BatchOperation {
+    OpCode op;      ///< Код операции
+    Complex a;      ///< Первый операнд
+    Complex b;      ///< Второй операнд (для унарных операций не используется)
+};
+
+/**
+ * @brief Параллельно вычисляет пакет операций
+ * @param pool Пул потоков
+ * @param operations Операции
+ * @param n Количество операций
+ * @param results Результаты (n элементов)
+ * @param failed Признаки ошибки (n элементов: 1 - операция не выполнена)
+ * @param precision Точность вычислений
+ * @return Количество неудачных операций
+ *
+ * Операции делятся на блоки по 4096, блоки раздаются потокам пула.
+ * Каждый результат пишется в свою ячейку, поэтому синхронизация не нужна,
+ * а итог не зависит от числа потоков. Деление на ноль проверяется заранее,
+ * без исключений.
+ */
+inline size_t evaluateOperations(WorkStealingPool& pool, const BatchOperation* operations, size_t n,
+                                 Complex* results, uint8_t* failed, Precision precision = Precision::Double) {
+    const size_t chunk = 4096;
+    std::atomic<size_t> failures(0);
+    pool.parallelFor((n + chunk - 1) / chunk, [&](size_t task, size_t) {
+        const size_t begin = task * chunk;
+        const size_t end = std::min(n, begin + chunk);
+        size_t localFailures = 0;
+        for (size_t i = begin; i < end; ++i) {
+            const BatchOperation& operation = operations[i];
+            COMPLEX_METRICS_OPERATION(operation.op);
+            if (operation.op == OpCode::Divide && isZeroDivisor(precision, operation.b)) {
+                COMPLEX_METRICS_ERROR(operation.op);
+                results[i] = Complex();
+                failed[i] = 1;
+                ++localFailures;
+                continue;
+            }
+            try {
+                results[i] = applyOperation(precision, operation.op, operation.a, operation.b);
+                failed[i] = 0;
+            } catch (const std::exception&) {
+                COMPLEX_METRICS_ERROR(operation.op);
+                results[i] = Complex();
+                failed[i] = 1;
+                ++localFailures;
+            }
+        }
+        failures.fetch_add(localFailures, std::memory_order_relaxed);
+    });
+    return failures.load();
+}
+
+namespace reduction {
+
+/**
+ * @struct ModulusMaximum
+ * @brief Результат maxModulus()
+ */
+struct ModulusMaximum {
+    double modulus;  ///< Наибольший модуль (NaN, если сравнимых элементов нет)
+    size_t index;    ///< Номер первого элемента с этим модулем (размер массива, если их нет)
+};
+
+/**
+ * @brief Сворачивает массив по блокам chunkSize и складывает результаты деревом
+ * @param n Количество элементов
+ * @param pool Пул потоков (при одном блоке не используется)
+ * @param identity Результат для пустого блока
+ * @param body body(начало, длина, результат) - свертка одного блока
+ * @return Результат для всего массива
+ *
+ * Результат блока c лежит в ячейке c, а дерево обходит ячейки в
+ * фиксированном порядке, так что итог не зависит от распределения блоков
+ * между потоками.
+ */
+template <class Result, class Body>
+Result reduceChunks(size_t n, WorkStealingPool& pool, const Result& identity, const Body& body) {
+    const size_t chunks = (n + chunkSize - 1) / chunkSize;
+    if (chunks <= 1) {
+        Result result = identity;
+        body(0, n, result);
+        return result;
+    }
+    std::vector<Result> partials(chunks, identity);
+    pool.parallelFor(chunks, [&](size_t chunk, size_t) {
+        const size_t begin = chunk * chunkSize;
+        body(begin, std::min(n - begin, chunkSize), partials[chunk]);
+    });
+    for (size_t step = 1; step < chunks; step *= 2) {
+        for (size_t c = 0; c + step < chunks; c += 2 * step) {
+            partials[c] = combine(partials[c], partials[c + step]);
+        }
+    }
+    return partials[0];
+}
+
+/**
+ * @brief Сумма элементов
+ * @param a Массив
+ * @param pool Пул потоков
+ * @return Σ a[k] (с компенсацией ошибок округления)
+ */
+inline Complex sum(const ComplexArray& a, WorkStealingPool& pool = WorkStealingPool::shared()) {
+    const ComplexKernels& k = activeKernels();
+    Partial total = reduceChunks(a.size(), pool, Partial{}, [&](size_t begin, size_t n, Partial& out) {
+        k.sum(a.real() + begin, a.imag() + begin, n, out);
+    });
+    return Complex(total.re.hi + total.re.lo, total.im.hi + total.im.lo);
+}
+
+/**
+ * @brief Скалярное произведение с сопряжением первого множителя
+ * @param a Первый массив (сопрягается)
+ * @param b Второй массив
+ * @param pool Пул потоков
+ * @return Σ conj(a[k])·b[k]
+ * @throw std::invalid_argument Если размеры a и b различаются
+ */
+inline Complex dotc(const ComplexArray& a, const ComplexArray& b,
+                    WorkStealingPool& pool = WorkStealingPool::shared()) {
+    if (a.size() != b.size()) {
+        throw std::invalid_argument("Размеры массивов не совпадают");
+    }
+    const ComplexKernels& k = activeKernels();
+    Partial total = reduceChunks(a.size(), pool, Partial{}, [&](size_t begin, size_t n, Partial& out) {
+        k.dotc(a.real() + begin, a.imag() + begin, b.real() + begin, b.imag() + begin, n, out);
+    });
+    return Complex(total.re.hi + total.re.lo, total.im.hi + total.im.lo);
+}
+
+/**
+ * @brief Квадрат евклидовой нормы
+ * @param a Массив
+ * @param pool Пул потоков
+ * @return Σ |a[k]|²
+ */
+inline double norm2(const ComplexArray& a, WorkStealingPool& pool = WorkStealingPool::shared()) {
+    const ComplexKernels& k = activeKernels();
+    Partial total = reduceChunks(a.size(), pool, Partial{}, [&](size_t begin, size_t n, Partial& out) {
+        k.norm2(a.real() + begin, a.imag() + begin, n, out);
+    });
+    return total.re.hi + total.re.lo;
+}
+
+/**
+ * @brief Наибольший модуль элемента
+ * @param a Массив
+ * @param pool Пул потоков
+ * @return Модуль и номер первого элемента с наибольшим x² + y²
+ *
+ * Элементы с NaN пропускаются. Если наибольший x² + y² переполнился
+ * (|a[k]| > ~1.3e154) или ушел в субнормальные числа (|a[k]| < ~1.5e-154),
+ * массив просматривается еще раз с компонентами, умноженными на 2^∓600:
+ * такое масштабирование точное, поэтому порядок элементов тот же, а
+ * модуль не переполняется.
+ */
+inline ModulusMaximum maxModulus(const ComplexArray& a, WorkStealingPool& pool = WorkStealingPool::shared()) {
+    const ComplexKernels& k = activeKernels();
+    Peak peak = reduceChunks(a.size(), pool, Peak{-1.0, a.size()}, [&](size_t begin, size_t n, Peak& out) {
+        k.maxModulus(a.real() + begin, a.imag() + begin, n, begin, out);
+    });
+    if (peak.squared < 0) {
+        return ModulusMaximum{std::numeric_limits<double>::quiet_NaN(), a.size()};
+    }
+    if (std::isinf(peak.squared) || peak.squared < std::numeric_limits<double>::min()) {
+        const double scale = std::isinf(peak.squared) ? 0x1p-600 : 0x1p600;
+        peak = reduceChunks(a.size(), pool, Peak{-1.0, a.size()}, [&](size_t begin, size_t n, Peak& out) {
+            const double* re = a.real() + begin;
+            const double* im = a.imag() + begin;
+            for (size_t j = 0; j < n; ++j) {
+                const double x = re[j] * scale;
+                const double y = im[j] * scale;
+                const double squared = x * x + y * y;
+                if (squared > out.squared) {
+                    out = Peak{squared, begin + j};
+                }
+            }
+        });
+        return ModulusMaximum{std::sqrt(peak.squared) / scale, peak.index};
+    }
+    return ModulusMaximum{std::sqrt(peak.squared), peak.index};
+}
+
+} // namespace reduction
+
+/**
+ * @enum MatrixOp
+ * @brief Операция над множителем в ComplexMatrix::gemm() и gemv()
+ */
+enum class MatrixOp : unsigned char {
+    None = 0,               ///< A
+    Transpose = 1,          ///< A^T
+    ConjugateTranspose = 2  ///< A^H
+};
+
+/**
+ * @class ComplexMatrix
+ * @brief Плотная комплексная матрица: строки подряд, части раздельно (SoA)
+ *
+ * Действительные и мнимые части лежат в двух массивах ComplexArray; шаг
+ * строк округлен вверх до 8 элементов, так что каждая строка выровнена на
+ * 64 байта, а хвосты строк заполнены нулями.
+ *
+ * gemm() устроен по схеме GotoBLAS: C делится на полосы blockCols столбцов,
+ * общая размерность - на куски blockDepth. Кусок B упаковывается один раз
+ * (и переиспользуется из L2/L3), а полосы строк A раздаются потокам пула;
+ * каждый поток упаковывает свой блок A и проходит его микроядром
+ * gemm::tile() плитками 4 × 16. Транспонирование и сопряжение выполняются
+ * при упаковке, поэтому все варианты работают одним и тем же ядром.
+ * Каждый элемент C пишет только один поток, так что при фиксированном
+ * уровне SIMD результат не зависит от числа потоков.
+ *
+ * gemmReference() и gemvReference() - прямые циклы на операторах Complex
+ * для проверки быстрых версий.
+ */
+class ComplexMatrix {
+private:
+    size_t rowCount;    ///< Количество строк
+    size_t colCount;    ///< Количество столбцов
+    size_t stride;      ///< Шаг строк в элементах (кратен 8)
+    ComplexArray data;  ///< rowCount · stride элементов
+
+    static const size_t blockDepth = 384;   ///< Кусок общей размерности (подобран на 1024 × 1024)
+    static const size_t blockRows = 96;     ///< Строк A в блоке одного потока (блок A - в L2)
+    static const size_t blockCols = 2048;   ///< Столбцов в упакованном куске B
+    static const size_t parallelThreshold = 1 << 15;  ///< Меньшие поэлементные операции - без пула
+
+    static size_t roundUp(size_t value, size_t step) { return (value + step - 1) / step * step; }
+
+    /**
+     * @brief Элемент op(A)
+     */
+    Complex element(MatrixOp op, size_t i, size_t j) const {
+        if (op == MatrixOp::None) {
+            return get(i, j);
+        }
+        Complex value = get(j, i);
+        return op == MatrixOp::ConjugateTranspose ? Complex(value.getReal(), -value.getImag()) : value;
+    }
+
+    /**
+     * @brief Упаковывает блок op(A)[i0.., p0..] полосами по gemm::tileRows строк
+     * @param dst На полосу - depth шагов по 2·tileRows чисел; недостающие строки - нули
+     */
+    void packRows(MatrixOp op, size_t i0, size_t rows, size_t p0, size_t depth, double* dst) const {
+        const double* re = data.real();
+        const double* im = data.imag();
+        const double sign = op == MatrixOp::ConjugateTranspose ? -1.0 : 1.0;
+        for (size_t ir = 0; ir < rows; ir += gemm::tileRows) {
+            const size_t height = std::min(gemm::tileRows, rows - ir);
+            double* panel = dst + ir * 2 * depth;
+            for (size_t k = 0; k < depth; ++k) {
+                double* step = panel + k * 2 * gemm::tileRows;
+                for (size_t i = 0; i < gemm::tileRows; ++i) {
+                    if (i >= height) {
+                        step[i] = step[gemm::tileRows + i] = 0;
+                        continue;
+                    }
+                    size_t row = i0 + ir + i, col = p0 + k;
+                    size_t offset = op == MatrixOp::None ? row * stride + col : col * stride + row;
+                    step[i] = re[offset];
+                    step[gemm::tileRows + i] = sign * im[offset];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Упаковывает блок op(B)[p0.., j0..j0+cols] в одну полосу gemm::tileCols столбцов
+     */
+    void packColumns(MatrixOp op, size_t p0, size_t depth, size_t j0, size_t cols, double* dst) const {
+        const double* re = data.real();
+        const double* im = data.imag();
+        const double sign = op == MatrixOp::ConjugateTranspose ? -1.0 : 1.0;
+        for (size_t k = 0; k < depth; ++k) {
+            double* step = dst + k * 2 * gemm::tileCols;
+            for (size_t j = 0; j < gemm::tileCols; ++j) {
+                if (j >= cols) {
+                    step[j] = step[gemm::tileCols + j] = 0;
+                    continue;
+                }
+                size_t row = p0 + k, col = j0 + j;
+                size_t offset = op == MatrixOp::None ? row * stride + col : col * stride + row;
+                step[j] = re[offset];
+                step[gemm::tileCols + j] = sign * im[offset];
+            }
+        }
+    }
+
+    /**
+     * @brief Умножает строки [begin, end) на beta (при beta = 0 - обнуляет, не размножая NaN)
+     */
+    void scaleRows(size_t begin, size_t end, const Complex& beta) {
+        for (size_t i = begin; i < end; ++i) {
+            double* re = realRow(i);
+            double* im = imagRow(i);
+            if (beta.getReal() == 0 && beta.getImag() == 0) {
+                std::fill(re, re + colCount, 0.0);
+                std::fill(im, im + colCount, 0.0);
+            } else if (beta.getReal() != 1 || beta.getImag() != 0) {
+                for (size_t j = 0; j < colCount; ++j) {
+                    Complex value = beta * Complex(re[j], im[j]);
+                    re[j] = value.getReal();
+                    im[j] = value.getImag();
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Выполняет body(начало, конец) над полосами строк через пул
+     *
+     * Маленькие объемы обрабатываются в вызывающем потоке.
+     */
+    template <class Body>
+    static void forRows(size_t rows, size_t work, WorkStealingPool& pool, const Body& body) {
+        if (work < parallelThreshold || pool.size() == 1) {
+            body(0, rows);
+            return;
+        }
+        const size_t tasks = std::min(rows, 4 * pool.size());
+        pool.parallelFor(tasks, [&](size_t task, size_t) {
+            body(rows * task / tasks, rows * (task + 1) / tasks);
+        });
+    }
+
+    /**
+     * @brief Проверяет размеры для поэлементной операции и готовит out
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void prepare(const ComplexMatrix& a, const ComplexMatrix& b, ComplexMatrix& out) {
+        if (a.rowCount != b.rowCount || a.colCount != b.colCount) {
+            throw std::invalid_argument("Размеры матриц не совпадают");
+        }
+        if (out.rowCount != a.rowCount || out.colCount != a.colCount) {
+            out = ComplexMatrix(a.rowCount, a.colCount);
+        }
+    }
+
+    /**
+     * @brief Размеры op(A)·op(B)
+     * @throw std::invalid_argument Если внутренние размеры не совпадают
+     */
+    static void productShape(MatrixOp opA, MatrixOp opB, const ComplexMatrix& a, const ComplexMatrix& b,
+                             size_t& m, size_t& n, size_t& depth) {
+        m = opA == MatrixOp::None ? a.rowCount : a.colCount;
+        depth = opA == MatrixOp::None ? a.colCount : a.rowCount;
+        n = opB == MatrixOp::None ? b.colCount : b.rowCount;
+        size_t depthB = opB == MatrixOp::None ? b.rowCount : b.colCount;
+        if (depth != depthB) {
+            throw std::invalid_argument("Размеры матриц не согласованы для умножения");
+        }
+    }
+
+    /**
+     * @brief Готовит C размером m × n перед C = ... + beta·C
+     * @throw std::invalid_argument Если размер C не подходит, а beta ≠ 0
+     */
+    static void prepareOutput(ComplexMatrix& c, size_t m, size_t n, const Complex& beta) {
+        if (c.rowCount != m || c.colCount != n) {
+            if (beta.getReal() != 0 || beta.getImag() != 0) {
+                throw std::invalid_argument("Размер матрицы результата не совпадает с произведением");
+            }
+            c = ComplexMatrix(m, n);
+        }
+    }
+
+public:
+    /**
+     * @brief Конструктор по умолчанию (матрица 0 × 0)
+     */
+    ComplexMatrix() : rowCount(0), colCount(0), stride(0) {}
+
+    /**
+     * @brief Нулевая матрица
+     * @param rows Количество строк
+     * @param cols Количество столбцов
+     */
+    ComplexMatrix(size_t rows, size_t cols)
+        : rowCount(rows), colCount(cols), stride(roundUp(cols, 8)), data(rows * roundUp(cols, 8)) {}
+
+    /**
+     * @brief Матрица из элементов, перечисленных по строкам
+     * @param rows Количество строк
+     * @param cols Количество столбцов
+     * @param values rows · cols элементов
+     * @throw std::invalid_argument Если количество элементов не равно rows · cols
+     */
+    ComplexMatrix(size_t rows, size_t cols, const std::vector<Complex>& values) : ComplexMatrix(rows, cols) {
+        if (values.size() != rows * cols) {
+            throw std::invalid_argument("Количество элементов не совпадает с размером матрицы");
+        }
+        for (size_t i = 0; i < rows; ++i) {
+            for (size_t j = 0; j < cols; ++j) {
+                set(i, j, values[i * cols + j]);
+            }
+        }
+    }
+
+    /**
+     * @brief Единичная матрица
+     * @param n Размер
+     * @return Матрица n × n с единицами на диагонали
+     */
+    static ComplexMatrix identity(size_t n) {
+        ComplexMatrix result(n, n);
+        for (size_t i = 0; i < n; ++i) {
+            result.set(i, i, Complex(1, 0));
+        }
+        return result;
+    }
+
+    size_t rows() const { return rowCount; }
+    size_t cols() const { return colCount; }
+
+    /**
+     * @brief Шаг строк в элементах
+     * @return Расстояние между началами соседних строк (кратно 8)
+     */
+    size_t leadingDimension() const { return stride; }
+
+    Complex get(size_t i, size_t j) const { return data.get(i * stride + j); }
+    void set(size_t i, size_t j, const Complex& c) { data.set(i * stride + j, c); }
+
+    /**
+     * @brief Действительные части строки i (выровнены на 64 байта)
+     */
+    double* realRow(size_t i) { return data.real() + i * stride; }
+    const double* realRow(size_t i) const { return data.real() + i * stride; }
+
+    /**
+     * @brief Мнимые части строки i
+     */
+    double* imagRow(size_t i) { return data.imag() + i * stride; }
+    const double* imagRow(size_t i) const { return data.imag() + i * stride; }
+
+    /**
+     * @brief Элементы по строкам
+     * @return Вектор из rows() · cols() элементов
+     */
+    std::vector<Complex> toVector() const {
+        std::vector<Complex> values;
+        values.reserve(rowCount * colCount);
+        for (size_t i = 0; i < rowCount; ++i) {
+            for (size_t j = 0; j < colCount; ++j) {
+                values.push_back(get(i, j));
+            }
+        }
+        return values;
+    }
+
+    /**
+     * @brief Поэлементное сложение: out = a + b
+     * @param a Первая матрица
+     * @param b Вторая матрица
+     * @param out Результат (может совпадать с a или b)
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void add(const ComplexMatrix& a, const ComplexMatrix& b, ComplexMatrix& out,
+                    WorkStealingPool& pool = WorkStealingPool::shared()) {
+        prepare(a, b, out);
+        const ComplexKernels& k = activeKernels();
+        forRows(a.rowCount, a.rowCount * a.colCount, pool, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                k.add(a.realRow(i), a.imagRow(i), b.realRow(i), b.imagRow(i), out.realRow(i), out.imagRow(i),
+                      a.colCount);
+            }
+        });
+    }
+
+    /**
+     * @brief Поэлементное вычитание: out = a - b
+     * @param a Уменьшаемое
+     * @param b Вычитаемое
+     * @param out Результат (может совпадать с a или b)
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void subtract(const ComplexMatrix& a, const ComplexMatrix& b, ComplexMatrix& out,
+                         WorkStealingPool& pool = WorkStealingPool::shared()) {
+        prepare(a, b, out);
+        const ComplexKernels& k = activeKernels();
+        forRows(a.rowCount, a.rowCount * a.colCount, pool, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                k.subtract(a.realRow(i), a.imagRow(i), b.realRow(i), b.imagRow(i), out.realRow(i),
+                           out.imagRow(i), a.colCount);
+            }
+        });
+    }
+
+    /**
+     * @brief Поэлементное (адамарово) произведение: out[i][j] = a[i][j] · b[i][j]
+     * @param a Первая матрица
+     * @param b Вторая матрица
+     * @param out Результат (может совпадать с a или b)
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если размеры a и b различаются
+     */
+    static void multiplyElements(const ComplexMatrix& a, const ComplexMatrix& b, ComplexMatrix& out,
+                                 WorkStealingPool& pool = WorkStealingPool::shared()) {
+        prepare(a, b, out);
+        const ComplexKernels& k = activeKernels();
+        forRows(a.rowCount, a.rowCount * a.colCount, pool, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                k.multiply(a.realRow(i), a.imagRow(i), b.realRow(i), b.imagRow(i), out.realRow(i),
+                           out.imagRow(i), a.colCount);
+            }
+        });
+    }
+
+    /**
+     * @brief Умножение матриц: C = alpha · op(A) · op(B) + beta · C
+     * @param opA Операция над A
+     * @param opB Операция над B
+     * @param alpha Множитель произведения
+     * @param a Матрица A
+     * @param b Матрица B
+     * @param beta Множитель C (0 - прежнее содержимое C не используется, даже NaN)
+     * @param c Результат; при beta = 0 размер подгоняется, может совпадать с a или b
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если размеры не согласованы
+     */
+    static void gemm(MatrixOp opA, MatrixOp opB, const Complex& alpha, const ComplexMatrix& a,
+                     const ComplexMatrix& b, const Complex& beta, ComplexMatrix& c,
+                     WorkStealingPool& pool = WorkStealingPool::shared()) {
+        size_t m, n, depth;
+        productShape(opA, opB, a, b, m, n, depth);
+        if (&c == &a || &c == &b) {
+            ComplexMatrix result(c);
+            gemm(opA, opB, alpha, a, b, beta, result, pool);
+            c = std::move(result);
+            return;
+        }
+        prepareOutput(c, m, n, beta);
+        forRows(m, m * n, pool, [&](size_t begin, size_t end) { c.scaleRows(begin, end, beta); });
+        if (m == 0 || n == 0 || depth == 0 || (alpha.getReal() == 0 && alpha.getImag() == 0)) {
+            return;
+        }
+
+        const ComplexKernels& k = activeKernels();
+        // Блоки строк поменьше, если иначе части потоков не достанется работы
+        const size_t rowsPerTask = std::min(blockRows, roundUp((m + pool.size() - 1) / pool.size(), gemm::tileRows));
+        const size_t tasks = (m + rowsPerTask - 1) / rowsPerTask;
+        std::vector<double> packedB(2 * blockDepth * roundUp(std::min(n, blockCols), gemm::tileCols));
+        std::vector<std::vector<double>> packedA(pool.size());
+        for (size_t j0 = 0; j0 < n; j0 += blockCols) {
+            const size_t nc = std::min(blockCols, n - j0);
+            const size_t panels = (nc + gemm::tileCols - 1) / gemm::tileCols;
+            for (size_t p0 = 0; p0 < depth; p0 += blockDepth) {
+                const size_t kc = std::min(blockDepth, depth - p0);
+                pool.parallelFor(panels, [&](size_t panel, size_t) {
+                    const size_t j = panel * gemm::tileCols;
+                    b.packColumns(opB, p0, kc, j0 + j, std::min(gemm::tileCols, nc - j),
+                                  packedB.data() + panel * 2 * kc * gemm::tileCols);
+                });
+                pool.parallelFor(tasks, [&](size_t task, size_t worker) {
+                    const size_t i0 = task * rowsPerTask;
+                    const size_t mc = std::min(rowsPerTask, m - i0);
+                    std::vector<double>& blockA = packedA[worker];
+                    blockA.resize(2 * kc * roundUp(mc, gemm::tileRows));
+                    a.packRows(opA, i0, mc, p0, kc, blockA.data());
+                    for (size_t jr = 0; jr < nc; jr += gemm::tileCols) {
+                        const double* panelB = packedB.data() + jr * 2 * kc;
+                        for (size_t ir = 0; ir < mc; ir += gemm::tileRows) {
+                            k.gemmTile(kc, blockA.data() + ir * 2 * kc, panelB,
+                                       c.realRow(i0 + ir) + j0 + jr, c.imagRow(i0 + ir) + j0 + jr, c.stride,
+                                       std::min(gemm::tileRows, mc - ir), std::min(gemm::tileCols, nc - jr),
+                                       alpha.getReal(), alpha.getImag());
+                        }
+                    }
+                });
+            }
+        }
+    }
+
+    /**
+     * @brief Произведение матриц: out = a · b
+     * @param a Левый множитель
+     * @param b Правый множитель
+     * @param out Результат (может совпадать с a или b)
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если a.cols() ≠ b.rows()
+     */
+    static void multiply(const ComplexMatrix& a, const ComplexMatrix& b, ComplexMatrix& out,
+                         WorkStealingPool& pool = WorkStealingPool::shared()) {
+        gemm(MatrixOp::None, MatrixOp::None, Complex(1, 0), a, b, Complex(), out, pool);
+    }
+
+    /**
+     * @brief Умножение матрицы на вектор: y = alpha · op(A) · x + beta · y
+     * @param op Операция над A
+     * @param alpha Множитель произведения
+     * @param a Матрица
+     * @param x Вектор длины op(A).cols()
+     * @param beta Множитель y (0 - прежнее содержимое y не используется)
+     * @param y Результат длины op(A).rows(); при beta = 0 размер подгоняется
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если размеры не согласованы
+     *
+     * Для A строки независимы и делятся между потоками; для A^T и A^H
+     * y += alpha·x[i]·op(строка i) по всем строкам, а между потоками
+     * делятся столбцы, так что каждый элемент y пишет один поток.
+     */
+    static void gemv(MatrixOp op, const Complex& alpha, const ComplexMatrix& a, const ComplexArray& x,
+                     const Complex& beta, ComplexArray& y, WorkStealingPool& pool = WorkStealingPool::shared()) {
+        const size_t m = op == MatrixOp::None ? a.rowCount : a.colCount;
+        const size_t n = op == MatrixOp::None ? a.colCount : a.rowCount;
+        if (x.size() != n) {
+            throw std::invalid_argument("Длина вектора не совпадает с числом столбцов");
+        }
+        if (&x == &y) {
+            ComplexArray result(y);
+            gemv(op, alpha, a, x, beta, result, pool);
+            y = std::move(result);
+            return;
+        }
+        if (y.size() != m) {
+            if (beta.getReal() != 0 || beta.getImag() != 0) {
+                throw std::invalid_argument("Длина вектора результата не совпадает с числом строк");
+            }
+            y = ComplexArray(m);
+        }
+        const ComplexKernels& k = activeKernels();
+        double* yr = y.real();
+        double* yi = y.imag();
+        const bool zeroBeta = beta.getReal() == 0 && beta.getImag() == 0;
+        if (op == MatrixOp::None) {
+            forRows(m, m * n, pool, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    double sum[2];
+                    k.dotu(a.realRow(i), a.imagRow(i), x.real(), x.imag(), n, sum);
+                    Complex value = alpha * Complex(sum[0], sum[1]);
+                    if (!zeroBeta) {
+                        value = value + beta * Complex(yr[i], yi[i]);
+                    }
+                    yr[i] = value.getReal();
+                    yi[i] = value.getImag();
+                }
+            });
+            return;
+        }
+        // Полосы столбцов кратны 8, чтобы у каждого потока векторы шли по выровненным адресам
+        const size_t slice = std::max<size_t>(64, roundUp((m + 4 * pool.size() - 1) / (4 * pool.size()), 8));
+        const size_t slices = (m + slice - 1) / slice;
+        auto body = [&](size_t s) {
+            const size_t j0 = s * slice;
+            const size_t width = std::min(slice, m - j0);
+            for (size_t j = j0; j < j0 + width; ++j) {
+                Complex value = zeroBeta ? Complex() : beta * Complex(yr[j], yi[j]);
+                yr[j] = value.getReal();
+                yi[j] = value.getImag();
+            }
+            for (size_t i = 0; i < n; ++i) {
+                Complex scale = alpha * x.get(i);
+                k.axpy(scale.getReal(), scale.getImag(), a.realRow(i) + j0, a.imagRow(i) + j0, yr + j0, yi + j0,
+                       width, op == MatrixOp::ConjugateTranspose);
+            }
+        };
+        if (m * n < parallelThreshold || slices == 1) {
+            for (size_t s = 0; s < slices; ++s) {
+                body(s);
+            }
+        } else {
+            pool.parallelFor(slices, [&](size_t s, size_t) { body(s); });
+        }
+    }
+
+    /**
+     * @brief Эталонное умножение матриц на операторах Complex (тройной цикл)
+     *
+     * Параметры и результат - как у gemm(); служит для проверки gemm().
+     */
+    static void gemmReference(MatrixOp opA, MatrixOp opB, const Complex& alpha, const ComplexMatrix& a,
+                              const ComplexMatrix& b, const Complex& beta, ComplexMatrix& c) {
+        size_t m, n, depth;
+        productShape(opA, opB, a, b, m, n, depth);
+        ComplexMatrix result(m, n);
+        const bool zeroBeta = beta.getReal() == 0 && beta.getImag() == 0;
+        if (!zeroBeta && (c.rowCount != m || c.colCount != n)) {
+            throw std::invalid_argument("Размер матрицы результата не совпадает с произведением");
+        }
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                Complex sum;
+                for (size_t p = 0; p < depth; ++p) {
+                    sum = sum + a.element(opA, i, p) * b.element(opB, p, j);
+                }
+                Complex value = alpha * sum;
+                if (!zeroBeta) {
+                    value = value + beta * c.get(i, j);
+                }
+                result.set(i, j, value);
+            }
+        }
+        c = std::move(result);
+    }
+
+    /**
+     * @brief Эталонное умножение матрицы на вектор на операторах Complex
+     *
+     * Параметры и результат - как у gemv().
+     */
+    static void gemvReference(MatrixOp op, const Complex& alpha, const ComplexMatrix& a, const ComplexArray& x,
+                              const Complex& beta, ComplexArray& y) {
+        const size_t m = op == MatrixOp::None ? a.rowCount : a.colCount;
+        const size_t n = op == MatrixOp::None ? a.colCount : a.rowCount;
+        const bool zeroBeta = beta.getReal() == 0 && beta.getImag() == 0;
+        if (x.size() != n || (!zeroBeta && y.size() != m)) {
+            throw std::invalid_argument("Длина вектора не совпадает с размером матрицы");
+        }
+        ComplexArray result(m);
+        for (size_t i = 0; i < m; ++i) {
+            Complex sum;
+            for (size_t j = 0; j < n; ++j) {
+                sum = sum + a.element(op, i, j) * x.get(j);
+            }
+            Complex value = alpha * sum;
+            if (!zeroBeta) {
+                value = value + beta * y.get(i);
+            }
+            result.set(i, value);
+        }
+        y = std::move(result);
+    }
+};
+
+namespace escape {
+
+const size_t tileSize = 1024;  ///< Точек в задаче пула
+
+/**
+ * @struct Result
+ * @brief Результат escapeTime()
+ */
+struct Result {
+    std::vector<uint32_t> counts;  ///< Число шагов для каждой точки
+    ComplexArray last;             ///< Последнее z каждой точки (пусто, если не запрошено)
+};
+
+/**
+ * @brief Итерирует z -> z² + c (z₀ = 0) для каждой точки сетки
+ * @param c Точки сетки (например, строки изображения подряд)
+ * @param maxIterations Наибольшее число шагов
+ * @param keepLast Сохранить последнее z (для сглаженной раскраски и анализа)
+ * @param pool Пул потоков
+ * @return Число шагов: maxIterations - точка не вышла из круга |z| ≤ 2
+ *         раньше, иначе номер шага, после которого |z| > 2
+ *
+ * Сетка делится на задачи по tileSize точек; точки внутри множества
+ * требуют в сотни раз больше шагов, чем соседние, и неравную работу
+ * выравнивает перехват задач в WorkStealingPool. Результат не зависит ни
+ * от числа потоков, ни от уровня SIMD.
+ */
+inline Result escapeTime(const ComplexArray& c, uint32_t maxIterations, bool keepLast = false,
+                         WorkStealingPool& pool = WorkStealingPool::shared()) {
+    Result result;
+    const size_t n = c.size();
+    result.counts.resize(n);
+    if (keepLast) {
+        result.last = ComplexArray(n);
+    }
+    const ComplexKernels& k = activeKernels();
+    const size_t tasks = (n + tileSize - 1) / tileSize;
+    auto body = [&](size_t task, size_t) {
+        const size_t first = task * tileSize;
+        const size_t count = std::min(tileSize, n - first);
+        k.escapeTime(c.real() + first, c.imag() + first, count, maxIterations, result.counts.data() + first,
+                     keepLast ? result.last.real() + first : nullptr,
+                     keepLast ? result.last.imag() + first : nullptr);
+    };
+    if (tasks <= 1) {
+        for (size_t task = 0; task < tasks; ++task) {
+            body(task, 0);
+        }
+    } else {
+        pool.parallelFor(tasks, body);
+    }
+    return result;
+}
+
+} // namespace escape
+
+/**
+ * @struct ModulusKey
+ * @brief Ключ упорядочивания комплексного числа по модулю
+ *
+ * Ключ - битовое представление квадрата модуля. Для неотрицательных double
+ * порядок битовых образов как беззнаковых целых совпадает с порядком чисел,
+ * поэтому ключи можно сортировать поразрядно, не вычисляя ни одного корня.
+ * NaN получает ключ больше бесконечности и оказывается в конце.
+ */
+struct ModulusKey {
+    uint64_t key;   ///< Битовый образ квадрата модуля
+    size_t index;   ///< Позиция числа в исходной последовательности
+
+    /**
+     * @brief Вычисляет ключ для числа
+     * @param c Комплексное число
+     * @return Битовый образ квадрата модуля
+     */
+    static uint64_t of(const Complex& c) {
+        double squared = c.squaredModulus();
+        uint64_t bits;
+        std::memcpy(&bits, &squared, sizeof(bits));
+        return bits;
+    }
+};
+
+/**
+ * @brief Строит ключи для последовательности комплексных чисел
+ * @param values Указатель на первый элемент
+ * @param n Количество элементов
+ * @return Ключи в исходном порядке
+ */
+inline std::vector<ModulusKey> buildModulusKeys(const Complex* values, size_t n) {
+    std::vector<ModulusKey> keys(n);
+    for (size_t k = 0; k < n; ++k) {
+        keys[k] = {ModulusKey::of(values[k]), k};
+    }
+    return keys;
+}
+
+/**
+ * @brief Строит ключи для массива в формате SoA
+ * @param values Массив комплексных чисел
+ * @return Ключи в исходном порядке
+ */
+inline std::vector<ModulusKey> buildModulusKeys(const ComplexArray& values) {
+    std::vector<ModulusKey> keys(values.size());
+    const double* re = values.real();
+    const double* im = values.imag();
+    for (size_t k = 0; k < keys.size(); ++k) {
+        double squared = re[k] * re[k] + im[k] * im[k];
+        std::memcpy(&keys[k].key, &squared, sizeof(squared));
+        keys[k].index = k;
+    }
+    return keys;
+}
+
+/**
+ * @brief Устойчивая поразрядная сортировка ключей по возрастанию
+ * @param keys Сортируемые ключи
+ *
+ * LSD-сортировка по 11-битным разрядам (6 проходов, гистограммы строятся
+ * за один проход). Разряды, одинаковые у всех ключей, пропускаются.
+ * Небольшие массивы сортируются через std::stable_sort.
+ */
+inline void radixSortModulusKeys(std::vector<ModulusKey>& keys) {
+    const size_t n = keys.size();
+    if (n < 1024) {
+        std::stable_sort(keys.begin(), keys.end(),
+                         [](const ModulusKey& a, const ModulusKey& b) { return a.key < b.key; });
+        return;
+    }
+
+    const int bits = 11;
+    const int passes = 6;
+    const size_t buckets = size_t(1) << bits;
+    std::vector<size_t> histogram(passes * buckets, 0);
+    for (const ModulusKey& item : keys) {
+        for (int pass = 0; pass < passes; ++pass) {
+            ++histogram[pass * buckets + ((item.key >> (pass * bits)) & (buckets - 1))];
+        }
+    }
+
+    std::vector<ModulusKey> buffer(n);
+    for (int pass = 0; pass < passes; ++pass) {
+        size_t* counts = histogram.data() + pass * buckets;
+        const int shift = pass * bits;
+        if (counts[(keys[0].key >> shift) & (buckets - 1)] == n) {
+            continue;  // У всех ключей этот разряд одинаков
+        }
+        size_t offset = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            size_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (const ModulusKey& item : keys) {
+            buffer[counts[(item.key >> shift) & (buckets - 1)]++] = item;
+        }
+        keys.swap(buffer);
+    }
+}
+
+/**
+ * @brief Индексы элементов в порядке возрастания модуля
+ * @param values Исходные числа
+ * @return Перестановка индексов (устойчивая для равных модулей)
+ */
+inline std::vector<size_t> argsortByModulus(const std::vector<Complex>& values) {
+    std::vector<ModulusKey> keys = buildModulusKeys(values.data(), values.size());
+    radixSortModulusKeys(keys);
+    std::vector<size_t> order(keys.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        order[k] = keys[k].index;
+    }
+    return order;
+}
+
+/**
+ * @brief Сортирует числа по возрастанию модуля
+ * @param values Сортируемые числа
+ *
+ * Модули не вычисляются: ключи (квадраты модулей) строятся один раз,
+ * затем выполняется поразрядная сортировка и одна перестановка данных.
+ */
+inline void sortByModulus(std::vector<Complex>& values) {
+    std::vector<ModulusKey> keys = buildModulusKeys(values.data(), values.size());
+    radixSortModulusKeys(keys);
+    std::vector<Complex> sorted(values.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        sorted[k] = values[keys[k].index];
+    }
+    values.swap(sorted);
+}
+
+/**
+ * @brief Частичная сортировка по модулю
+ * @param values Числа
+ * @param count Сколько наименьших по модулю чисел упорядочить
+ *
+ * После вызова первые count элементов - наименьшие по модулю в порядке
+ * возрастания, порядок остальных не определен.
+ */
+inline void partialSortByModulus(std::vector<Complex>& values, size_t count) {
+    count = std::min(count, values.size());
+    std::vector<ModulusKey> keys = buildModulusKeys(values.data(), values.size());
+    std::partial_sort(keys.begin(), keys.begin() + count, keys.end(),
+                      [](const ModulusKey& a, const ModulusKey& b) { return a.key < b.key; });
+    std::vector<Complex> reordered(values.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        reordered[k] = values[keys[k].index];
+    }
+    values.swap(reordered);
+}
+
+/**
+ * @brief Ставит на позицию n элемент, который был бы там после сортировки по модулю
+ * @param values Числа
+ * @param n Позиция
+ *
+ * Слева от позиции n остаются числа с модулем не больше, справа - не меньше.
+ */
+inline void nthElementByModulus(std::vector<Complex>& values, size_t n) {
+    if (n >= values.size()) {
+        return;
+    }
+    std::vector<ModulusKey> keys = buildModulusKeys(values.data(), values.size());
+    std::nth_element(keys.begin(), keys.begin() + n, keys.end(),
+                     [](const ModulusKey& a, const ModulusKey& b) { return a.key < b.key; });
+    std::vector<Complex> reordered(values.size());
+    for (size_t k = 0; k < keys.size(); ++k) {
+        reordered[k] = values[keys[k].index];
+    }
+    values.swap(reordered);
+}
+
+/**
+ * @brief Индексы k наибольших (или наименьших) по модулю элементов
+ * @param keys Ключи, построенные buildModulusKeys() (порядок будет изменен)
+ * @param k Количество элементов
+ * @param largest true - наибольшие (по убыванию), false - наименьшие (по возрастанию)
+ * @return Индексы выбранных элементов в порядке ранга
+ *
+ * Отбор за O(n) через nth_element, затем сортируются только k ключей.
+ */
+inline std::vector<size_t> selectTopKByModulus(std::vector<ModulusKey>& keys, size_t k, bool largest) {
+    k = std::min(k, keys.size());
+    auto less = [](const ModulusKey& a, const ModulusKey& b) {
+        return a.key < b.key || (a.key == b.key && a.index < b.index);
+    };
+    auto greater = [](const ModulusKey& a, const ModulusKey& b) {
+        return a.key > b.key || (a.key == b.key && a.index < b.index);
+    };
+    if (largest) {
+        std::nth_element(keys.begin(), keys.begin() + k, keys.end(), greater);
+        std::sort(keys.begin(), keys.begin() + k, greater);
+    } else {
+        std::nth_element(keys.begin(), keys.begin() + k, keys.end(), less);
+        std::sort(keys.begin(), keys.begin() + k, less);
+    }
+    std::vector<size_t> indices(k);
+    for (size_t i = 0; i < k; ++i) {
+        indices[i] = keys[i].index;
+    }
+    return indices;
+}
+
+/**
+ * @brief Индексы k наибольших (или наименьших) по модулю чисел
+ * @param values Числа
+ * @param k Количество элементов
+ * @param largest true - наибольшие, false - наименьшие
+ * @return Индексы в порядке ранга; при равных модулях раньше идет меньший индекс
+ */
+inline std::vector<size_t> topKByModulus(const std::vector<Complex>& values, size_t k, bool largest = true) {
+    std::vector<ModulusKey> keys = buildModulusKeys(values.data(), values.size());
+    return selectTopKByModulus(keys, k, largest);
+}
+
+/**
+ * @brief Индексы k наибольших (или наименьших) по модулю элементов массива SoA
+ * @param values Массив
+ * @param k Количество элементов
+ * @param largest true - наибольшие, false - наименьшие
+ * @return Индексы в порядке ранга
+ */
+inline std::vector<size_t> topKByModulus(const ComplexArray& values, size_t k, bool largest = true) {
+    std::vector<ModulusKey> keys = buildModulusKeys(values);
+    return selectTopKByModulus(keys, k, largest);
+}
+
+/**
+ * @class ComplexExpression
+ * @brief Скомпилированное выражение над комплексными числами
+ *
+ * Выражение вида "(z*z + c) / (z - 1)" разбирается один раз: константные
+ * подвыражения сворачиваются, результат компилируется в компактный
+ * регистровый байт-код. Затем программа многократно вычисляется для разных
+ * значений переменных без повторного разбора и без выделения памяти на
+ * каждое вычисление.
+ *
+ * Грамматика:
+ * - выражение: слагаемое { ("+" | "-") слагаемое }
+ * - слагаемое: унарное { ("*" | "/") унарное }
+ * - унарное:   ("-" | "+" | "++" | "--") унарное | первичное
+ * - первичное: число ["i"] | "i" | переменная | функция "(" выражение ")" |
+ *              "pow(" выражение "," выражение ")" | "(" выражение ")"
+ * - функция:   "modulus" | "exp" | "log" | "sqrt" | "sin" | "cos" | "arg"
+ *
+ * Операции выполняются через applyOperation(), поэтому результат совпадает
+ * с операторами Complex: "++x" дает x + 1 (сама переменная не меняется),
+ * "modulus(x)" - число (|x|, 0), "arg(x)" - число (arg x, 0); функции
+ * вычисляются на уровне MathAccuracy::Precise.
+ *
+ * Регистры: сначала переменные, затем константы, затем временные значения.
+ */
+class ComplexExpression {
+public:
+    /**
+     * @struct Instruction
+     * @brief Инструкция байт-кода: dst = op(a, b)
+     */
+    struct Instruction {
+        OpCode op;      ///< Операция (для унарных b не используется)
+        uint16_t dst;   ///< Регистр результата
+        uint16_t a;     ///< Первый операнд
+        uint16_t b;     ///< Второй операнд
+    };
+
+private:
+    /**
+     * @struct Node
+     * @brief Узел дерева разбора
+     */
+    struct Node {
+        enum Kind { Constant, Variable, Operation } kind;  ///< Вид узла
+        OpCode op;          ///< Операция (для Operation)
+        Complex value;      ///< Значение (для Constant)
+        size_t variable;    ///< Номер переменной (для Variable)
+        int left;           ///< Первый операнд (для Operation)
+        int right;          ///< Второй операнд (-1 для унарных)
+    };
+
+    /**
+     * @class Parser
+     * @brief Рекурсивный спуск по тексту выражения
+     */
+    class Parser {
+    private:
+        const std::string& text;
+        size_t pos;
+        std::vector<Node>& nodes;
+        std::vector<std::string>& names;
+        bool fixedNames;
+
+    public:
+        Parser(const std::string& source, std::vector<Node>& tree, std::vector<std::string>& variables, bool fixed)
+            : text(source), pos(0), nodes(tree), names(variables), fixedNames(fixed) {}
+
+        /**
+         * @brief Разбирает весь текст
+         * @return Индекс корня дерева
+         */
+        int parse() {
+            int root = parseExpression();
+            skipSpaces();
+            if (pos != text.size()) {
+                error("неожиданный символ '" + std::string(1, text[pos]) + "'");
+            }
+            return root;
+        }
+
+    private:
+        [[noreturn]] void error(const std::string& message) const {
+            throw std::invalid_argument("Ошибка в выражении (позиция " + std::to_string(pos + 1) + "): " + message);
+        }
+
+        void skipSpaces() {
+            while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+                ++pos;
+            }
+        }
+
+        bool accept(const char* token) {
+            skipSpaces();
+            size_t length = std::strlen(token);
+            if (text.compare(pos, length, token) == 0) {
+                pos += length;
+                return true;
+            }
+            return false;
+        }
+
+        int add(const Node& node) {
+            nodes.push_back(node);
+            return static_cast<int>(nodes.size() - 1);
+        }
+
+        /**
+         * @brief Создает узел операции, сворачивая константы
+         */
+        int operation(OpCode op, int left, int right = -1) {
+            const Node& l = nodes[left];
+            if (l.kind == Node::Constant && (right < 0 || nodes[right].kind == Node::Constant)) {
+                try {
+                    Complex b = right < 0 ? Complex() : nodes[right].value;
+                    return add(Node{Node::Constant, op, applyOperation(op, l.value, b), 0, -1, -1});
+                } catch (const std::runtime_error&) {
+                    // Деление на константный ноль остается до времени выполнения
+                }
+            }
+            return add(Node{Node::Operation, op, Complex(), 0, left, right});
+        }
+
+        int parseExpression() {
+            int left = parseTerm();
+            for (;;) {
+                if (accept("+")) {
+                    left = operation(OpCode::Add, left, parseTerm());
+                } else if (accept("-")) {
+                    left = operation(OpCode::Subtract, left, parseTerm());
+                } else {
+                    return left;
+                }
+            }
+        }
+
+        int parseTerm() {
+            int left = parseUnary();
+            for (;;) {
+                if (accept("*")) {
+                    left = operation(OpCode::Multiply, left, parseUnary());
+                } else if (accept("/")) {
+                    left = operation(OpCode::Divide, left, parseUnary());
+                } else {
+                    return left;
+                }
+            }
+        }
+
+        int parseUnary() {
+            if (accept("++")) {
+                return operation(OpCode::Increment, parseUnary());
+            }
+            if (accept("--")) {
+                return operation(OpCode::Decrement, parseUnary());
+            }
+            if (accept("-")) {
+                return operation(OpCode::Negate, parseUnary());
+            }
+            if (accept("+")) {
+                return parseUnary();
+            }
+            return parsePrimary();
+        }
+
+        /**
+         * @brief Разбирает аргументы функции (два для бинарных операций)
+         */
+        int parseCall(const std::string& name, OpCode op) {
+            if (!accept("(")) {
+                error("ожидалась '(' после " + name);
+            }
+            int first = parseExpression();
+            int second = -1;
+            if (isBinaryOperation(op)) {
+                if (!accept(",")) {
+                    error("ожидалась ','");
+                }
+                second = parseExpression();
+            }
+            if (!accept(")")) {
+                error("ожидалась ')'");
+            }
+            return operation(op, first, second);
+        }
+
+        int parsePrimary() {
+            skipSpaces();
+            if (pos == text.size()) {
+                error("неожиданный конец выражения");
+            }
+            if (accept("(")) {
+                int inner = parseExpression();
+                if (!accept(")")) {
+                    error("ожидалась ')'");
+                }
+                return inner;
+            }
+
+            char ch = text[pos];
+            if (std::isdigit(static_cast<unsigned char>(ch)) || ch == '.') {
+                double value = 0;
+                std::from_chars_result r = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+                if (r.ec != std::errc()) {
+                    error("неверное число");
+                }
+                pos = static_cast<size_t>(r.ptr - text.data());
+                if (pos < text.size() && text[pos] == 'i' &&
+                    (pos + 1 == text.size() || !std::isalnum(static_cast<unsigned char>(text[pos + 1])))) {
+                    ++pos;
+                    return add(Node{Node::Constant, OpCode::Add, Complex(0, value), 0, -1, -1});
+                }
+                return add(Node{Node::Constant, OpCode::Add, Complex(value, 0), 0, -1, -1});
+            }
+
+            if (std::isalpha(static_cast<unsigned char>(ch)) || ch == '_') {
+                size_t start = pos;
+                while (pos < text.size() &&
+                       (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_')) {
+                    ++pos;
+                }
+                std::string name = text.substr(start, pos - start);
+                if (name == "i") {
+                    return add(Node{Node::Constant, OpCode::Add, Complex(0, 1), 0, -1, -1});
+                }
+                struct Function {
+                    const char* name;
+                    OpCode op;
+                };
+                static const Function functions[] = {
+                    {"modulus", OpCode::Modulus}, {"exp", OpCode::Exp}, {"log", OpCode::Log},
+                    {"sqrt", OpCode::Sqrt}, {"sin", OpCode::Sin}, {"cos", OpCode::Cos},
+                    {"arg", OpCode::Arg}, {"pow", OpCode::Pow}
+                };
+                for (const Function& function : functions) {
+                    if (name == function.name) {
+                        return parseCall(name, function.op);
+                    }
+                }
+                size_t index = std::find(names.begin(), names.end(), name) - names.begin();
+                if (index == names.size()) {
+                    if (fixedNames) {
+                        pos = start;
+                        error("неизвестная переменная '" + name + "'");
+                    }
+                    names.push_back(name);
+                }
+                return add(Node{Node::Variable, OpCode::Add, Complex(), index, -1, -1});
+            }
+
+            error("неожиданный символ '" + std::string(1, ch) + "'");
+        }
+    };
+
+    std::vector<std::string> variableNames;  ///< Имена переменных в порядке привязки
+    std::vector<Complex> constants;          ///< Значения константных регистров
+    std::vector<Instruction> code;           ///< Байт-код
+    size_t registerTotal;                    ///< Всего регистров
+    uint16_t resultRegister;                 ///< Регистр с результатом
+
+    /**
+     * @brief Собирает константы дерева в таблицу
+     */
+    void collectConstants(const std::vector<Node>& nodes, int node) {
+        const Node& n = nodes[node];
+        if (n.kind == Node::Constant) {
+            for (const Complex& c : constants) {
+                if (std::memcmp(&c, &n.value, sizeof(Complex)) == 0) {
+                    return;
+                }
+            }
+            constants.push_back(n.value);
+        } else if (n.kind == Node::Operation) {
+            collectConstants(nodes, n.left);
+            if (n.right >= 0) {
+                collectConstants(nodes, n.right);
+            }
+        }
+    }
+
+    /**
+     * @brief Генерирует байт-код для поддерева
+     * @return Регистр, в котором окажется значение поддерева
+     *
+     * Временные регистры освобождаются сразу после использования,
+     * поэтому их число равно глубине вложенности, а не размеру выражения.
+     */
+    uint16_t emit(const std::vector<Node>& nodes, int node, std::vector<uint16_t>& freeTemps) {
+        const Node& n = nodes[node];
+        const size_t firstTemp = variableNames.size() + constants.size();
+        if (n.kind == Node::Variable) {
+            return static_cast<uint16_t>(n.variable);
+        }
+        if (n.kind == Node::Constant) {
+            size_t k = 0;
+            while (std::memcmp(&constants[k], &n.value, sizeof(Complex)) != 0) {
+                ++k;
+            }
+            return static_cast<uint16_t>(variableNames.size() + k);
+        }
+
+        uint16_t a = emit(nodes, n.left, freeTemps);
+        uint16_t b = n.right >= 0 ? emit(nodes, n.right, freeTemps) : a;
+        if (n.right >= 0 && b >= firstTemp) {
+            freeTemps.push_back(b);
+        }
+        if (a >= firstTemp) {
+            freeTemps.push_back(a);
+        }
+        uint16_t dst;
+        if (!freeTemps.empty()) {
+            dst = freeTemps.back();
+            freeTemps.pop_back();
+        } else {
+            if (registerTotal >= 0xFFFF) {
+                throw std::invalid_argument("Выражение слишком сложное");
+            }
+            dst = static_cast<uint16_t>(registerTotal++);
+        }
+        code.push_back(Instruction{n.op, dst, a, b});
+        return dst;
+    }
+
+public:
+    /**
+     * @brief Компилирует выражение
+     * @param text Текст выражения
+     * @param variables Имена переменных в порядке привязки; если список пуст,
+     *        переменные нумеруются в порядке первого появления в тексте
+     * @throw std::invalid_argument При синтаксической ошибке
+     */
+    explicit ComplexExpression(const std::string& text, const std::vector<std::string>& variables = {})
+        : variableNames(variables), registerTotal(0), resultRegister(0) {
+        std::vector<Node> nodes;
+        Parser parser(text, nodes, variableNames, !variables.empty());
+        int root = parser.parse();
+        collectConstants(nodes, root);
+        registerTotal = variableNames.size() + constants.size();
+        std::vector<uint16_t> freeTemps;
+        resultRegister = emit(nodes, root, freeTemps);
+    }
+
+    /**
+     * @brief Имена переменных
+     * @return Имена в порядке привязки значений
+     */
+    const std::vector<std::string>& variables() const { return variableNames; }
+
+    /**
+     * @brief Байт-код программы
+     * @return Последовательность инструкций
+     */
+    const std::vector<Instruction>& instructions() const { return code; }
+
+    /**
+     * @brief Количество временных регистров
+     * @return Сколько элементов нужно в буфере для evaluate()
+     */
+    size_t scratchSize() const { return registerTotal - variableNames.size() - constants.size(); }
+
+    /**
+     * @brief Вычисляет выражение
+     * @param bindings Значения переменных в порядке variables()
+     * @param scratch Буфер временных регистров размером не меньше scratchSize()
+     * @return Значение выражения
+     * @throw std::runtime_error При делении на ноль
+     *
+     * Не выделяет память: буфер регистров предоставляет вызывающий код.
+     */
+    Complex evaluate(const Complex* bindings, Complex* scratch) const {
+        const size_t variableCount = variableNames.size();
+        const size_t firstTemp = variableCount + constants.size();
+        auto load = [&](uint16_t reg) -> const Complex& {
+            if (reg < variableCount) {
+                return bindings[reg];
+            }
+            if (reg < firstTemp) {
+                return constants[reg - variableCount];
+            }
+            return scratch[reg - firstTemp];
+        };
+        for (const Instruction& instruction : code) {
+            scratch[instruction.dst - firstTemp] = applyOperation(instruction.op, load(instruction.a), load(instruction.b));
+        }
+        return load(resultRegister);
+    }
+
+    /**
+     * @brief Вычисляет выражение (удобная форма)
+     * @param bindings Значения переменных в порядке variables()
+     * @return Значение выражения
+     * @throw std::invalid_argument Если значений меньше, чем переменных
+     * @throw std::runtime_error При делении на ноль
+     */
+    Complex evaluate(const std::vector<Complex>& bindings) const {
+        if (bindings.size() < variableNames.size()) {
+            throw std::invalid_argument("Не заданы значения всех переменных");
+        }
+        std::vector<Complex> scratch(scratchSize());
+        return evaluate(bindings.data(), scratch.data());
+    }
+
+    /**
+     * @brief Вычисляет выражение для массивов значений переменных
+     * @param inputs Массивы значений переменных в порядке variables()
+     * @param out Результаты (размер подгоняется под входные массивы)
+     * @throw std::invalid_argument Если массивов меньше, чем переменных,
+     *        или их размеры различаются
+     * @throw std::runtime_error При делении на ноль (результаты остальных
+     *        элементов в этом случае не определены)
+     *
+     * Программа выполняется поинструкционно над блоками по 256 элементов
+     * векторными ядрами ComplexArray (трансцендентные функции - поэлементно на
+ * уровне Precise, как в evaluate()). Память выделяется один раз на весь вызов.
+     * Если переменных нет, вычисляется out.size() копий значения.
+     */
+    void evaluateBatch(const std::vector<const ComplexArray*>& inputs, ComplexArray& out) const {
+        const size_t variableCount = variableNames.size();
+        if (inputs.size() < variableCount) {
+            throw std::invalid_argument("Не заданы значения всех переменных");
+        }
+        const size_t n = variableCount == 0 ? out.size() : inputs[0]->size();
+        for (size_t v = 0; v < variableCount; ++v) {
+            if (inputs[v]->size() != n) {
+                throw std::invalid_argument("Размеры массивов не совпадают");
+            }
+        }
+        if (out.size() != n) {
+            out = ComplexArray(n);
+        }
+
+        const size_t block = 256;
+        const size_t firstTemp = variableCount + constants.size();
+        std::vector<double> storage(2 * (registerTotal - variableCount) * block);
+        std::vector<double*> re(registerTotal), im(registerTotal);
+        for (size_t reg = variableCount; reg < registerTotal; ++reg) {
+            re[reg] = storage.data() + 2 * (reg - variableCount) * block;
+            im[reg] = re[reg] + block;
+            if (reg < firstTemp) {
+                std::fill(re[reg], re[reg] + block, constants[reg - variableCount].getReal());
+                std::fill(im[reg], im[reg] + block, constants[reg - variableCount].getImag());
+            }
+        }
+
+        const ComplexKernels& k = activeKernels();
+        for (size_t base = 0; base < n; base += block) {
+            const size_t m = std::min(block, n - base);
+            for (size_t v = 0; v < variableCount; ++v) {
+                re[v] = const_cast<double*>(inputs[v]->real()) + base;  // Только для чтения
+                im[v] = const_cast<double*>(inputs[v]->imag()) + base;
+            }
+            for (const Instruction& in : code) {
+                double* dr = re[in.dst];
+                double* di = im[in.dst];
+                const double* ar = re[in.a];
+                const double* ai = im[in.a];
+                switch (in.op) {
+                    case OpCode::Add:      k.add(ar, ai, re[in.b], im[in.b], dr, di, m); break;
+                    case OpCode::Subtract: k.subtract(ar, ai, re[in.b], im[in.b], dr, di, m); break;
+                    case OpCode::Multiply: k.multiply(ar, ai, re[in.b], im[in.b], dr, di, m); break;
+                    case OpCode::Divide:
+                        if (k.divide(ar, ai, re[in.b], im[in.b], dr, di, m)) {
+                            throw std::runtime_error("Деление на ноль!");
+                        }
+                        break;
+                    case OpCode::Negate:   k.negate(ar, ai, dr, di, m); break;
+                    case OpCode::Modulus:
+                        k.modulus(ar, ai, dr, m);
+                        std::fill(di, di + m, 0.0);
+                        break;
+                    case OpCode::Increment:
+                    case OpCode::Decrement: {
+                        const double step = in.op == OpCode::Increment ? 1.0 : -1.0;
+                        for (size_t j = 0; j < m; ++j) {
+                            dr[j] = ar[j] + step;
+                            di[j] = ai[j];
+                        }
+                        break;
+                    }
+                    case OpCode::Exp:
+                        transcendental::preciseLoop<transcendental::Exp>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::Log:
+                        transcendental::preciseLoop<transcendental::Log>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::Sqrt:
+                        transcendental::preciseLoop<transcendental::Sqrt>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::Sin:
+                        transcendental::preciseLoop<transcendental::Sin>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::Cos:
+                        transcendental::preciseLoop<transcendental::Cos>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::ToPolar:
+                        transcendental::preciseLoop<transcendental::ToPolar>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::FromPolar:
+                        transcendental::preciseLoop<transcendental::FromPolar>(ar, ai, dr, di, m);
+                        break;
+                    case OpCode::Pow:
+                        transcendental::preciseBinaryLoop<transcendental::Pow>(ar, ai, re[in.b], im[in.b], dr, di, m);
+                        break;
+                    case OpCode::Arg:
+                        transcendental::preciseLoop<transcendental::Arg>(ar, ai, dr, nullptr, m);
+                        std::fill(di, di + m, 0.0);
+                        break;
+                    case OpCode::Compare:
+                        throw std::logic_error("Сравнение не поддерживается в выражениях");
+                    case OpCode::Custom:
+                        throw std::logic_error("Операция вне меню не поддерживается в выражениях");
+                }
+            }
+            std::memcpy(out.real() + base, re[resultRegister], m * sizeof(double));
+            std::memcpy(out.imag() + base, im[resultRegister], m * sizeof(double));
+        }
+    }
+};
+
+/**
+ * @class FftPlan
+ * @brief План быстрого преобразования Фурье заданного размера
+ *
+ * Для размеров вида 2^a·3^b·5^c преобразование выполняется схемой Стокхэма
+ * (прореживание по частоте) со ступенями по основаниям 4, 2, 3 и 5; для
+ * остальных размеров - алгоритмом Блюстейна через свертку размера 2^k.
+ * Поворотные множители вычисляются один раз при создании плана, а планы
+ * кэшируются по размеру (FftPlan::get()), так что повторные преобразования
+ * того же размера ничего не пересчитывают.
+ *
+ * Данные хранятся в формате SoA (как в ComplexArray) и преобразуются на
+ * месте; рабочий буфер берется из потоколокальной памяти и переиспользуется.
+ * План не изменяется после создания, поэтому одним планом можно пользоваться
+ * из нескольких потоков одновременно.
+ *
+ * Прямое преобразование: X[k] = Σ x[t]·exp(-2πi·t·k/n),
+ * обратное нормировано на 1/n.
+ */
+class FftPlan {
+private:
+    /**
+     * @struct Stage
+     * @brief Ступень схемы Стокхэма
+     */
+    struct Stage {
+        size_t radix;               ///< Основание ступени
+        size_t length;              ///< Длина подпреобразования на этой ступени
+        size_t stride;              ///< Шаг между независимыми подпреобразованиями
+        std::vector<double> twRe;   ///< Поворотные множители w^(j·k), k = 1..radix-1
+        std::vector<double> twIm;
+    };
+
+    size_t n;                               ///< Размер преобразования
+    std::vector<Stage> stages;              ///< Ступени (пусто для Блюстейна и n = 1)
+
+    // Алгоритм Блюстейна
+    std::shared_ptr<const FftPlan> convolution; ///< План свертки размера 2^k
+    std::vector<double> chirpRe, chirpIm;       ///< exp(-iπk²/n)
+    std::vector<double> kernelRe, kernelIm;     ///< БПФ сопряженного чирпа, деленное на размер свертки
+
+    // Вещественный вход (четное n)
+    std::vector<double> realTwRe, realTwIm;     ///< exp(-2πik/n), k = 0..n/2
+
+    /**
+     * @brief Раскладывает n на множители 4, 2, 3, 5
+     * @return Основания ступеней или пустой вектор, если есть другие простые множители
+     */
+    static std::vector<size_t> factorize(size_t value) {
+        std::vector<size_t> radices;
+        while (value % 4 == 0) { radices.push_back(4); value /= 4; }
+        while (value % 2 == 0) { radices.push_back(2); value /= 2; }
+        while (value % 3 == 0) { radices.push_back(3); value /= 3; }
+        while (value % 5 == 0) { radices.push_back(5); value /= 5; }
+        if (value != 1) {
+            radices.clear();
+        }
+        return radices;
+    }
+
+    /**
+     * @brief Потоколокальный рабочий буфер
+     * @param slot Номер буфера (разные уровни вложенности берут разные буферы)
+     * @param size Требуемое количество double
+     */
+    static double* scratch(int slot, size_t size) {
+        thread_local std::vector<double> buffers[2];
+        std::vector<double>& buffer = buffers[slot];
+        if (buffer.size() < size) {
+            buffer.resize(size);
+        }
+        return buffer.data();
+    }
+
+    /**
+     * @brief Одна ступень Стокхэма: из (xr, xi) в (yr, yi)
+     */
+    static void runStage(const Stage& stage, const double* xr, const double* xi, double* yr, double* yi) {
+        const size_t p = stage.radix;
+        const size_t m = stage.length / p;
+        const size_t s = stage.stride;
+        const double* twr = stage.twRe.data();
+        const double* twi = stage.twIm.data();
+
+        for (size_t j = 0; j < m; ++j) {
+            const double* wr = twr + j * (p - 1);
+            const double* wi = twi + j * (p - 1);
+            for (size_t q = 0; q < s; ++q) {
+                double ar[5], ai[5], br[5], bi[5];
+                for (size_t t = 0; t < p; ++t) {
+                    ar[t] = xr[q + s * (j + t * m)];
+                    ai[t] = xi[q + s * (j + t * m)];
+                }
+                butterfly(p, ar, ai, br, bi);
+                const size_t out = q + s * p * j;
+                yr[out] = br[0];
+                yi[out] = bi[0];
+                for (size_t k = 1; k < p; ++k) {
+                    yr[out + s * k] = br[k] * wr[k - 1] - bi[k] * wi[k - 1];
+                    yi[out + s * k] = br[k] * wi[k - 1] + bi[k] * wr[k - 1];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Прямое ДПФ малого размера (2, 3, 4 или 5)
+     */
+    static void butterfly(size_t p, const double* ar, const double* ai, double* br, double* bi) {
+        switch (p) {
+            case 2:
+                br[0] = ar[0] + ar[1]; bi[0] = ai[0] + ai[1];
+                br[1] = ar[0] - ar[1]; bi[1] = ai[0] - ai[1];
+                break;
+            case 3: {
+                const double sin60 = 0.86602540378443864676;
+                double t1r = ar[1] + ar[2], t1i = ai[1] + ai[2];
+                double t2r = ar[1] - ar[2], t2i = ai[1] - ai[2];
+                double ur = ar[0] - 0.5 * t1r, ui = ai[0] - 0.5 * t1i;
+                br[0] = ar[0] + t1r; bi[0] = ai[0] + t1i;
+                br[1] = ur + sin60 * t2i; bi[1] = ui - sin60 * t2r;
+                br[2] = ur - sin60 * t2i; bi[2] = ui + sin60 * t2r;
+                break;
+            }
+            case 4: {
+                double s02r = ar[0] + ar[2], s02i = ai[0] + ai[2];
+                double d02r = ar[0] - ar[2], d02i = ai[0] - ai[2];
+                double s13r = ar[1] + ar[3], s13i = ai[1] + ai[3];
+                double d13r = ar[1] - ar[3], d13i = ai[1] - ai[3];
+                br[0] = s02r + s13r; bi[0] = s02i + s13i;
+                br[1] = d02r + d13i; bi[1] = d02i - d13r;
+                br[2] = s02r - s13r; bi[2] = s02i - s13i;
+                br[3] = d02r - d13i; bi[3] = d02i + d13r;
+                break;
+            }
+            case 5: {
+                const double c1 = 0.30901699437494742410, c2 = -0.80901699437494742410;
+                const double s1 = 0.95105651629515357212, s2 = 0.58778525229247312917;
+                double t1r = ar[1] + ar[4], t1i = ai[1] + ai[4];
+                double t2r = ar[2] + ar[3], t2i = ai[2] + ai[3];
+                double t3r = ar[1] - ar[4], t3i = ai[1] - ai[4];
+                double t4r = ar[2] - ar[3], t4i = ai[2] - ai[3];
+                double u1r = ar[0] + c1 * t1r + c2 * t2r, u1i = ai[0] + c1 * t1i + c2 * t2i;
+                double u2r = ar[0] + c2 * t1r + c1 * t2r, u2i = ai[0] + c2 * t1i + c1 * t2i;
+                double v1r = s1 * t3r + s2 * t4r, v1i = s1 * t3i + s2 * t4i;
+                double v2r = s2 * t3r - s1 * t4r, v2i = s2 * t3i - s1 * t4i;
+                br[0] = ar[0] + t1r + t2r; bi[0] = ai[0] + t1i + t2i;
+                br[1] = u1r + v1i; bi[1] = u1i - v1r;
+                br[4] = u1r - v1i; bi[4] = u1i + v1r;
+                br[2] = u2r + v2i; bi[2] = u2i - v2r;
+                br[3] = u2r - v2i; bi[3] = u2i + v2r;
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Прямое преобразование схемой Стокхэма на месте
+     */
+    void runStockham(double* re, double* im) const {
+        double* work = scratch(0, 2 * n);
+        double* xr = re;
+        double* xi = im;
+        double* yr = work;
+        double* yi = work + n;
+        for (const Stage& stage : stages) {
+            runStage(stage, xr, xi, yr, yi);
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+        }
+        if (xr != re) {
+            std::memcpy(re, xr, n * sizeof(double));
+            std::memcpy(im, xi, n * sizeof(double));
+        }
+    }
+
+    /**
+     * @brief Прямое преобразование алгоритмом Блюстейна на месте
+     */
+    void runBluestein(double* re, double* im) const {
+        const size_t m = convolution->size();
+        double* ar = scratch(1, 2 * m);
+        double* ai = ar + m;
+        for (size_t k = 0; k < n; ++k) {
+            ar[k] = re[k] * chirpRe[k] - im[k] * chirpIm[k];
+            ai[k] = re[k] * chirpIm[k] + im[k] * chirpRe[k];
+        }
+        std::fill(ar + n, ar + m, 0.0);
+        std::fill(ai + n, ai + m, 0.0);
+
+        convolution->runStockham(ar, ai);
+        // Свертка: умножение на спектр ядра и обратное БПФ через сопряжение
+        for (size_t k = 0; k < m; ++k) {
+            double r = ar[k] * kernelRe[k] - ai[k] * kernelIm[k];
+            double i = ar[k] * kernelIm[k] + ai[k] * kernelRe[k];
+            ar[k] = r;
+            ai[k] = -i;
+        }
+        convolution->runStockham(ar, ai);
+
+        for (size_t k = 0; k < n; ++k) {
+            double cr = ar[k], ci = -ai[k];
+            re[k] = cr * chirpRe[k] - ci * chirpIm[k];
+            im[k] = cr * chirpIm[k] + ci * chirpRe[k];
+        }
+    }
+
+    /**
+     * @brief Проверяет размер массива
+     */
+    void check(const ComplexArray& data) const {
+        if (data.size() != n) {
+            throw std::invalid_argument("Размер массива не совпадает с размером плана БПФ");
+        }
+    }
+
+public:
+    /**
+     * @brief Строит план (обычно вместо этого используется get())
+     * @param size Размер преобразования
+     * @throw std::invalid_argument При size = 0
+     */
+    explicit FftPlan(size_t size) : n(size) {
+        if (n == 0) {
+            throw std::invalid_argument("Размер БПФ должен быть положительным");
+        }
+        const double pi = 3.14159265358979323846;
+        std::vector<size_t> radices = factorize(n);
+        if (!radices.empty() || n == 1) {
+            size_t length = n, stride = 1;
+            for (size_t p : radices) {
+                Stage stage;
+                stage.radix = p;
+                stage.length = length;
+                stage.stride = stride;
+                const size_t m = length / p;
+                stage.twRe.resize(m * (p - 1));
+                stage.twIm.resize(m * (p - 1));
+                for (size_t j = 0; j < m; ++j) {
+                    for (size_t k = 1; k < p; ++k) {
+                        double angle = -2 * pi * static_cast<double>(j * k) / static_cast<double>(length);
+                        stage.twRe[j * (p - 1) + k - 1] = std::cos(angle);
+                        stage.twIm[j * (p - 1) + k - 1] = std::sin(angle);
+                    }
+                }
+                stages.push_back(std::move(stage));
+                length = m;
+                stride *= p;
+            }
+        } else {
+            size_t m = 1;
+            while (m < 2 * n - 1) {
+                m <<= 1;
+            }
+            convolution = get(m);
+            chirpRe.resize(n);
+            chirpIm.resize(n);
+            for (size_t k = 0; k < n; ++k) {
+                uint64_t k2 = (static_cast<uint64_t>(k) * k) % (2 * n);  // exp периодична по k² с периодом 2n
+                double angle = -pi * static_cast<double>(k2) / static_cast<double>(n);
+                chirpRe[k] = std::cos(angle);
+                chirpIm[k] = std::sin(angle);
+            }
+            kernelRe.assign(m, 0.0);
+            kernelIm.assign(m, 0.0);
+            for (size_t k = 0; k < n; ++k) {
+                kernelRe[k] = chirpRe[k];
+                kernelIm[k] = -chirpIm[k];
+                if (k != 0) {
+                    kernelRe[m - k] = chirpRe[k];
+                    kernelIm[m - k] = -chirpIm[k];
+                }
+            }
+            convolution->runStockham(kernelRe.data(), kernelIm.data());
+            for (size_t k = 0; k < m; ++k) {
+                kernelRe[k] /= static_cast<double>(m);
+                kernelIm[k] /= static_cast<double>(m);
+            }
+        }
+        if (n % 2 == 0) {
+            realTwRe.resize(n / 2 + 1);
+            realTwIm.resize(n / 2 + 1);
+            for (size_t k = 0; k <= n / 2; ++k) {
+                double angle = -2 * pi * static_cast<double>(k) / static_cast<double>(n);
+                realTwRe[k] = std::cos(angle);
+                realTwIm[k] = std::sin(angle);
+            }
+        }
+    }
+
+    /**
+     * @brief Возвращает план из кэша, создавая его при первом запросе
+     * @param size Размер преобразования
+     * @return План (общий для всех потоков)
+     */
+    static std::shared_ptr<const FftPlan> get(size_t size) {
+        static std::mutex cacheMutex;
+        static std::map<size_t, std::shared_ptr<const FftPlan>> cache;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            auto found = cache.find(size);
+            if (found != cache.end()) {
+                return found->second;
+            }
+        }
+        // План строится без блокировки: Блюстейн сам запрашивает план свертки
+        std::shared_ptr<const FftPlan> plan = std::make_shared<const FftPlan>(size);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        return cache.emplace(size, plan).first->second;
+    }
+
+    /**
+     * @brief Размер преобразования
+     * @return n
+     */
+    size_t size() const { return n; }
+
+    /**
+     * @brief Используется ли алгоритм Блюстейна
+     * @return true если n имеет простые множители кроме 2, 3, 5
+     */
+    bool usesBluestein() const { return convolution != nullptr; }
+
+    /**
+     * @brief Прямое преобразование на месте
+     * @param re Действительные части (n элементов)
+     * @param im Мнимые части (n элементов)
+     */
+    void forward(double* re, double* im) const {
+        if (convolution) {
+            runBluestein(re, im);
+        } else {
+            runStockham(re, im);
+        }
+    }
+
+    /**
+     * @brief Обратное преобразование на месте (с нормировкой 1/n)
+     * @param re Действительные части (n элементов)
+     * @param im Мнимые части (n элементов)
+     *
+     * Выполняется как сопряжение, прямое преобразование и снова сопряжение.
+     */
+    void inverse(double* re, double* im) const {
+        for (size_t k = 0; k < n; ++k) {
+            im[k] = -im[k];
+        }
+        forward(re, im);
+        const double scale = 1.0 / static_cast<double>(n);
+        for (size_t k = 0; k < n; ++k) {
+            re[k] *= scale;
+            im[k] *= -scale;
+        }
+    }
+
+    /**
+     * @brief Прямое преобразование массива на месте
+     * @param data Массив из n элементов
+     * @throw std::invalid_argument Если размер не равен n
+     */
+    void forward(ComplexArray& data) const {
+        check(data);
+        forward(data.real(), data.imag());
+    }
+
+    /**
+     * @brief Обратное преобразование массива на месте
+     * @param data Массив из n элементов
+     * @throw std::invalid_argument Если размер не равен n
+     */
+    void inverse(ComplexArray& data) const {
+        check(data);
+        inverse(data.real(), data.imag());
+    }
+
+    /**
+     * @brief Пакет прямых преобразований
+     * @param data count подряд идущих сигналов по n элементов
+     * @param count Количество сигналов
+     * @param pool Пул потоков, по которому распределяются сигналы
+     * @throw std::invalid_argument Если размер data не равен n·count
+     */
+    void forwardBatch(ComplexArray& data, size_t count, WorkStealingPool& pool = WorkStealingPool::shared()) const {
+        transformBatch(data, count, pool, false);
+    }
+
+    /**
+     * @brief Пакет обратных преобразований
+     * @param data count подряд идущих спектров по n элементов
+     * @param count Количество спектров
+     * @param pool Пул потоков
+     * @throw std::invalid_argument Если размер data не равен n·count
+     */
+    void inverseBatch(ComplexArray& data, size_t count, WorkStealingPool& pool = WorkStealingPool::shared()) const {
+        transformBatch(data, count, pool, true);
+    }
+
+    /**
+     * @brief Преобразование вещественного сигнала
+     * @param input n вещественных отсчетов
+     * @param spectrum Первые n/2 + 1 элементов спектра (остальные сопряженно симметричны)
+     *
+     * Для четного n сигнал упаковывается в комплексный массив вдвое меньшей
+     * длины (четные отсчеты - действительная часть, нечетные - мнимая),
+     * преобразуется планом размера n/2 и затем разделяется на спектр.
+     */
+    void forwardReal(const double* input, ComplexArray& spectrum) const {
+        const size_t bins = n / 2 + 1;
+        if (spectrum.size() != bins) {
+            spectrum = ComplexArray(bins);
+        }
+        double* outRe = spectrum.real();
+        double* outIm = spectrum.imag();
+        if (n % 2 != 0) {
+            ComplexArray full(n);
+            std::memcpy(full.real(), input, n * sizeof(double));
+            forward(full.real(), full.imag());
+            std::memcpy(outRe, full.real(), bins * sizeof(double));
+            std::memcpy(outIm, full.imag(), bins * sizeof(double));
+            return;
+        }
+
+        const size_t h = n / 2;
+        ComplexArray packed(h);
+        for (size_t k = 0; k < h; ++k) {
+            packed.real()[k] = input[2 * k];
+            packed.imag()[k] = input[2 * k + 1];
+        }
+        get(h)->forward(packed.real(), packed.imag());
+        const double* zr = packed.real();
+        const double* zi = packed.imag();
+        for (size_t k = 0; k <= h; ++k) {
+            size_t a = k % h, b = (h - k) % h;
+            // E = (Z[k] + conj(Z[h-k])) / 2, O = -i·(Z[k] - conj(Z[h-k])) / 2
+            double er = 0.5 * (zr[a] + zr[b]), ei = 0.5 * (zi[a] - zi[b]);
+            double orr = 0.5 * (zi[a] + zi[b]), oi = -0.5 * (zr[a] - zr[b]);
+            outRe[k] = er + orr * realTwRe[k] - oi * realTwIm[k];
+            outIm[k] = ei + orr * realTwIm[k] + oi * realTwRe[k];
+        }
+    }
+
+    /**
+     * @brief Обратное преобразование в вещественный сигнал
+     * @param spectrum Первые n/2 + 1 элементов спектра
+     * @param output n вещественных отсчетов (с нормировкой 1/n)
+     * @throw std::invalid_argument Если в спектре не n/2 + 1 элементов
+     */
+    void inverseReal(const ComplexArray& spectrum, double* output) const {
+        const size_t bins = n / 2 + 1;
+        if (spectrum.size() != bins) {
+            throw std::invalid_argument("Ожидалось n/2 + 1 элементов спектра");
+        }
+        const double* xr = spectrum.real();
+        const double* xi = spectrum.imag();
+        if (n % 2 != 0) {
+            ComplexArray full(n);
+            for (size_t k = 0; k < n; ++k) {
+                bool mirrored = k >= bins;
+                size_t source = mirrored ? n - k : k;
+                full.real()[k] = xr[source];
+                full.imag()[k] = mirrored ? -xi[source] : xi[source];
+            }
+            inverse(full.real(), full.imag());
+            std::memcpy(output, full.real(), n * sizeof(double));
+            return;
+        }
+
+        const size_t h = n / 2;
+        ComplexArray packed(h);
+        for (size_t k = 0; k < h; ++k) {
+            // E = (X[k] + conj(X[h-k])) / 2, O = (X[k] - conj(X[h-k]))·conj(w^k) / 2, Z = E + i·O
+            double er = 0.5 * (xr[k] + xr[h - k]), ei = 0.5 * (xi[k] - xi[h - k]);
+            double dr = 0.5 * (xr[k] - xr[h - k]), di = 0.5 * (xi[k] + xi[h - k]);
+            double orr = dr * realTwRe[k] + di * realTwIm[k];
+            double oi = di * realTwRe[k] - dr * realTwIm[k];
+            packed.real()[k] = er - oi;
+            packed.imag()[k] = ei + orr;
+        }
+        get(h)->inverse(packed.real(), packed.imag());
+        for (size_t k = 0; k < h; ++k) {
+            output[2 * k] = packed.real()[k];
+            output[2 * k + 1] = packed.imag()[k];
+        }
+    }
+
+private:
+    void transformBatch(ComplexArray& data, size_t count, WorkStealingPool& pool, bool inverseTransform) const {
+        if (data.size() != n * count) {
+            throw std::invalid_argument("Размер массива не равен n * count");
+        }
+        double* re = data.real();
+        double* im = data.imag();
+        pool.parallelFor(count, [&](size_t k, size_t) {
+            if (inverseTransform) {
+                inverse(re + k * n, im + k * n);
+            } else {
+                forward(re + k * n, im + k * n);
+            }
+        });
+    }
+};
+
+/**
+ * @brief Эталонное ДПФ по определению, на операторах Complex
+ * @param x Сигнал
+ * @param inverseTransform true - обратное преобразование (с нормировкой 1/n)
+ * @return Спектр (или сигнал для обратного преобразования)
+ *
+ * Работает за O(n²) и нужно только для проверки FftPlan.
+ */
+inline std::vector<Complex> naiveDft(const std::vector<Complex>& x, bool inverseTransform = false) {
+    const double pi = 3.14159265358979323846;
+    const size_t n = x.size();
+    const double sign = inverseTransform ? 1.0 : -1.0;
+    std::vector<Complex> result(n);
+    for (size_t k = 0; k < n; ++k) {
+        Complex sum;
+        for (size_t t = 0; t < n; ++t) {
+            double angle = sign * 2 * pi * static_cast<double>((t * k) % n) / static_cast<double>(n);
+            sum = sum + x[t] * Complex(std::cos(angle), std::sin(angle));
+        }
+        result[k] = inverseTransform ? sum / Complex(static_cast<double>(n), 0) : sum;
+    }
+    return result;
+}
+
+/**
+ * @struct BasicOperationRecord
+ * @brief Запись об операции для истории вычислений
+ * 
+ * Хранит информацию об одной выполненной операции:
+ * тип операции, операнды и результат. T - точность чисел записи
+ * (см. BasicComplex<T>); Calculator::addToHistory() сохраняет запись
+ * вместе с этой точностью.
+ */
+template <class T>
+struct BasicOperationRecord {
+    std::string operation;  ///< Тип операции (+, -, *, / и т.д.)
+    BasicComplex<T> num1;   ///< Первый операнд
+    BasicComplex<T> num2;   ///< Второй операнд (может быть пустым для унарных операций)
+    BasicComplex<T> result; ///< Результат операции
+    
+    /**
+     * @brief Конструктор для бинарных операций
+     * @param op Тип операции
+     * @param n1 Первый операнд
+     * @param n2 Второй операнд
+     * @param res Результат операции
+     */
+    BasicOperationRecord(const std::string& op, const BasicComplex<T>& n1, const BasicComplex<T>& n2,
+                         const BasicComplex<T>& res)
+        : operation(op), num1(n1), num2(n2), result(res) {}
+    
+    /**
+     * @brief Конструктор для унарных операций
+     * @param op Тип операции
+     * @param n1 Операнд
+     * @param res Результат операции
+     */
+    BasicOperationRecord(const std::string& op, const BasicComplex<T>& n1, const BasicComplex<T>& res)
+        : operation(op), num1(n1), num2(), result(res) {}
+    
+    /**
+     * @brief Вывод информации об операции
+     * 
+     * Формат вывода зависит от типа операции:
+     * - Для унарных: "операция число = результат"
+     * - Для бинарных: "число1 операция число2 = результат"
+     */
+    void display() const {
+        if (num2 == BasicComplex<T>()) {
+            std::cout << operation << " " << num1 << " = " << result;
+        } else {
+            std::cout << num1 << " " << operation << " " << num2 << " = " << result;
+        }
+        std::cout << std::endl;
+    }
+};
+
+using OperationRecord = BasicOperationRecord<double>;  ///< Запись истории в двойной точности
+
+/**
+ * @brief Ищет код операции по ее обозначению в истории
+ * @param name Обозначение (как в operationName(), а также "++" и "--")
+ * @param op Найденный код (не меняется, если обозначение неизвестно)
+ * @return true если обозначение известно
+ */
+inline bool findOperation(const std::string& name, OpCode& op) {
+    for (int code = static_cast<int>(OpCode::Add); code <= static_cast<int>(OpCode::FromPolar); ++code) {
+        if (isKnownOperation(code) && name == operationName(static_cast<OpCode>(code))) {
+            op = static_cast<OpCode>(code);
+            return true;
+        }
+    }
+    if (name == "++") {
+        op = OpCode::Increment;
+        return true;
+    }
+    if (name == "--") {
+        op = OpCode::Decrement;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Определяет код операции по ее обозначению в истории
+ * @param name Обозначение (как в operationName(), а также "++" и "--")
+ * @return Код операции
+ * @throw std::invalid_argument Если обозначение неизвестно
+ */
+inline OpCode operationFromName(const std::string& name) {
+    OpCode op;
+    if (!findOperation(name, op)) {
+        throw std::invalid_argument("Неизвестная операция: " + name);
+    }
+    return op;
+}
+
+/**
+ * @class ResultCache
+ * @brief Ограниченный потокобезопасный кэш результатов дорогих операций
+ *
+ * Ключ - код операции, точность и точные битовые образы операндов (у
+ * унарных операций второй операнд не входит в ключ), так что кэш
+ * возвращает ровно то, что вернула бы applyOperation(). Кэшируются только
+ * операции из isCached(): деление, модуль и трансцендентные функции;
+ * сложение дешевле поиска в таблице. Ошибки (деление на ноль) не кэшируются.
+ *
+ * Кэш разделен на shardCount частей по старшим битам хэша, у каждой свой
+ * мьютекс, поэтому потоки редко ждут друг друга. Часть - массив из
+ * capacity / shardCount ячеек и таблица с открытой адресацией (линейное
+ * пробирование, удаление сдвигом назад) над ним. Память выделяется один
+ * раз в конструкторе. Вытеснение - CLOCK: попадание ставит ячейке бит
+ * обращения, а стрелка при вставке в полную часть снимает эти биты и
+ * освобождает первую ячейку без него.
+ */
+class ResultCache {
+public:
+    static const size_t shardCount = 16;  ///< Количество частей (степень двойки)
+
+    /**
+     * @struct Stats
+     * @brief Счетчики кэша
+     */
+    struct Stats {
+        uint64_t hits = 0;       ///< Найдено в кэше
+        uint64_t misses = 0;     ///< Вычислено заново
+        uint64_t evictions = 0;  ///< Вытеснено записей
+        size_t size = 0;         ///< Записей сейчас
+        size_t capacity = 0;     ///< Наибольшее число записей
+
+        /**
+         * @brief Доля попаданий
+         * @return hits / (hits + misses), 0 если обращений не было
+         */
+        double hitRate() const {
+            uint64_t total = hits + misses;
+            return total == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(total);
+        }
+    };
+
+private:
+    /**
+     * @struct Key
+     * @brief Битовые образы операндов, код операции и точность
+     */
+    struct Key {
+        uint64_t words[4];
+        uint8_t op;
+        uint8_t precision;
+
+        bool operator==(const Key& other) const {
+            return op == other.op && precision == other.precision &&
+                   std::memcmp(words, other.words, sizeof(words)) == 0;
+        }
+    };
+
+    /**
+     * @struct Slot
+     * @brief Ячейка кэша
+     */
+    struct Slot {
+        Key key;
+        uint64_t hash;         ///< Хэш ключа (для удаления из таблицы без пересчета)
+        Complex value;         ///< Результат
+        bool referenced = false;  ///< Бит обращения CLOCK
+    };
+
+    /**
+     * @struct Shard
+     * @brief Часть кэша под своим мьютексом (на отдельной строке кэша процессора)
+     */
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;      ///< Ячейки; стрелка CLOCK обходит их по кругу
+        std::vector<uint32_t> table;  ///< Номер ячейки + 1 (0 - пусто), размер - степень двойки
+        size_t hand = 0;              ///< Стрелка CLOCK
+        size_t size = 0;              ///< Занятых ячеек
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shardCapacity;  ///< Ячеек в одной части
+
+    static Key makeKey(Precision precision, OpCode op, const Complex& a, const Complex& b) {
+        Key key;
+        double values[4] = {a.getReal(), a.getImag(), 0.0, 0.0};
+        if (isBinaryOperation(op)) {
+            values[2] = b.getReal();
+            values[3] = b.getImag();
+        }
+        std::memcpy(key.words, values, sizeof(values));
+        key.op = static_cast<uint8_t>(op);
+        key.precision = static_cast<uint8_t>(precision);
+        return key;
+    }
+
+    /**
+     * @brief Перемешивает биты слов ключа (финализатор MurmurHash3 на каждом шаге)
+     */
+    static uint64_t hashOf(const Key& key) {
+        uint64_t h = (static_cast<uint64_t>(key.op) << 8 | key.precision) * 0x9E3779B97F4A7C15ull;
+        for (uint64_t word : key.words) {
+            h ^= word;
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDull;
+            h ^= h >> 33;
+            h *= 0xC4CEB9FE1A85EC53ull;
+            h ^= h >> 33;
+        }
+        return h;
+    }
+
+    Shard& shardOf(uint64_t hash) const { return shards[hash >> 60 & (shardCount - 1)]; }
+
+    /**
+     * @brief Позиция ключа в таблице части или пустая позиция, где он был бы
+     */
+    static size_t probe(const Shard& shard, const Key& key, uint64_t hash) {
+        const size_t mask = shard.table.size() - 1;
+        size_t position = hash & mask;
+        while (shard.table[position] != 0 && !(shard.slots[shard.table[position] - 1].key == key)) {
+            position = (position + 1) & mask;
+        }
+        return position;
+    }
+
+    /**
+     * @brief Удаляет ячейку из таблицы, сдвигая назад следующие за ней элементы цепочки
+     */
+    static void unlink(Shard& shard, size_t slot) {
+        const size_t mask = shard.table.size() - 1;
+        size_t hole = shard.slots[slot].hash & mask;
+        while (shard.table[hole] != slot + 1) {
+            hole = (hole + 1) & mask;
+        }
+        for (size_t next = (hole + 1) & mask; shard.table[next] != 0; next = (next + 1) & mask) {
+            size_t home = shard.slots[shard.table[next] - 1].hash & mask;
+            // Элемент можно перенести в дыру, если его исходная позиция не лежит между дырой и им
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                shard.table[hole] = shard.table[next];
+                hole = next;
+            }
+        }
+        shard.table[hole] = 0;
+    }
+
+public:
+    /**
+     * @brief Конструктор
+     * @param capacity Наибольшее число записей (округляется вверх до кратного shardCount)
+     */
+    explicit ResultCache(size_t capacity = 1 << 16)
+        : shards(new Shard[shardCount]), shardCapacity(std::max<size_t>(1, (capacity + shardCount - 1) / shardCount)) {
+        size_t tableSize = 1;
+        while (tableSize < 2 * shardCapacity) {
+            tableSize *= 2;
+        }
+        for (size_t s = 0; s < shardCount; ++s) {
+            shards[s].slots.resize(shardCapacity);
+            shards[s].table.assign(tableSize, 0);
+        }
+    }
+
+    /**
+     * @brief Кэшируется ли операция
+     * @param op Код операции
+     * @return true для деления, модуля и трансцендентных функций
+     */
+    static bool isCached(OpCode op) {
+        switch (op) {
+            case OpCode::Divide:
+            case OpCode::Modulus:
+            case OpCode::Exp:
+            case OpCode::Log:
+            case OpCode::Sqrt:
+            case OpCode::Sin:
+            case OpCode::Cos:
+            case OpCode::Pow:
+            case OpCode::Arg:
+            case OpCode::ToPolar:
+            case OpCode::FromPolar:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * @brief Ищет результат в кэше
+     * @param precision Точность
+     * @param op Код операции
+     * @param a Первый операнд
+     * @param b Второй операнд
+     * @param result Найденный результат
+     * @return true если результат найден
+     */
+    bool lookup(Precision precision, OpCode op, const Complex& a, const Complex& b, Complex& result) {
+        const Key key = makeKey(precision, op, a, b);
+        const uint64_t hash = hashOf(key);
+        Shard& shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t entry = shard.table[probe(shard, key, hash)];
+        if (entry == 0) {
+            ++shard.misses;
+            return false;
+        }
+        Slot& slot = shard.slots[entry - 1];
+        slot.referenced = true;
+        result = slot.value;
+        ++shard.hits;
+        return true;
+    }
+
+    /**
+     * @brief Сохраняет результат, при необходимости вытесняя другой (CLOCK)
+     * @param precision Точность
+     * @param op Код операции
+     * @param a Первый операнд
+     * @param b Второй операнд
+     * @param result Результат
+     */
+    void insert(Precision precision, OpCode op, const Complex& a, const Complex& b, const Complex& result) {
+        const Key key = makeKey(precision, op, a, b);
+        const uint64_t hash = hashOf(key);
+        Shard& shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t position = probe(shard, key, hash);
+        if (shard.table[position] != 0) {
+            shard.slots[shard.table[position] - 1].value = result;  // Другой поток успел раньше
+            return;
+        }
+        size_t victim;
+        if (shard.size < shardCapacity) {
+            victim = shard.size++;
+        } else {
+            while (shard.slots[shard.hand].referenced) {
+                shard.slots[shard.hand].referenced = false;
+                shard.hand = (shard.hand + 1) % shardCapacity;
+            }
+            victim = shard.hand;
+            shard.hand = (shard.hand + 1) % shardCapacity;
+            unlink(shard, victim);
+            ++shard.evictions;
+            position = probe(shard, key, hash);
+        }
+        Slot& slot = shard.slots[victim];
+        slot.key = key;
+        slot.hash = hash;
+        slot.value = result;
+        slot.referenced = false;
+        shard.table[position] = static_cast<uint32_t>(victim + 1);
+    }
+
+    /**
+     * @brief Результат операции: из кэша или вычисленный и сохраненный
+     * @param precision Точность
+     * @param op Код операции
+     * @param a Первый операнд
+     * @param b Второй операнд
+     * @return То же, что applyOperation(precision, op, a, b)
+     * @throw std::runtime_error При делении на ноль (ошибка не кэшируется)
+     */
+    Complex evaluate(Precision precision, OpCode op, const Complex& a, const Complex& b) {
+        if (!isCached(op)) {
+            return applyOperation(precision, op, a, b);
+        }
+        Complex result;
+        if (lookup(precision, op, a, b, result)) {
+            return result;
+        }
+        result = applyOperation(precision, op, a, b);
+        insert(precision, op, a, b, result);
+        return result;
+    }
+
+    /**
+     * @brief Удаляет все записи (счетчики сохраняются)
+     */
+    void clear() {
+        for (size_t s = 0; s < shardCount; ++s) {
+            std::lock_guard<std::mutex> lock(shards[s].mutex);
+            std::fill(shards[s].table.begin(), shards[s].table.end(), 0u);
+            shards[s].size = 0;
+            shards[s].hand = 0;
+        }
+    }
+
+    /**
+     * @brief Счетчики, сложенные по всем частям
+     * @return Попадания, промахи, вытеснения и заполненность
+     */
+    Stats stats() const {
+        Stats total;
+        total.capacity = shardCapacity * shardCount;
+        for (size_t s = 0; s < shardCount; ++s) {
+            std::lock_guard<std::mutex> lock(shards[s].mutex);
+            total.hits += shards[s].hits;
+            total.misses += shards[s].misses;
+            total.evictions += shards[s].evictions;
+            total.size += shards[s].size;
+        }
+        return total;
+    }
+};
+
+/**
+ * @class HistoryStore
+ * @brief Компактное хранилище истории операций
+ *
+ * Каждая запись занимает 51 байт: однобайтовые код операции, точность
+ * вычислений и номер обозначения, четыре double операндов и два double
+ * результата. Для сравнения, OperationRecord занимает 80 байт плюс буфер
+ * строки в куче и запас емкости вектора. Запись меньше лишь примерно в 1,6
+ * раза (без учета кучи): от прежней цели сжать историю в 4 раза пришлось
+ * отказаться, потому что результат хранится в том виде, в котором его
+ * передал вызывающий код, и не пересчитывается при чтении.
+ *
+ * Обозначение операции, которое не совпадает с operationName() (например
+ * "++" или операция вне меню с кодом OpCode::Custom), запоминается в
+ * таблице обозначений один раз, а запись хранит только его номер. Таблица
+ * вмещает maxNames обозначений и не очищается.
+ *
+ * Записи лежат в блоках по chunkSize штук. Блоки выделяются по мере
+ * заполнения и никогда не перемещаются, поэтому добавление - O(1) без
+ * копирования старых записей. При ограниченной емкости хранилище работает
+ * как кольцевой буфер: новая запись вытесняет самую старую, а память
+ * после первого заполнения больше не выделяется (кроме строки для впервые
+ * встреченного обозначения). Каждой записи присваивается
+ * порядковый номер, который не меняется при вытеснении.
+ */
+class HistoryStore {
+public:
+    static const size_t chunkSize = 1024;  ///< Количество записей в одном блоке
+    static const size_t maxNames = 255;    ///< Вместимость таблицы обозначений
+
+private:
+    /**
+     * @struct Chunk
+     * @brief Блок записей: операнды и коды операций в отдельных массивах
+     */
+    struct Chunk {
+        double operands[chunkSize * 4];  ///< re1, im1, re2, im2 для каждой записи
+        double results[chunkSize * 2];   ///< re, im результата для каждой записи
+        OpCode ops[chunkSize];           ///< Коды операций
+        Precision precisions[chunkSize]; ///< Точность вычислений
+        uint8_t nameIds[chunkSize];      ///< Номер обозначения + 1 (0 - operationName())
+    };
+
+    std::vector<std::unique_ptr<Chunk>> chunks;  ///< Выделенные блоки
+    size_t capacity;  ///< Максимум записей (0 - без ограничения)
+    size_t head;      ///< Физическая позиция самой старой записи
+    size_t count;     ///< Текущее количество записей
+    uint64_t evicted; ///< Сколько записей вытеснено или удалено с начала работы
+    ResultCache* cache = nullptr;  ///< Кэш для пересчета в setOperands() (nullptr - без кэша)
+    std::vector<std::string> names;  ///< Таблица обозначений, отличных от operationName()
+
+    /**
+     * @brief Номер обозначения для записи
+     * @param op Код операции
+     * @param name Обозначение (nullptr - operationName(op))
+     * @return 0 для operationName(op), иначе номер в таблице + 1
+     * @throw std::length_error Если таблица обозначений заполнена
+     */
+    uint8_t nameId(OpCode op, const std::string* name) {
+        if (!name || *name == operationName(op)) {
+            return 0;
+        }
+        for (size_t k = 0; k < names.size(); ++k) {
+            if (names[k] == *name) {
+                return static_cast<uint8_t>(k + 1);
+            }
+        }
+        if (names.size() == maxNames) {
+            throw std::length_error("Слишком много различных обозначений операций в истории");
+        }
+        names.push_back(*name);
+        return static_cast<uint8_t>(names.size());
+    }
+
+    /**
+     * @brief Переводит логический индекс в физическую позицию
+     * @param i Индекс записи (0 - самая старая)
+     * @return Позиция в блоках
+     */
+    size_t physical(size_t i) const {
+        size_t position = head + i;
+        if (capacity != 0 && position >= capacity) {
+            position -= capacity;
+        }
+        return position;
+    }
+
+    /**
+     * @brief Адрес операндов записи
+     * @param i Индекс записи
+     * @return Указатель на четыре double
+     */
+    const double* operandsAt(size_t i) const {
+        size_t position = physical(i);
+        return chunks[position / chunkSize]->operands + (position % chunkSize) * 4;
+    }
+
+public:
+    /**
+     * @brief Конструктор
+     * @param maxRecords Емкость кольцевого буфера (0 - без ограничения)
+     */
+    explicit HistoryStore(size_t maxRecords = 0)
+        : capacity(maxRecords), head(0), count(0), evicted(0) {
+        if (capacity != 0) {
+            chunks.reserve((capacity + chunkSize - 1) / chunkSize);
+        }
+    }
+
+    /**
+     * @brief Добавляет запись
+     * @param op Код операции
+     * @param a Первый операнд
+     * @param b Второй операнд (для унарных операций - 0)
+     * @param result Результат операции
+     * @param precision Точность, в которой вычислен результат
+     * @param name Обозначение операции, если оно отличается от operationName(op)
+     *
+     * @throw std::length_error Если новое обозначение не помещается в таблицу;
+     *        история не меняется
+     *
+     * Операнды сохраняются уже округленными до precision, результат - как есть.
+     * При заполненном кольцевом буфере самая старая запись вытесняется.
+     */
+    void append(OpCode op, const Complex& a, const Complex& b, const Complex& result,
+                Precision precision = Precision::Double, const std::string* name = nullptr) {
+        const uint8_t id = nameId(op, name);
+        if (capacity != 0 && count == capacity) {
+            head = (head + 1 == capacity) ? 0 : head + 1;
+            --count;
+            ++evicted;
+        }
+        size_t position = physical(count);
+        if (position / chunkSize == chunks.size()) {
+            chunks.push_back(std::unique_ptr<Chunk>(new Chunk));
+        }
+        Chunk& chunk = *chunks[position / chunkSize];
+        double* operands = chunk.operands + (position % chunkSize) * 4;
+        Complex first = roundToPrecision(precision, a);
+        Complex second = roundToPrecision(precision, b);
+        operands[0] = first.getReal();
+        operands[1] = first.getImag();
+        operands[2] = second.getReal();
+        operands[3] = second.getImag();
+        chunk.results[(position % chunkSize) * 2] = result.getReal();
+        chunk.results[(position % chunkSize) * 2 + 1] = result.getImag();
+        chunk.ops[position % chunkSize] = op;
+        chunk.precisions[position % chunkSize] = precision;
+        chunk.nameIds[position % chunkSize] = id;
+        ++count;
+    }
+
+    /**
+     * @brief Заменяет операнды записи
+     * @param i Индекс записи (0 - самая старая)
+     * @param a Первый операнд
+     * @param b Второй операнд (для унарных операций - 0)
+     * @throw std::runtime_error Если делитель записи становится нулем; запись не меняется
+     * @throw std::invalid_argument Для операции OpCode::Custom: ее нельзя пересчитать
+     *
+     * Операнды, как и в append(), округляются до точности записи, а результат
+     * вычисляется заново (через кэш, если он подключен).
+     */
+    void setOperands(size_t i, const Complex& a, const Complex& b) {
+        const Precision recordPrecision = precision(i);
+        const OpCode op = opcode(i);
+        if (op == OpCode::Divide && isZeroDivisor(recordPrecision, b)) {
+            throw std::runtime_error("Деление на ноль!");
+        }
+        Complex first = roundToPrecision(recordPrecision, a);
+        Complex second = roundToPrecision(recordPrecision, b);
+        Complex value = cache ? cache->evaluate(recordPrecision, op, first, second)
+                              : applyOperation(recordPrecision, op, first, second);
+        size_t position = physical(i);
+        Chunk& chunk = *chunks[position / chunkSize];
+        double* operands = chunk.operands + (position % chunkSize) * 4;
+        operands[0] = first.getReal();
+        operands[1] = first.getImag();
+        operands[2] = second.getReal();
+        operands[3] = second.getImag();
+        chunk.results[(position % chunkSize) * 2] = value.getReal();
+        chunk.results[(position % chunkSize) * 2 + 1] = value.getImag();
+    }
+
+    /**
+     * @brief Удаляет все записи
+     *
+     * Выделенные блоки сохраняются и переиспользуются последующими записями.
+     */
+    void clear() {
+        evicted += count;
+        head = 0;
+        count = 0;
+    }
+
+    /**
+     * @brief Количество записей
+     * @return Размер истории
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Проверяет, пуста ли история
+     * @return true если записей нет
+     */
+    bool empty() const { return count == 0; }
+
+    /**
+     * @brief Емкость кольцевого буфера
+     * @return Максимум записей (0 - без ограничения)
+     */
+    size_t maxRecords() const { return capacity; }
+
+    /**
+     * @brief Порядковый номер самой старой записи
+     * @return Номер, начиная с 0 для первой записи за время работы
+     */
+    uint64_t firstSequence() const { return evicted; }
+
+    /**
+     * @brief Код операции записи
+     * @param i Индекс записи (0 - самая старая)
+     * @return Код операции
+     */
+    OpCode opcode(size_t i) const {
+        size_t position = physical(i);
+        return chunks[position / chunkSize]->ops[position % chunkSize];
+    }
+
+    /**
+     * @brief Точность, в которой вычисляется результат записи
+     * @param i Индекс записи
+     * @return Точность
+     */
+    Precision precision(size_t i) const {
+        size_t position = physical(i);
+        return chunks[position / chunkSize]->precisions[position % chunkSize];
+    }
+
+    /**
+     * @brief Первый операнд записи
+     * @param i Индекс записи
+     * @return Операнд
+     */
+    Complex first(size_t i) const {
+        const double* operands = operandsAt(i);
+        return Complex(operands[0], operands[1]);
+    }
+
+    /**
+     * @brief Второй операнд записи
+     * @param i Индекс записи
+     * @return Операнд (0 для унарных операций)
+     */
+    Complex second(size_t i) const {
+        const double* operands = operandsAt(i);
+        return Complex(operands[2], operands[3]);
+    }
+
+    /**
+     * @brief Результат операции записи
+     * @param i Индекс записи
+     * @return Сохраненный результат
+     */
+    Complex result(size_t i) const {
+        size_t position = physical(i);
+        const double* value = chunks[position / chunkSize]->results + (position % chunkSize) * 2;
+        return Complex(value[0], value[1]);
+    }
+
+    /**
+     * @brief Обозначение операции записи
+     * @param i Индекс записи
+     * @return Обозначение, переданное при добавлении, или operationName()
+     */
+    const char* name(size_t i) const {
+        size_t position = physical(i);
+        const uint8_t id = chunks[position / chunkSize]->nameIds[position % chunkSize];
+        return id == 0 ? operationName(opcode(i)) : names[id - 1].c_str();
+    }
+
+    /**
+     * @brief Подключает кэш, через который setOperands() пересчитывает результаты
+     * @param resultCache Кэш (nullptr - вычислять каждый раз); должен жить дольше хранилища
+     */
+    void setResultCache(ResultCache* resultCache) { cache = resultCache; }
+
+    /**
+     * @brief Восстанавливает полную запись для вывода
+     * @param i Индекс записи
+     * @return Запись в формате OperationRecord
+     */
+    OperationRecord record(size_t i) const {
+        return OperationRecord(name(i), first(i), second(i), result(i));
+    }
+
+    /**
+     * @brief Объем памяти, занятой блоками записей
+     * @return Количество байт
+     */
+    size_t memoryUsage() const {
+        return chunks.size() * sizeof(Chunk);
+    }
+};
+
+/**
+ * @struct HistoryQuery
+ * @brief Условия отбора записей истории и параметры страницы
+ *
+ * Все условия объединяются по "и". Записи возвращаются в порядке
+ * порядковых номеров; следующая страница запрашивается с cursor,
+ * равным HistoryPage::nextCursor предыдущей.
+ */
+struct HistoryQuery {
+    uint32_t opcodes = 0;                   ///< Маска операций (бит 1 << код); 0 - любые
+    double minResultModulus = 0;            ///< Нижняя граница модуля результата
+    double maxResultModulus = std::numeric_limits<double>::infinity();  ///< Верхняя граница модуля результата
+    double minOperandModulus = 0;           ///< Нижняя граница большего из модулей операндов
+    double maxOperandModulus = std::numeric_limits<double>::infinity(); ///< Верхняя граница большего из модулей операндов
+    uint64_t firstSequence = 0;             ///< Наименьший порядковый номер (включительно)
+    uint64_t lastSequence = std::numeric_limits<uint64_t>::max();  ///< Наибольший номер (включительно)
+    uint64_t cursor = 0;                    ///< Начать с записи с номером не меньше cursor
+    size_t limit = 100;                     ///< Размер страницы
+
+    /**
+     * @brief Добавляет операцию в маску
+     * @param op Код операции
+     * @return Ссылка на запрос
+     */
+    HistoryQuery& withOperation(OpCode op) {
+        opcodes |= 1u << static_cast<unsigned>(op);
+        return *this;
+    }
+
+    /**
+     * @brief Ограничен ли модуль результата
+     * @return true если задана хотя бы одна граница
+     */
+    bool filtersResult() const {
+        return minResultModulus > 0 || maxResultModulus != std::numeric_limits<double>::infinity();
+    }
+
+    /**
+     * @brief Ограничены ли модули операндов
+     * @return true если задана хотя бы одна граница
+     */
+    bool filtersOperands() const {
+        return minOperandModulus > 0 || maxOperandModulus != std::numeric_limits<double>::infinity();
+    }
+};
+
+/**
+ * @struct HistoryPage
+ * @brief Страница результатов запроса к истории
+ */
+struct HistoryPage {
+    std::vector<uint64_t> sequences;  ///< Порядковые номера найденных записей (по возрастанию)
+    uint64_t nextCursor = 0;          ///< cursor для следующей страницы
+    bool hasMore = false;             ///< Есть ли еще записи после этой страницы
+};
+
+/**
+ * @class HistoryIndex
+ * @brief Вторичные индексы истории: списки записей по операциям и индекс по модулю результата
+ *
+ * Списки по операциям - порядковые номера в порядке добавления, поэтому
+ * они всегда отсортированы, а вытесненные записи снимаются с начала.
+ * Индекс по модулю - отсортированный массив пар (модуль, номер) и буфер
+ * новых пар, который вливается в массив перед поиском; вытесненные пары
+ * отбрасываются при поиске и вычищаются, когда их становится больше половины.
+ * Вместе индексы занимают около 24 байт на запись.
+ */
+class HistoryIndex {
+public:
+    /**
+     * @struct Entry
+     * @brief Элемент индекса по модулю результата
+     */
+    struct Entry {
+        double modulus;     ///< Модуль результата
+        uint64_t sequence;  ///< Порядковый номер записи
+
+        bool operator<(const Entry& other) const {
+            return modulus < other.modulus || (modulus == other.modulus && sequence < other.sequence);
+        }
+    };
+
+private:
+    static const size_t opcodeSlots = 32;
+
+    std::deque<uint64_t> postings[opcodeSlots];  ///< Номера записей по кодам операций
+    std::vector<Entry> sorted;                   ///< Индекс по модулю, упорядоченный
+    std::vector<Entry> pending;                  ///< Новые пары, еще не влитые в sorted
+    std::vector<Entry> removed;                  ///< Пары пересчитанных записей, еще не удаленные из sorted
+    uint64_t firstSequence = 0;                  ///< Номер самой старой живой записи
+    size_t stale = 0;                            ///< Вытесненных пар в sorted и pending
+
+    /**
+     * @brief Ключ индекса по модулю: NaN индексируется как +inf
+     */
+    static double key(double modulus) {
+        return modulus == modulus ? modulus : std::numeric_limits<double>::infinity();
+    }
+
+    void mergePending() {
+        if (!pending.empty()) {
+            std::sort(pending.begin(), pending.end());
+            size_t middle = sorted.size();
+            sorted.insert(sorted.end(), pending.begin(), pending.end());
+            std::inplace_merge(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(middle), sorted.end());
+            pending.clear();
+        }
+        if (!removed.empty()) {
+            // Один проход слиянием: каждая пара из removed удаляет одну равную ей в sorted
+            std::sort(removed.begin(), removed.end());
+            size_t r = 0, kept = 0;
+            for (size_t k = 0; k < sorted.size(); ++k) {
+                while (r < removed.size() && removed[r] < sorted[k]) {
+                    ++r;
+                }
+                if (r < removed.size() && !(sorted[k] < removed[r])) {
+                    ++r;
+                    continue;
+                }
+                sorted[kept++] = sorted[k];
+            }
+            sorted.resize(kept);
+            removed.clear();
+        }
+    }
+
+public:
+    /**
+     * @brief Добавляет запись в индексы
+     * @param sequence Порядковый номер
+     * @param op Код операции
+     * @param resultModulus Модуль результата (NaN индексируется как +inf)
+     */
+    void add(uint64_t sequence, OpCode op, double resultModulus) {
+        postings[static_cast<size_t>(op) % opcodeSlots].push_back(sequence);
+        pending.push_back(Entry{key(resultModulus), sequence});
+    }
+
+    /**
+     * @brief Переносит запись в индексе по модулю после пересчета результата
+     * @param sequence Порядковый номер
+     * @param oldModulus Прежний модуль результата
+     * @param newModulus Новый модуль результата
+     *
+     * Прежняя пара удаляется из упорядоченного массива при следующем поиске,
+     * одним проходом для всех пересчитанных записей.
+     */
+    void update(uint64_t sequence, double oldModulus, double newModulus) {
+        removed.push_back(Entry{key(oldModulus), sequence});
+        pending.push_back(Entry{key(newModulus), sequence});
+    }
+
+    /**
+     * @brief Снимает с индексов вытесненную запись
+     * @param op Код операции самой старой записи
+     * @param sequence Ее порядковый номер
+     */
+    void evict(OpCode op, uint64_t sequence) {
+        std::deque<uint64_t>& list = postings[static_cast<size_t>(op) % opcodeSlots];
+        if (!list.empty() && list.front() == sequence) {
+            list.pop_front();
+        }
+        firstSequence = sequence + 1;
+        if (++stale > (sorted.size() + pending.size()) / 2) {
+            auto dead = [&](const Entry& e) { return e.sequence < firstSequence; };
+            sorted.erase(std::remove_if(sorted.begin(), sorted.end(), dead), sorted.end());
+            pending.erase(std::remove_if(pending.begin(), pending.end(), dead), pending.end());
+            removed.erase(std::remove_if(removed.begin(), removed.end(), dead), removed.end());
+            stale = 0;
+        }
+    }
+
+    /**
+     * @brief Удаляет все записи из индексов
+     * @param nextSequence Номер, который получит следующая запись
+     */
+    void clear(uint64_t nextSequence) {
+        for (auto& list : postings) {
+            list.clear();
+        }
+        sorted.clear();
+        pending.clear();
+        removed.clear();
+        firstSequence = nextSequence;
+        stale = 0;
+    }
+
+    /**
+     * @brief Список номеров записей операции
+     * @param op Код операции
+     * @return Номера по возрастанию
+     */
+    const std::deque<uint64_t>& postingList(OpCode op) const {
+        return postings[static_cast<size_t>(op) % opcodeSlots];
+    }
+
+    /**
+     * @brief Сколько записей с номером в [first, last] у операции
+     */
+    size_t countPostings(unsigned op, uint64_t first, uint64_t last) const {
+        const std::deque<uint64_t>& list = postings[op % opcodeSlots];
+        return static_cast<size_t>(std::upper_bound(list.begin(), list.end(), last) -
+                                   std::lower_bound(list.begin(), list.end(), first));
+    }
+
+    /**
+     * @brief Диапазон индекса по модулю результата
+     * @param minModulus Нижняя граница (включительно)
+     * @param maxModulus Верхняя граница (включительно)
+     * @return Пара итераторов; могут попадаться вытесненные записи
+     */
+    std::pair<std::vector<Entry>::const_iterator, std::vector<Entry>::const_iterator>
+    modulusRange(double minModulus, double maxModulus) {
+        mergePending();
+        auto first = std::lower_bound(sorted.cbegin(), sorted.cend(), Entry{minModulus, 0});
+        auto last = std::upper_bound(first, sorted.cend(), Entry{maxModulus, std::numeric_limits<uint64_t>::max()});
+        return std::make_pair(first, last);
+    }
+
+    /**
+     * @brief Объем памяти индексов (приблизительно)
+     * @return Количество байт
+     */
+    size_t memoryUsage() const {
+        size_t total = (sorted.capacity() + pending.capacity() + removed.capacity()) * sizeof(Entry);
+        for (const auto& list : postings) {
+            total += list.size() * sizeof(uint64_t);
+        }
+        return total;
+    }
+};
+
+/**
+ * @brief Выполняет запрос к истории
+ * @param store История
+ * @param index Индексы (nullptr - только последовательный просмотр)
+ * @param query Условия и параметры страницы
+ * @return Страница результатов
+ *
+ * Запрос перебирает кандидатов по самому узкому доступному источнику:
+ * диапазону номеров, спискам выбранных операций или диапазону индекса по
+ * модулю, а остальные условия проверяет у каждого кандидата. В первых двух
+ * случаях перебор идет по возрастанию номеров и останавливается, как только
+ * набрана страница; кандидаты из индекса по модулю сначала сортируются по
+ * номеру. Без индекса модуль берется от сохраненного результата записи (см.
+ * HistoryStore::result()).
+ */
+inline HistoryPage queryHistory(const HistoryStore& store, HistoryIndex* index, const HistoryQuery& query) {
+    HistoryPage page;
+    page.nextCursor = query.cursor;
+    if (store.empty() || query.limit == 0) {
+        return page;
+    }
+    const uint64_t base = store.firstSequence();
+    const uint64_t first = std::max({query.firstSequence, query.cursor, base});
+    const uint64_t last = std::min<uint64_t>(query.lastSequence, base + store.size() - 1);
+    if (first > last) {
+        return page;
+    }
+
+    auto matches = [&](uint64_t sequence) {
+        size_t i = static_cast<size_t>(sequence - base);
+        OpCode op = store.opcode(i);
+        if (query.opcodes != 0 && !(query.opcodes & (1u << static_cast<unsigned>(op)))) {
+            return false;
+        }
+        if (query.filtersOperands()) {
+            double operand = store.first(i).modulus();
+            if (isBinaryOperation(op)) {
+                operand = std::max(operand, store.second(i).modulus());
+            }
+            if (operand < query.minOperandModulus || operand > query.maxOperandModulus) {
+                return false;
+            }
+        }
+        if (query.filtersResult()) {
+            double modulus = store.result(i).modulus();
+            if (!(modulus >= query.minResultModulus && modulus <= query.maxResultModulus)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    // Возвращает false, когда страница заполнена
+    auto take = [&](uint64_t sequence) {
+        if (page.sequences.size() == query.limit) {
+            page.hasMore = true;
+            return false;
+        }
+        page.sequences.push_back(sequence);
+        page.nextCursor = sequence + 1;
+        return true;
+    };
+
+    // Оценка числа кандидатов у каждого источника
+    enum { BySequence, ByOperation, ByModulus } plan = BySequence;
+    size_t best = static_cast<size_t>(last - first + 1);
+    if (index && query.opcodes != 0) {
+        size_t count = 0;
+        for (unsigned op = 0; op < 32; ++op) {
+            if (query.opcodes & (1u << op)) {
+                count += index->countPostings(op, first, last);
+            }
+        }
+        if (count < best) {
+            best = count;
+            plan = ByOperation;
+        }
+    }
+    if (index && query.filtersResult()) {
+        auto range = index->modulusRange(query.minResultModulus, query.maxResultModulus);
+        if (static_cast<size_t>(range.second - range.first) < best) {
+            plan = ByModulus;
+        }
+    }
+
+    if (plan == BySequence) {
+        for (uint64_t sequence = first; sequence <= last; ++sequence) {
+            if (matches(sequence) && !take(sequence)) {
+                break;
+            }
+        }
+    } else if (plan == ByOperation) {
+        // Слияние списков выбранных операций по возрастанию номеров
+        std::vector<std::pair<std::deque<uint64_t>::const_iterator, std::deque<uint64_t>::const_iterator>> lists;
+        for (unsigned op = 0; op < 32; ++op) {
+            if (query.opcodes & (1u << op)) {
+                const std::deque<uint64_t>& list = index->postingList(static_cast<OpCode>(op));
+                lists.emplace_back(std::lower_bound(list.begin(), list.end(), first), list.end());
+            }
+        }
+        for (;;) {
+            size_t next = lists.size();
+            for (size_t k = 0; k < lists.size(); ++k) {
+                if (lists[k].first != lists[k].second && *lists[k].first <= last &&
+                    (next == lists.size() || *lists[k].first < *lists[next].first)) {
+                    next = k;
+                }
+            }
+            if (next == lists.size()) {
+                break;
+            }
+            uint64_t sequence = *lists[next].first++;
+            if (matches(sequence) && !take(sequence)) {
+                break;
+            }
+        }
+    } else {
+        auto range = index->modulusRange(query.minResultModulus, query.maxResultModulus);
+        std::vector<uint64_t> candidates;
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->sequence >= first && it->sequence <= last) {
+                candidates.push_back(it->sequence);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (uint64_t sequence : candidates) {
+            if (matches(sequence) && !take(sequence)) {
+                break;
+            }
+        }
+    }
+    return page;
+}
+
+/**
+ * @struct HistoryOperand
+ * @brief Операнд операции в истории: число или результат более ранней записи
+ *
+ * Неявно создается из Complex, поэтому числа передаются как обычно, а
+ * ссылка на результат - через resultOf().
+ */
+struct HistoryOperand {
+    static const uint64_t noSource = std::numeric_limits<uint64_t>::max();  ///< Операнд - число
+
+    Complex value;               ///< Число (если source == noSource)
+    uint64_t source = noSource;  ///< Порядковый номер записи, результат которой служит операндом
+
+    HistoryOperand(const Complex& number = Complex()) : value(number) {}
+
+    /**
+     * @brief Ссылка на результат записи
+     * @param sequence Порядковый номер записи
+     * @return Операнд, связанный с этой записью
+     */
+    static HistoryOperand resultOf(uint64_t sequence) {
+        HistoryOperand operand;
+        operand.source = sequence;
+        return operand;
+    }
+};
+
+/**
+ * @class HistoryGraph
+ * @brief Граф зависимостей между записями истории и запомненные результаты
+ *
+ * Операнд записи может быть связан с результатом более ранней записи, так
+ * что ребра ведут только назад и порядок номеров - топологический. Изменение
+ * операнда помечает "грязными" запись и все, что от нее зависит (обход
+ * останавливается на уже помеченных), но ничего не пересчитывает. Результат
+ * пересчитывается при чтении: resolve() обновляет только грязных предков
+ * одной записи, settle() - все грязные записи по возрастанию номеров.
+ * Пересчет отсекается рано: если операнды записи после подстановки
+ * результатов источников побитово те же, запомненный результат остается, а
+ * apply не вызывается. Записи, источник которых вытеснен из истории, хранят
+ * его последнее значение как число.
+ *
+ * Узел занимает около 64 байт плюс список зависимых записей.
+ */
+class HistoryGraph {
+private:
+    /**
+     * @struct Node
+     * @brief Запись истории в графе
+     */
+    struct Node {
+        uint64_t sources[2];              ///< Источники операндов (HistoryOperand::noSource - число)
+        std::vector<uint64_t> dependents; ///< Записи, операнды которых ссылаются на эту
+        Complex result;                   ///< Запомненный результат
+        bool dirty = false;               ///< Результат мог устареть
+        bool edited = false;              ///< Операнд-число изменен с последнего пересчета
+        bool queued = false;              ///< Уже в очереди пересчета resolve()
+    };
+
+    std::deque<Node> nodes;           ///< Узлы записей, начиная с номера first
+    uint64_t first = 0;               ///< Номер записи nodes.front()
+    std::vector<uint64_t> dirtyList;  ///< Помеченные записи (могут быть уже пересчитаны)
+    size_t recomputed = 0;            ///< Сколько раз результат вычислялся заново
+
+    static bool sameValue(const Complex& a, const Complex& b) {
+        double x[2] = {a.getReal(), a.getImag()};
+        double y[2] = {b.getReal(), b.getImag()};
+        return std::memcmp(x, y, sizeof(x)) == 0;
+    }
+
+    Node& node(uint64_t sequence) { return nodes[static_cast<size_t>(sequence - first)]; }
+
+    /**
+     * @brief Пересчитывает одну запись, источники которой уже актуальны
+     * @throw std::runtime_error Если делитель стал нулем; запись остается грязной
+     */
+    void recompute(uint64_t sequence, HistoryStore& store, HistoryIndex* index) {
+        Node& target = node(sequence);
+        const size_t i = static_cast<size_t>(sequence - store.firstSequence());
+        const Precision recordPrecision = store.precision(i);
+        Complex operands[2] = {store.first(i), store.second(i)};
+        bool changed = target.edited;
+        for (size_t p = 0; p < 2; ++p) {
+            if (target.sources[p] != HistoryOperand::noSource && target.sources[p] >= first) {
+                Complex value = roundToPrecision(recordPrecision, node(target.sources[p]).result);
+                if (!sameValue(value, operands[p])) {
+                    operands[p] = value;
+                    changed = true;
+                }
+            }
+        }
+        if (changed) {
+            store.setOperands(i, operands[0], operands[1]);
+            Complex value = store.result(i);
+            ++recomputed;
+            if (index && !sameValue(value, target.result)) {
+                index->update(sequence, target.result.modulus(), value.modulus());
+            }
+            target.result = value;
+        }
+        target.dirty = false;
+        target.edited = false;
+    }
+
+public:
+    /**
+     * @brief Удаляет все узлы
+     * @param nextSequence Номер, который получит следующая запись
+     */
+    void clear(uint64_t nextSequence) {
+        nodes.clear();
+        dirtyList.clear();
+        first = nextSequence;
+    }
+
+    /**
+     * @brief Добавляет узел новой записи
+     * @param sequence Порядковый номер (следующий за последним узлом)
+     * @param result Результат записи
+     * @param source1 Источник первого операнда
+     * @param source2 Источник второго операнда
+     *
+     * Источники, которых уже нет в графе, не связываются.
+     */
+    void add(uint64_t sequence, const Complex& result, uint64_t source1 = HistoryOperand::noSource,
+             uint64_t source2 = HistoryOperand::noSource) {
+        nodes.emplace_back();
+        Node& added = nodes.back();
+        added.result = result;
+        uint64_t sources[2] = {source1, source2};
+        for (size_t p = 0; p < 2; ++p) {
+            added.sources[p] = HistoryOperand::noSource;
+            if (sources[p] != HistoryOperand::noSource && sources[p] >= first && sources[p] < sequence) {
+                added.sources[p] = sources[p];
+                std::vector<uint64_t>& list = node(sources[p]).dependents;
+                if (list.empty() || list.back() != sequence) {
+                    list.push_back(sequence);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Удаляет узел самой старой записи (при ее вытеснении из истории)
+     */
+    void evictFront() {
+        nodes.pop_front();
+        ++first;
+    }
+
+    /**
+     * @brief Отмечает, что операнд-число записи изменен
+     * @param sequence Порядковый номер записи
+     * @param position Номер операнда; его связь с источником снимается
+     *
+     * Запись и все зависящие от нее помечаются грязными.
+     */
+    void edit(uint64_t sequence, size_t position) {
+        Node& target = node(sequence);
+        uint64_t previous = target.sources[position];
+        target.sources[position] = HistoryOperand::noSource;
+        if (previous != HistoryOperand::noSource && previous >= first &&
+            target.sources[1 - position] != previous) {
+            std::vector<uint64_t>& list = node(previous).dependents;
+            list.erase(std::remove(list.begin(), list.end(), sequence), list.end());
+        }
+        target.edited = true;
+        std::vector<uint64_t> stack(1, sequence);
+        while (!stack.empty()) {
+            uint64_t current = stack.back();
+            stack.pop_back();
+            Node& reached = node(current);
+            if (reached.dirty) {
+                continue;
+            }
+            reached.dirty = true;
+            dirtyList.push_back(current);
+            stack.insert(stack.end(), reached.dependents.begin(), reached.dependents.end());
+        }
+        if (dirtyList.size() > 2 * nodes.size()) {
+            // Только resolve() без settle(): список копит пересчитанные записи
+            dirtyList.erase(std::remove_if(dirtyList.begin(), dirtyList.end(),
+                                           [&](uint64_t s) { return s < first || !node(s).dirty; }),
+                            dirtyList.end());
+        }
+    }
+
+    /**
+     * @brief Актуальный результат записи
+     * @param sequence Порядковый номер записи
+     * @param store История (операнды пересчитанных записей обновляются)
+     * @param index Индексы истории (nullptr - нет)
+     * @return Результат
+     * @throw std::runtime_error Если при пересчете делитель стал нулем
+     *
+     * Пересчитываются только грязные предки записи: у чистой записи чисты и
+     * все предки, потому что пометка распространяется вниз по графу.
+     */
+    Complex resolve(uint64_t sequence, HistoryStore& store, HistoryIndex* index) {
+        if (node(sequence).dirty) {
+            std::vector<uint64_t> order, stack(1, sequence);
+            while (!stack.empty()) {
+                uint64_t current = stack.back();
+                stack.pop_back();
+                Node& reached = node(current);
+                if (!reached.dirty || reached.queued) {
+                    continue;
+                }
+                reached.queued = true;
+                order.push_back(current);
+                for (uint64_t s : reached.sources) {
+                    if (s != HistoryOperand::noSource && s >= first) {
+                        stack.push_back(s);
+                    }
+                }
+            }
+            std::sort(order.begin(), order.end());
+            try {
+                for (uint64_t s : order) {
+                    recompute(s, store, index);
+                    node(s).queued = false;
+                }
+            } catch (...) {
+                for (uint64_t s : order) {
+                    node(s).queued = false;
+                }
+                throw;
+            }
+        }
+        return node(sequence).result;
+    }
+
+    /**
+     * @brief Пересчитывает все грязные записи
+     * @param store История
+     * @param index Индексы истории (nullptr - нет)
+     * @throw std::runtime_error Если при пересчете делитель стал нулем; записи
+     *        до нее уже пересчитаны, она и остальные остаются грязными
+     */
+    void settle(HistoryStore& store, HistoryIndex* index) {
+        if (dirtyList.empty()) {
+            return;
+        }
+        std::sort(dirtyList.begin(), dirtyList.end());
+        dirtyList.erase(std::unique(dirtyList.begin(), dirtyList.end()), dirtyList.end());
+        size_t done = 0;
+        try {
+            for (; done < dirtyList.size(); ++done) {
+                uint64_t sequence = dirtyList[done];
+                if (sequence >= first && node(sequence).dirty) {
+                    recompute(sequence, store, index);
+                }
+            }
+        } catch (...) {
+            dirtyList.erase(dirtyList.begin(), dirtyList.begin() + static_cast<std::ptrdiff_t>(done));
+            throw;
+        }
+        dirtyList.clear();
+    }
+
+    /**
+     * @brief Сколько раз результат вычислялся заново (для проверки ранней отсечки)
+     * @return Количество вызовов операции при пересчетах
+     */
+    size_t recomputations() const { return recomputed; }
+};
+
+#ifdef COMPLEX_HAVE_POSIX
+
+/**
+ * @struct HistoryLogRecord
+ * @brief Запись журнала истории в том виде, в каком она лежит в файле
+ *
+ * Фиксированный размер 56 байт. Результат хранится в том виде, в котором
+ * его передал вызывающий код, и при чтении не пересчитывается. Контрольная
+ * сумма покрывает код операции, точность, операнды и результат; запись с
+ * неверной суммой или недопустимым кодом считается оборванной и вместе со
+ * всем, что за ней, отбрасывается при открытии. Точность double хранится
+ * как 0 и в сумму не входит.
+ */
+struct HistoryLogRecord {
+    uint8_t op;             ///< Код операции (OpCode)
+    uint8_t precision;      ///< Точность вычислений (Precision)
+    uint8_t reserved[2];    ///< Не используется, всегда 0
+    uint32_t checksum;      ///< Контрольная сумма FNV-1a
+    double operands[4];     ///< re1, im1, re2, im2
+    double results[2];      ///< re, im результата
+
+    /**
+     * @brief Вычисляет контрольную сумму записи
+     * @return FNV-1a по коду операции, точности, операндам и результату
+     */
+    uint32_t computeChecksum() const {
+        uint32_t hash = 2166136261u;
+        hash = (hash ^ op) * 16777619u;
+        if (precision != 0) {
+            hash = (hash ^ precision) * 16777619u;
+        }
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(operands);
+        for (size_t k = 0; k < sizeof(operands); ++k) {
+            hash = (hash ^ bytes[k]) * 16777619u;
+        }
+        bytes = reinterpret_cast<const unsigned char*>(results);
+        for (size_t k = 0; k < sizeof(results); ++k) {
+            hash = (hash ^ bytes[k]) * 16777619u;
+        }
+        return hash;
+    }
+
+    /**
+     * @brief Проверяет целостность записи
+     * @return true если код операции и точность допустимы и сумма совпадает
+     */
+    bool valid() const {
+        return isKnownOperation(op) && isPrecisionSupported(static_cast<Precision>(precision)) && checksum == computeChecksum();
+    }
+
+    /**
+     * @brief Код операции
+     * @return Код операции
+     */
+    OpCode opcode() const { return static_cast<OpCode>(op); }
+
+    /**
+     * @brief Первый операнд
+     * @return Операнд
+     */
+    Complex first() const { return Complex(operands[0], operands[1]); }
+
+    /**
+     * @brief Второй операнд
+     * @return Операнд
+     */
+    Complex second() const { return Complex(operands[2], operands[3]); }
+
+    /**
+     * @brief Результат операции
+     * @return Сохраненный результат
+     */
+    Complex result() const { return Complex(results[0], results[1]); }
+};
+
+static_assert(sizeof(HistoryLogRecord) == 56, "Формат записи журнала не должен зависеть от платформы");
+
+/**
+ * @class HistoryLog
+ * @brief Постоянный журнал истории, отображенный в память (mmap)
+ *
+ * Формат файла: 64-байтовый заголовок (сигнатура, версия, размер записи),
+ * за ним записи HistoryLogRecord подряд. Журнал только дописывается.
+ * Файл растет удвоением и после закрытия обрезается до фактического размера.
+ * Каждые syncInterval записей измененные страницы асинхронно сбрасываются
+ * на диск (msync), при закрытии - синхронно.
+ *
+ * После перезапуска журнал открывается заново, и прошлые записи доступны
+ * прямо из отображенной памяти - без разбора и копирования.
+ */
+class HistoryLog {
+public:
+    static const uint32_t version = 2;          ///< Версия формата файла (2 - с результатами)
+    static const size_t headerSize = 64;        ///< Размер заголовка в байтах
+
+private:
+    /**
+     * @struct Header
+     * @brief Заголовок файла журнала
+     */
+    struct Header {
+        char magic[8];          ///< Сигнатура "CXHLOG1"
+        uint32_t version;       ///< Версия формата
+        uint32_t recordSize;    ///< sizeof(HistoryLogRecord)
+        char reserved[48];      ///< Не используется
+    };
+
+    static_assert(sizeof(Header) == headerSize, "Размер заголовка журнала");
+
+    int fd;                 ///< Дескриптор файла
+    char* mapping;          ///< Отображенная область
+    size_t mappedSize;      ///< Размер отображения (и файла) в байтах
+    size_t count;           ///< Количество целых записей
+    size_t syncedCount;     ///< Сколько записей уже отправлено в msync
+    size_t syncInterval;    ///< Через сколько записей вызывать msync
+
+    /**
+     * @brief Бросает исключение с описанием системной ошибки
+     * @param what Что не удалось сделать
+     */
+    [[noreturn]] static void fail(const std::string& what) {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    /**
+     * @brief Отображает первые size байт файла
+     * @param size Размер отображения
+     *
+     * Прежнее отображение освобождается только после успешного создания
+     * нового, поэтому при ошибке журнал остается в рабочем состоянии.
+     */
+    void map(size_t size) {
+        void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            fail("Не удалось отобразить журнал в память");
+        }
+        if (mapping) {
+            ::msync(mapping, mappedSize, MS_ASYNC);
+            ::munmap(mapping, mappedSize);
+        }
+        mapping = static_cast<char*>(address);
+        mappedSize = size;
+    }
+
+    /**
+     * @brief Увеличивает файл и отображение
+     * @param size Новый размер в байтах
+     */
+    void grow(size_t size) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            fail("Не удалось увеличить журнал");
+        }
+        map(size);
+    }
+
+    /**
+     * @brief Адрес записи в отображении
+     * @param i Индекс записи
+     * @return Указатель на запись
+     */
+    HistoryLogRecord* recordAt(size_t i) const {
+        return reinterpret_cast<HistoryLogRecord*>(mapping + headerSize) + i;
+    }
+
+public:
+    /**
+     * @brief Открывает или создает журнал
+     * @param path Путь к файлу
+     * @param syncEvery Через сколько записей выполнять асинхронный msync
+     * @throw std::runtime_error Если файл не открывается или имеет чужой формат
+     *
+     * Записи проверяются с начала до первой поврежденной; оборванный хвост
+     * (например, после аварийного завершения) отбрасывается и обнуляется
+     * до первой новой записи.
+     */
+    explicit HistoryLog(const std::string& path, size_t syncEvery = 1024)
+        : fd(-1), mapping(nullptr), mappedSize(0), count(0), syncedCount(0), syncInterval(syncEvery) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            fail("Не удалось открыть журнал " + path);
+        }
+        try {
+            struct stat info;
+            if (::fstat(fd, &info) != 0) {
+                fail("Не удалось получить размер журнала");
+            }
+            size_t fileSize = static_cast<size_t>(info.st_size);
+            if (fileSize == 0) {
+                fileSize = headerSize + 4096 * sizeof(HistoryLogRecord);
+                if (::ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+                    fail("Не удалось создать журнал");
+                }
+                map(fileSize);
+                Header* header = reinterpret_cast<Header*>(mapping);
+                std::memcpy(header->magic, "CXHLOG1", 8);
+                header->version = version;
+                header->recordSize = sizeof(HistoryLogRecord);
+                ::msync(mapping, headerSize, MS_SYNC);
+            } else {
+                if (fileSize < headerSize) {
+                    throw std::runtime_error("Файл " + path + " не является журналом истории");
+                }
+                map(fileSize);
+                const Header* header = reinterpret_cast<const Header*>(mapping);
+                if (std::memcmp(header->magic, "CXHLOG1", 8) != 0) {
+                    throw std::runtime_error("Файл " + path + " не является журналом истории");
+                }
+                if (header->version != version) {
+                    throw std::runtime_error("Неподдерживаемая версия журнала истории");
+                }
+                if (header->recordSize != sizeof(HistoryLogRecord)) {
+                    throw std::runtime_error("Файл " + path + " не является журналом истории");
+                }
+                size_t available = (fileSize - headerSize) / sizeof(HistoryLogRecord);
+                while (count < available && recordAt(count)->valid()) {
+                    ++count;
+                }
+                if (count < available) {
+                    // Без обнуления целые записи за оборванной снова стали бы
+                    // частью журнала, если новая запись тоже оборвется
+                    const off_t end = static_cast<off_t>(headerSize + count * sizeof(HistoryLogRecord));
+                    if (::ftruncate(fd, end) != 0 || ::ftruncate(fd, static_cast<off_t>(fileSize)) != 0 ||
+                        ::fsync(fd) != 0) {
+                        fail("Не удалось отбросить поврежденный хвост журнала");
+                    }
+                }
+                syncedCount = count;
+            }
+        } catch (...) {
+            if (mapping) {
+                ::munmap(mapping, mappedSize);
+            }
+            ::close(fd);
+            throw;
+        }
+    }
+
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    /**
+     * @brief Деструктор
+     *
+     * Синхронно сбрасывает журнал на диск и обрезает файл до последней записи.
+     */
+    ~HistoryLog() {
+        ::msync(mapping, mappedSize, MS_SYNC);
+        ::munmap(mapping, mappedSize);
+        if (::ftruncate(fd, static_cast<off_t>(headerSize + count * sizeof(HistoryLogRecord))) == 0) {
+            ::fsync(fd);
+        }
+        ::close(fd);
+    }
+
+    /**
+     * @brief Дописывает запись в журнал
+     * @param op Код операции
+     * @param a Первый операнд
+     * @param b Второй операнд
+     * @param result Результат операции (сохраняется как есть)
+     * @param precision Точность вычислений (операнды округляются до нее)
+     *
+     * Указатели на записи, полученные ранее, становятся недействительными,
+     * если при добавлении файл пришлось увеличить.
+     */
+    void append(OpCode op, const Complex& a, const Complex& b, const Complex& result,
+                Precision precision = Precision::Double) {
+        if (headerSize + (count + 1) * sizeof(HistoryLogRecord) > mappedSize) {
+            grow(headerSize + 2 * (mappedSize - headerSize));
+        }
+        HistoryLogRecord* record = recordAt(count);
+        Complex first = roundToPrecision(precision, a);
+        Complex second = roundToPrecision(precision, b);
+        record->op = static_cast<uint8_t>(op);
+        record->precision = static_cast<uint8_t>(precision);
+        std::memset(record->reserved, 0, sizeof(record->reserved));
+        record->operands[0] = first.getReal();
+        record->operands[1] = first.getImag();
+        record->operands[2] = second.getReal();
+        record->operands[3] = second.getImag();
+        record->results[0] = result.getReal();
+        record->results[1] = result.getImag();
+        record->checksum = record->computeChecksum();
+        ++count;
+
+        if (count - syncedCount >= syncInterval) {
+            flush(false);
+        }
+    }
+
+    /**
+     * @brief Сбрасывает еще не сброшенные записи на диск
+     * @param wait true - дождаться записи (MS_SYNC), false - асинхронно
+     */
+    void flush(bool wait = true) {
+        COMPLEX_METRICS_PHASE(LogFlush);
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t begin = (headerSize + syncedCount * sizeof(HistoryLogRecord)) / page * page;
+        size_t end = headerSize + count * sizeof(HistoryLogRecord);
+        if (end > begin) {
+            ::msync(mapping + begin, end - begin, wait ? MS_SYNC : MS_ASYNC);
+        }
+        syncedCount = count;
+    }
+
+    /**
+     * @brief Количество записей в журнале
+     * @return Размер журнала
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @brief Доступ к записи без копирования
+     * @param i Индекс записи
+     * @return Ссылка на запись в отображенной памяти
+     */
+    const HistoryLogRecord& operator[](size_t i) const { return *recordAt(i); }
+
+    /**
+     * @brief Начало последовательности записей
+     * @return Указатель на первую запись
+     */
+    const HistoryLogRecord* begin() const { return recordAt(0); }
+
+    /**
+     * @brief Конец последовательности записей
+     * @return Указатель за последней записью
+     */
+    const HistoryLogRecord* end() const { return recordAt(count); }
+};
+
+/**
+ * @enum SampleFormat
+ * @brief Формат файла с последовательностью комплексных чисел
+ */
+enum class SampleFormat {
+    Float32,  ///< Пары float (re, im) подряд, порядок байт машины
+    Float64,  ///< Пары double (re, im) подряд, порядок байт машины
+    Text      ///< По числу в строке: "a + bi" (как formatComplex() / parseComplex())
+};
+
+/**
+ * @brief Определяет формат по названию
+ * @param name "f32", "f64" или "text"
+ * @return Формат
+ * @throw std::invalid_argument Если название неизвестно
+ */
+inline SampleFormat sampleFormatFromName(const std::string& name) {
+    if (name == "f32") {
+        return SampleFormat::Float32;
+    }
+    if (name == "f64") {
+        return SampleFormat::Float64;
+    }
+    if (name == "text") {
+        return SampleFormat::Text;
+    }
+    throw std::invalid_argument("Неизвестный формат: " + name + " (ожидалось f32, f64 или text)");
+}
+
+/**
+ * @brief Размер одного числа в двоичном формате
+ * @param format Формат
+ * @return Байт на число (0 для текста)
+ */
+inline size_t sampleSize(SampleFormat format) {
+    switch (format) {
+        case SampleFormat::Float32: return 2 * sizeof(float);
+        case SampleFormat::Float64: return 2 * sizeof(double);
+        case SampleFormat::Text:    break;
+    }
+    return 0;
+}
+
+/**
+ * @class BlockPipe
+ * @brief Ограниченная очередь блоков байт между двумя потоками
+ *
+ * Блоков ровно столько, сколько задано при создании: они переходят от
+ * производителя к потребителю и обратно, поэтому память постоянна, а
+ * сторона, которая обогнала другую, ждет ее. При двух блоках это двойная
+ * буферизация: пока один блок обрабатывается, второй читается или пишется.
+ *
+ * Производитель завершает поток вызовом finish(), потребитель прерывает
+ * его вызовом cancel(). Ошибка одной стороны (исключение) передается другой
+ * и бросается из ее следующего takeFree() или takeFull().
+ */
+class BlockPipe {
+public:
+    /**
+     * @struct Block
+     * @brief Блок данных
+     */
+    struct Block {
+        std::vector<char> data;  ///< Буфер фиксированного размера
+        size_t size = 0;         ///< Заполнено байт
+    };
+
+private:
+    std::vector<Block> blocks;     ///< Все блоки
+    std::deque<Block*> free;       ///< Блоки, ждущие производителя
+    std::deque<Block*> full;       ///< Блоки, ждущие потребителя
+    bool finished = false;         ///< Производитель больше ничего не отдаст
+    bool cancelled = false;        ///< Потребитель больше ничего не возьмет
+    std::exception_ptr error;      ///< Ошибка одной из сторон
+    std::mutex mutex;
+    std::condition_variable changed;
+
+public:
+    /**
+     * @brief Конструктор
+     * @param depth Количество блоков (не меньше 1)
+     * @param blockSize Размер блока в байтах
+     */
+    BlockPipe(size_t depth, size_t blockSize) : blocks(std::max<size_t>(depth, 1)) {
+        for (Block& block : blocks) {
+            block.data.resize(blockSize);
+            free.push_back(&block);
+        }
+    }
+
+    BlockPipe(const BlockPipe&) = delete;
+    BlockPipe& operator=(const BlockPipe&) = delete;
+
+    /**
+     * @brief Размер блока
+     */
+    size_t blockSize() const { return blocks[0].data.size(); }
+
+    /**
+     * @brief Берет пустой блок (производитель)
+     * @return Блок или nullptr, если потребитель прервал поток
+     * @throw Ошибка потребителя, если он прервал поток из-за нее
+     */
+    Block* takeFree() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !free.empty() || cancelled; });
+        if (cancelled) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return nullptr;
+        }
+        Block* block = free.front();
+        free.pop_front();
+        return block;
+    }
+
+    /**
+     * @brief Отдает заполненный блок потребителю
+     */
+    void putFull(Block* block) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            full.push_back(block);
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * @brief Берет заполненный блок (потребитель)
+     * @return Блок или nullptr, если производитель завершил поток и все блоки разобраны
+     * @throw Ошибка производителя, если он завершил поток из-за нее
+     */
+    Block* takeFull() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !full.empty() || finished; });
+        if (full.empty()) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return nullptr;
+        }
+        Block* block = full.front();
+        full.pop_front();
+        return block;
+    }
+
+    /**
+     * @brief Возвращает обработанный блок производителю
+     */
+    void putFree(Block* block) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            block->size = 0;
+            free.push_back(block);
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * @brief Бросает ошибку одной из сторон, если она была
+     */
+    void rethrow() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Производитель завершает поток
+     * @param failure Ошибка, из-за которой поток завершен (nullptr - штатный конец)
+     */
+    void finish(std::exception_ptr failure = nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            if (failure && !error) {
+                error = failure;
+            }
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * @brief Потребитель прерывает поток
+     * @param failure Ошибка, из-за которой поток прерван (nullptr - данные больше не нужны)
+     */
+    void cancel(std::exception_ptr failure = nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            if (failure && !error) {
+                error = failure;
+            }
+        }
+        changed.notify_all();
+    }
+};
+
+/**
+ * @class StreamReader
+ * @brief Потоковое чтение комплексных чисел из файла с упреждением
+ *
+ * Фоновый поток читает файл большими блоками (по умолчанию 4 МиБ) через
+ * BlockPipe, пока вызывающий поток разбирает и обрабатывает предыдущий
+ * блок. Память ограничена depth блоками и разобранными числами одного
+ * блока, поэтому размер файла не ограничен объемом памяти.
+ *
+ * Двоичный формат читается без разбора: блок содержит целое число
+ * значений, а оборванное значение в конце файла считается ошибкой.
+ * В текстовом формате каждая непустая строка - одно число в виде, который
+ * принимает parseComplex() ("3", "-2i", "1.5 - 4i", "nan"); строка,
+ * разорванная границей блока, склеивается с началом следующего. Строка
+ * длиннее maxLineLength считается ошибкой, чтобы файл без переводов строк
+ * не накапливался в памяти целиком.
+ */
+class StreamReader {
+public:
+    static const size_t defaultBlockSize = 4 << 20;  ///< Размер блока чтения по умолчанию
+    static const size_t maxLineLength = 64 * 1024;   ///< Максимальная длина строки текстового формата
+
+private:
+    int fd;                 ///< Дескриптор файла
+    bool ownsFd;            ///< Закрывать ли дескриптор (не закрывается для стандартного ввода)
+    SampleFormat format;    ///< Формат файла
+    BlockPipe pipe;         ///< Блоки между фоновым потоком и читателем
+    std::thread reader;     ///< Фоновый поток чтения
+    std::string carry;      ///< Начало строки, разорванной границей блока
+    uint64_t samples = 0;   ///< Прочитано чисел
+    uint64_t lines = 0;     ///< Прочитано строк (текстовый формат)
+    bool ended = false;     ///< Файл прочитан до конца
+
+    /**
+     * @brief Тело фонового потока: заполняет блоки, пока файл не кончится
+     *
+     * Блок заполняется целиком (read() может вернуть меньше, особенно для
+     * каналов), поэтому неполным бывает только последний блок.
+     */
+    void readAhead() {
+        try {
+            for (;;) {
+                BlockPipe::Block* block = pipe.takeFree();
+                if (!block) {
+                    return;
+                }
+                const size_t capacity = block->data.size();
+                while (block->size < capacity) {
+                    ssize_t n = ::read(fd, block->data.data() + block->size, capacity - block->size);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n < 0) {
+                        throw std::runtime_error(std::string("Ошибка чтения: ") + std::strerror(errno));
+                    }
+                    if (n == 0) {
+                        break;
+                    }
+                    block->size += static_cast<size_t>(n);
+                }
+                const bool last = block->size < capacity;
+                pipe.putFull(block);
+                if (last) {
+                    pipe.finish();
+                    return;
+                }
+            }
+        } catch (...) {
+            pipe.finish(std::current_exception());
+        }
+    }
+
+    /**
+     * @brief Разбирает блок двоичных данных
+     * @param data Данные
+     * @param size Размер в байтах
+     * @param out Разобранные числа (дописываются в конец)
+     */
+    void decodeBinary(const char* data, size_t size, std::vector<Complex>& out) {
+        const size_t bytes = sampleSize(format);
+        if (size % bytes != 0) {
+            throw std::runtime_error("Оборванное число в конце файла (после " +
+                                     std::to_string(samples + size / bytes) + " чисел)");
+        }
+        const size_t n = size / bytes;
+        const size_t start = out.size();
+        out.resize(start + n);
+        Complex* values = out.data() + start;
+        if (format == SampleFormat::Float64) {
+#ifndef COMPLEX_COUNT_INSTANCES
+            // Complex - это пара double (см. static_assert выше), формат файла тот же
+            std::memcpy(static_cast<void*>(values), data, size);
+            return;
+#endif
+            for (size_t i = 0; i < n; ++i) {
+                double pair[2];
+                std::memcpy(pair, data + i * bytes, sizeof(pair));
+                values[i] = Complex(pair[0], pair[1]);
+            }
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                float pair[2];
+                std::memcpy(pair, data + i * bytes, sizeof(pair));
+                values[i] = Complex(pair[0], pair[1]);
+            }
+        }
+    }
+
+    /**
+     * @brief Разбирает одну строку текстового формата
+     * @param first Начало строки
+     * @param last Конец строки (без '\n')
+     * @param out Разобранные числа (число дописывается в конец)
+     * @throw std::runtime_error Если строка - не комплексное число
+     *
+     * Пустые строки (и строки из одних пробелов) пропускаются.
+     */
+    void decodeLine(const char* first, const char* last, std::vector<Complex>& out) {
+        ++lines;
+        auto isBlank = [](char ch) { return ch == ' ' || ch == '\t' || ch == '\r'; };
+        while (first != last && isBlank(*first)) {
+            ++first;
+        }
+        while (last != first && isBlank(last[-1])) {
+            --last;
+        }
+        if (first == last) {
+            return;
+        }
+        Complex value;
+        std::from_chars_result r = parseComplex(first, last, value);
+        if (r.ec != std::errc() || r.ptr != last) {
+            throw std::runtime_error("Строка " + std::to_string(lines) + ": ожидалось комплексное число");
+        }
+        out.push_back(value);
+    }
+
+    /**
+     * @brief Дописывает часть незавершенной строки в carry
+     * @param first Начало части
+     * @param last Конец части
+     * @throw std::runtime_error Если строка становится длиннее maxLineLength
+     */
+    void keepPartialLine(const char* first, const char* last) {
+        if (carry.size() + static_cast<size_t>(last - first) > maxLineLength) {
+            throw std::runtime_error("Строка " + std::to_string(lines + 1) + ": длиннее " +
+                                     std::to_string(maxLineLength) + " байт");
+        }
+        carry.append(first, last);
+    }
+
+    /**
+     * @brief Разбирает блок текста
+     * @param data Данные
+     * @param size Размер в байтах
+     * @param out Разобранные числа (дописываются в конец)
+     * @throw std::runtime_error Если строка - не число или длиннее maxLineLength
+     */
+    void decodeText(const char* data, size_t size, std::vector<Complex>& out) {
+        const char* end = data + size;
+        const char* newline = static_cast<const char*>(std::memchr(data, '\n', size));
+        if (!newline) {
+            keepPartialLine(data, end);
+            return;
+        }
+        const char* p = data;
+        if (!carry.empty()) {
+            keepPartialLine(data, newline);
+            decodeLine(carry.data(), carry.data() + carry.size(), out);
+            carry.clear();
+            p = newline + 1;
+        }
+        while ((newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p))))) {
+            decodeLine(p, newline, out);
+            p = newline + 1;
+        }
+        keepPartialLine(p, end);
+    }
+
+public:
+    /**
+     * @brief Открывает файл и запускает чтение с упреждением
+     * @param path Путь к файлу ("-" - стандартный ввод)
+     * @param format Формат файла
+     * @param blockSize Размер блока чтения (для двоичных форматов округляется
+     *        вниз до целого числа значений)
+     * @param depth Количество блоков (2 - двойная буферизация)
+     * @throw std::runtime_error Если файл не открывается
+     */
+    StreamReader(const std::string& path, SampleFormat format, size_t blockSize = defaultBlockSize,
+                 size_t depth = 2)
+        : fd(-1), ownsFd(path != "-"), format(format),
+          pipe(depth, format == SampleFormat::Text ? std::max<size_t>(blockSize, 1)
+                      : std::max(blockSize / sampleSize(format), size_t(1)) * sampleSize(format)) {
+        fd = ownsFd ? ::open(path.c_str(), O_RDONLY) : STDIN_FILENO;
+        if (fd < 0) {
+            throw std::runtime_error("Не удалось открыть файл " + path + ": " + std::strerror(errno));
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        try {
+            reader = std::thread(&StreamReader::readAhead, this);
+        } catch (...) {
+            if (ownsFd) {
+                ::close(fd);
+            }
+            throw;
+        }
+    }
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    /**
+     * @brief Деструктор: останавливает фоновый поток и закрывает файл
+     */
+    ~StreamReader() {
+        pipe.cancel();
+        reader.join();
+        if (ownsFd) {
+            ::close(fd);
+        }
+    }
+
+    /**
+     * @brief Читает очередную порцию чисел
+     * @param out Прочитанные числа (прежнее содержимое заменяется)
+     * @return Количество прочитанных чисел; 0 - файл кончился
+     * @throw std::runtime_error При ошибке чтения или разбора
+     *
+     * Порция - один блок файла; для текста она может оказаться пустой (блок
+     * из одной недочитанной строки), такие блоки пропускаются.
+     */
+    size_t read(std::vector<Complex>& out) {
+        out.clear();
+        while (out.empty() && !ended) {
+            BlockPipe::Block* block = pipe.takeFull();
+            if (!block) {
+                ended = true;
+                if (format == SampleFormat::Text && !carry.empty()) {
+                    decodeLine(carry.data(), carry.data() + carry.size(), out);
+                    carry.clear();
+                }
+                break;
+            }
+            try {
+                if (format == SampleFormat::Text) {
+                    decodeText(block->data.data(), block->size, out);
+                } else {
+                    decodeBinary(block->data.data(), block->size, out);
+                }
+            } catch (...) {
+                pipe.putFree(block);
+                throw;
+            }
+            pipe.putFree(block);
+        }
+        samples += out.size();
+        return out.size();
+    }
+
+    /**
+     * @brief Сколько чисел уже прочитано
+     */
+    uint64_t position() const { return samples; }
+};
+
+/**
+ * @class StreamWriter
+ * @brief Потоковая запись комплексных чисел в файл с отложенной записью
+ *
+ * Числа кодируются в блоки вызывающим потоком, а пишет их на диск фоновый
+ * поток, так что запись идет одновременно с вычислением следующих порций.
+ * Если диск не успевает, write() ждет свободного блока: память ограничена
+ * depth блоками.
+ *
+ * Текстовый формат - по числу в строке в виде formatComplex(); такой файл
+ * читается обратно StreamReader без потерь точности.
+ */
+class StreamWriter {
+public:
+    static const size_t defaultBlockSize = 4 << 20;  ///< Размер блока записи по умолчанию
+
+private:
+    int fd;                              ///< Дескриптор файла
+    bool ownsFd;                         ///< Закрывать ли дескриптор (не закрывается для стандартного вывода)
+    SampleFormat format;                 ///< Формат файла
+    BlockPipe pipe;                      ///< Блоки между писателем и фоновым потоком
+    std::thread writer;                  ///< Фоновый поток записи
+    BlockPipe::Block* current = nullptr; ///< Заполняемый блок
+    bool finished = false;               ///< Вызван finish()
+
+    /**
+     * @brief Тело фонового потока: пишет заполненные блоки по порядку
+     */
+    void writeBehind() {
+        try {
+            while (BlockPipe::Block* block = pipe.takeFull()) {
+                size_t offset = 0;
+                while (offset < block->size) {
+                    ssize_t n = ::write(fd, block->data.data() + offset, block->size - offset);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n < 0) {
+                        throw std::runtime_error(std::string("Ошибка записи: ") + std::strerror(errno));
+                    }
+                    offset += static_cast<size_t>(n);
+                }
+                pipe.putFree(block);
+            }
+        } catch (...) {
+            pipe.cancel(std::current_exception());
+        }
+    }
+
+    /**
+     * @brief Отдает текущий блок фоновому потоку и берет следующий
+     */
+    void rotate() {
+        pipe.putFull(current);
+        current = pipe.takeFree();
+        if (!current) {
+            throw std::runtime_error("Запись прервана");
+        }
+    }
+
+public:
+    /**
+     * @brief Создает (или перезаписывает) файл и запускает поток записи
+     * @param path Путь к файлу ("-" - стандартный вывод)
+     * @param format Формат файла
+     * @param blockSize Размер блока записи
+     * @param depth Количество блоков (2 - двойная буферизация)
+     * @throw std::runtime_error Если файл не создается
+     */
+    StreamWriter(const std::string& path, SampleFormat format, size_t blockSize = defaultBlockSize,
+                 size_t depth = 2)
+        : fd(-1), ownsFd(path != "-"), format(format),
+          pipe(depth, std::max(blockSize, complexTextMaxLength + 1)) {
+        fd = ownsFd ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+        if (fd < 0) {
+            throw std::runtime_error("Не удалось создать файл " + path + ": " + std::strerror(errno));
+        }
+        current = pipe.takeFree();
+        try {
+            writer = std::thread(&StreamWriter::writeBehind, this);
+        } catch (...) {
+            if (ownsFd) {
+                ::close(fd);
+            }
+            throw;
+        }
+    }
+
+    StreamWriter(const StreamWriter&) = delete;
+    StreamWriter& operator=(const StreamWriter&) = delete;
+
+    /**
+     * @brief Деструктор: если finish() не вызывался, запись прерывается
+     *
+     * Файл в этом случае может остаться неполным.
+     */
+    ~StreamWriter() {
+        if (!finished) {
+            pipe.finish();
+            writer.join();
+        }
+        if (ownsFd) {
+            ::close(fd);
+        }
+    }
+
+    /**
+     * @brief Записывает числа
+     * @param values Числа
+     * @param n Количество чисел
+     * @throw std::runtime_error Если фоновая запись завершилась ошибкой
+     */
+    void write(const Complex* values, size_t n) {
+        const size_t capacity = pipe.blockSize();
+        if (format == SampleFormat::Text) {
+            for (size_t i = 0; i < n; ++i) {
+                if (capacity - current->size < complexTextMaxLength + 1) {
+                    rotate();
+                }
+                char* first = current->data.data() + current->size;
+                std::to_chars_result r = formatComplex(first, first + complexTextMaxLength, values[i]);
+                *r.ptr = '\n';
+                current->size += static_cast<size_t>(r.ptr - first) + 1;
+            }
+            return;
+        }
+        const size_t bytes = sampleSize(format);
+#ifndef COMPLEX_COUNT_INSTANCES
+        while (format == SampleFormat::Float64 && n != 0) {
+            if (capacity - current->size < bytes) {
+                rotate();
+            }
+            const size_t count = std::min(n, (capacity - current->size) / bytes);
+            std::memcpy(current->data.data() + current->size, static_cast<const void*>(values), count * bytes);
+            current->size += count * bytes;
+            values += count;
+            n -= count;
+        }
+#endif
+        for (size_t i = 0; i < n; ++i) {
+            if (capacity - current->size < bytes) {
+                rotate();
+            }
+            char* target = current->data.data() + current->size;
+            if (format == SampleFormat::Float64) {
+                const double pair[2] = {values[i].getReal(), values[i].getImag()};
+                std::memcpy(target, pair, sizeof(pair));
+            } else {
+                const float pair[2] = {static_cast<float>(values[i].getReal()), static_cast<float>(values[i].getImag())};
+                std::memcpy(target, pair, sizeof(pair));
+            }
+            current->size += bytes;
+        }
+    }
+
+    /**
+     * @brief Дописывает остаток, дожидается фонового потока и проверяет ошибки
+     * @throw std::runtime_error Если запись не удалась
+     */
+    void finish() {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        if (current->size != 0) {
+            pipe.putFull(current);
+        }
+        pipe.finish();
+        writer.join();
+        pipe.rethrow();
+        if (ownsFd && ::close(fd) != 0) {
+            fd = -1;
+            ownsFd = false;
+            throw std::runtime_error(std::string("Ошибка записи: ") + std::strerror(errno));
+        }
+        ownsFd = false;
+    }
+};
+
+#endif // COMPLEX_HAVE_POSIX
+
+/**
+ * @class Calculator
+ * @brief Калькулятор комплексных чисел с историей операций
+ * 
+ * Предоставляет интерфейс для выполнения операций над комплексными числами
+ * и ведения истории выполненных операций.
+ */
+class Calculator {
+private:
+    // mutable: чтение истории досчитывает записи, помеченные графом зависимостей
+    mutable HistoryStore history;  ///< Хранилище истории операций
+    Precision precision;   ///< Точность вычислений
+    std::unique_ptr<HistoryIndex> historyIndex;  ///< Индексы истории (если включены)
+    std::unique_ptr<HistoryGraph> historyGraph;  ///< Граф зависимостей истории (если включен)
+    std::shared_ptr<ResultCache> resultCache;    ///< Кэш результатов (может быть общим для нескольких калькуляторов)
+#ifdef COMPLEX_HAVE_POSIX
+    std::unique_ptr<HistoryLog> historyLog;  ///< Постоянный журнал (если открыт)
+#endif
+    
+public:
+    /**
+     * @brief Конструктор
+     * @param historyCapacity Максимум записей в истории (0 - без ограничения);
+     *        при переполнении вытесняются самые старые записи
+     * @param precision Точность вычислений
+     * @throw std::invalid_argument Если точность не поддерживается
+     */
+    explicit Calculator(size_t historyCapacity = 0, Precision precision = Precision::Double)
+        : history(historyCapacity), precision(Precision::Double) {
+        setPrecision(precision);
+    }
+
+    /**
+     * @brief Выбирает точность вычислений
+     * @param value Точность
+     * @throw std::invalid_argument Если точность не поддерживается
+     *
+     * Действует на последующие операции; записи истории сохраняют ту
+     * точность, в которой были выполнены.
+     */
+    void setPrecision(Precision value) {
+        if (!isPrecisionSupported(value)) {
+            throw std::invalid_argument("Точность не поддерживается");
+        }
+        precision = value;
+    }
+
+    /**
+     * @brief Текущая точность вычислений
+     * @return Точность
+     */
+    Precision getPrecision() const { return precision; }
+
+    /**
+     * @brief Выполняет операцию в текущей точности
+     * @param op Код операции
+     * @param num1 Первый операнд
+     * @param num2 Второй операнд (для унарных операций не указывается)
+     * @return Результат
+     * @throw std::runtime_error При делении на ноль
+     *
+     * Вызов и ошибки учитываются в метриках (COMPLEX_METRICS).
+     */
+    Complex calculate(OpCode op, const Complex& num1, const Complex& num2 = Complex()) const {
+        COMPLEX_METRICS_OPERATION(op);
+        try {
+            return evaluate(precision, op, num1, num2);
+        } catch (const std::exception&) {
+            COMPLEX_METRICS_ERROR(op);
+            throw;
+        }
+    }
+
+    /**
+     * @brief Добавляет запись в историю операций
+     * @param record Запись для добавления
+     * @throw std::invalid_argument Если операция записи вне меню, а журнал
+     *        подключен: в журнал пишутся только известные коды операций
+     *
+     * Запись сохраняется как есть: операция, операнды и результат не
+     * проверяются и не пересчитываются. Операция с неизвестным обозначением
+     * хранится с кодом OpCode::Custom вместе со своим обозначением.
+     */
+    template <class T>
+    void addToHistory(const BasicOperationRecord<T>& record) {
+        OpCode op = OpCode::Custom;
+        findOperation(record.operation, op);
+#ifdef COMPLEX_HAVE_POSIX
+        if (op == OpCode::Custom && historyLog) {
+            throw std::invalid_argument("Операцию \"" + record.operation + "\" нельзя записать в журнал");
+        }
+#endif
+        appendRecord(op, complexCast<double>(record.num1), complexCast<double>(record.num2),
+                     complexCast<double>(record.result), PrecisionOf<T>::value, &record.operation);
+    }
+
+    /**
+     * @brief Добавляет запись в историю без промежуточного OperationRecord
+     * @param op Код операции
+     * @param num1 Первый операнд
+     * @param num2 Второй операнд (для унарных операций не указывается)
+     *
+     * Операция записывается в текущей точности калькулятора.
+     */
+    void addToHistory(OpCode op, const Complex& num1, const Complex& num2 = Complex()) {
+        appendRecord(op, num1, num2, evaluate(precision, op, num1, num2), precision);
+    }
+
+    /**
+     * @brief Параллельное вычисление пакета операций
+     * @param operations Операции в порядке поступления
+     * @param results Результаты (размер подгоняется под operations)
+     * @param failed Признаки ошибки (1 - операция не выполнена, например деление на ноль)
+     * @param recordHistory Записывать ли успешные операции в историю
+     * @param pool Пул потоков (по умолчанию общий пул по числу ядер)
+     * @return Количество неудачных операций
+     *
+     * Вычисления распределяются по потокам (см. evaluateOperations()), каждый
+     * поток пишет результаты своих блоков в отдельные участки массива.
+     * Затем вызывающий поток добавляет успешные операции в историю строго
+     * в исходном порядке вместе с уже вычисленными результатами, поэтому
+     * история не зависит от числа потоков и операции не вычисляются повторно.
+     */
+    size_t runParallelBatch(const std::vector<BatchOperation>& operations, std::vector<Complex>& results,
+                            std::vector<uint8_t>& failed, bool recordHistory = true,
+                            WorkStealingPool& pool = WorkStealingPool::shared()) {
+        results.resize(operations.size());
+        failed.resize(operations.size());
+        size_t failures = evaluateOperations(pool, operations.data(), operations.size(), results.data(),
+                                             failed.data(), precision);
+        if (recordHistory) {
+            for (size_t i = 0; i < operations.size(); ++i) {
+                if (!failed[i]) {
+                    const BatchOperation& operation = operations[i];
+                    appendRecord(operation.op, operation.a, isBinaryOperation(operation.op) ? operation.b : Complex(),
+                                 results[i], precision);
+                }
+            }
+        }
+        return failures;
+    }
+
+#ifdef COMPLEX_HAVE_POSIX
+    /**
+     * @brief Подключает постоянный журнал истории
+     * @param path Путь к файлу журнала (создается, если его нет)
+     * @throw std::runtime_error Если журнал не удалось открыть
+     *
+     * Все последующие операции дописываются и в журнал. Записи, сделанные
+     * прошлыми запусками, доступны через getHistoryLog().
+     */
+    void openHistoryLog(const std::string& path) {
+        historyLog.reset(new HistoryLog(path));
+    }
+
+    /**
+     * @brief Доступ к постоянному журналу
+     * @return Указатель на журнал или nullptr, если он не подключен
+     */
+    const HistoryLog* getHistoryLog() const { return historyLog.get(); }
+#endif
+
+#ifdef COMPLEX_METRICS
+    /**
+     * @brief Сводка метрик операций
+     * @return Счетчики и гистограммы, объединенные по всем потокам
+     *
+     * Метрики общие для процесса: в них входят операции всех калькуляторов
+     * и пакетные вычисления в потоках пула.
+     */
+    metrics::Snapshot getMetrics() const { return metrics::snapshot(); }
+
+    /**
+     * @brief Записывает сводку метрик в файл
+     * @param path Путь; ".json" - в формате JSON, иначе таблицей
+     * @throw std::runtime_error Если файл не удалось записать
+     */
+    void writeMetrics(const std::string& path) const { metrics::snapshot().writeFile(path); }
+#endif
+
+    /**
+     * @brief Включает или выключает индексы истории
+     * @param enabled true - построить индексы по текущей истории и обновлять их
+     *
+     * С индексами queryHistory() находит записи по операциям и по модулю
+     * результата без полного просмотра, но каждое добавление в историю
+     * дополнительно вычисляет результат и занимает около 24 байт.
+     */
+    void setHistoryIndexing(bool enabled) {
+        if (!enabled) {
+            historyIndex.reset();
+            return;
+        }
+        if (historyIndex) {
+            return;
+        }
+        settleHistory();
+        std::unique_ptr<HistoryIndex> index(new HistoryIndex);
+        index->clear(history.firstSequence());
+        for (size_t i = 0; i < history.size(); ++i) {
+            index->add(history.firstSequence() + i, history.opcode(i), history.result(i).modulus());
+        }
+        historyIndex = std::move(index);
+    }
+
+    /**
+     * @brief Включены ли индексы истории
+     * @return true если индексы обновляются
+     */
+    bool isHistoryIndexed() const { return historyIndex != nullptr; }
+
+    /**
+     * @brief Включает или выключает граф зависимостей истории
+     * @param enabled true - запоминать результаты и связи между записями
+     *
+     * Существующие записи входят в граф без связей. С графом операнд записи
+     * может ссылаться на результат более ранней записи (recordOperation()),
+     * а изменение операнда (setHistoryOperand()) пересчитывает при чтении
+     * только зависящие от него записи. Граф занимает около 64 байт на запись.
+     */
+    void setHistoryDependencies(bool enabled) {
+        if (!enabled) {
+            settleHistory();
+            historyGraph.reset();
+            return;
+        }
+        if (historyGraph) {
+            return;
+        }
+        std::unique_ptr<HistoryGraph> graph(new HistoryGraph);
+        graph->clear(history.firstSequence());
+        for (size_t i = 0; i < history.size(); ++i) {
+            graph->add(history.firstSequence() + i, history.result(i));
+        }
+        historyGraph = std::move(graph);
+    }
+
+    /**
+     * @brief Включен ли граф зависимостей истории
+     * @return true если связи между записями запоминаются
+     */
+    bool hasHistoryDependencies() const { return historyGraph != nullptr; }
+
+    /**
+     * @brief Подключает кэш результатов дорогих операций
+     * @param cache Кэш (nullptr - отключить); один кэш можно отдать нескольким
+     *        калькуляторам, в том числе в разных потоках
+     *
+     * Через кэш идут calculate(), пакетный режим и пересчет записей истории
+     * при замене операндов (см. HistoryStore::setOperands()). Ссылкой на кэш
+     * запись истории не служит: результат в ней дублируется (см.
+     * HistoryStore), потому что результат из OperationRecord не обязан
+     * совпадать с вычисленным, а кэш вытесняет старые значения.
+     * runParallelBatch() кэш не использует: его векторные ядра быстрее
+     * поиска в таблице.
+     */
+    void setResultCache(std::shared_ptr<ResultCache> cache) {
+        resultCache = std::move(cache);
+        history.setResultCache(resultCache.get());
+    }
+
+    /**
+     * @brief Подключенный кэш результатов
+     * @return Указатель на кэш или nullptr
+     */
+    ResultCache* getResultCache() const { return resultCache.get(); }
+
+    /**
+     * @brief Выполняет операцию и записывает ее в историю со связями
+     * @param op Код операции
+     * @param num1 Первый операнд: число или HistoryOperand::resultOf(номер)
+     * @param num2 Второй операнд (для унарных операций не указывается)
+     * @return Порядковый номер новой записи
+     * @throw std::out_of_range Если записи-источника нет в истории
+     * @throw std::runtime_error При делении на ноль
+     *
+     * Операция выполняется в текущей точности. Без графа зависимостей
+     * ссылки на записи просто заменяются их текущими результатами.
+     */
+    uint64_t recordOperation(OpCode op, const HistoryOperand& num1, const HistoryOperand& num2 = HistoryOperand()) {
+        const HistoryOperand* operands[2] = {&num1, &num2};
+        Complex values[2];
+        uint64_t sources[2] = {HistoryOperand::noSource, HistoryOperand::noSource};
+        const size_t count = isBinaryOperation(op) ? 2 : 1;
+        for (size_t p = 0; p < count; ++p) {
+            values[p] = operands[p]->value;
+            if (operands[p]->source != HistoryOperand::noSource) {
+                values[p] = historyResult(operands[p]->source);
+                sources[p] = operands[p]->source;
+            }
+        }
+        COMPLEX_METRICS_OPERATION(op);
+        try {
+            appendRecord(op, values[0], values[1], evaluate(precision, op, values[0], values[1]), precision,
+                         nullptr, sources[0], sources[1]);
+        } catch (const std::exception&) {
+            COMPLEX_METRICS_ERROR(op);
+            throw;
+        }
+        return history.firstSequence() + history.size() - 1;
+    }
+
+    /**
+     * @brief Заменяет операнд записи истории числом
+     * @param sequence Порядковый номер записи
+     * @param position 0 - первый, 1 - второй операнд (только у бинарных операций)
+     * @param value Новое значение; связь операнда с источником снимается
+     * @throw std::out_of_range Если записи нет или операнда с таким номером нет
+     * @throw std::runtime_error Если делитель становится нулем (запись не меняется)
+     *
+     * С графом зависимостей запись и все зависящие от нее помечаются и
+     * пересчитываются при чтении; без графа обновляется только эта запись.
+     * Постоянный журнал хранит записи в исходном виде.
+     */
+    void setHistoryOperand(uint64_t sequence, size_t position, const Complex& value) {
+        const size_t i = historyPosition(sequence);
+        if (position > 1 || (position == 1 && !isBinaryOperation(history.opcode(i)))) {
+            throw std::out_of_range("У операции нет операнда с таким номером");
+        }
+        if (historyGraph) {
+            // Операнды записи должны быть актуальны до замены одного из них
+            historyGraph->resolve(sequence, history, historyIndex.get());
+        }
+        Complex first = position == 0 ? value : history.first(i);
+        Complex second = position == 1 ? value : history.second(i);
+        const double oldModulus = historyIndex ? history.result(i).modulus() : 0;
+        history.setOperands(i, first, second);
+        if (historyGraph) {
+            historyGraph->edit(sequence, position);
+        } else if (historyIndex) {
+            historyIndex->update(sequence, oldModulus, history.result(i).modulus());
+        }
+    }
+
+    /**
+     * @brief Результат записи истории
+     * @param sequence Порядковый номер записи
+     * @return Результат; с графом - запомненный, при необходимости пересчитанный
+     * @throw std::out_of_range Если записи нет в истории
+     * @throw std::runtime_error Если при пересчете делитель стал нулем
+     */
+    Complex historyResult(uint64_t sequence) {
+        const size_t i = historyPosition(sequence);
+        if (historyGraph) {
+            return historyGraph->resolve(sequence, history, historyIndex.get());
+        }
+        return history.result(i);
+    }
+
+    /**
+     * @brief Поиск в истории
+     * @param query Условия отбора и параметры страницы
+     * @return Номера найденных записей и курсор следующей страницы
+     *
+     * Не константный: индекс по модулю доупорядочивает новые записи при поиске.
+     */
+    HistoryPage queryHistory(const HistoryQuery& query) {
+        settleHistory();
+        return ::queryHistory(history, historyIndex.get(), query);
+    }
+
+    /**
+     * @brief Выводит одну страницу результатов поиска в истории
+     * @param query Условия отбора и параметры страницы
+     * @return Страница (для запроса следующей по nextCursor)
+     */
+    HistoryPage viewHistory(const HistoryQuery& query) {
+        HistoryPage page = queryHistory(query);
+        if (page.sequences.empty()) {
+            std::cout << "Записей не найдено." << std::endl;
+            return page;
+        }
+        for (uint64_t sequence : page.sequences) {
+            std::cout << sequence + 1 << ". ";
+            history.record(static_cast<size_t>(sequence - history.firstSequence())).display();
+        }
+        if (page.hasMore) {
+            std::cout << "... (есть еще записи, cursor = " << page.nextCursor << ")" << std::endl;
+        }
+        return page;
+    }
+
+    /**
+     * @brief Доступ к хранилищу истории
+     * @return Ссылка на хранилище
+     */
+    const HistoryStore& getHistory() const {
+        settleHistory();
+        return history;
+    }
+    
+    /**
+     * @brief Просмотр истории операций
+     * 
+     * Выводит все сохраненные операции в порядке их выполнения.
+     * Если история пуста, выводит соответствующее сообщение.
+     */
+    void viewHistory() const {
+        settleHistory();
+        if (history.empty()) {
+            std::cout << "История операций пуста." << std::endl;
+            return;
+        }
+        
+        std::cout << "\n=== История операций ===" << std::endl;
+        for (size_t i = 0; i < history.size(); ++i) {
+            std::cout << history.firstSequence() + i + 1 << ". ";
+            history.record(i).display();
+        }
+        std::cout << "========================\n" << std::endl;
+    }
+
+    /**
+     * @brief Быстрая выгрузка всей истории в поток
+     * @param out Выходной поток
+     *
+     * Строки имеют тот же вид, что и в viewHistory() ("N. a + b = r"), но
+     * числа форматируются через formatComplex() в кратчайшем точном виде,
+     * а вывод идет блоками по 1 МиБ без сброса буфера после каждой строки.
+     */
+    void writeHistory(std::ostream& out) const {
+        COMPLEX_METRICS_PHASE(HistoryWrite);
+        settleHistory();
+        const size_t blockSize = 1 << 20;
+        std::string buffer;
+        buffer.reserve(blockSize + 256);
+        for (size_t i = 0; i < history.size(); ++i) {
+            char number[24];
+            std::to_chars_result r = std::to_chars(number, number + sizeof(number), history.firstSequence() + i + 1);
+            buffer.append(number, static_cast<size_t>(r.ptr - number));
+            buffer += ". ";
+
+            Complex num1 = history.first(i);
+            Complex num2 = history.second(i);
+            if (num2.getReal() == 0 && num2.getImag() == 0) {
+                buffer += history.name(i);
+                buffer += ' ';
+                appendComplexText(buffer, num1);
+            } else {
+                appendComplexText(buffer, num1);
+                buffer += ' ';
+                buffer += history.name(i);
+                buffer += ' ';
+                appendComplexText(buffer, num2);
+            }
+            buffer += " = ";
+            appendComplexText(buffer, history.result(i));
+            buffer += '\n';
+
+            if (buffer.size() >= blockSize) {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+    
+    /**
+     * @brief Очистка истории операций
+     * 
+     * Удаляет все записи из истории.
+     */
+    void clearHistory() {
+        history.clear();
+        if (historyIndex) {
+            historyIndex->clear(history.firstSequence());
+        }
+        if (historyGraph) {
+            historyGraph->clear(history.firstSequence());
+        }
+        std::cout << "История операций очищена." << std::endl;
+    }
+
+    /**
+     * @struct BatchStats
+     * @brief Итоги пакетной обработки
+     */
+    struct BatchStats {
+        size_t operations = 0;  ///< Количество выполненных операций
+        size_t errors = 0;      ///< Количество строк с ошибками
+    };
+
+    /**
+     * @brief Пакетный (неинтерактивный) режим
+     * @param in Входной поток с операциями
+     * @param out Выходной поток для результатов
+     * @param recordHistory Записывать ли выполненные операции в историю
+     * @return Количество выполненных операций и ошибок
+     *
+     * Каждая строка входа имеет вид "код re1 im1 [re2 im2]", где код - номер
+     * операции из меню (1-9). Для бинарных операций задаются оба числа,
+     * для унарных - одно. Вместо пары "re im" можно указать комплексный
+     * литерал с мнимой частью, например "1 3-4i 2i". Пустые строки и строки,
+     * начинающиеся с '#', пропускаются.
+     * На каждую операцию выводится ровно одна строка: результат (в виде
+     * formatComplex()) или "error: <сообщение>".
+     *
+     * Вход читается, а выход пишется блоками по 1 МиБ, без меню, пауз
+     * и сброса буфера после каждой строки.
+     */
+    BatchStats runBatch(std::istream& in, std::ostream& out, bool recordHistory = false) {
+        const size_t blockSize = 1 << 20;
+        std::vector<char> buffer(blockSize + 1);
+        std::string output;
+        output.reserve(blockSize + 256);
+        BatchStats stats;
+        size_t pending = 0;  // Начало незавершенной строки, перенесенное из прошлого блока
+
+        for (;;) {
+            if (pending == buffer.size() - 1) {
+                buffer.resize(buffer.size() * 2);  // Строка длиннее буфера
+            }
+            {
+                COMPLEX_METRICS_PHASE(BatchRead);
+                in.read(buffer.data() + pending, static_cast<std::streamsize>(buffer.size() - 1 - pending));
+            }
+            const bool eof = !in;
+            char* lineStart = buffer.data();
+            char* end = buffer.data() + pending + static_cast<size_t>(in.gcount());
+            *end = '\0';
+
+            while (char* newline = static_cast<char*>(std::memchr(lineStart, '\n', end - lineStart))) {
+                *newline = '\0';
+                processBatchLine(lineStart, newline, output, stats, recordHistory);
+                lineStart = newline + 1;
+                if (output.size() >= blockSize) {
+                    COMPLEX_METRICS_PHASE(BatchWrite);
+                    out.write(output.data(), static_cast<std::streamsize>(output.size()));
+                    output.clear();
+                }
+            }
+
+            pending = static_cast<size_t>(end - lineStart);
+            if (eof) {
+                processBatchLine(lineStart, end, output, stats, recordHistory);
+                break;
+            }
+            std::memmove(buffer.data(), lineStart, pending);
+        }
+
+        {
+            COMPLEX_METRICS_PHASE(BatchWrite);
+            out.write(output.data(), static_cast<std::streamsize>(output.size()));
+            out.flush();
+        }
+        return stats;
+    }
+
+    /**
+     * @brief Обрабатывает одну строку в формате пакетного режима
+     * @param first Начало строки
+     * @param last Конец строки (по этому адресу должен стоять '\0')
+     * @param out Буфер, в который дописывается строка ответа
+     * @param stats Счетчики операций и ошибок
+     * @param recordHistory Записывать ли операцию в историю
+     *
+     * Используется сервером (CalculatorServer), который сам делит поток
+     * запросов на строки.
+     */
+    void processLine(const char* first, const char* last, std::string& out, BatchStats& stats,
+                     bool recordHistory = true) {
+        processBatchLine(first, last, out, stats, recordHistory);
+    }
+
+#ifdef COMPLEX_HAVE_POSIX
+    /**
+     * @brief Потоковая обработка набора чисел, который не помещается в память
+     * @param op Код операции
+     * @param in Первые операнды
+     * @param out Результаты: ровно одно число на каждый первый операнд
+     * @param operand Второй операнд бинарной операции, общий для всех чисел
+     * @param second Поток вторых операндов (nullptr - везде operand)
+     * @param pool Пул потоков для вычислений
+     * @return operations - успешные операции, errors - неудачные (например
+     *         деление на ноль); результат неудачной операции - NaN
+     * @throw std::runtime_error При ошибке ввода-вывода, разбора или если
+     *        в second меньше чисел, чем в in
+     *
+     * Порции, которые выдает StreamReader, вычисляются параллельно через
+     * evaluateOperations() в текущей точности и сразу отдаются StreamWriter.
+     * Чтение следующей порции и запись предыдущей идут в фоновых потоках
+     * одновременно с вычислением, а память не зависит от размера файлов.
+     * История не ведется. По окончании вызывается out.finish().
+     */
+    BatchStats runStream(OpCode op, StreamReader& in, StreamWriter& out, const Complex& operand = Complex(),
+                         StreamReader* second = nullptr, WorkStealingPool& pool = WorkStealingPool::shared()) {
+        std::vector<Complex> first, other, seconds, results;
+        std::vector<BatchOperation> operations;
+        std::vector<uint8_t> failed;
+        size_t otherOffset = 0;
+        BatchStats stats;
+        const bool binary = isBinaryOperation(op);
+        for (;;) {
+            {
+                COMPLEX_METRICS_PHASE(BatchRead);
+                if (in.read(first) == 0) {
+                    break;
+                }
+            }
+            const size_t n = first.size();
+            if (binary) {
+                seconds.assign(n, operand);
+                for (size_t i = 0; second && i < n; ++i) {
+                    if (otherOffset == other.size()) {
+                        COMPLEX_METRICS_PHASE(BatchRead);
+                        otherOffset = 0;
+                        if (second->read(other) == 0) {
+                            throw std::runtime_error("Во втором потоке меньше чисел, чем в первом");
+                        }
+                    }
+                    seconds[i] = other[otherOffset++];
+                }
+            }
+
+            results.resize(n);
+            size_t failures = 0;
+            if (!evaluateArithmetic(op, first.data(), binary ? seconds.data() : first.data(), n, results.data(),
+                                    pool)) {
+                operations.resize(n);
+                for (size_t i = 0; i < n; ++i) {
+                    operations[i] = BatchOperation{op, first[i], binary ? seconds[i] : Complex()};
+                }
+                failed.resize(n);
+                failures = evaluateOperations(pool, operations.data(), n, results.data(), failed.data(), precision);
+                for (size_t i = 0; failures != 0 && i < n; ++i) {
+                    if (failed[i]) {
+                        results[i] = Complex(std::numeric_limits<double>::quiet_NaN(), 0);
+                    }
+                }
+            }
+            stats.operations += n - failures;
+            stats.errors += failures;
+            {
+                COMPLEX_METRICS_PHASE(BatchWrite);
+                out.write(results.data(), n);
+            }
+        }
+        COMPLEX_METRICS_PHASE(BatchWrite);
+        out.finish();
+        return stats;
+    }
+
+    /**
+     * @brief Быстрый путь runStream() для операций, которые не могут завершиться ошибкой
+     * @param op Код операции
+     * @param a Первые операнды
+     * @param b Вторые операнды (для унарных операций не читаются)
+     * @param n Количество операций
+     * @param results Результаты
+     * @param pool Пул потоков
+     * @return false, если для op и текущей точности быстрого пути нет
+     *
+     * В точности double сложение, вычитание, умножение и унарный минус
+     * вычисляются прямо операторами Complex: результат тот же, что у
+     * applyOperation(), но без выбора точности и операции на каждое число,
+     * который для таких дешевых операций в несколько раз дороже самой
+     * арифметики.
+     */
+    bool evaluateArithmetic(OpCode op, const Complex* a, const Complex* b, size_t n, Complex* results,
+                            WorkStealingPool& pool) const {
+        if (precision != Precision::Double) {
+            return false;
+        }
+        auto run = [&](auto apply) {
+            const size_t chunk = 4096;
+            pool.parallelFor((n + chunk - 1) / chunk, [&](size_t task, size_t) {
+                const size_t end = std::min(n, (task + 1) * chunk);
+                for (size_t i = task * chunk; i < end; ++i) {
+                    COMPLEX_METRICS_OPERATION(op);
+                    results[i] = apply(a[i], b[i]);
+                }
+            });
+        };
+        switch (op) {
+            case OpCode::Add:      run([](const Complex& x, const Complex& y) { return x + y; }); return true;
+            case OpCode::Subtract: run([](const Complex& x, const Complex& y) { return x - y; }); return true;
+            case OpCode::Multiply: run([](const Complex& x, const Complex& y) { return x * y; }); return true;
+            case OpCode::Negate:   run([](const Complex& x, const Complex&) { return -x; }); return true;
+            default:               return false;
+        }
+    }
+#endif
+
+    /**
+     * @brief Основной цикл работы калькулятора
+     * 
+     * Предоставляет интерактивное меню для выбора операций:
+     * 1. Сложение
+     * 2. Вычитание
+     * 3. Умножение
+     * 4. Деление
      * 5. Инкремент
      * 6. Декремент
      * 7. Сравнение модулей
@@ -369,181 +10241,1640 @@ public:
      * 9. Вычисление модуля
      * 10. Просмотр истории
      * 11. Очистка истории
+     * 12-20. Экспонента, логарифм, корень, степень, аргумент, синус, косинус,
+     *        перевод в полярную форму и обратно (уровень MathAccuracy::Precise)
      * 0. Выход
      */
-    void performOperations() {
-        int choice;
-        Complex num1, num2, result;
-        
-        do {
-            displayMenu();
-            std::cout << "Выберите операцию: ";
-            std::cin >> choice;
-            
-            switch (choice) {
-                case 1: { // Сложение
-                    std::cout << "\n--- Сложение ---" << std::endl;
-                    num1 = inputComplex("Введите первое число:");
-                    num2 = inputComplex("Введите второе число:");
-                    result = num1 + num2;
-                    std::cout << "Результат: " << num1 << " + " << num2 << " = " << result << std::endl;
-                    addToHistory(OperationRecord("+", num1, num2, result));
-                    break;
+    void performOperations() {
+        int choice;
+        Complex num1, num2, result;
+        
+        do {
+            displayMenu();
+            std::cout << "Выберите операцию: ";
+            std::cin >> choice;
+            
+            switch (choice) {
+                case 1: { // Сложение
+                    std::cout << "\n--- Сложение ---" << std::endl;
+                    num1 = inputComplex("Введите первое число:");
+                    num2 = inputComplex("Введите второе число:");
+                    result = calculate(OpCode::Add, num1, num2);
+                    std::cout << "Результат: " << num1 << " + " << num2 << " = " << result << std::endl;
+                    addToHistory(OpCode::Add, num1, num2);
+                    break;
+                }
+                case 2: { // Вычитание
+                    std::cout << "\n--- Вычитание ---" << std::endl;
+                    num1 = inputComplex("Введите первое число:");
+                    num2 = inputComplex("Введите второе число:");
+                    result = calculate(OpCode::Subtract, num1, num2);
+                    std::cout << "Результат: " << num1 << " - " << num2 << " = " << result << std::endl;
+                    addToHistory(OpCode::Subtract, num1, num2);
+                    break;
+                }
+                case 3: { // Умножение
+                    std::cout << "\n--- Умножение ---" << std::endl;
+                    num1 = inputComplex("Введите первое число:");
+                    num2 = inputComplex("Введите второе число:");
+                    result = calculate(OpCode::Multiply, num1, num2);
+                    std::cout << "Результат: " << num1 << " * " << num2 << " = " << result << std::endl;
+                    addToHistory(OpCode::Multiply, num1, num2);
+                    break;
+                }
+                case 4: { // Деление
+                    std::cout << "\n--- Деление ---" << std::endl;
+                    num1 = inputComplex("Введите первое число:");
+                    num2 = inputComplex("Введите второе число:");
+                    try {
+                        result = calculate(OpCode::Divide, num1, num2);
+                        std::cout << "Результат: " << num1 << " / " << num2 << " = " << result << std::endl;
+                        addToHistory(OpCode::Divide, num1, num2);
+                    } catch (const std::runtime_error& e) {
+                        std::cout << "Ошибка: " << e.what() << std::endl;
+                    }
+                    break;
+                }
+                case 5: { // Инкремент
+                    std::cout << "\n--- Инкремент (++x) ---" << std::endl;
+                    num1 = inputComplex("Введите число:");
+                    result = calculate(OpCode::Increment, num1);
+                    std::cout << "Результат: ++" << num1 << " = " << result << std::endl;
+                    addToHistory(OpCode::Increment, num1);
+                    break;
+                }
+                case 6: { // Декремент
+                    std::cout << "\n--- Декремент (--x) ---" << std::endl;
+                    num1 = inputComplex("Введите число:");
+                    result = calculate(OpCode::Decrement, num1);
+                    std::cout << "Результат: --" << num1 << " = " << result << std::endl;
+                    addToHistory(OpCode::Decrement, num1);
+                    break;
+                }
+                case 7: { // Сравнение
+                    std::cout << "\n--- Сравнение модулей ---" << std::endl;
+                    num1 = inputComplex("Введите первое число:");
+                    num2 = inputComplex("Введите второе число:");
+                    double mod1 = calculate(OpCode::Modulus, num1).getReal();
+                    double mod2 = calculate(OpCode::Modulus, num2).getReal();
+                    std::cout << "|" << num1 << "| = " << mod1 << std::endl;
+                    std::cout << "|" << num2 << "| = " << mod2 << std::endl;
+                    
+                    if (num1 == num2) {
+                        std::cout << "Модули чисел равны" << std::endl;
+                    } else if (mod1 < mod2) {
+                        std::cout << "Модуль первого числа меньше" << std::endl;
+                    } else {
+                        std::cout << "Модуль первого числа больше" << std::endl;
+                    }
+                    addToHistory(OpCode::Compare, num1, num2);
+                    break;
+                }
+                case 8: { // Унарный минус
+                    std::cout << "\n--- Унарный минус ---" << std::endl;
+                    num1 = inputComplex("Введите число:");
+                    result = calculate(OpCode::Negate, num1);
+                    std::cout << "Результат: -" << num1 << " = " << result << std::endl;
+                    addToHistory(OpCode::Negate, num1);
+                    break;
+                }
+                case 9: { // Модуль
+                    std::cout << "\n--- Модуль числа ---" << std::endl;
+                    num1 = inputComplex("Введите число:");
+                    double mod = calculate(OpCode::Modulus, num1).getReal();
+                    std::cout << "Модуль " << num1 << " = " << mod << std::endl;
+                    addToHistory(OpCode::Modulus, num1);
+                    break;
+                }
+                case 10: // История
+                    viewHistory();
+                    break;
+                case 12: // Экспонента
+                    performFunction(OpCode::Exp, "Экспонента e^z");
+                    break;
+                case 13: // Логарифм
+                    performFunction(OpCode::Log, "Натуральный логарифм");
+                    break;
+                case 14: // Корень
+                    performFunction(OpCode::Sqrt, "Квадратный корень");
+                    break;
+                case 15: { // Степень
+                    std::cout << "\n--- Степень a^b ---" << std::endl;
+                    num1 = inputComplex("Введите основание:");
+                    num2 = inputComplex("Введите показатель:");
+                    result = calculate(OpCode::Pow, num1, num2);
+                    std::cout << "Результат: (" << num1 << ")^(" << num2 << ") = " << result << std::endl;
+                    addToHistory(OpCode::Pow, num1, num2);
+                    break;
+                }
+                case 16: { // Аргумент
+                    std::cout << "\n--- Аргумент числа ---" << std::endl;
+                    num1 = inputComplex("Введите число:");
+                    double angle = calculate(OpCode::Arg, num1).getReal();
+                    std::cout << "arg(" << num1 << ") = " << angle << std::endl;
+                    addToHistory(OpCode::Arg, num1);
+                    break;
+                }
+                case 17: // Синус
+                    performFunction(OpCode::Sin, "Синус");
+                    break;
+                case 18: // Косинус
+                    performFunction(OpCode::Cos, "Косинус");
+                    break;
+                case 19: { // В полярную форму
+                    std::cout << "\n--- Перевод в полярную форму ---" << std::endl;
+                    num1 = inputComplex("Введите число:");
+                    result = calculate(OpCode::ToPolar, num1);
+                    std::cout << num1 << " = " << result.getReal() << " * e^(" << result.getImag() << "i)" << std::endl;
+                    addToHistory(OpCode::ToPolar, num1);
+                    break;
+                }
+                case 20: { // Из полярной формы
+                    std::cout << "\n--- Число по модулю и аргументу ---" << std::endl;
+                    double r, theta;
+                    std::cout << "  Модуль: ";
+                    std::cin >> r;
+                    std::cout << "  Аргумент (радианы): ";
+                    std::cin >> theta;
+                    num1 = roundToPrecision(precision, Complex(r, theta));
+                    result = calculate(OpCode::FromPolar, num1);
+                    std::cout << "Результат: " << num1.getReal() << " * e^(" << num1.getImag() << "i) = "
+                              << result << std::endl;
+                    addToHistory(OpCode::FromPolar, num1);
+                    break;
+                }
+                case 11: // Очистка истории
+                    clearHistory();
+                    break;
+                case 0: // Выход
+                    std::cout << "Выход из программы." << std::endl;
+                    break;
+                default:
+                    std::cout << "Неверный выбор. Попробуйте снова." << std::endl;
+            }
+            
+            if (choice != 0 && choice != 10 && choice != 11) {
+                pause();
+            }
+            
+        } while (choice != 0);
+    }
+    
+private:
+    /**
+     * @brief Выполняет операцию через кэш результатов, если он подключен
+     */
+    Complex evaluate(Precision recordPrecision, OpCode op, const Complex& num1, const Complex& num2) const {
+        if (resultCache) {
+            return resultCache->evaluate(recordPrecision, op, num1, num2);
+        }
+        return applyOperation(recordPrecision, op, num1, num2);
+    }
+
+    /**
+     * @brief Досчитывает записи, помеченные графом зависимостей
+     * @throw std::runtime_error Если при пересчете делитель стал нулем
+     */
+    void settleHistory() const {
+        if (historyGraph) {
+            historyGraph->settle(history, historyIndex.get());
+        }
+    }
+
+    /**
+     * @brief Индекс записи в хранилище по порядковому номеру
+     * @throw std::out_of_range Если записи нет (вытеснена или еще не создана)
+     */
+    size_t historyPosition(uint64_t sequence) const {
+        if (sequence < history.firstSequence() || sequence - history.firstSequence() >= history.size()) {
+            throw std::out_of_range("Записи с таким номером нет в истории");
+        }
+        return static_cast<size_t>(sequence - history.firstSequence());
+    }
+
+    /**
+     * @brief Записывает операцию в историю и журнал
+     * @param op Код операции
+     * @param num1 Первый операнд
+     * @param num2 Второй операнд
+     * @param result Результат операции
+     * @param recordPrecision Точность, в которой вычислен результат
+     * @param name Обозначение операции, если оно задано вызывающим кодом
+     */
+    void appendRecord(OpCode op, const Complex& num1, const Complex& num2, const Complex& result,
+                      Precision recordPrecision, const std::string* name = nullptr,
+                      uint64_t source1 = HistoryOperand::noSource, uint64_t source2 = HistoryOperand::noSource) {
+        {
+            COMPLEX_METRICS_SAMPLED_PHASE(HistoryAppend);
+            if (historyIndex || historyGraph) {
+                if (history.maxRecords() != 0 && history.size() == history.maxRecords()) {
+                    if (historyIndex) {
+                        historyIndex->evict(history.opcode(0), history.firstSequence());
+                    }
+                    if (historyGraph) {
+                        historyGraph->evictFront();
+                    }
+                }
+                history.append(op, num1, num2, result, recordPrecision, name);
+                const uint64_t sequence = history.firstSequence() + history.size() - 1;
+                if (historyIndex) {
+                    historyIndex->add(sequence, op, result.modulus());
+                }
+                if (historyGraph) {
+                    historyGraph->add(sequence, result, source1, source2);
+                }
+            } else {
+                history.append(op, num1, num2, result, recordPrecision, name);
+            }
+        }
+#ifdef COMPLEX_HAVE_POSIX
+        if (historyLog) {
+            COMPLEX_METRICS_SAMPLED_PHASE(LogAppend);
+            historyLog->append(op, num1, num2, result, recordPrecision);
+        }
+#endif
+    }
+
+    /**
+     * @brief Вычисление функции одного аргумента из меню
+     * @param op Код операции
+     * @param title Заголовок пункта меню
+     */
+    void performFunction(OpCode op, const char* title) {
+        std::cout << "\n--- " << title << " ---" << std::endl;
+        Complex num1 = inputComplex("Введите число:");
+        Complex result = calculate(op, num1);
+        std::cout << "Результат: " << operationName(op) << "(" << num1 << ") = " << result << std::endl;
+        addToHistory(op, num1);
+    }
+
+    /**
+     * @brief Вывод меню операций
+     */
+    void displayMenu() const {
+        std::cout << "\n=== Калькулятор комплексных чисел ===" << std::endl;
+        std::cout << "1. Сложение" << std::endl;
+        std::cout << "2. Вычитание" << std::endl;
+        std::cout << "3. Умножение" << std::endl;
+        std::cout << "4. Деление" << std::endl;
+        std::cout << "5. Инкремент (++x)" << std::endl;
+        std::cout << "6. Декремент (--x)" << std::endl;
+        std::cout << "7. Сравнение модулей" << std::endl;
+        std::cout << "8. Унарный минус" << std::endl;
+        std::cout << "9. Вычисление модуля" << std::endl;
+        std::cout << "10. Просмотр истории операций" << std::endl;
+        std::cout << "11. Очистка истории операций" << std::endl;
+        std::cout << "12. Экспонента" << std::endl;
+        std::cout << "13. Натуральный логарифм" << std::endl;
+        std::cout << "14. Квадратный корень" << std::endl;
+        std::cout << "15. Степень" << std::endl;
+        std::cout << "16. Аргумент" << std::endl;
+        std::cout << "17. Синус" << std::endl;
+        std::cout << "18. Косинус" << std::endl;
+        std::cout << "19. Перевод в полярную форму" << std::endl;
+        std::cout << "20. Число по модулю и аргументу" << std::endl;
+        std::cout << "0. Выход" << std::endl;
+    }
+    
+    /**
+     * @brief Ввод комплексного числа с консоли
+     * @param prompt Приглашение для ввода
+     * @return Введенное комплексное число, округленное до текущей точности
+     */
+    Complex inputComplex(const std::string& prompt) {
+        double real, imag;
+        std::cout << prompt << std::endl;
+        std::cout << "  Действительная часть: ";
+        std::cin >> real;
+        std::cout << "  Мнимая часть: ";
+        std::cin >> imag;
+        return roundToPrecision(precision, Complex(real, imag));
+    }
+    
+    /**
+     * @brief Пауза выполнения программы
+     * 
+     * Ожидает нажатия клавиши Enter для продолжения
+     */
+    void pause() {
+        std::cout << "\nНажмите Enter для продолжения...";
+        std::cin.ignore();
+        std::cin.get();
+    }
+
+    /**
+     * @brief Обработка одной строки пакетного режима
+     * @param first Начало строки
+     * @param last Конец строки (по этому адресу должен стоять '\0')
+     * @param out Буфер, в который дописывается результат
+     * @param stats Счетчики операций и ошибок
+     * @param recordHistory Записывать ли операцию в историю
+     */
+    void processBatchLine(const char* first, const char* last, std::string& out,
+                          BatchStats& stats, bool recordHistory) {
+        while (first != last && std::isspace(static_cast<unsigned char>(*first))) {
+            ++first;
+        }
+        if (first == last || *first == '#') {
+            return;
+        }
+
+        int code = 0;
+        std::from_chars_result parsed = std::from_chars(first, last, code);
+        if (parsed.ec != std::errc() || !isKnownOperation(code)) {
+            appendError(out, stats, "неверный код операции");
+            return;
+        }
+        OpCode op = static_cast<OpCode>(code);
+        const char* next = parsed.ptr;
+        COMPLEX_METRICS_OPERATION(op);
+
+        Complex num1, num2;
+        if (!parseBatchOperand(next, last, num1) ||
+            (isBinaryOperation(op) && !parseBatchOperand(next, last, num2))) {
+            COMPLEX_METRICS_ERROR(op);
+            appendError(out, stats, "ожидалось число");
+            return;
+        }
+        while (next != last && std::isspace(static_cast<unsigned char>(*next))) {
+            ++next;
+        }
+        if (next != last) {
+            COMPLEX_METRICS_ERROR(op);
+            appendError(out, stats, "лишние символы в строке");
+            return;
+        }
+
+        if (op == OpCode::Divide && isZeroDivisor(precision, num2)) {
+            COMPLEX_METRICS_ERROR(op);
+            appendError(out, stats, "Деление на ноль!");  // Без исключения: в пакетах это частый случай
+            return;
+        }
+        try {
+            Complex result = evaluate(precision, op, num1, num2);
+            appendComplexText(out, result);
+            out += '\n';
+            ++stats.operations;
+            if (recordHistory) {
+                addToHistory(op, num1, isBinaryOperation(op) ? num2 : Complex());
+            }
+        } catch (const std::exception& e) {
+            COMPLEX_METRICS_ERROR(op);
+            appendError(out, stats, e.what());
+        }
+    }
+
+    /**
+     * @brief Дописывает сообщение об ошибке пакетного режима
+     * @param out Выходной буфер
+     * @param stats Счетчики, в которых учитывается ошибка
+     * @param message Текст ошибки
+     */
+    static void appendError(std::string& out, BatchStats& stats, const char* message) {
+        out += "error: ";
+        out += message;
+        out += '\n';
+        ++stats.errors;
+    }
+
+    /**
+     * @brief Разбирает операнд строки пакетного режима
+     * @param p Текущая позиция (сдвигается за операнд)
+     * @param last Конец строки
+     * @param value Разобранное число
+     * @return true если операнд прочитан
+     *
+     * Операнд задается либо парой чисел "re im", либо одним комплексным
+     * литералом с мнимой частью ("3-4i", "2i", "1 + 2i").
+     */
+    static bool parseBatchOperand(const char*& p, const char* last, Complex& value) {
+        while (p != last && std::isspace(static_cast<unsigned char>(*p))) {
+            ++p;
+        }
+        Complex literal;
+        std::from_chars_result r = parseComplex(p, last, literal);
+        if (r.ec != std::errc()) {
+            return false;
+        }
+        p = r.ptr;
+        if (p[-1] == 'i') {
+            value = literal;
+            return true;
+        }
+        while (p != last && std::isspace(static_cast<unsigned char>(*p))) {
+            ++p;
+        }
+        double imag = 0;
+        if (p != last && *p == '+') {
+            ++p;
+        }
+        r = std::from_chars(p, last, imag);
+        if (r.ec != std::errc()) {
+            return false;
+        }
+        p = r.ptr;
+        value = Complex(literal.getReal(), imag);
+        return true;
+    }
+};
+
+#ifdef COMPLEX_HAVE_EPOLL
+
+/**
+ * @struct SocketAddress
+ * @brief Адрес сервера: Unix-сокет или TCP на локальном интерфейсе
+ */
+struct SocketAddress {
+    sockaddr_storage storage;   ///< Адрес в формате sockaddr_un или sockaddr_in
+    socklen_t length = 0;       ///< Длина адреса
+    std::string unixPath;       ///< Путь Unix-сокета (пусто для TCP)
+
+    /**
+     * @brief Разбирает адрес
+     * @param text "unix:/путь", "tcp:порт" или "tcp:127.0.0.1:порт"
+     * @return Адрес
+     * @throw std::invalid_argument Если адрес задан неверно
+     *
+     * TCP-адрес без хоста означает 127.0.0.1: сервер рассчитан на
+     * локальных клиентов.
+     */
+    static SocketAddress parse(const std::string& text) {
+        SocketAddress address;
+        std::memset(&address.storage, 0, sizeof(address.storage));
+        if (text.compare(0, 5, "unix:") == 0) {
+            address.unixPath = text.substr(5);
+            sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&address.storage);
+            if (address.unixPath.empty() || address.unixPath.size() >= sizeof(un->sun_path)) {
+                throw std::invalid_argument("Неверный путь Unix-сокета: " + text);
+            }
+            un->sun_family = AF_UNIX;
+            std::memcpy(un->sun_path, address.unixPath.c_str(), address.unixPath.size() + 1);
+            address.length = sizeof(sockaddr_un);
+            return address;
+        }
+        if (text.compare(0, 4, "tcp:") == 0) {
+            std::string rest = text.substr(4);
+            std::string host = "127.0.0.1";
+            size_t colon = rest.rfind(':');
+            if (colon != std::string::npos) {
+                host = rest.substr(0, colon);
+                rest = rest.substr(colon + 1);
+            }
+            unsigned port = 0;
+            std::from_chars_result r = std::from_chars(rest.data(), rest.data() + rest.size(), port);
+            sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&address.storage);
+            if (r.ec != std::errc() || r.ptr != rest.data() + rest.size() || port == 0 || port > 65535 ||
+                ::inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1) {
+                throw std::invalid_argument("Неверный TCP-адрес: " + text);
+            }
+            in->sin_family = AF_INET;
+            in->sin_port = htons(static_cast<uint16_t>(port));
+            address.length = sizeof(sockaddr_in);
+            return address;
+        }
+        throw std::invalid_argument("Адрес должен начинаться с unix: или tcp: - " + text);
+    }
+
+    /**
+     * @brief Создает неблокирующий сокет нужного семейства
+     * @return Дескриптор
+     * @throw std::runtime_error При ошибке socket()
+     */
+    int openSocket() const {
+        int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        if (storage.ss_family == AF_INET) {
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd;
+    }
+
+    const sockaddr* data() const { return reinterpret_cast<const sockaddr*>(&storage); }
+};
+
+/**
+ * @class CalculatorServer
+ * @brief Сервер калькулятора на epoll: много клиентов, у каждого своя история
+ *
+ * Протокол строковый и совпадает с пакетным режимом: клиент присылает
+ * строки "код re1 im1 [re2 im2]", сервер отвечает на каждую ровно одной
+ * строкой с результатом или "error: ...". Клиент может отправлять запросы,
+ * не дожидаясь ответов (конвейер): ответы приходят в том же порядке.
+ * Строка "history" возвращает историю сессии в формате writeHistory(),
+ * завершенную строкой ".".
+ *
+ * Все соединения обслуживает один поток с неблокирующими сокетами.
+ * У каждой сессии свой Calculator с кольцевой историей ограниченной
+ * емкости, поэтому память на тысячи клиентов ограничена. Если клиент
+ * не читает ответы, сервер перестает читать его запросы, пока очередь
+ * ответов не опустеет. Кэш результатов, если он задан, общий для всех сессий.
+ *
+ * Когда кончаются дескрипторы (EMFILE/ENFILE), слушающий сокет снимается с
+ * epoll до закрытия какой-нибудь сессии, а новые клиенты ждут в очереди
+ * listen(). Если открытых сессий нет и ждать нечего, сервер освобождает
+ * запасной дескриптор, принимает клиента и сразу закрывает соединение.
+ */
+class CalculatorServer {
+public:
+    static const size_t sessionHistory = 4096;       ///< Емкость истории одной сессии
+    static const size_t maxLineLength = 64 * 1024;   ///< Максимальная длина строки запроса
+    static const size_t outputLimit = 1 << 20;       ///< Порог очереди ответов для паузы чтения
+
+private:
+    /**
+     * @struct Session
+     * @brief Состояние одного соединения
+     */
+    struct Session {
+        int fd;                         ///< Сокет клиента
+        Calculator calc;                ///< Калькулятор и история сессии
+        std::string input;              ///< Принятые, но еще не обработанные байты
+        std::string output;             ///< Ответы, еще не отправленные клиенту
+        size_t sent = 0;                ///< Сколько байт output уже отправлено
+        uint32_t watched = EPOLLIN | EPOLLRDHUP;  ///< События, на которые подписан сокет
+        bool finished = false;          ///< Клиент закрыл свою сторону соединения
+        Calculator::BatchStats stats;   ///< Счетчики операций сессии
+
+        Session(int socket, Precision precision) : fd(socket), calc(sessionHistory, precision) {}
+    };
+
+    SocketAddress address;
+    Precision precision;
+    std::shared_ptr<ResultCache> cache;  ///< Общий кэш результатов сессий (может отсутствовать)
+    int listener = -1;
+    int epoll = -1;
+    int wakeup = -1;    ///< eventfd для stop()
+    int spare = -1;     ///< Запасной дескриптор для отказа клиентам при EMFILE
+    bool accepting = true;  ///< Слушающий сокет подписан на epoll
+    std::map<int, std::unique_ptr<Session>> sessions;
+    std::atomic<bool> stopping{false};
+
+    void watch(int fd, uint32_t events, int operation) {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll, operation, fd, &event) != 0) {
+            throw std::runtime_error(std::string("epoll_ctl: ") + std::strerror(errno));
+        }
+    }
+
+    /**
+     * @brief Принимает клиента и сразу закрывает соединение, освободив запасной дескриптор
+     * @return false если запасного дескриптора нет и отказать не удалось
+     */
+    bool refuseClient() {
+        if (spare < 0) {
+            spare = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if (spare < 0) {
+                return false;
+            }
+        }
+        ::close(spare);
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        spare = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return true;
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
                 }
-                case 2: { // Вычитание
-                    std::cout << "\n--- Вычитание ---" << std::endl;
-                    num1 = inputComplex("Введите первое число:");
-                    num2 = inputComplex("Введите второе число:");
-                    result = num1 - num2;
-                    std::cout << "Результат: " << num1 << " - " << num2 << " = " << result << std::endl;
-                    addToHistory(OperationRecord("-", num1, num2, result));
-                    break;
+                if (errno == EMFILE || errno == ENFILE) {
+                    // Иначе слушающий сокет остается готовым и epoll_wait возвращается сразу
+                    if (!sessions.empty()) {
+                        ::epoll_ctl(epoll, EPOLL_CTL_DEL, listener, nullptr);
+                        accepting = false;  // Возобновится в closeSession()
+                    } else if (refuseClient()) {
+                        continue;
+                    }
                 }
-                case 3: { // Умножение
-                    std::cout << "\n--- Умножение ---" << std::endl;
-                    num1 = inputComplex("Введите первое число:");
-                    num2 = inputComplex("Введите второе число:");
-                    result = num1 * num2;
-                    std::cout << "Результат: " << num1 << " * " << num2 << " = " << result << std::endl;
-                    addToHistory(OperationRecord("*", num1, num2, result));
+                return;  // EAGAIN - очередь пуста
+            }
+            if (address.storage.ss_family == AF_INET) {
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            sessions[fd].reset(new Session(fd, precision));
+            sessions[fd]->calc.setResultCache(cache);
+            watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+        }
+    }
+
+    void closeSession(Session& session) {
+        ::epoll_ctl(epoll, EPOLL_CTL_DEL, session.fd, nullptr);
+        ::close(session.fd);
+        sessions.erase(session.fd);
+        if (!accepting) {
+            watch(listener, EPOLLIN, EPOLL_CTL_ADD);
+            accepting = true;
+        }
+    }
+
+    /**
+     * @brief Выполняет все полные строки из входного буфера
+     * @return false если строка слишком длинная и сессию нужно закрыть
+     */
+    bool processInput(Session& session) {
+        size_t start = 0;
+        for (;;) {
+            size_t newline = session.input.find('\n', start);
+            if (newline == std::string::npos) {
+                break;
+            }
+            char* first = &session.input[start];
+            char* last = &session.input[newline];
+            *last = '\0';
+            if (last - first >= 7 && std::strncmp(first, "history", 7) == 0 &&
+                std::all_of(first + 7, last, [](char c) { return std::isspace(static_cast<unsigned char>(c)); })) {
+                std::ostringstream text;
+                session.calc.writeHistory(text);
+                session.output += text.str();
+                session.output += ".\n";
+            } else {
+                session.calc.processLine(first, last, session.output, session.stats);
+            }
+            start = newline + 1;
+        }
+        session.input.erase(0, start);
+        return session.input.size() <= maxLineLength;
+    }
+
+    /**
+     * @brief Отправляет накопленные ответы
+     * @return false если соединение разорвано
+     */
+    bool flushOutput(Session& session) {
+        while (session.sent < session.output.size()) {
+            ssize_t n = ::send(session.fd, session.output.data() + session.sent,
+                               session.output.size() - session.sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     break;
                 }
-                case 4: { // Деление
-                    std::cout << "\n--- Деление ---" << std::endl;
-                    num1 = inputComplex("Введите первое число:");
-                    num2 = inputComplex("Введите второе число:");
-                    try {
-                        result = num1 / num2;
-                        std::cout << "Результат: " << num1 << " / " << num2 << " = " << result << std::endl;
-                        addToHistory(OperationRecord("/", num1, num2, result));
-                    } catch (const std::runtime_error& e) {
-                        std::cout << "Ошибка: " << e.what() << std::endl;
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            session.sent += static_cast<size_t>(n);
+        }
+        if (session.sent == session.output.size()) {
+            session.output.clear();
+            session.sent = 0;
+        }
+        // Чтение приостанавливается, пока клиент не заберет ответы
+        bool pending = !session.output.empty();
+        bool reading = !session.finished && session.output.size() - session.sent < outputLimit;
+        uint32_t events = (reading ? EPOLLIN | EPOLLRDHUP : 0u) | (pending ? EPOLLOUT : 0u);
+        if (events != session.watched) {
+            watch(session.fd, events, EPOLL_CTL_MOD);
+            session.watched = events;
+        }
+        return true;
+    }
+
+    void serviceSession(Session& session, uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            closeSession(session);
+            return;
+        }
+        if ((session.watched & EPOLLIN) && (events & (EPOLLIN | EPOLLRDHUP))) {
+            char buffer[64 * 1024];
+            for (;;) {
+                ssize_t n = ::recv(session.fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    session.input.append(buffer, static_cast<size_t>(n));
+                    if (static_cast<size_t>(n) < sizeof(buffer)) {
+                        break;
                     }
+                } else if (n == 0) {
+                    session.finished = true;
                     break;
-                }
-                case 5: { // Инкремент
-                    std::cout << "\n--- Инкремент (++x) ---" << std::endl;
-                    num1 = inputComplex("Введите число:");
-                    Complex original = num1;
-                    result = ++num1;
-                    std::cout << "Результат: ++" << original << " = " << result << std::endl;
-                    addToHistory(OperationRecord("++(префикс)", original, result));
+                } else if (errno == EINTR) {
+                    continue;
+                } else {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        closeSession(session);
+                        return;
+                    }
                     break;
                 }
-                case 6: { // Декремент
-                    std::cout << "\n--- Декремент (--x) ---" << std::endl;
-                    num1 = inputComplex("Введите число:");
-                    Complex original = num1;
-                    result = --num1;
-                    std::cout << "Результат: --" << original << " = " << result << std::endl;
-                    addToHistory(OperationRecord("--(префикс)", original, result));
-                    break;
+            }
+            if (!processInput(session)) {
+                closeSession(session);  // Строка без перевода строки длиннее maxLineLength
+                return;
+            }
+        }
+        // Закрытое клиентом соединение держится, пока не уйдут все ответы
+        if (!flushOutput(session) || (session.finished && session.output.empty())) {
+            closeSession(session);
+        }
+    }
+
+public:
+    /**
+     * @brief Создает сервер и начинает слушать адрес
+     * @param listenAddress Адрес (см. SocketAddress::parse())
+     * @param sessionPrecision Точность вычислений в сессиях
+     * @param resultCache Кэш результатов, общий для сессий (nullptr - без кэша)
+     * @throw std::invalid_argument При неверном адресе
+     * @throw std::runtime_error Если сокет не удалось открыть
+     *
+     * Существующий файл Unix-сокета по тому же пути удаляется.
+     */
+    explicit CalculatorServer(const std::string& listenAddress, Precision sessionPrecision = Precision::Double,
+                              std::shared_ptr<ResultCache> resultCache = nullptr)
+        : address(SocketAddress::parse(listenAddress)), precision(sessionPrecision), cache(std::move(resultCache)) {
+        listener = address.openSocket();
+        int one = 1;
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (!address.unixPath.empty()) {
+            ::unlink(address.unixPath.c_str());
+        }
+        if (::bind(listener, address.data(), address.length) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+            std::string message = std::string("Не удалось слушать ") + listenAddress + ": " + std::strerror(errno);
+            ::close(listener);
+            throw std::runtime_error(message);
+        }
+        epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        watch(listener, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wakeup, EPOLLIN, EPOLL_CTL_ADD);
+        spare = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    /**
+     * @brief Закрывает все соединения и слушающий сокет
+     */
+    ~CalculatorServer() {
+        for (auto& entry : sessions) {
+            ::close(entry.first);
+        }
+        ::close(listener);
+        ::close(epoll);
+        ::close(wakeup);
+        if (spare >= 0) {
+            ::close(spare);
+        }
+        if (!address.unixPath.empty()) {
+            ::unlink(address.unixPath.c_str());
+        }
+    }
+
+    CalculatorServer(const CalculatorServer&) = delete;
+    CalculatorServer& operator=(const CalculatorServer&) = delete;
+
+    /**
+     * @brief Цикл обработки событий; возвращается после stop()
+     */
+    void run() {
+        epoll_event events[256];
+        while (!stopping.load()) {
+            int ready = ::epoll_wait(epoll, events, 256, -1);
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
                 }
-                case 7: { // Сравнение
-                    std::cout << "\n--- Сравнение модулей ---" << std::endl;
-                    num1 = inputComplex("Введите первое число:");
-                    num2 = inputComplex("Введите второе число:");
-                    std::cout << "|" << num1 << "| = " << num1.modulus() << std::endl;
-                    std::cout << "|" << num2 << "| = " << num2.modulus() << std::endl;
-                    
-                    if (num1 == num2) {
-                        std::cout << "Модули чисел равны" << std::endl;
-                    } else if (num1 < num2) {
-                        std::cout << "Модуль первого числа меньше" << std::endl;
-                    } else {
-                        std::cout << "Модуль первого числа больше" << std::endl;
+                throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+            }
+            for (int k = 0; k < ready; ++k) {
+                int fd = events[k].data.fd;
+                if (fd == listener) {
+                    acceptClients();
+                } else if (fd != wakeup) {
+                    auto found = sessions.find(fd);
+                    if (found != sessions.end()) {
+                        serviceSession(*found->second, events[k].events);
                     }
-                    addToHistory(OperationRecord("сравнение", num1, num2, 
-                        Complex(std::max(num1.modulus(), num2.modulus()), 0)));
-                    break;
                 }
-                case 8: { // Унарный минус
-                    std::cout << "\n--- Унарный минус ---" << std::endl;
-                    num1 = inputComplex("Введите число:");
-                    result = -num1;
-                    std::cout << "Результат: -" << num1 << " = " << result << std::endl;
-                    addToHistory(OperationRecord("унарный -", num1, result));
-                    break;
+            }
+        }
+    }
+
+    /**
+     * @brief Останавливает run() (можно вызывать из другого потока и из обработчика сигнала)
+     */
+    void stop() {
+        stopping.store(true);
+        uint64_t one = 1;
+        ssize_t written = ::write(wakeup, &one, sizeof(one));
+        (void)written;
+    }
+
+    /**
+     * @brief Количество открытых сессий
+     * @return Число клиентов
+     */
+    size_t sessionCount() const { return sessions.size(); }
+};
+
+/**
+ * @struct LoadReport
+ * @brief Итоги нагрузочного теста
+ */
+struct LoadReport {
+    size_t requests = 0;        ///< Получено ответов
+    size_t errors = 0;          ///< Из них "error: ..."
+    double seconds = 0;         ///< Длительность теста
+    double p50Micros = 0;       ///< Медиана задержки, мкс
+    double p99Micros = 0;       ///< 99-й процентиль задержки, мкс
+
+    /**
+     * @brief Пропускная способность
+     * @return Ответов в секунду
+     */
+    double throughput() const { return seconds > 0 ? static_cast<double>(requests) / seconds : 0; }
+};
+
+/**
+ * @brief Нагрузочный клиент для CalculatorServer
+ * @param serverAddress Адрес сервера
+ * @param connections Количество одновременных соединений
+ * @param requestsPerConnection Сколько запросов отправляет каждое соединение
+ * @param pipeline Сколько запросов соединение держит в полете одновременно
+ * @return Пропускная способность и задержки
+ * @throw std::runtime_error Если соединиться не удалось или сервер закрыл соединение
+ *
+ * Задержка запроса - время от его отправки до получения строки ответа;
+ * процентили считаются по всем запросам всех соединений.
+ */
+inline LoadReport runLoadGenerator(const std::string& serverAddress, size_t connections,
+                                   size_t requestsPerConnection, size_t pipeline) {
+    typedef std::chrono::steady_clock Clock;
+    struct Connection {
+        int fd = -1;
+        size_t sent = 0;                    ///< Отправлено запросов
+        size_t received = 0;                ///< Получено ответов
+        std::vector<Clock::time_point> sentAt;
+        std::string input;
+    };
+
+    static const char* const requests[] = {
+        "1 1.5 -2 0.25 4\n", "3 3 4 1 -2\n", "4 7 1 2 -3\n", "9 3 4\n", "2 1e3 2 -5 0.5\n", "8 -1 2\n",
+    };
+    const size_t requestKinds = sizeof(requests) / sizeof(requests[0]);
+    pipeline = std::max<size_t>(pipeline, 1);
+
+    SocketAddress address = SocketAddress::parse(serverAddress);
+    int epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Connection> pool(connections);
+    std::vector<double> latencies;
+    latencies.reserve(connections * requestsPerConnection);
+    LoadReport report;
+
+    auto cleanup = [&]() {
+        for (Connection& c : pool) {
+            if (c.fd >= 0) {
+                ::close(c.fd);
+            }
+        }
+        ::close(epoll);
+    };
+
+    // Отправляет запросы, пока в полете меньше pipeline
+    auto refill = [&](Connection& c) {
+        std::string batch;
+        Clock::time_point now = Clock::now();
+        while (c.sent < requestsPerConnection && c.sent - c.received < pipeline) {
+            batch += requests[c.sent % requestKinds];
+            c.sentAt[c.sent++] = now;
+        }
+        size_t offset = 0;
+        while (offset < batch.size()) {
+            ssize_t n = ::send(c.fd, batch.data() + offset, batch.size() - offset, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                // Буфер сокета полон: дожидаемся его освобождения
+                pollfd waiter = {c.fd, POLLOUT, 0};
+                if (errno != EAGAIN || ::poll(&waiter, 1, 10000) <= 0) {
+                    throw std::runtime_error(std::string("send: ") + std::strerror(errno));
                 }
-                case 9: { // Модуль
-                    std::cout << "\n--- Модуль числа ---" << std::endl;
-                    num1 = inputComplex("Введите число:");
-                    double mod = num1.modulus();
-                    std::cout << "Модуль " << num1 << " = " << mod << std::endl;
-                    addToHistory(OperationRecord("модуль", num1, Complex(mod, 0)));
-                    break;
+                continue;
+            }
+            offset += static_cast<size_t>(n);
+        }
+    };
+
+    Clock::time_point begin = Clock::now();
+    try {
+        for (size_t i = 0; i < connections; ++i) {
+            Connection& c = pool[i];
+            c.fd = address.openSocket();
+            if (::connect(c.fd, address.data(), address.length) != 0 && errno != EINPROGRESS) {
+                throw std::runtime_error(std::string("connect: ") + std::strerror(errno));
+            }
+            pollfd waiter = {c.fd, POLLOUT, 0};
+            ::poll(&waiter, 1, 10000);
+            c.sentAt.resize(requestsPerConnection);
+            epoll_event event;
+            std::memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            ::epoll_ctl(epoll, EPOLL_CTL_ADD, c.fd, &event);
+            refill(c);
+        }
+
+        size_t active = requestsPerConnection == 0 ? 0 : connections;
+        epoll_event events[256];
+        char buffer[64 * 1024];
+        while (active > 0) {
+            int ready = ::epoll_wait(epoll, events, 256, 10000);
+            if (ready <= 0) {
+                if (ready < 0 && errno == EINTR) {
+                    continue;
                 }
-                case 10: // История
-                    viewHistory();
-                    break;
-                case 11: // Очистка истории
-                    clearHistory();
-                    break;
-                case 0: // Выход
-                    std::cout << "Выход из программы." << std::endl;
-                    break;
-                default:
-                    std::cout << "Неверный выбор. Попробуйте снова." << std::endl;
+                throw std::runtime_error("Сервер не отвечает");
             }
-            
-            if (choice != 0 && choice != 10 && choice != 11) {
-                pause();
+            for (int k = 0; k < ready; ++k) {
+                Connection& c = pool[events[k].data.u64];
+                ssize_t n = ::recv(c.fd, buffer, sizeof(buffer), 0);
+                if (n == 0) {
+                    throw std::runtime_error("Сервер закрыл соединение");
+                }
+                if (n < 0) {
+                    continue;
+                }
+                Clock::time_point now = Clock::now();
+                c.input.append(buffer, static_cast<size_t>(n));
+                size_t start = 0, newline;
+                while ((newline = c.input.find('\n', start)) != std::string::npos) {
+                    if (c.input.compare(start, 6, "error:") == 0) {
+                        ++report.errors;
+                    }
+                    latencies.push_back(std::chrono::duration<double, std::micro>(now - c.sentAt[c.received]).count());
+                    ++c.received;
+                    start = newline + 1;
+                }
+                c.input.erase(0, start);
+                if (c.received == requestsPerConnection) {
+                    --active;
+                    ::epoll_ctl(epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+                } else {
+                    refill(c);
+                }
             }
-            
-        } while (choice != 0);
+        }
+    } catch (...) {
+        cleanup();
+        throw;
     }
-    
-private:
+    report.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    cleanup();
+
+    report.requests = latencies.size();
+    if (!latencies.empty()) {
+        auto quantile = [&](double q) {
+            size_t index = std::min(latencies.size() - 1, static_cast<size_t>(q * static_cast<double>(latencies.size())));
+            std::nth_element(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(index), latencies.end());
+            return latencies[index];
+        };
+        report.p50Micros = quantile(0.5);
+        report.p99Micros = quantile(0.99);
+    }
+    return report;
+}
+
+#endif // COMPLEX_HAVE_EPOLL
+
+/**
+ * @namespace bench
+ * @brief Набор замеров производительности (режим "--bench")
+ *
+ * Замеряются все операторы Complex и modulus() - по задержке (цепочка, где
+ * каждая операция ждет результата предыдущей) и по пропускной способности
+ * (независимые операции над массивами), добавление в историю и ее вывод
+ * при 10^3..10^7 записях, вывод через operator<< и разбор чисел так, как это
+ * делает Calculator::inputComplex().
+ *
+ * Каждый замер прогревается, затем повторяется Options::repetitions раз;
+ * в отчет попадают медиана и медианное абсолютное отклонение (MAD) времени
+ * одной операции в наносекундах. Поток привязывается к одному процессору,
+ * чтобы планировщик не переносил его между ядрами посреди замера.
+ * Результаты пишутся в JSON и могут сравниваться с сохраненной базовой
+ * линией: замедление больше порога считается регрессией.
+ */
+namespace bench {
+
+/**
+ * @struct Options
+ * @brief Параметры запуска замеров
+ */
+struct Options {
+    const char* output = nullptr;    ///< Файл для JSON (nullptr - стандартный вывод)
+    const char* baseline = nullptr;  ///< JSON предыдущего запуска для сравнения
+    double threshold = 10;           ///< Допустимое замедление относительно базовой линии, %
+    std::string filter;              ///< Подстрока имени: запускаются только совпадающие замеры
+    size_t repetitions = 15;         ///< Повторов каждого замера
+    size_t maxRecords = 10000000;    ///< Наибольший размер истории
+    size_t cpu = std::numeric_limits<size_t>::max();  ///< Процессор для привязки (max - первый доступный)
+    double minSeconds = 0.01;        ///< Наименьшая длительность одного повтора микрозамера
+};
+
+/**
+ * @struct Result
+ * @brief Итог одного замера
+ */
+struct Result {
+    std::string name;        ///< Имя замера
+    double median = 0;       ///< Медиана времени одной операции, нс
+    double mad = 0;          ///< Медианное абсолютное отклонение, нс
+    size_t items = 0;        ///< Операций в одном повторе
+    size_t repetitions = 0;  ///< Количество повторов
+};
+
+/**
+ * @brief Не дает компилятору выбросить вычисление value
+ *
+ * Барьер "memory" к тому же заставляет считать все записи в память
+ * наблюдаемыми, поэтому циклы с записью в массив не удаляются.
+ */
+template <class T>
+inline void keep(const T& value) {
+#ifdef __GNUC__
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+/**
+ * @brief Скрывает от компилятора значение x
+ *
+ * Без этого цепочку вида x = -x компилятор может свернуть, и замер задержки
+ * покажет ноль. Значение остается в регистре, лишних команд не появляется.
+ */
+inline void opaque(Complex& x) {
+    double re = x.getReal(), im = x.getImag();
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    asm volatile("" : "+x"(re), "+x"(im));
+#elif defined(__GNUC__) && defined(__aarch64__)
+    asm volatile("" : "+w"(re), "+w"(im));
+#endif
+    x = Complex(re, im);
+}
+
+/**
+ * @class NullBuffer
+ * @brief Буфер потока, который отбрасывает все данные
+ *
+ * Форматирование в std::ostream при этом выполняется полностью, так что
+ * замер вывода не зависит от скорости терминала или диска.
+ */
+class NullBuffer : public std::streambuf {
+protected:
+    int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/**
+ * @brief Медиана и MAD выборки
+ * @param samples Выборка (порядок элементов меняется)
+ * @param median Медиана
+ * @param mad Медиана модулей отклонений от медианы
+ */
+inline void summarize(std::vector<double>& samples, double& median, double& mad) {
+    auto middle = [](std::vector<double>& v) {
+        size_t half = v.size() / 2;
+        std::nth_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(half), v.end());
+        double upper = v[half];
+        if (v.size() % 2 != 0) {
+            return upper;
+        }
+        return (*std::max_element(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(half)) + upper) / 2;
+    };
+    median = middle(samples);
+    for (double& s : samples) {
+        s = std::fabs(s - median);
+    }
+    mad = middle(samples);
+}
+
+/**
+ * @class Suite
+ * @brief Запуск замеров и сбор результатов
+ */
+class Suite {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Suite(const Options& options) : options(options) {}
+
     /**
-     * @brief Вывод меню операций
+     * @brief Проходит ли замер фильтр
+     * @param name Имя замера
      */
-    void displayMenu() const {
-        std::cout << "\n=== Калькулятор комплексных чисел ===" << std::endl;
-        std::cout << "1. Сложение" << std::endl;
-        std::cout << "2. Вычитание" << std::endl;
-        std::cout << "3. Умножение" << std::endl;
-        std::cout << "4. Деление" << std::endl;
-        std::cout << "5. Инкремент (++x)" << std::endl;
-        std::cout << "6. Декремент (--x)" << std::endl;
-        std::cout << "7. Сравнение модулей" << std::endl;
-        std::cout << "8. Унарный минус" << std::endl;
-        std::cout << "9. Вычисление модуля" << std::endl;
-        std::cout << "10. Просмотр истории операций" << std::endl;
-        std::cout << "11. Очистка истории операций" << std::endl;
-        std::cout << "0. Выход" << std::endl;
+    bool wanted(const std::string& name) const {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
     }
-    
+
     /**
-     * @brief Ввод комплексного числа с консоли
-     * @param prompt Приглашение для ввода
-     * @return Введенное комплексное число
+     * @brief Время выполнения f в секундах
      */
-    Complex inputComplex(const std::string& prompt) {
-        double real, imag;
-        std::cout << prompt << std::endl;
-        std::cout << "  Действительная часть: ";
-        std::cin >> real;
-        std::cout << "  Мнимая часть: ";
-        std::cin >> imag;
-        return Complex(real, imag);
+    template <class F>
+    static double time(F f) {
+        Clock::time_point begin = Clock::now();
+        f();
+        return std::chrono::duration<double>(Clock::now() - begin).count();
     }
-    
+
     /**
-     * @brief Пауза выполнения программы
-     * 
-     * Ожидает нажатия клавиши Enter для продолжения
+     * @brief Замер, в котором повтор сам отмеряет свое время
+     * @param name Имя замера
+     * @param items Операций в одном повторе
+     * @param repetitions Количество повторов
+     * @param run Выполняет повтор и возвращает его длительность в секундах
+     *
+     * Подготовка данных внутри run вне отмеренного участка в результат не
+     * входит. Первый прогон считается прогревом и отбрасывается.
      */
-    void pause() {
-        std::cout << "\nНажмите Enter для продолжения...";
-        std::cin.ignore();
-        std::cin.get();
+    template <class Run>
+    void record(const std::string& name, size_t items, size_t repetitions, Run run) {
+        if (!wanted(name)) {
+            return;
+        }
+        run();
+        std::vector<double> samples(std::max<size_t>(repetitions, 1));
+        for (double& sample : samples) {
+            sample = run() * 1e9 / static_cast<double>(items);
+        }
+        Result result;
+        result.name = name;
+        result.items = items;
+        result.repetitions = samples.size();
+        summarize(samples, result.median, result.mad);
+        std::fprintf(stderr, "%-36s %12.3f ns  ± %.3f\n", name.c_str(), result.median, result.mad);
+        results.push_back(result);
+    }
+
+    /**
+     * @brief Микрозамер: body(rounds) выполняет rounds · items операций
+     * @param name Имя замера
+     * @param items Операций в одном раунде
+     * @param body Тело замера
+     *
+     * Число раундов удваивается, пока повтор не займет Options::minSeconds,
+     * так что погрешность часов не влияет на результат; подбор заодно
+     * прогревает кэши и предсказатель переходов.
+     */
+    template <class Body>
+    void loop(const std::string& name, size_t items, Body body) {
+        if (!wanted(name)) {
+            return;
+        }
+        size_t rounds = 1;
+        while (time([&] { body(rounds); }) < options.minSeconds) {
+            rounds *= 2;
+        }
+        record(name, items * rounds, options.repetitions, [&] { return time([&] { body(rounds); }); });
     }
+
+    const Options& getOptions() const { return options; }
+    const std::vector<Result>& getResults() const { return results; }
+
+private:
+    Options options;              ///< Параметры запуска
+    std::vector<Result> results;  ///< Результаты в порядке выполнения
 };
 
+const size_t blockSize = 4096;  ///< Элементов в массивах замеров пропускной способности
+const size_t chainLength = 1024;  ///< Операций в одном раунде замера задержки
+
+/**
+ * @brief Замер задержки: x = step(x) цепочкой
+ * @param seed Начальное значение
+ * @param step Операция; должна оставлять значения в ограниченном диапазоне
+ */
+template <class Step>
+void latency(Suite& suite, const std::string& name, Complex seed, Step step) {
+    suite.loop(name + ".latency", chainLength, [&](size_t rounds) {
+        Complex x = seed;
+        for (size_t i = 0; i < rounds * chainLength; ++i) {
+            x = step(x);
+            opaque(x);
+        }
+        keep(x);
+    });
+}
+
+/**
+ * @brief Замер пропускной способности: out[i] = op(a[i], b[i])
+ */
+template <class Op>
+void throughput(Suite& suite, const std::string& name, const std::vector<Complex>& a,
+                const std::vector<Complex>& b, Op op) {
+    using R = decltype(op(a[0], b[0]));
+    std::unique_ptr<R[]> out(new R[a.size()]);
+    suite.loop(name + ".throughput", a.size(), [&](size_t rounds) {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < a.size(); ++i) {
+                out[i] = op(a[i], b[i]);
+            }
+            keep(out[0]);
+        }
+    });
+}
+
+/**
+ * @brief Замеры оператора сравнения
+ * @param y Второй операнд
+ * @param p, q Значения, для которых сравнение с y дает разные ответы
+ *
+ * В цепочке задержки результат сравнения выбирает следующий левый операнд
+ * (p или q) по индексу, а не переходом: предсказатель переходов разорвал бы
+ * зависимость, и замер показал бы пропускную способность.
+ */
+template <class Compare>
+void comparison(Suite& suite, const std::string& name, const std::vector<Complex>& a,
+                const std::vector<Complex>& b, Complex y, Complex p, Complex q, Compare compare) {
+    Complex choice[2];
+    choice[compare(p, y)] = q;
+    choice[compare(q, y)] = p;
+    latency(suite, name, p, [&](Complex x) { return choice[compare(x, y)]; });
+    throughput(suite, name, a, b, compare);
+}
+
+/**
+ * @brief Тестовые операнды: |a| в [0.5, 2.5], Re b ≥ 0.5 (делитель не ноль)
+ */
+inline void makeOperands(std::vector<Complex>& a, std::vector<Complex>& b) {
+    a.resize(blockSize);
+    b.resize(blockSize);
+    for (size_t i = 0; i < blockSize; ++i) {
+        double t = static_cast<double>(i);
+        a[i] = Complex(1.5 + std::cos(0.7 * t), std::sin(1.3 * t));
+        b[i] = Complex(1 + 0.5 * std::sin(0.9 * t), 0.5 * std::cos(0.4 * t));
+    }
+}
+
+/**
+ * @brief Операторы Complex и modulus()
+ *
+ * Цепочки задержки подобраны так, чтобы значения не уходили в
+ * бесконечность или денормализованные числа: умножение и деление идут на
+ * число с единичным модулем, сложение и вычитание - с малым шагом.
+ */
+inline void runOperators(Suite& suite) {
+    std::vector<Complex> a, b;
+    makeOperands(a, b);
+    const Complex delta(1e-3, -1e-3);
+    const Complex unit(0.6, 0.8);
+
+    latency(suite, "complex.add", Complex(), [&](Complex x) { return x + delta; });
+    throughput(suite, "complex.add", a, b, [](Complex x, Complex y) { return x + y; });
+    latency(suite, "complex.subtract", Complex(), [&](Complex x) { return x - delta; });
+    throughput(suite, "complex.subtract", a, b, [](Complex x, Complex y) { return x - y; });
+    latency(suite, "complex.multiply", unit, [&](Complex x) { return x * unit; });
+    throughput(suite, "complex.multiply", a, b, [](Complex x, Complex y) { return x * y; });
+    latency(suite, "complex.divide", unit, [&](Complex x) { return x / unit; });
+    throughput(suite, "complex.divide", a, b, [](Complex x, Complex y) { return x / y; });
+    latency(suite, "complex.negate", unit, [](Complex x) { return -x; });
+    throughput(suite, "complex.negate", a, b, [](Complex x, Complex) { return -x; });
+
+    latency(suite, "complex.pre-increment", Complex(), [](Complex x) { return ++x; });
+    throughput(suite, "complex.pre-increment", a, b, [](Complex x, Complex) { return ++x; });
+    latency(suite, "complex.post-increment", Complex(), [](Complex x) { x++; return x; });
+    throughput(suite, "complex.post-increment", a, b, [](Complex x, Complex) { x++; return x; });
+    latency(suite, "complex.pre-decrement", Complex(), [](Complex x) { return --x; });
+    throughput(suite, "complex.pre-decrement", a, b, [](Complex x, Complex) { return --x; });
+    latency(suite, "complex.post-decrement", Complex(), [](Complex x) { x--; return x; });
+    throughput(suite, "complex.post-decrement", a, b, [](Complex x, Complex) { x--; return x; });
+
+    const Complex small(0.3, 0.4), large(1.2, 1.6);
+    comparison(suite, "complex.less", a, b, unit, small, large, [](Complex x, Complex y) { return x < y; });
+    comparison(suite, "complex.greater", a, b, unit, small, large, [](Complex x, Complex y) { return x > y; });
+    comparison(suite, "complex.less-equal", a, b, unit, small, large, [](Complex x, Complex y) { return x <= y; });
+    comparison(suite, "complex.greater-equal", a, b, unit, small, large,
+               [](Complex x, Complex y) { return x >= y; });
+    comparison(suite, "complex.equal", a, b, unit, unit, large, [](Complex x, Complex y) { return x == y; });
+    comparison(suite, "complex.not-equal", a, b, unit, unit, large, [](Complex x, Complex y) { return x != y; });
+
+    // Модуль растет как √n · Im x и за любое разумное время остается конечным
+    latency(suite, "complex.modulus", unit, [](Complex x) { return Complex(x.modulus(), x.getImag()); });
+    throughput(suite, "complex.modulus", a, b, [](Complex x, Complex) { return x.modulus(); });
+}
+
+/**
+ * @brief Вывод через operator<< и appendComplexText(), разбор как в
+ *        Calculator::inputComplex() и через parseComplex()
+ */
+inline void runFormatting(Suite& suite) {
+    std::vector<Complex> a, b;
+    makeOperands(a, b);
+
+    std::ostringstream os;
+    suite.loop("format.ostream", blockSize, [&](size_t rounds) {
+        for (size_t r = 0; r < rounds; ++r) {
+            os.str(std::string());
+            for (const Complex& c : a) {
+                os << c << '\n';
+            }
+            keep(os);
+        }
+    });
+
+    std::string text;
+    suite.loop("format.chars", blockSize, [&](size_t rounds) {
+        for (size_t r = 0; r < rounds; ++r) {
+            text.clear();
+            for (const Complex& c : a) {
+                appendComplexText(text, c);
+                text += '\n';
+            }
+            keep(text);
+        }
+    });
+
+    // inputComplex() читает действительную и мнимую части двумя operator>>
+    std::string pairs;
+    for (const Complex& c : a) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%.17g %.17g\n", c.getReal(), c.getImag());
+        pairs += line;
+    }
+    std::istringstream in(pairs);
+    std::vector<Complex> parsed(blockSize);
+    suite.loop("parse.istream", blockSize, [&](size_t rounds) {
+        for (size_t r = 0; r < rounds; ++r) {
+            in.clear();
+            in.seekg(0);
+            for (Complex& c : parsed) {
+                double real, imag;
+                in >> real >> imag;
+                c = Complex(real, imag);
+            }
+            keep(parsed[0]);
+        }
+    });
+
+    std::vector<size_t> starts;
+    text.clear();
+    for (const Complex& c : a) {
+        starts.push_back(text.size());
+        appendComplexText(text, c);
+        text += '\n';
+    }
+    suite.loop("parse.chars", blockSize, [&](size_t rounds) {
+        for (size_t r = 0; r < rounds; ++r) {
+            for (size_t i = 0; i < blockSize; ++i) {
+                parseComplex(text.data() + starts[i], text.data() + text.size(), parsed[i]);
+            }
+            keep(parsed[0]);
+        }
+    });
+}
+
+/**
+ * @brief Добавление в историю и ее вывод при 10^3..Options::maxRecords записях
+ *
+ * Время приводится к одной записи. Вывод viewHistory() идет в std::cout,
+ * который на время замера переключается на NullBuffer. Для 10^6 записей и
+ * больше повторов не более пяти: один повтор длится секунды.
+ */
+inline void runHistory(Suite& suite) {
+    std::vector<Complex> a, b;
+    makeOperands(a, b);
+    static const OpCode ops[4] = {OpCode::Add, OpCode::Subtract, OpCode::Multiply, OpCode::Divide};
+    auto fill = [&](Calculator& calc, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            calc.addToHistory(ops[i % 4], a[i % blockSize], b[i % blockSize]);
+        }
+    };
+
+    const Options& options = suite.getOptions();
+    for (size_t n = 1000; n <= options.maxRecords; n *= 10) {
+        size_t repetitions = n >= 1000000 ? std::min<size_t>(options.repetitions, 5) : options.repetitions;
+        std::string size = "/" + std::to_string(n);
+        suite.record("history.add" + size, n, repetitions, [&] {
+            Calculator calc;
+            return Suite::time([&] { fill(calc, n); });
+        });
+
+        if (!suite.wanted("history.view" + size) && !suite.wanted("history.write" + size)) {
+            continue;
+        }
+        Calculator calc;
+        fill(calc, n);
+        NullBuffer null;
+        suite.record("history.view" + size, n, repetitions, [&] {
+            std::streambuf* saved = std::cout.rdbuf(&null);
+            double seconds = Suite::time([&] { calc.viewHistory(); });
+            std::cout.rdbuf(saved);
+            return seconds;
+        });
+        std::ostream sink(&null);
+        suite.record("history.write" + size, n, repetitions, [&] {
+            return Suite::time([&] { calc.writeHistory(sink); });
+        });
+    }
+}
+
+/**
+ * @brief Привязывает поток к одному процессору
+ * @param cpu Номер процессора (max - первый из доступных потоку)
+ * @return Номер процессора или -1, если привязка не поддерживается
+ * @throw std::runtime_error Если процессор недоступен
+ */
+inline long pinThread(size_t cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu == std::numeric_limits<size_t>::max()) {
+        if (::sched_getaffinity(0, sizeof(set), &set) != 0) {
+            throw std::runtime_error(std::string("sched_getaffinity: ") + std::strerror(errno));
+        }
+        cpu = 0;
+        while (cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &set)) {
+            ++cpu;
+        }
+        CPU_ZERO(&set);
+    }
+    if (cpu >= CPU_SETSIZE) {
+        throw std::runtime_error("Нет доступного процессора");
+    }
+    CPU_SET(cpu, &set);
+    if (::sched_setaffinity(0, sizeof(set), &set) != 0) {
+        throw std::runtime_error("Не удалось привязать поток к процессору " + std::to_string(cpu) + ": " +
+                                 std::strerror(errno));
+    }
+    return static_cast<long>(cpu);
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Записывает результаты в JSON
+ * @param out Выходной поток
+ * @param results Результаты
+ * @param cpu Процессор, к которому был привязан поток (-1 - без привязки)
+ */
+inline void writeJson(std::ostream& out, const std::vector<Result>& results, long cpu) {
+    out << "{\n  \"simd\": \"" << activeKernels().name << "\",\n  \"cpu\": " << cpu
+        << ",\n  \"unit\": \"ns\",\n  \"benchmarks\": [\n";
+    std::streamsize precision = out.precision(9);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"median\": " << r.median << ", \"mad\": " << r.mad
+            << ", \"items\": " << r.items << ", \"repetitions\": " << r.repetitions << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out.precision(precision);
+    out << "  ]\n}\n";
+}
+
+/**
+ * @brief Читает результаты, записанные writeJson()
+ * @param path Путь к файлу
+ * @return Результаты по именам (заполнены name, median и mad)
+ * @throw std::runtime_error Если файл не открывается
+ *
+ * Это не общий разбор JSON: ищутся только поля "name", "median" и "mad"
+ * внутри каждого объекта.
+ */
+inline std::map<std::string, Result> readBaseline(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(std::string("Не удалось открыть файл: ") + path);
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto number = [&](const char* field, size_t from, size_t to) {
+        double value = 0;
+        size_t at = text.find(field, from);
+        if (at < to && (at = text.find(':', at)) < to) {
+            ++at;
+            while (at < to && text[at] == ' ') {
+                ++at;
+            }
+            std::from_chars(text.data() + at, text.data() + to, value);
+        }
+        return value;
+    };
+
+    std::map<std::string, Result> baseline;
+    size_t at = 0;
+    while ((at = text.find("\"name\"", at)) != std::string::npos) {
+        size_t open = text.find('"', text.find(':', at) + 1);
+        size_t close = text.find('"', open + 1);
+        size_t end = text.find('}', close);
+        if (open == std::string::npos || close == std::string::npos || end == std::string::npos) {
+            break;
+        }
+        Result r;
+        r.name = text.substr(open + 1, close - open - 1);
+        r.median = number("\"median\"", close, end);
+        r.mad = number("\"mad\"", close, end);
+        baseline[r.name] = r;
+        at = end;
+    }
+    return baseline;
+}
+
+/**
+ * @brief Сравнивает результаты с базовой линией
+ * @param results Текущие результаты
+ * @param baseline Базовая линия
+ * @param threshold Допустимое замедление, %
+ * @return Количество регрессий
+ *
+ * Регрессия - медиана выросла больше чем на threshold процентов и при этом
+ * больше чем на 3·(MAD + MAD базовой линии), чтобы шум короткого замера не
+ * считался замедлением. Замеры, которых нет в базовой линии, только
+ * печатаются.
+ */
+inline size_t compare(const std::vector<Result>& results, const std::map<std::string, Result>& baseline,
+                      double threshold) {
+    size_t regressions = 0;
+    std::fprintf(stderr, "\n%-36s %12s %12s %9s\n", "benchmark", "baseline, ns", "current, ns", "change");
+    for (const Result& r : results) {
+        auto found = baseline.find(r.name);
+        if (found == baseline.end() || found->second.median <= 0) {
+            std::fprintf(stderr, "%-36s %12s %12.3f %9s\n", r.name.c_str(), "-", r.median, "new");
+            continue;
+        }
+        const Result& base = found->second;
+        double change = (r.median / base.median - 1) * 100;
+        bool regression = change > threshold && r.median - base.median > 3 * (r.mad + base.mad);
+        regressions += regression;
+        std::fprintf(stderr, "%-36s %12.3f %12.3f %+8.1f%%%s\n", r.name.c_str(), base.median, r.median, change,
+                     regression ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+/**
+ * @brief Выполняет все замеры
+ * @param options Параметры запуска
+ * @return Код завершения: 0 - успешно, 2 - есть регрессии относительно базовой линии
+ * @throw std::runtime_error При ошибке ввода-вывода или привязки к процессору
+ */
+inline int run(const Options& options) {
+    // Базовая линия читается до замеров, чтобы ошибка в пути не стоила минут
+    std::map<std::string, Result> baseline;
+    if (options.baseline) {
+        baseline = readBaseline(options.baseline);
+    }
+    long cpu = pinThread(options.cpu);
+    std::fprintf(stderr, "simd: %s, cpu: %ld\n", activeKernels().name, cpu);
+
+    Suite suite(options);
+    runOperators(suite);
+    runFormatting(suite);
+    runHistory(suite);
+
+    if (options.output) {
+        std::ofstream file(options.output, std::ios::binary);
+        writeJson(file, suite.getResults(), cpu);
+        if (!file) {
+            throw std::runtime_error(std::string("Не удалось записать файл: ") + options.output);
+        }
+    } else {
+        writeJson(std::cout, suite.getResults(), cpu);
+    }
+
+    if (options.baseline) {
+        size_t regressions = compare(suite.getResults(), baseline, options.threshold);
+        if (regressions != 0) {
+            std::fprintf(stderr, "Регрессий: %zu (порог %.1f%%)\n", regressions, options.threshold);
+            return 2;
+        }
+    }
+    return 0;
+}
+
+} // namespace bench
+
 /**
- * @brief Инициализация статической переменной-счетчика
+ * @brief Разбирает числовое значение параметра командной строки
+ * @param value Текст значения
+ * @param target Куда записать число
+ * @return true, если значение целиком является числом; иначе сообщение
+ *         выводится в std::cerr, а target не меняется
  */
-int Complex::count = 0;
+template <class T>
+bool parseNumberOption(const char* value, T& target) {
+    T parsed;
+    std::from_chars_result r = std::from_chars(value, value + std::strlen(value), parsed);
+    if (r.ec != std::errc() || *r.ptr != '\0') {
+        std::cerr << "Неверное число: " << value << std::endl;
+        return false;
+    }
+    target = parsed;
+    return true;
+}
 
 /**
  * @brief Основная функция программы
@@ -554,8 +11885,284 @@ int Complex::count = 0;
  * 2. Демонстрация всех перегруженных операторов
  * 3. Тестирование системы истории операций
  * 4. Запуск интерактивного режима калькулятора
+ *
+ * Параметры командной строки:
+ * - "--batch [файл]" - вместо демонстрации выполняется пакетный режим
+ *   (см. Calculator::runBatch): операции читаются из файла или, если файл
+ *   не указан либо равен "-", из стандартного ввода. Код возврата 2 означает,
+ *   что часть строк завершилась ошибкой.
+ * - "--history-log файл" - операции дописываются в постоянный журнал
+ *   (см. HistoryLog); в пакетном режиме это включает запись истории.
+ * - "--precision имя" - точность вычислений (double, float, long-double,
+ *   fixed16, fixed32).
+ * - "--metrics файл" - при завершении записать метрики (нужна сборка с
+ *   COMPLEX_METRICS); ".json" - в формате JSON.
+ * - "--serve адрес" - режим сервера (см. CalculatorServer), адрес
+ *   "unix:/путь" или "tcp:порт"; работает до SIGINT/SIGTERM.
+ * - "--loadgen адрес" - нагрузочный клиент для сервера; параметры
+ *   "--connections N" (по умолчанию 64), "--requests N" на соединение
+ *   (10000) и "--pipeline N" запросов в полете (16).
+ * - "--cache N" - кэш результатов дорогих операций на N записей (см.
+ *   ResultCache) для пакетного режима и сервера.
+ * - "--bench [файл.json]" - замеры производительности (см. bench::run);
+ *   результаты в JSON пишутся в файл или стандартный вывод. Параметры:
+ *   "--baseline файл" - сравнить с прошлым запуском, "--threshold P" -
+ *   допустимое замедление в процентах (10), "--filter текст" - только
+ *   замеры, в имени которых есть текст, "--repetitions N" (15),
+ *   "--max-records N" - наибольший размер истории (10000000), "--cpu N" -
+ *   процессор для привязки. Код возврата 2 означает регрессию.
+ * - "--stream код вход выход" - потоковая обработка больших файлов (см.
+ *   Calculator::runStream): операция (номер из меню или обозначение, как
+ *   "+" или "exp") применяется к каждому числу входа, "-" - стандартные
+ *   ввод и вывод. "--format f32|f64|text" - формат входа (f64),
+ *   "--output-format" - формат выхода (как у входа), "--operand z" -
+ *   второй операнд бинарной операции, "--second файл" - файл вторых
+ *   операндов. Код возврата 2 означает, что часть операций не выполнена.
  */
-int main() {
+int main(int argc, char* argv[]) {
+    bool batch = false;
+    const char* batchInput = nullptr;
+    const char* historyLogPath = nullptr;
+    Precision precision = Precision::Double;
+    const char* metricsPath = nullptr;
+    const char* serveAddress = nullptr;
+    const char* loadAddress = nullptr;
+    size_t loadConnections = 64, loadRequests = 10000, loadPipeline = 16;
+    size_t cacheCapacity = 0;
+    bool benchmark = false;
+    bench::Options benchOptions;
+    const char* streamOperation = nullptr;
+    const char* streamInput = nullptr;
+    const char* streamOutput = nullptr;
+    const char* streamSecond = nullptr;
+    const char* streamFormat = "f64";
+    const char* streamOutputFormat = nullptr;
+    Complex streamOperand;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 < argc && (argv[i + 1][0] != '-' || std::strcmp(argv[i + 1], "-") == 0)) {
+                batchInput = argv[++i];
+            }
+        } else if (std::strcmp(argv[i], "--history-log") == 0 && i + 1 < argc) {
+            historyLogPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (std::strcmp(argv[i], "--loadgen") == 0 && i + 1 < argc) {
+            loadAddress = argv[++i];
+        } else if (std::strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], loadConnections)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], loadRequests)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], loadPipeline)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], cacheCapacity)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--bench") == 0) {
+            benchmark = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                benchOptions.output = argv[++i];
+            }
+        } else if (std::strcmp(argv[i], "--stream") == 0 && i + 3 < argc) {
+            streamOperation = argv[++i];
+            streamInput = argv[++i];
+            streamOutput = argv[++i];
+        } else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            streamFormat = argv[++i];
+        } else if (std::strcmp(argv[i], "--output-format") == 0 && i + 1 < argc) {
+            streamOutputFormat = argv[++i];
+        } else if (std::strcmp(argv[i], "--second") == 0 && i + 1 < argc) {
+            streamSecond = argv[++i];
+        } else if (std::strcmp(argv[i], "--operand") == 0 && i + 1 < argc) {
+            const char* value = argv[++i];
+            const char* end = value + std::strlen(value);
+            std::from_chars_result r = parseComplex(value, end, streamOperand);
+            if (r.ec != std::errc() || r.ptr != end) {
+                std::cerr << "Неверное число: " << value << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            benchOptions.baseline = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            benchOptions.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], benchOptions.repetitions)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--max-records") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], benchOptions.maxRecords)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], benchOptions.cpu)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            if (!parseNumberOption(argv[++i], benchOptions.threshold)) {
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            try {
+                precision = precisionFromName(argv[++i]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Неизвестный параметр: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+#ifndef COMPLEX_HAVE_POSIX
+    if (historyLogPath) {
+        std::cerr << "Журнал истории не поддерживается на этой платформе" << std::endl;
+        return 1;
+    }
+#endif
+#ifndef COMPLEX_METRICS
+    if (metricsPath) {
+        std::cerr << "Программа собрана без метрик (нужен -DCOMPLEX_METRICS)" << std::endl;
+        return 1;
+    }
+#endif
+
+    if (benchmark) {
+        try {
+            return bench::run(benchOptions);
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Потоковая обработка файлов
+    if (streamOperation) {
+#ifdef COMPLEX_HAVE_POSIX
+        try {
+            OpCode op;
+            int code = 0;
+            const char* end = streamOperation + std::strlen(streamOperation);
+            std::from_chars_result r = std::from_chars(streamOperation, end, code);
+            if (r.ec == std::errc() && r.ptr == end && isKnownOperation(code)) {
+                op = static_cast<OpCode>(code);
+            } else {
+                op = operationFromName(streamOperation);
+            }
+            SampleFormat inputFormat = sampleFormatFromName(streamFormat);
+            SampleFormat outputFormat = streamOutputFormat ? sampleFormatFromName(streamOutputFormat) : inputFormat;
+
+            Calculator calc(0, precision);
+            StreamReader input(streamInput, inputFormat);
+            std::unique_ptr<StreamReader> second;
+            if (streamSecond) {
+                second.reset(new StreamReader(streamSecond, inputFormat));
+            }
+            StreamWriter output(streamOutput, outputFormat);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            Calculator::BatchStats stats = calc.runStream(op, input, output, streamOperand, second.get());
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            std::fprintf(stderr, "operations: %zu, errors: %zu, time: %.3f s, %.1f M/s\n", stats.operations,
+                         stats.errors, seconds, static_cast<double>(input.position()) / seconds / 1e6);
+#ifdef COMPLEX_METRICS
+            if (metricsPath) {
+                calc.writeMetrics(metricsPath);
+            }
+#endif
+            return stats.errors == 0 ? 0 : 2;
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return 1;
+        }
+#else
+        std::cerr << "Потоковый режим не поддерживается на этой платформе" << std::endl;
+        return 1;
+#endif
+    }
+
+    std::shared_ptr<ResultCache> cache;
+    if (cacheCapacity != 0) {
+        cache = std::make_shared<ResultCache>(cacheCapacity);
+    }
+
+    // Сервер и нагрузочный клиент
+    if (serveAddress || loadAddress) {
+#ifdef COMPLEX_HAVE_EPOLL
+        try {
+            if (loadAddress) {
+                LoadReport report = runLoadGenerator(loadAddress, loadConnections, loadRequests, loadPipeline);
+                std::printf("requests: %zu, errors: %zu, time: %.3f s\n", report.requests, report.errors, report.seconds);
+                std::printf("throughput: %.0f req/s, p50: %.1f us, p99: %.1f us\n",
+                            report.throughput(), report.p50Micros, report.p99Micros);
+                return report.errors == 0 ? 0 : 2;
+            }
+            static CalculatorServer* activeServer = nullptr;
+            CalculatorServer server(serveAddress, precision, cache);
+            activeServer = &server;
+            std::signal(SIGINT, [](int) { activeServer->stop(); });
+            std::signal(SIGTERM, [](int) { activeServer->stop(); });
+            std::cerr << "Сервер слушает " << serveAddress << std::endl;
+            server.run();
+#ifdef COMPLEX_METRICS
+            if (metricsPath) {
+                metrics::snapshot().writeFile(metricsPath);
+            }
+#endif
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+#else
+        std::cerr << "Режим сервера поддерживается только в Linux (epoll)" << std::endl;
+        return 1;
+#endif
+    }
+
+    // Пакетный режим
+    if (batch) {
+        std::ios::sync_with_stdio(false);
+        // Полная история остается в журнале, в памяти - только последние записи
+        Calculator calc(historyLogPath ? 65536 : 0, precision);
+        calc.setResultCache(cache);
+        Calculator::BatchStats stats;
+        try {
+#ifdef COMPLEX_HAVE_POSIX
+            if (historyLogPath) {
+                calc.openHistoryLog(historyLogPath);
+            }
+#endif
+            if (batchInput && std::strcmp(batchInput, "-") != 0) {
+                std::ifstream file(batchInput, std::ios::binary);
+                if (!file) {
+                    std::cerr << "Не удалось открыть файл: " << batchInput << std::endl;
+                    return 1;
+                }
+                stats = calc.runBatch(file, std::cout, historyLogPath != nullptr);
+            } else {
+                stats = calc.runBatch(std::cin, std::cout, historyLogPath != nullptr);
+            }
+#ifdef COMPLEX_METRICS
+            if (metricsPath) {
+                calc.writeMetrics(metricsPath);
+            }
+#endif
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return 1;
+        }
+        return stats.errors == 0 ? 0 : 2;
+    }
+
     // Демонстрация создания объектов Complex
     Complex c1(3, 4);
     Complex c2(1, -2);
@@ -592,7 +12199,7 @@ int main() {
     std::cout << "c1 == c3: " << (c1 == c3 ? "true" : "false") << std::endl;
 
     // Тестирование системы истории операций
-    Calculator calc;
+    Calculator calc(0, precision);
     Complex result = c1 + c2;
     calc.addToHistory(OperationRecord("+", c1, c2, result));
     
@@ -606,7 +12213,32 @@ int main() {
     calc.viewHistory();
 
     // Запуск интерактивного режима калькулятора
+#ifdef COMPLEX_HAVE_POSIX
+    if (historyLogPath) {
+        try {
+            calc.openHistoryLog(historyLogPath);
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+#endif
     calc.performOperations();
+
+#ifdef COMPLEX_METRICS
+    if (metricsPath) {
+        try {
+            calc.writeMetrics(metricsPath);
+        } catch (const std::exception& e) {
+            std::cerr << "Ошибка: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+#endif
+
+#ifdef COMPLEX_COUNT_INSTANCES
+    std::cout << "Живых объектов Complex: " << Complex::instanceCount() << std::endl;
+#endif
     
     return 0;
 }
\ No newline at end of file